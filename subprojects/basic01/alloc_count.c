@@ -0,0 +1,44 @@
+/* GStreamer
+ *
+ * Supplement to Basic Tutorial 1: heap allocation counter for the binding benchmarks
+ *
+ * The wrappers call the __libc_ entry points rather than looking the next malloc up with
+ * dlsym, which allocates itself and would recurse.
+ */
+
+#include "alloc_count.h"
+
+#include <stddef.h>
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t count, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static unsigned long long allocations;
+
+void *
+malloc (size_t size)
+{
+  __atomic_add_fetch (&allocations, 1, __ATOMIC_RELAXED);
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t count, size_t size)
+{
+  __atomic_add_fetch (&allocations, 1, __ATOMIC_RELAXED);
+  return __libc_calloc (count, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  __atomic_add_fetch (&allocations, 1, __ATOMIC_RELAXED);
+  return __libc_realloc (ptr, size);
+}
+
+unsigned long long
+alloc_count (void)
+{
+  return __atomic_load_n (&allocations, __ATOMIC_RELAXED);
+}
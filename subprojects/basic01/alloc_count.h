@@ -0,0 +1,25 @@
+/* GStreamer
+ *
+ * Supplement to Basic Tutorial 1: heap allocation counter for the binding benchmarks
+ *
+ * liballoccount replaces malloc, calloc and realloc with wrappers that count every call,
+ * from any thread, and forward to glibc. Linking a program against it is enough, since it
+ * comes before libc in the lookup order; a Python interpreter gets it with LD_PRELOAD, and
+ * with PYTHONMALLOC=malloc the Python objects are counted too.
+ */
+
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Number of malloc, calloc and realloc calls so far */
+unsigned long long alloc_count (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ALLOC_COUNT_H */
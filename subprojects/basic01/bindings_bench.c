@@ -0,0 +1,325 @@
+/* GStreamer
+ *
+ * Supplement to Basic Tutorial 1: binding overhead benchmark, C version
+ *
+ * bindings_bench.c, bindings_bench.cpp and bindings_bench.py run the same hot operations on
+ * the same pipeline, through the C API, gstreamermm and PyGObject, and print the time and
+ * the heap allocations per operation:
+ *  - property: set and get "num-buffers" by name
+ *  - bus: post an application message, dispatch it from the main context to a bus watch
+ *    and read its integer field
+ *  - probe: one buffer probe callback, net of the same run without the probe, on
+ *    "fakesrc sizetype=empty ! fakesink" whose empty buffers cost next to nothing
+ *  - position: a position query on the paused pipeline
+ *  - signal: connect and disconnect a "pad-added" handler
+ *
+ *   videotestsrc name=source ! fakesink name=sink sync=false
+ *
+ * The probe cost is a difference of two runs, so it is measured in alternating rounds and
+ * printed with its standard deviation from round to round; a deviation as large as the cost
+ * means the difference is noise, and then it may well come out negative.
+ *
+ * With --tsv the results are printed as tab separated lines, for bindings_bench.py --compare.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <gst/gst.h>
+
+#include "alloc_count.h"
+
+static gint opt_iterations = 100000;
+static gint opt_buffers = 100000;
+static gboolean opt_tsv = FALSE;
+
+#define PROBE_ROUNDS 5
+
+static GOptionEntry entries[] = {
+  {"iterations", 'n', 0, G_OPTION_ARG_INT, &opt_iterations,
+      "Operations per measurement (default 100000)", "N"},
+  {"buffers", 'b', 0, G_OPTION_ARG_INT, &opt_buffers,
+      "Buffers for the probe measurement (default 100000)", "N"},
+  {"tsv", 0, 0, G_OPTION_ARG_NONE, &opt_tsv, "Print tab separated results",
+      NULL},
+  {NULL}
+};
+
+typedef struct _Sample
+{
+  gint64 start_time;
+  unsigned long long start_allocs;
+} Sample;
+
+static gint received;
+
+static void
+sample_start (Sample * sample)
+{
+  sample->start_allocs = alloc_count ();
+  sample->start_time = g_get_monotonic_time ();
+}
+
+/* Microseconds and allocations since sample_start() */
+static void
+sample_stop (Sample * sample, gdouble * usecs, gdouble * allocs)
+{
+  *usecs = g_get_monotonic_time () - sample->start_time;
+  *allocs = alloc_count () - sample->start_allocs;
+}
+
+/* A negative deviation is not printed, only the probe has one */
+static void
+report (const gchar * operation, gdouble usecs, gdouble allocs, gint count,
+    gdouble deviation)
+{
+  gchar *sd;
+
+  sd = deviation < 0.0 ? g_strdup ("-") : g_strdup_printf ("%.1f",
+      1e3 * deviation / count);
+  if (opt_tsv)
+    g_print ("%s\t%.1f\t%.2f\t%s\n", operation, 1e3 * usecs / count,
+        allocs / count, sd);
+  else
+    g_print ("%12s%12.1f%12.2f%12s\n", operation, 1e3 * usecs / count,
+        allocs / count, sd);
+  g_free (sd);
+}
+
+static gboolean
+on_bus_message (GstBus * bus, GstMessage * message, gpointer user_data)
+{
+  gint value;
+
+  if (GST_MESSAGE_TYPE (message) == GST_MESSAGE_APPLICATION &&
+      gst_structure_get_int (gst_message_get_structure (message), "value",
+          &value))
+    received++;
+  return TRUE;
+}
+
+static GstPadProbeReturn
+on_buffer (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  (*(gint *) user_data)++;
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+on_pad_added (GstElement * element, GstPad * pad, gpointer user_data)
+{
+}
+
+static void
+bench_property (GstElement * source)
+{
+  Sample sample;
+  gdouble usecs, allocs;
+  gint i, value = 0;
+
+  sample_start (&sample);
+  for (i = 0; i < opt_iterations; i++) {
+    g_object_set (source, "num-buffers", i, NULL);
+    g_object_get (source, "num-buffers", &value, NULL);
+  }
+  sample_stop (&sample, &usecs, &allocs);
+  report ("property", usecs, allocs, opt_iterations, -1.0);
+}
+
+static void
+bench_bus (GstElement * pipeline)
+{
+  GstBus *bus;
+  Sample sample;
+  gdouble usecs, allocs;
+  gint i;
+  guint watch_id;
+
+  /* A bus of our own, the pipeline's is flushing while it is stopped */
+  bus = gst_bus_new ();
+  watch_id = gst_bus_add_watch (bus, on_bus_message, NULL);
+  received = 0;
+
+  sample_start (&sample);
+  for (i = 0; i < opt_iterations; i++) {
+    gst_bus_post (bus, gst_message_new_application (GST_OBJECT (pipeline),
+            gst_structure_new ("bench", "value", G_TYPE_INT, i, NULL)));
+    g_main_context_iteration (NULL, FALSE);
+  }
+  sample_stop (&sample, &usecs, &allocs);
+
+  g_source_remove (watch_id);
+  gst_object_unref (bus);
+  if (received != opt_iterations)
+    g_printerr ("bus: %d of %d messages dispatched\n", received,
+        opt_iterations);
+  report ("bus", usecs, allocs, opt_iterations, -1.0);
+}
+
+/* Play num-buffers buffers to EOS, with or without a buffer probe */
+static void
+run_buffers (GstElement * pipeline, GstElement * source, gboolean probe,
+    gdouble * usecs, gdouble * allocs)
+{
+  GstBus *bus;
+  GstMessage *message;
+  GstPad *pad;
+  Sample sample;
+  gulong probe_id = 0;
+  gint count = 0;
+
+  g_object_set (source, "num-buffers", opt_buffers, NULL);
+  pad = gst_element_get_static_pad (source, "src");
+  if (probe)
+    probe_id = gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, on_buffer,
+        &count, NULL);
+
+  gst_element_set_state (pipeline, GST_STATE_PAUSED);
+  gst_element_get_state (pipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
+
+  bus = gst_element_get_bus (pipeline);
+  sample_start (&sample);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  message = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  sample_stop (&sample, usecs, allocs);
+
+  if (GST_MESSAGE_TYPE (message) == GST_MESSAGE_ERROR)
+    g_printerr ("probe: the pipeline failed\n");
+  gst_message_unref (message);
+  gst_object_unref (bus);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+
+  if (probe)
+    gst_pad_remove_probe (pad, probe_id);
+  gst_object_unref (pad);
+}
+
+static void
+bench_probe (void)
+{
+  GstElement *pipeline, *source;
+  GError *error = NULL;
+  gdouble usecs, allocs, base_usecs, base_allocs;
+  gdouble sum = 0.0, sum_squares = 0.0, alloc_sum = 0.0, mean, variance;
+  gint i;
+
+  pipeline = gst_parse_launch ("fakesrc name=source sizetype=empty ! "
+      "fakesink sync=false", &error);
+  if (!pipeline) {
+    g_printerr ("probe: could not create the pipeline: %s\n", error->message);
+    g_clear_error (&error);
+    return;
+  }
+  source = gst_bin_get_by_name (GST_BIN (pipeline), "source");
+
+  /* A first run warms up the caches and the allocator, the rounds alternate so
+   * that a drift affects both runs alike */
+  run_buffers (pipeline, source, FALSE, &base_usecs, &base_allocs);
+  for (i = 0; i < PROBE_ROUNDS; i++) {
+    run_buffers (pipeline, source, FALSE, &base_usecs, &base_allocs);
+    run_buffers (pipeline, source, TRUE, &usecs, &allocs);
+    sum += usecs - base_usecs;
+    sum_squares += (usecs - base_usecs) * (usecs - base_usecs);
+    alloc_sum += allocs - base_allocs;
+  }
+  mean = sum / PROBE_ROUNDS;
+  variance = (sum_squares - PROBE_ROUNDS * mean * mean) / (PROBE_ROUNDS - 1);
+  report ("probe", mean, alloc_sum / PROBE_ROUNDS, opt_buffers,
+      sqrt (MAX (variance, 0.0)));
+
+  gst_object_unref (source);
+  gst_object_unref (pipeline);
+}
+
+static void
+bench_position (GstElement * pipeline, GstElement * source)
+{
+  Sample sample;
+  gdouble usecs, allocs;
+  gint64 position;
+  gint i, answered = 0;
+
+  g_object_set (source, "num-buffers", -1, NULL);
+  gst_element_set_state (pipeline, GST_STATE_PAUSED);
+  gst_element_get_state (pipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
+
+  sample_start (&sample);
+  for (i = 0; i < opt_iterations; i++) {
+    if (gst_element_query_position (pipeline, GST_FORMAT_TIME, &position))
+      answered++;
+  }
+  sample_stop (&sample, &usecs, &allocs);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  if (answered != opt_iterations)
+    g_printerr ("position: %d of %d queries answered\n", answered,
+        opt_iterations);
+  report ("position", usecs, allocs, opt_iterations, -1.0);
+}
+
+static void
+bench_signal (GstElement * sink)
+{
+  Sample sample;
+  gdouble usecs, allocs;
+  gint i;
+  gulong handler_id;
+
+  sample_start (&sample);
+  for (i = 0; i < opt_iterations; i++) {
+    handler_id = g_signal_connect (sink, "pad-added",
+        G_CALLBACK (on_pad_added), NULL);
+    g_signal_handler_disconnect (sink, handler_id);
+  }
+  sample_stop (&sample, &usecs, &allocs);
+  report ("signal", usecs, allocs, opt_iterations, -1.0);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  GstElement *pipeline, *source, *sink;
+
+  /* Older GLib hands out small blocks from its own slice allocator, which
+   * would hide them from the counter */
+  g_setenv ("G_SLICE", "always-malloc", TRUE);
+
+  context = g_option_context_new ("- binding overhead benchmark, C");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("Failed to parse options: %s\n", error->message);
+    g_clear_error (&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free (context);
+
+  gst_init (&argc, &argv);
+
+  pipeline = gst_parse_launch ("videotestsrc name=source ! "
+      "fakesink name=sink sync=false", &error);
+  if (!pipeline) {
+    g_printerr ("Could not create the pipeline: %s\n", error->message);
+    g_clear_error (&error);
+    return EXIT_FAILURE;
+  }
+  source = gst_bin_get_by_name (GST_BIN (pipeline), "source");
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+
+  if (!opt_tsv)
+    g_print ("%12s%12s%12s%12s\n", "operation", "ns/op", "allocs/op",
+        "sd ns/op");
+  bench_property (source);
+  bench_bus (pipeline);
+  bench_probe ();
+  bench_position (pipeline, source);
+  bench_signal (sink);
+
+  gst_object_unref (sink);
+  gst_object_unref (source);
+  gst_object_unref (pipeline);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,281 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 1: Binding overhead benchmark, gstreamermm version
+ *
+ * Runs the operations of bindings_bench.c through the gstreamermm API, the way the C++
+ * tutorials write them, on the same pipeline and with the same output. The difference to
+ * the C numbers is what the wrapper costs: RefPtr and wrapper objects, Glib::Value copies,
+ * sigc++ slots and Glib::ustring conversions. The probe is measured like there, in alternating
+ * rounds on empty fakesrc buffers, and printed with its standard deviation.
+ */
+
+#include <gstreamermm.h>
+#include <glibmm.h>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include "alloc_count.h"
+
+using Glib::RefPtr;
+
+namespace
+{
+
+// Command line options
+gint opt_iterations {100000};
+gint opt_buffers {100000};
+gboolean opt_tsv {FALSE};
+
+const int probe_rounds {5};
+
+GOptionEntry entries[] =
+{
+  { "iterations", 'n', 0, G_OPTION_ARG_INT, &opt_iterations, "Operations per measurement (default 100000)", "N" },
+  { "buffers", 'b', 0, G_OPTION_ARG_INT, &opt_buffers, "Buffers for the probe measurement (default 100000)", "N" },
+  { "tsv", 0, 0, G_OPTION_ARG_NONE, &opt_tsv, "Print tab separated results", nullptr },
+  { nullptr }
+};
+
+class Sample
+{
+public:
+  Sample() : start_allocs {alloc_count()}, start_time {std::chrono::steady_clock::now()} {}
+
+  // Nanoseconds and allocations since construction
+  void stop(double& nsecs, double& allocs) const
+  {
+    nsecs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start_time).count();
+    allocs = alloc_count() - start_allocs;
+  }
+
+private:
+  unsigned long long start_allocs;
+  std::chrono::steady_clock::time_point start_time;
+};
+
+gint received {0};
+
+// A negative deviation is not printed, only the probe has one
+void report(const char* operation, double nsecs, double allocs, gint count, double deviation = -1.0)
+{
+  std::ostringstream sd;
+  if (deviation < 0.0)
+    sd << "-";
+  else
+    sd << std::fixed << std::setprecision(1) << deviation / count;
+
+  if (opt_tsv)
+    std::cout << operation << "\t" << std::fixed << std::setprecision(1) << nsecs / count << "\t" <<
+      std::setprecision(2) << allocs / count << "\t" << sd.str() << std::endl;
+  else
+    std::cout << std::setw(12) << operation << std::fixed << std::setprecision(1) << std::setw(12) <<
+      nsecs / count << std::setprecision(2) << std::setw(12) << allocs / count << std::setw(12) << sd.str() << std::endl;
+}
+
+bool on_bus_message(const RefPtr<Gst::Bus>&, const RefPtr<Gst::Message>& message)
+{
+  if (message->get_message_type() == Gst::MESSAGE_APPLICATION)
+  {
+    int value {0};
+    message->get_structure().get_field("value", value);
+    received++;
+  }
+  return true;
+}
+
+void on_pad_added(const RefPtr<Gst::Pad>&)
+{
+}
+
+void bench_property(const RefPtr<Gst::Element>& source)
+{
+  int value {0};
+  Sample sample;
+  for (gint i = 0; i < opt_iterations; i++)
+  {
+    source->set_property("num-buffers", i);
+    source->get_property("num-buffers", value);
+  }
+
+  double nsecs, allocs;
+  sample.stop(nsecs, allocs);
+  report("property", nsecs, allocs, opt_iterations);
+}
+
+void bench_bus(const RefPtr<Gst::Element>& pipeline)
+{
+  // A bus of our own, the pipeline's is flushing while it is stopped
+  RefPtr<Gst::Bus> bus {Gst::Bus::create()};
+  guint watch_id {bus->add_watch(sigc::ptr_fun(&on_bus_message))};
+  RefPtr<Glib::MainContext> main_context {Glib::MainContext::get_default()};
+  received = 0;
+
+  Sample sample;
+  for (gint i = 0; i < opt_iterations; i++)
+  {
+    Gst::Structure structure {"bench"};
+    structure.set_field("value", i);
+    bus->post(Gst::MessageApplication::create(pipeline, structure));
+    main_context->iteration(false);
+  }
+
+  double nsecs, allocs;
+  sample.stop(nsecs, allocs);
+  bus->remove_watch(watch_id);
+  if (received != opt_iterations)
+    std::cerr << "bus: " << received << " of " << opt_iterations << " messages dispatched" << std::endl;
+  report("bus", nsecs, allocs, opt_iterations);
+}
+
+// Play num-buffers buffers to EOS, with or without a buffer probe
+void run_buffers(const RefPtr<Gst::Element>& pipeline, const RefPtr<Gst::Element>& source, bool probe,
+    double& nsecs, double& allocs)
+{
+  source->set_property("num-buffers", opt_buffers);
+  RefPtr<Gst::Pad> pad {source->get_static_pad("src")};
+  gint count {0};
+  gulong probe_id {0};
+  if (probe)
+    probe_id = pad->add_probe(Gst::PAD_PROBE_TYPE_BUFFER,
+        [&count] (const RefPtr<Gst::Pad>&, const Gst::PadProbeInfo&) -> Gst::PadProbeReturn {
+          count++;
+          return Gst::PAD_PROBE_OK;
+        });
+
+  Gst::State state, pending;
+  pipeline->set_state(Gst::STATE_PAUSED);
+  pipeline->get_state(state, pending, Gst::CLOCK_TIME_NONE);
+
+  RefPtr<Gst::Bus> bus {pipeline->get_bus()};
+  Sample sample;
+  pipeline->set_state(Gst::STATE_PLAYING);
+  RefPtr<Gst::Message> message {bus->pop(Gst::CLOCK_TIME_NONE, Gst::MESSAGE_EOS | Gst::MESSAGE_ERROR)};
+  sample.stop(nsecs, allocs);
+
+  if (message->get_message_type() == Gst::MESSAGE_ERROR)
+    std::cerr << "probe: the pipeline failed" << std::endl;
+  pipeline->set_state(Gst::STATE_NULL);
+  if (probe)
+    pad->remove_probe(probe_id);
+}
+
+void bench_probe()
+{
+  RefPtr<Gst::Bin> pipeline;
+  try
+  {
+    pipeline = RefPtr<Gst::Bin>::cast_dynamic(Gst::Parse::launch("fakesrc name=source sizetype=empty ! fakesink sync=false"));
+  }
+  catch (const Glib::Error& ex)
+  {
+    std::cerr << "probe: could not create the pipeline: " << ex.what() << std::endl;
+    return;
+  }
+  RefPtr<Gst::Element> source {pipeline->get_element("source")};
+
+  // Warm up once, then alternate so that a drift affects both runs alike
+  double nsecs, allocs, base_nsecs, base_allocs;
+  run_buffers(pipeline, source, false, base_nsecs, base_allocs);
+  double sum {0.0}, sum_squares {0.0}, alloc_sum {0.0};
+  for (int i = 0; i < probe_rounds; i++)
+  {
+    run_buffers(pipeline, source, false, base_nsecs, base_allocs);
+    run_buffers(pipeline, source, true, nsecs, allocs);
+    sum += nsecs - base_nsecs;
+    sum_squares += (nsecs - base_nsecs) * (nsecs - base_nsecs);
+    alloc_sum += allocs - base_allocs;
+  }
+  double mean {sum / probe_rounds};
+  double variance {(sum_squares - probe_rounds * mean * mean) / (probe_rounds - 1)};
+  report("probe", mean, alloc_sum / probe_rounds, opt_buffers, std::sqrt(std::max(variance, 0.0)));
+}
+
+void bench_position(const RefPtr<Gst::Element>& pipeline, const RefPtr<Gst::Element>& source)
+{
+  source->set_property("num-buffers", -1);
+  Gst::State state, pending;
+  pipeline->set_state(Gst::STATE_PAUSED);
+  pipeline->get_state(state, pending, Gst::CLOCK_TIME_NONE);
+
+  gint64 position {0};
+  gint answered {0};
+  Sample sample;
+  for (gint i = 0; i < opt_iterations; i++)
+  {
+    if (pipeline->query_position(Gst::FORMAT_TIME, position))
+      answered++;
+  }
+
+  double nsecs, allocs;
+  sample.stop(nsecs, allocs);
+  pipeline->set_state(Gst::STATE_NULL);
+  if (answered != opt_iterations)
+    std::cerr << "position: " << answered << " of " << opt_iterations << " queries answered" << std::endl;
+  report("position", nsecs, allocs, opt_iterations);
+}
+
+void bench_signal(const RefPtr<Gst::Element>& sink)
+{
+  Sample sample;
+  for (gint i = 0; i < opt_iterations; i++)
+  {
+    sigc::connection connection {sink->signal_pad_added().connect(sigc::ptr_fun(&on_pad_added))};
+    connection.disconnect();
+  }
+
+  double nsecs, allocs;
+  sample.stop(nsecs, allocs);
+  report("signal", nsecs, allocs, opt_iterations);
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  // Older GLib hands out small blocks from its own slice allocator, which would hide them from the counter
+  g_setenv("G_SLICE", "always-malloc", TRUE);
+
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("- binding overhead benchmark, gstreamermm")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  // Initialize gstreamermm:
+  Gst::init(argc, argv);
+
+  RefPtr<Gst::Bin> pipeline;
+  try
+  {
+    pipeline = RefPtr<Gst::Bin>::cast_dynamic(Gst::Parse::launch("videotestsrc name=source ! fakesink name=sink sync=false"));
+  }
+  catch (const Glib::Error& ex)
+  {
+    std::cerr << "Could not create the pipeline: " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  RefPtr<Gst::Element> source {pipeline->get_element("source")};
+  RefPtr<Gst::Element> sink {pipeline->get_element("sink")};
+
+  if (!opt_tsv)
+    std::cout << std::setw(12) << "operation" << std::setw(12) << "ns/op" << std::setw(12) << "allocs/op" <<
+      std::setw(12) << "sd ns/op" << std::endl;
+  bench_property(source);
+  bench_bus(pipeline);
+  bench_probe();
+  bench_position(pipeline, source);
+  bench_signal(sink);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,260 @@
+#!/usr/bin/env python3
+
+"""
+Supplement to Basic Tutorial 1: Binding overhead benchmark, Python version
+
+Runs the operations of bindings_bench.c through PyGObject, on the same pipelines and with the
+same output, the probe in alternating rounds with its standard deviation. Allocations are counted by liballoccount, which has to be preloaded; --alloc-lib
+does that by running the script again with LD_PRELOAD, and with PYTHONMALLOC=malloc so the
+Python objects are counted as well. Without it the allocation column shows "-".
+
+--compare runs the C and C++ versions too and prints all three side by side, e.g.
+
+    python3 bindings_bench.py --alloc-lib builddir/subprojects/basic01/liballoccount.so \\
+        --compare builddir/subprojects/basic01
+"""
+
+import argparse
+import ctypes
+import math
+import os
+import subprocess
+import sys
+import time
+
+import gi
+gi.require_version("Gst", "1.0")
+gi.require_version("GLib", "2.0")
+from gi.repository import GLib, Gst
+
+OPERATIONS = ["property", "bus", "probe", "position", "signal"]
+PROBE_ROUNDS = 5
+
+
+def find_alloc_count():
+    """The counter of a preloaded liballoccount, or None"""
+    try:
+        alloc_count = ctypes.CDLL(None).alloc_count
+    except AttributeError:
+        return None
+    alloc_count.restype = ctypes.c_ulonglong
+    alloc_count.argtypes = []
+    return alloc_count
+
+
+alloc_count = find_alloc_count()
+
+
+class Sample:
+    def __init__(self):
+        self.start_allocs = alloc_count() if alloc_count else 0
+        self.start_time = time.perf_counter_ns()
+
+    def stop(self):
+        """Nanoseconds and allocations since construction"""
+        nsecs = time.perf_counter_ns() - self.start_time
+        allocs = alloc_count() - self.start_allocs if alloc_count else None
+        return nsecs, allocs
+
+
+def bench_property(source, iterations):
+    sample = Sample()
+    for i in range(iterations):
+        source.set_property("num-buffers", i)
+        source.get_property("num-buffers")
+    return sample.stop()
+
+
+def bench_bus(pipeline, iterations):
+    received = [0]
+
+    def on_bus_message(bus, message):
+        if message.type == Gst.MessageType.APPLICATION:
+            ok, value = message.get_structure().get_int("value")
+            if ok:
+                received[0] += 1
+        return True
+
+    # A bus of our own, the pipeline's is flushing while it is stopped
+    bus = Gst.Bus.new()
+    watch_id = bus.add_watch(GLib.PRIORITY_DEFAULT, on_bus_message)
+    context = GLib.MainContext.default()
+
+    sample = Sample()
+    for i in range(iterations):
+        structure = Gst.Structure.new_empty("bench")
+        structure.set_value("value", i)
+        bus.post(Gst.Message.new_application(pipeline, structure))
+        context.iteration(False)
+    result = sample.stop()
+
+    GLib.source_remove(watch_id)
+    if received[0] != iterations:
+        sys.stderr.write("bus: %d of %d messages dispatched\n" % (received[0], iterations))
+    return result
+
+
+def run_buffers(pipeline, source, buffers, probe):
+    """Play num-buffers buffers to EOS, with or without a buffer probe"""
+    count = [0]
+
+    def on_buffer(pad, info):
+        count[0] += 1
+        return Gst.PadProbeReturn.OK
+
+    source.set_property("num-buffers", buffers)
+    pad = source.get_static_pad("src")
+    probe_id = pad.add_probe(Gst.PadProbeType.BUFFER, on_buffer) if probe else 0
+
+    pipeline.set_state(Gst.State.PAUSED)
+    pipeline.get_state(Gst.CLOCK_TIME_NONE)
+
+    bus = pipeline.get_bus()
+    sample = Sample()
+    pipeline.set_state(Gst.State.PLAYING)
+    message = bus.timed_pop_filtered(Gst.CLOCK_TIME_NONE, Gst.MessageType.EOS | Gst.MessageType.ERROR)
+    result = sample.stop()
+
+    if message.type == Gst.MessageType.ERROR:
+        sys.stderr.write("probe: the pipeline failed\n")
+    pipeline.set_state(Gst.State.NULL)
+    if probe:
+        pad.remove_probe(probe_id)
+    return result
+
+
+def bench_probe(buffers):
+    """Mean nanoseconds, allocations and standard deviation of the probed run's extra cost"""
+    pipeline = Gst.parse_launch("fakesrc name=source sizetype=empty ! fakesink sync=false")
+    source = pipeline.get_by_name("source")
+
+    # Warm up once, then alternate the runs
+    run_buffers(pipeline, source, buffers, False)
+    nsecs, allocs = [], []
+    for i in range(PROBE_ROUNDS):
+        base = run_buffers(pipeline, source, buffers, False)
+        probed = run_buffers(pipeline, source, buffers, True)
+        nsecs.append(probed[0] - base[0])
+        if probed[1] is not None:
+            allocs.append(probed[1] - base[1])
+
+    mean = sum(nsecs) / PROBE_ROUNDS
+    deviation = math.sqrt(sum((n - mean) ** 2 for n in nsecs) / (PROBE_ROUNDS - 1))
+    return mean, sum(allocs) / PROBE_ROUNDS if allocs else None, deviation
+
+
+def bench_position(pipeline, source, iterations):
+    source.set_property("num-buffers", -1)
+    pipeline.set_state(Gst.State.PAUSED)
+    pipeline.get_state(Gst.CLOCK_TIME_NONE)
+
+    answered = 0
+    sample = Sample()
+    for i in range(iterations):
+        ok, position = pipeline.query_position(Gst.Format.TIME)
+        if ok:
+            answered += 1
+    result = sample.stop()
+
+    pipeline.set_state(Gst.State.NULL)
+    if answered != iterations:
+        sys.stderr.write("position: %d of %d queries answered\n" % (answered, iterations))
+    return result
+
+
+def on_pad_added(element, pad):
+    pass
+
+
+def bench_signal(sink, iterations):
+    sample = Sample()
+    for i in range(iterations):
+        handler_id = sink.connect("pad-added", on_pad_added)
+        sink.disconnect(handler_id)
+    return sample.stop()
+
+
+def run_python(iterations, buffers):
+    """{operation: (ns/op, allocs/op or None, deviation ns/op or None)} for PyGObject"""
+    pipeline = Gst.parse_launch("videotestsrc name=source ! fakesink name=sink sync=false")
+    source = pipeline.get_by_name("source")
+    sink = pipeline.get_by_name("sink")
+
+    measured = {
+        "property": (bench_property(source, iterations), iterations),
+        "bus": (bench_bus(pipeline, iterations), iterations),
+        "probe": (bench_probe(buffers), buffers),
+        "position": (bench_position(pipeline, source, iterations), iterations),
+        "signal": (bench_signal(sink, iterations), iterations),
+    }
+    results = {}
+    for operation, (result, count) in measured.items():
+        nsecs, allocs = result[:2]
+        deviation = result[2] / count if len(result) > 2 else None
+        results[operation] = (nsecs / count, None if allocs is None else allocs / count, deviation)
+    return results
+
+
+def run_native(program, iterations, buffers):
+    """{operation: (ns/op, allocs/op, deviation ns/op or None)} from the --tsv output of the C or C++ version"""
+    output = subprocess.run([program, "--tsv", "--iterations", str(iterations), "--buffers", str(buffers)],
+                            check=True, stdout=subprocess.PIPE, universal_newlines=True).stdout
+    results = {}
+    for line in output.splitlines():
+        operation, nsecs, allocs, deviation = line.split("\t")
+        results[operation] = (float(nsecs), float(allocs), None if deviation == "-" else float(deviation))
+    return results
+
+
+def format_optional(value, precision):
+    return "%14s" % "-" if value is None else "%14.*f" % (precision, value)
+
+
+def print_results(columns):
+    names = [name for name, results in columns]
+    sys.stdout.write("%12s" % "operation" + "".join("%14s" % ("ns " + name) for name in names) +
+                     "".join("%14s" % ("allocs " + name) for name in names) +
+                     "".join("%14s" % ("sd " + name) for name in names) + "\n")
+    for operation in OPERATIONS:
+        sys.stdout.write("%12s" % operation +
+                         "".join("%14.1f" % results[operation][0] for name, results in columns) +
+                         "".join(format_optional(results[operation][1], 2) for name, results in columns) +
+                         "".join(format_optional(results[operation][2], 1) for name, results in columns) + "\n")
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description="binding overhead benchmark, PyGObject")
+    parser.add_argument("-n", "--iterations", type=int, default=100000,
+                        help="operations per measurement (default 100000)")
+    parser.add_argument("-b", "--buffers", type=int, default=100000,
+                        help="buffers for the probe measurement (default 100000)")
+    parser.add_argument("--tsv", action="store_true", help="print tab separated results")
+    parser.add_argument("--alloc-lib", metavar="PATH", help="liballoccount.so, to count allocations")
+    parser.add_argument("--compare", metavar="DIR",
+                        help="build directory with bindings_bench_c and bindings_bench_cpp to compare with")
+    args = parser.parse_args(argv[1:])
+
+    # The counter has to replace malloc before the interpreter starts
+    if args.alloc_lib and not alloc_count:
+        env = dict(os.environ, LD_PRELOAD=os.path.abspath(args.alloc_lib), PYTHONMALLOC="malloc")
+        os.execve(sys.executable, [sys.executable] + argv, env)
+
+    Gst.init(None)
+
+    columns = []
+    if args.compare:
+        for name, program in (("C", "bindings_bench_c"), ("C++", "bindings_bench_cpp")):
+            columns.append((name, run_native(os.path.join(args.compare, program), args.iterations, args.buffers)))
+    python = run_python(args.iterations, args.buffers)
+
+    if args.tsv:
+        for operation in OPERATIONS:
+            nsecs, allocs, deviation = python[operation]
+            sys.stdout.write("%s\t%.1f\t%s\t%s\n" % (operation, nsecs, "-" if allocs is None else "%.2f" % allocs,
+                                                   "-" if deviation is None else "%.1f" % deviation))
+    else:
+        print_results(columns + [("Python", python)])
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,370 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 1: Hot-standby failover player
+ *
+ * Instead of quitting on the first ERROR message, two playbins decode the same media. The
+ * primary one feeds the output, the standby one plays along into the unselected input of the
+ * output. Periodic position queries compare the two, and only when the standby drifted by
+ * more than a frame it is sought ahead of the primary, by what the last such seek took, so
+ * that it lands in step. When the primary posts an error the output switches to the standby
+ * right away, within one frame interval, and the failed playbin is torn down and started
+ * again as the new standby, to be aligned with its new primary.
+ *  - Both players render into intervideosink/interaudiosink channels, the output pipeline
+ *    reads both channels with intervideosrc/interaudiosrc and an input-selector picks one.
+ *  - The gap between the last frame of the failed player and the first frame of the standby
+ *    is measured on the inter sinks and printed on each failover.
+ */
+
+#include <gstreamermm.h>
+#include <glibmm/main.h>
+#include <glibmm/convert.h>
+#include <atomic>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+
+using Glib::RefPtr;
+
+namespace
+{
+
+// Command line options
+gint opt_sync_interval {500};
+gint opt_inject_error {0};
+
+GOptionEntry entries[] =
+{
+  { "sync-interval", 's', 0, G_OPTION_ARG_INT, &opt_sync_interval,
+    "Milliseconds between drift checks of the standby against the primary (default 500)", "MS" },
+  { "inject-error", 'e', 0, G_OPTION_ARG_INT, &opt_inject_error,
+    "Inject an error into the primary player every N seconds (default 0, disabled)", "SEC" },
+  { nullptr }
+};
+
+// One of the two decoding pipelines
+struct Player
+{
+  RefPtr<Gst::Element> playbin;
+  RefPtr<Gst::Element> video_sink;
+  guint watch_id {0};
+  // Prerolled at least once since it was built, and whether a re-aligning seek is in flight
+  bool ready {false};
+  bool aligning {false};
+  // Monotonic time (us) the re-aligning seek was sent, and how long the last one took
+  gint64 align_start {0};
+  gint64 align_cost {0};
+  // Set after an error, further messages of a failed player are ignored until it is rebuilt
+  bool failed {false};
+  // Monotonic time (us) of the last video frame handed to the output by this player
+  std::atomic<gint64> last_frame {0};
+};
+
+RefPtr<Glib::MainLoop> mainloop;
+RefPtr<Gst::Element> output;
+Glib::ustring uri;
+Player players[2];
+std::atomic<int> primary {0};
+
+// Failover bookkeeping, written by the main loop and read by the frame probes
+std::atomic<bool> switching {false};
+std::atomic<gint64> gap {-1};
+gint64 failover_start {0};
+gint64 last_primary_frame {0};
+guint failovers {0};
+// Standby position minus primary position (ns) at the last sync, reported on a failover
+gint64 last_drift {0};
+gint64 failover_drift {0};
+
+void build_player(int index);
+
+std::string channel_name(const char* media, int index)
+{
+  return std::string {"failover-"} + media + std::to_string(index);
+}
+
+// Remember when each player last produced a frame, and measure the output gap on a failover.
+GstPadProbeReturn on_frame(GstPad*, GstPadProbeInfo*, gpointer user_data)
+{
+  int index {GPOINTER_TO_INT(user_data)};
+  gint64 now {g_get_monotonic_time()};
+  players[index].last_frame.store(now, std::memory_order_relaxed);
+
+  if (index == primary && switching.exchange(false))
+    gap.store(now - last_primary_frame, std::memory_order_relaxed);
+
+  return GST_PAD_PROBE_OK;
+}
+
+// Switch the output to the standby player and rebuild the failed one.
+void failover()
+{
+  int failed {primary};
+  int standby {1 - failed};
+
+  failover_start = g_get_monotonic_time();
+  last_primary_frame = players[failed].last_frame.load(std::memory_order_relaxed);
+  failovers++;
+  players[failed].failed = true;
+
+  if (!players[standby].ready)
+  {
+    std::cerr << "Standby player is not ready, restarting both players." << std::endl;
+    build_player(failed);
+    build_player(standby);
+    return;
+  }
+
+  // The standby is already playing within a frame of the primary, only the output switches
+  failover_drift = last_drift;
+  primary = standby;
+  switching = true;
+
+  RefPtr<Gst::Bin> bin {RefPtr<Gst::Bin>::cast_dynamic(output)};
+  for (const char* media : {"video", "audio"})
+  {
+    RefPtr<Gst::Element> selector {bin->get_element(std::string {media} + "-selector")};
+    RefPtr<Gst::Pad> pad {selector->get_static_pad("sink_" + std::to_string(standby))};
+    selector->set_property("active-pad", pad);
+  }
+
+  // Tear down the failed player from the main loop, the output no longer depends on it
+  Glib::signal_idle().connect_once([failed] () { build_player(failed); });
+}
+
+bool on_player_message(const RefPtr<Gst::Bus>&, const RefPtr<Gst::Message>& message, int index)
+{
+  if (players[index].failed)
+    return true;
+
+  switch (message->get_message_type())
+  {
+    case Gst::MESSAGE_EOS:
+      if (index == primary)
+      {
+        std::cout << std::endl << "End of stream" << std::endl;
+        mainloop->quit();
+      }
+      break;
+    case Gst::MESSAGE_ERROR:
+    {
+      RefPtr<Gst::MessageError> msgError {RefPtr<Gst::MessageError>::cast_static(message)};
+      Glib::Error err {msgError->parse_error()};
+      std::cerr << std::endl << (index == primary ? "Primary" : "Standby") << " player error from " <<
+        message->get_source()->get_name() << ": " << err.what() << std::endl;
+
+      if (index == primary)
+      {
+        failover();
+      }
+      else
+      {
+        players[index].failed = true;
+        Glib::signal_idle().connect_once([index] () { build_player(index); });
+      }
+      break;
+    }
+    case Gst::MESSAGE_ASYNC_DONE:
+      // The standby has prerolled, either initially or after a re-aligning seek
+      if (index != primary)
+      {
+        Player& player {players[index]};
+        if (player.aligning)
+          player.align_cost = g_get_monotonic_time() - player.align_start;
+        player.ready = true;
+        player.aligning = false;
+      }
+      break;
+    default:
+      break;
+  }
+
+  return true;
+}
+
+// Create a fresh playbin for a slot. It starts playing and becomes the standby.
+void build_player(int index)
+{
+  Player& player {players[index]};
+  if (player.playbin)
+  {
+    player.playbin->get_bus()->remove_watch(player.watch_id);
+    player.playbin->set_state(Gst::STATE_NULL);
+  }
+  player.ready = false;
+  player.aligning = false;
+  player.align_cost = 0;
+  player.failed = false;
+
+  player.playbin = Gst::ElementFactory::create_element("playbin", "player" + std::to_string(index));
+  player.video_sink = Gst::ElementFactory::create_element("intervideosink");
+  RefPtr<Gst::Element> video_sink {player.video_sink};
+  RefPtr<Gst::Element> audio_sink {Gst::ElementFactory::create_element("interaudiosink")};
+  video_sink->set_property("channel", Glib::ustring {channel_name("video", index)});
+  audio_sink->set_property("channel", Glib::ustring {channel_name("audio", index)});
+
+  gst_pad_add_probe(video_sink->get_static_pad("sink")->gobj(), GST_PAD_PROBE_TYPE_BUFFER,
+      &on_frame, GINT_TO_POINTER(index), nullptr);
+
+  player.playbin->set_property("uri", uri);
+  player.playbin->set_property("video-sink", video_sink);
+  player.playbin->set_property("audio-sink", audio_sink);
+  player.watch_id = player.playbin->get_bus()->add_watch(
+      sigc::bind(sigc::ptr_fun(&on_player_message), index));
+
+  // Play right away into its channel, on_sync() aligns it with the primary once it is ready
+  player.playbin->set_state(Gst::STATE_PLAYING);
+}
+
+// The duration of one video frame of a player, 40 ms until its caps are known
+gint64 frame_duration(const Player& player)
+{
+  gint64 duration {40 * GST_MSECOND};
+  GstPad* pad {gst_element_get_static_pad(player.video_sink->gobj(), "sink")};
+  GstCaps* caps {gst_pad_get_current_caps(pad)};
+  gint num {0}, denom {0};
+  if (caps && gst_structure_get_fraction(gst_caps_get_structure(caps, 0), "framerate", &num, &denom) && num > 0)
+    duration = gst_util_uint64_scale_int(GST_SECOND, denom, num);
+  if (caps)
+    gst_caps_unref(caps);
+  gst_object_unref(pad);
+  return duration;
+}
+
+// Keep the playing standby within a frame of the primary's position.
+bool on_sync()
+{
+  Player& standby {players[1 - primary]};
+  gint64 position {0}, standby_position {0};
+  if (standby.ready && !standby.aligning && !standby.failed &&
+      players[primary].playbin->query_position(Gst::FORMAT_TIME, position) &&
+      standby.playbin->query_position(Gst::FORMAT_TIME, standby_position))
+  {
+    // A flushing seek only on the unselected input, and only when it is needed; the standby
+    // keeps playing while it prerolls, so it is sent ahead by what the last seek took
+    last_drift = standby_position - position;
+    if (std::abs(last_drift) > frame_duration(standby))
+    {
+      standby.aligning = true;
+      standby.align_start = g_get_monotonic_time();
+      standby.playbin->seek(Gst::FORMAT_TIME, Gst::SEEK_FLAG_FLUSH | Gst::SEEK_FLAG_ACCURATE,
+          position + standby.align_cost * GST_USECOND);
+    }
+  }
+
+  // Report the measured gap of the last failover once the standby delivered its first frame
+  gint64 measured {gap.exchange(-1)};
+  if (measured >= 0)
+  {
+    std::cout << "Failover " << failovers << ": output gap " << std::fixed << std::setprecision(1) <<
+      measured / 1000.0 << " ms, first frame " <<
+      (players[primary].last_frame.load() - failover_start) / 1000.0 << " ms after the error, standby " <<
+      failover_drift / 1e6 << " ms off" << std::endl;
+  }
+
+  return true;
+}
+
+// Simulate a failure of the primary decoder.
+bool on_inject_error()
+{
+  std::cout << std::endl << "Injecting error into the primary player." << std::endl;
+  GError* error {g_error_new_literal(GST_STREAM_ERROR, GST_STREAM_ERROR_DECODE, "Injected decoder error")};
+  GstElement* playbin {players[primary].playbin->gobj()};
+  gst_element_post_message(playbin, gst_message_new_error(GST_OBJECT(playbin), error, "failover test"));
+  g_error_free(error);
+  return true;
+}
+
+bool on_output_message(const RefPtr<Gst::Bus>&, const RefPtr<Gst::Message>& message)
+{
+  if (message->get_message_type() == Gst::MESSAGE_ERROR)
+  {
+    RefPtr<Gst::MessageError> msgError {RefPtr<Gst::MessageError>::cast_static(message)};
+    std::cerr << "Output error: " << msgError->parse_error().what() << std::endl;
+    mainloop->quit();
+    return false;
+  }
+  return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("<media file or uri>")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  if (argc < 2)
+  {
+    std::cout << "Usage: " << argv[0] << " [options] <media file or uri>" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Initialize gstreamermm:
+  Gst::init(argc, argv);
+
+  if (gst_uri_is_valid(argv[1]))
+    uri = argv[1];
+  else
+    uri = Glib::filename_to_uri(argv[1]);
+
+  // The output reads both channels, the input-selectors decide which one is shown
+  std::string description;
+  for (const char* media : {"video", "audio"})
+  {
+    for (int i = 0; i < 2; i++)
+      description += std::string {"inter"} + media + "src channel=" + channel_name(media, i) +
+        " ! queue ! " + media + "-selector.sink_" + std::to_string(i) + " ";
+  }
+  description += "input-selector name=video-selector ! videoconvert ! autovideosink "
+    "input-selector name=audio-selector ! audioconvert ! audioresample ! autoaudiosink";
+
+  try
+  {
+    output = Gst::Parse::launch(description);
+  }
+  catch (const Glib::Error& ex)
+  {
+    std::cerr << "Could not create the output pipeline: " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Create the main loop.
+  mainloop = Glib::MainLoop::create();
+  output->get_bus()->add_watch(sigc::ptr_fun(&on_output_message));
+
+  build_player(0);
+  build_player(1);
+
+  if (output->set_state(Gst::STATE_PLAYING) == Gst::STATE_CHANGE_FAILURE)
+  {
+    std::cerr << "Unable to set the output pipeline to the playing state." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  Glib::signal_timeout().connect(sigc::ptr_fun(&on_sync), opt_sync_interval);
+  if (opt_inject_error > 0)
+    Glib::signal_timeout().connect_seconds(sigc::ptr_fun(&on_inject_error), opt_inject_error);
+
+  std::cout << "Running." << std::endl;
+  mainloop->run();
+
+  // Clean up nicely:
+  std::cout << "Returned. Setting state to NULL." << std::endl;
+  for (Player& player : players)
+    player.playbin->set_state(Gst::STATE_NULL);
+  output->set_state(Gst::STATE_NULL);
+
+  return EXIT_SUCCESS;
+}
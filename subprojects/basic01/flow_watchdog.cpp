@@ -0,0 +1,185 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 1: Flow watchdog
+ */
+
+#include "flow_watchdog.h"
+#include <glibmm/main.h>
+#include <algorithm>
+
+FlowWatchdog::FlowWatchdog(const Glib::RefPtr<Gst::Element>& pipeline, guint window_ms)
+  : m_pipeline{ pipeline }
+  , m_window{ static_cast<gint64>(window_ms) * 1000 }
+  , m_element_added_id{ 0 }
+{
+  // Check four times per window, so a stall is reported at most a quarter window late
+  m_check_conn = Glib::signal_timeout().connect(sigc::mem_fun(*this, &FlowWatchdog::on_check),
+      std::max(window_ms / 4, 1u));
+}
+
+FlowWatchdog::~FlowWatchdog()
+{
+  m_check_conn.disconnect();
+  if (m_element_added_id)
+    g_signal_handler_disconnect(m_pipeline->gobj(), m_element_added_id);
+
+  // Releases the pads held by the idle callbacks that did not run yet
+  {
+    std::lock_guard<std::mutex> lock {m_pending_mutex};
+    for (sigc::connection& connection : m_pending)
+      connection.disconnect();
+    m_pending.clear();
+  }
+
+  for (auto& watched : m_pads)
+  {
+    gst_pad_remove_probe(watched->pad, watched->probe_id);
+    gst_object_unref(watched->pad);
+  }
+}
+
+void FlowWatchdog::watch_pad(const Glib::RefPtr<Gst::Pad>& pad)
+{
+  std::unique_ptr<WatchedPad> watched {new WatchedPad};
+  watched->pad = GST_PAD(gst_object_ref(pad->gobj()));
+  watched->last_idle = g_get_monotonic_time();
+  watched->probe_id = gst_pad_add_probe(watched->pad,
+      static_cast<GstPadProbeType>(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST |
+        GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+      &FlowWatchdog::on_pad_probe, watched.get(), nullptr);
+  m_pads.push_back(std::move(watched));
+}
+
+void FlowWatchdog::watch_sinks()
+{
+  m_element_added_id = g_signal_connect(m_pipeline->gobj(), "deep-element-added",
+      G_CALLBACK(&FlowWatchdog::on_deep_element_added), this);
+}
+
+void FlowWatchdog::set_recover_slot(const SlotRecover& slot)
+{
+  m_recover = slot;
+}
+
+GstPadProbeReturn FlowWatchdog::on_pad_probe(GstPad*, GstPadProbeInfo* info, gpointer user_data)
+{
+  WatchedPad* watched {static_cast<WatchedPad*>(user_data)};
+
+  if (info->type & (GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST))
+  {
+    gint64 now {g_get_monotonic_time()};
+    watched->last_buffer.store(now, std::memory_order_relaxed);
+    if (watched->stalled.load(std::memory_order_acquire))
+    {
+      gint64 none {0};
+      watched->resumed.compare_exchange_strong(none, now, std::memory_order_relaxed);
+    }
+    watched->buffers.fetch_add(1, std::memory_order_relaxed);
+  }
+  else
+  {
+    // A pad that reached EOS is done, not stalled
+    switch (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)))
+    {
+      case GST_EVENT_EOS:
+        watched->eos.store(true, std::memory_order_relaxed);
+        break;
+      case GST_EVENT_STREAM_START:
+      case GST_EVENT_FLUSH_STOP:
+        watched->eos.store(false, std::memory_order_relaxed);
+        break;
+      default:
+        break;
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+void FlowWatchdog::on_deep_element_added(GstBin*, GstBin*, GstElement* element, gpointer user_data)
+{
+  if (GST_IS_BIN(element) || !GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK))
+    return;
+
+  // Called from whichever thread adds the element, defer to the main loop that owns the list
+  GstPad* pad {gst_element_get_static_pad(element, "sink")};
+  if (!pad)
+    return;
+
+  FlowWatchdog* watchdog {static_cast<FlowWatchdog*>(user_data)};
+  Glib::RefPtr<Gst::Pad> sink_pad {Glib::wrap(pad, false)};
+  std::lock_guard<std::mutex> lock {watchdog->m_pending_mutex};
+  auto& pending = watchdog->m_pending;
+  pending.erase(std::remove_if(pending.begin(), pending.end(),
+      [] (const sigc::connection& connection) { return !connection.connected(); }), pending.end());
+  pending.push_back(Glib::signal_idle().connect([watchdog, sink_pad] () -> bool {
+    watchdog->watch_pad(sink_pad);
+    return false;
+  }));
+}
+
+bool FlowWatchdog::on_check()
+{
+  gint64 now {g_get_monotonic_time()};
+  bool playing {GST_STATE(m_pipeline->gobj()) == GST_STATE_PLAYING &&
+    GST_STATE_PENDING(m_pipeline->gobj()) == GST_STATE_VOID_PENDING};
+
+  for (auto& watched : m_pads)
+  {
+    guint64 buffers {watched->buffers.load(std::memory_order_relaxed)};
+    bool moving {buffers != watched->last_buffers};
+    watched->last_buffers = buffers;
+
+    if (moving && watched->stalled_since)
+    {
+      watched->stalled.store(false, std::memory_order_relaxed);
+      gint64 resumed {watched->resumed.exchange(0, std::memory_order_relaxed)};
+      post(watched->pad, "recovered", "time-to-recover",
+          static_cast<guint64>((resumed ? resumed : now) - watched->stalled_since) * GST_USECOND);
+      watched->stalled_since = 0;
+    }
+
+    // Buffers are not expected while paused, at EOS or before the first one arrived
+    if (!playing || watched->eos.load(std::memory_order_relaxed) || buffers == 0)
+    {
+      watched->last_idle = now;
+      continue;
+    }
+
+    // The flow stopped with the last buffer, or when buffers were last not expected
+    gint64 stall_start {std::max(watched->last_buffer.load(std::memory_order_relaxed), watched->last_idle)};
+    if (!moving && !watched->stalled_since && now - stall_start >= m_window)
+    {
+      watched->stalled_since = stall_start;
+      watched->resumed.store(0, std::memory_order_relaxed);
+      watched->stalled.store(true, std::memory_order_release);
+      post(watched->pad, "stalled", "time-to-detect",
+          static_cast<guint64>(now - stall_start) * GST_USECOND);
+
+      if (m_recover)
+      {
+        GstElement* element {gst_pad_get_parent_element(watched->pad)};
+        if (element)
+          m_recover(Glib::wrap(element, false));
+      }
+    }
+  }
+
+  return true;
+}
+
+void FlowWatchdog::post(GstPad* pad, const char* event, const char* field, guint64 value)
+{
+  GstElement* element {gst_pad_get_parent_element(pad)};
+  if (!element)
+    return;
+
+  GstStructure* structure {gst_structure_new("flow-watchdog",
+      "event", G_TYPE_STRING, event,
+      "element", G_TYPE_STRING, GST_OBJECT_NAME(element),
+      "pad", G_TYPE_STRING, GST_OBJECT_NAME(pad),
+      field, G_TYPE_UINT64, value,
+      nullptr)};
+  gst_element_post_message(element, gst_message_new_element(GST_OBJECT(element), structure));
+  gst_object_unref(element);
+}
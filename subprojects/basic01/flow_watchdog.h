@@ -0,0 +1,86 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 1: Flow watchdog
+ *
+ * Bus handlers only learn about errors and EOS, a pipeline that silently stops moving
+ * buffers goes unnoticed. The watchdog counts buffers on selected pads with cheap atomic
+ * probes and checks the counters from the main loop. When a pad has not seen a buffer for
+ * the configured window while the pipeline is PLAYING, an element message is posted on the
+ * bus naming the stalled element:
+ *
+ *   flow-watchdog, event=(string)stalled, element=(string)..., pad=(string)...,
+ *       time-to-detect=(guint64)...
+ *   flow-watchdog, event=(string)recovered, element=(string)..., pad=(string)...,
+ *       time-to-recover=(guint64)...
+ *
+ * Times are in nanoseconds and count from the last buffer before the stall, to the check
+ * that noticed it, or to the first buffer after it. An optional recovery slot is invoked on
+ * each stall.
+ */
+
+#ifndef FLOW_WATCHDOG_H
+#define FLOW_WATCHDOG_H
+
+#include <gstreamermm.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class FlowWatchdog
+{
+public:
+  // The slot receives the element owning the stalled pad
+  using SlotRecover = sigc::slot<void, const Glib::RefPtr<Gst::Element>&>;
+
+  FlowWatchdog(const Glib::RefPtr<Gst::Element>& pipeline, guint window_ms);
+  ~FlowWatchdog();
+
+  FlowWatchdog(const FlowWatchdog&) = delete;
+  FlowWatchdog& operator=(const FlowWatchdog&) = delete;
+
+  // Watch a single pad.
+  void watch_pad(const Glib::RefPtr<Gst::Pad>& pad);
+
+  // Watch the sink pad of every sink element, including those added later inside bins.
+  void watch_sinks();
+
+  // Invoke a slot to restart the flow whenever a stall is detected.
+  void set_recover_slot(const SlotRecover& slot);
+
+private:
+  struct WatchedPad
+  {
+    GstPad* pad {nullptr};
+    gulong probe_id {0};
+    std::atomic<guint64> buffers {0};
+    std::atomic<bool> eos {false};
+    // Monotonic times (us) of the last buffer, and of the first one after a detected stall
+    std::atomic<gint64> last_buffer {0};
+    std::atomic<gint64> resumed {0};
+    std::atomic<bool> stalled {false};
+    guint64 last_buffers {0};
+    // Last time buffers were not expected, while paused, at EOS or before the first one
+    gint64 last_idle {0};
+    gint64 stalled_since {0};
+  };
+
+  static GstPadProbeReturn on_pad_probe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+  static void on_deep_element_added(GstBin* bin, GstBin* sub_bin, GstElement* element, gpointer user_data);
+
+  bool on_check();
+  void post(GstPad* pad, const char* event, const char* field, guint64 value);
+
+private:
+  Glib::RefPtr<Gst::Element> m_pipeline;
+  std::vector<std::unique_ptr<WatchedPad>> m_pads;
+  SlotRecover m_recover;
+  sigc::connection m_check_conn;
+  gint64 m_window;
+  gulong m_element_added_id;
+  // Sink pads found from other threads, waiting for the main loop to watch them
+  std::mutex m_pending_mutex;
+  std::vector<sigc::connection> m_pending;
+};
+
+#endif // FLOW_WATCHDOG_H
@@ -22,16 +22,56 @@
 #include <iostream>
 #include <stdlib.h>
 #include <gstreamermm/playbin.h>
+#include <memory>
+#include "flow_watchdog.h"
+#include "gstmmapsrc.h"
+#include "file_prefetch.h"
+#include "qos_controller.h"
+#include "thread_policy.h"
 
 namespace
 {
 
 Glib::RefPtr<Glib::MainLoop> mainloop;
+std::unique_ptr<QosController> qos;
+
+// Command line options
+gint opt_watchdog {0};
+gboolean opt_auto_recover {FALSE};
+gboolean opt_mmap {FALSE};
+gint opt_prefetch {0};
+gboolean opt_evict {FALSE};
+gboolean opt_qos {FALSE};
+gchar** opt_thread_policy {nullptr};
+gboolean opt_thread_report {FALSE};
+
+GOptionEntry entries[] =
+{
+  { "watchdog", 'w', 0, G_OPTION_ARG_INT, &opt_watchdog,
+    "Report sinks that receive no buffers for this many milliseconds (default 0, disabled)", "MS" },
+  { "auto-recover", 'r', 0, G_OPTION_ARG_NONE, &opt_auto_recover,
+    "Restart the flow with a flushing seek when the watchdog detects a stall", nullptr },
+  { "mmap", 'm', 0, G_OPTION_ARG_NONE, &opt_mmap, "Read local files through mmapsrc instead of filesrc", nullptr },
+  { "prefetch", 'p', 0, G_OPTION_ARG_INT, &opt_prefetch,
+    "Prefetch the header, index and first SECONDS of a local file at startup (default 0, disabled)", "SECONDS" },
+  { "evict", 'e', 0, G_OPTION_ARG_NONE, &opt_evict,
+    "Drop a local file from the page cache first, to measure a cold start", nullptr },
+  { "qos", 'q', 0, G_OPTION_ARG_NONE, &opt_qos,
+    "Lower the decoding and post-processing quality while the sinks drop frames", nullptr },
+  { "thread-policy", 't', 0, G_OPTION_ARG_STRING_ARRAY, &opt_thread_policy,
+    "Affinity, scheduling and name of streaming threads, e.g. vqueue:cpus=2,fifo=10 (repeatable)", "RULE" },
+  { "thread-report", 'T', 0, G_OPTION_ARG_NONE, &opt_thread_report,
+    "Print CPU time, context switches and migrations of the streaming threads at exit", nullptr },
+  { nullptr }
+};
 
 // This function is used to receive asynchronous messages in the main loop.
 bool on_bus_message(const Glib::RefPtr<Gst::Bus>& /* bus */,
     const Glib::RefPtr<Gst::Message>& message)
 {
+  if (qos)
+    qos->handle_message(message->gobj());
+
   switch (message->get_message_type()) {
     case Gst::MESSAGE_EOS:
       std::cout << std::endl << "End of stream" << std::endl;
@@ -54,6 +94,28 @@ bool on_bus_message(const Glib::RefPtr<Gst::Bus>& /* bus */,
       mainloop->quit();
       return false;
     }
+    case Gst::MESSAGE_ELEMENT:
+    {
+      // First frame time, stall and recovery reports of the flow watchdog
+      const GstStructure* structure {gst_message_get_structure(message->gobj())};
+      guint64 first_frame {0};
+      if (gst_structure_has_name(structure, "first-frame") &&
+          gst_structure_get_uint64(structure, "time", &first_frame))
+      {
+        std::cout << "First frame after " << first_frame / GST_MSECOND << " ms" << std::endl;
+      }
+      else if (gst_structure_has_name(structure, "flow-watchdog"))
+      {
+        guint64 time {0};
+        if (!gst_structure_get_uint64(structure, "time-to-detect", &time))
+          gst_structure_get_uint64(structure, "time-to-recover", &time);
+        std::cout << std::endl << "Flow watchdog: " <<
+          gst_structure_get_string(structure, "element") << " " <<
+          gst_structure_get_string(structure, "event") << " after " <<
+          time / GST_MSECOND << " ms" << std::endl;
+      }
+      break;
+    }
     default:
       break;
   }
@@ -61,14 +123,54 @@ bool on_bus_message(const Glib::RefPtr<Gst::Bus>& /* bus */,
   return true;
 }
 
+// Let the QoS controller evaluate the last interval and report its steps
+bool on_qos_timeout()
+{
+  if (qos->update())
+  {
+    std::cout << std::endl << "QoS: level " << qos->get_level() << ", " <<
+      QosController::get_level_name(qos->get_level()) << ", sinks dropped " << qos->get_sink_dropped() <<
+      " of " << qos->get_sink_dropped() + qos->get_sink_rendered() << " frames" << std::endl;
+    for (const auto& drop : qos->get_drops())
+      std::cout << "  " << drop.first << " dropped " << drop.second << std::endl;
+  }
+  return true;
+}
+
+// Restart the flow of a stalled playbin by flushing and seeking back to where it stopped.
+void recover_playback(const Glib::RefPtr<Gst::Element>& playbin)
+{
+  gint64 position {0};
+  if (playbin->query_position(Gst::FORMAT_TIME, position) &&
+      playbin->seek(Gst::FORMAT_TIME, Gst::SEEK_FLAG_FLUSH | Gst::SEEK_FLAG_KEY_UNIT, position))
+    return;
+
+  // Seeking is not possible, cycle the state to rebuild the streaming threads
+  playbin->set_state(Gst::STATE_READY);
+  playbin->set_state(Gst::STATE_PLAYING);
+}
+
 } // anonymous namespace
 
 int main(int argc, char** argv)
 {
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("<media file or uri>")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
   // Check input arguments:
   if (argc < 2)
   {
-    std::cout << "Usage: " << argv[0] << " <media file or uri>" << std::endl;
+    std::cout << "Usage: " << argv[0] << " [options] <media file or uri>" << std::endl;
     std::cout << "example uri https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm" << std::endl;
     return EXIT_FAILURE;
   }
@@ -76,6 +178,10 @@ int main(int argc, char** argv)
   // Initialize gstreamermm:
   Gst::init(argc, argv);
 
+  // Rank mmapsrc above filesrc, so playbin picks it for file:// URIs
+  if (opt_mmap)
+    gst_mmap_src_register(TRUE);
+
   // Create a playbin element.
 #ifndef GSTREAMERMM_DISABLE_DEPRECATED
   Glib::RefPtr<Gst::PlayBin> playbin = Gst::PlayBin::create();
@@ -97,26 +203,75 @@ int main(int argc, char** argv)
   else
     uri = Glib::filename_to_uri(argv[1]);
 
+  // Start reading the file before the playbin asks for it, and time the first frame from here
+  if (opt_evict && !FilePrefetch::evict(uri))
+    std::cerr << "Could not evict " << uri << " from the page cache." << std::endl;
+  gint64 start_time {g_get_monotonic_time()};
+  std::unique_ptr<FilePrefetch> prefetch;
+  if (opt_prefetch > 0)
+    prefetch.reset(new FilePrefetch(uri, opt_prefetch));
+  watch_first_frame(GST_ELEMENT(playbin->gobj()), start_time);
+
   // Set the playbin's uri property.
   playbin->set_property("uri", uri);
 
   // Create the main loop.
   mainloop = Glib::MainLoop::create();
 
+  // Configure the streaming threads as they start, this takes the sync handler of the bus
+  std::unique_ptr<ThreadPolicy> thread_policy;
+  if (opt_thread_policy || opt_thread_report)
+  {
+    thread_policy.reset(new ThreadPolicy(GST_ELEMENT(playbin->gobj())));
+    for (gchar** spec = opt_thread_policy; spec && *spec; spec++)
+    {
+      ThreadPolicy::Rule rule;
+      std::string message;
+      if (!ThreadPolicy::parse(*spec, rule, message))
+      {
+        std::cerr << "Invalid thread policy \"" << *spec << "\": " << message << std::endl;
+        return EXIT_FAILURE;
+      }
+      thread_policy->add_rule(rule);
+    }
+  }
+
   // Get the bus from the playbin, and add a bus watch to the default main
   // context with the default priority:
   Glib::RefPtr<Gst::Bus> bus = playbin->get_bus();
   bus->add_watch(sigc::ptr_fun(&on_bus_message));
 
+  // Watch the sinks of the playbin for silent stalls
+  std::unique_ptr<FlowWatchdog> watchdog;
+  if (opt_watchdog > 0)
+  {
+    watchdog.reset(new FlowWatchdog(playbin, opt_watchdog));
+    watchdog->watch_sinks();
+    if (opt_auto_recover)
+      watchdog->set_recover_slot(sigc::hide(sigc::bind(sigc::ptr_fun(&recover_playback), playbin)));
+  }
+
+  // Trade quality for smooth playback when the machine can not keep up
+  if (opt_qos)
+  {
+    qos.reset(new QosController(GST_ELEMENT(playbin->gobj())));
+    Glib::signal_timeout().connect(sigc::ptr_fun(&on_qos_timeout), 500);
+  }
+
   // Now set the playbin to the PLAYING state and start the main loop:
   std::cout << "Setting to PLAYING." << std::endl;
   playbin->set_state(Gst::STATE_PLAYING);
   std::cout << "Running." << std::endl;
   mainloop->run();
 
+  // Before NULL, while the streaming threads still exist
+  if (thread_policy)
+    std::cout << std::endl << thread_policy->report();
+
   // Clean up nicely:
   std::cout << "Returned. Setting state to NULL." << std::endl;
   playbin->set_state(Gst::STATE_NULL);
+  qos.reset();
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,417 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 2: High-rate synthetic frame injector
+ *
+ * videotestsrc renders its pattern for every frame, which makes the source itself the
+ * bottleneck when stressing downstream elements. This example precomputes a small ring of
+ * frames once, then pushes them through appsrc with correct timestamps, either paced to a
+ * target frame rate or as fast as downstream accepts them.
+ *  - How to feed a pipeline from the application with appsrc.
+ *  - How to allocate frames from a video buffer pool and reuse them without copying.
+ *  - How to honor the need-data/enough-data back-pressure signals of appsrc.
+ */
+
+#include <gstreamermm.h>
+#include <glibmm/main.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/video/video.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+using Glib::RefPtr;
+
+namespace
+{
+
+// Command line options
+gint opt_width {1920};
+gint opt_height {1080};
+gint opt_fps {60};
+gint opt_streams {1};
+gint opt_ring {8};
+gint opt_queue {4};
+gint opt_duration {10};
+gboolean opt_unthrottled {FALSE};
+gchar* opt_format {nullptr};
+gchar* opt_downstream {nullptr};
+
+GOptionEntry entries[] =
+{
+  { "width", 'w', 0, G_OPTION_ARG_INT, &opt_width, "Frame width (default 1920)", "W" },
+  { "height", 'h', 0, G_OPTION_ARG_INT, &opt_height, "Frame height (default 1080)", "H" },
+  { "fps", 'f', 0, G_OPTION_ARG_INT, &opt_fps, "Target frame rate per stream (default 60)", "FPS" },
+  { "streams", 'n', 0, G_OPTION_ARG_INT, &opt_streams, "Number of parallel streams (default 1)", "N" },
+  { "ring", 'r', 0, G_OPTION_ARG_INT, &opt_ring, "Number of precomputed frames (default 8)", "N" },
+  { "queue", 'q', 0, G_OPTION_ARG_INT, &opt_queue, "Frames queued in appsrc before back-pressure (default 4)", "N" },
+  { "duration", 't', 0, G_OPTION_ARG_INT, &opt_duration, "Seconds to run, 0 runs forever (default 10)", "SEC" },
+  { "unthrottled", 'u', 0, G_OPTION_ARG_NONE, &opt_unthrottled, "Push as fast as downstream accepts", nullptr },
+  { "format", 0, 0, G_OPTION_ARG_STRING, &opt_format, "Raw video format (default I420)", "FORMAT" },
+  { "downstream", 'd', 0, G_OPTION_ARG_STRING, &opt_downstream,
+    "Downstream bin description for each stream (default \"fakesink sync=false\")", "DESC" },
+  { nullptr }
+};
+
+// Per-stream state shared between the pusher thread and the appsrc callbacks
+struct Stream
+{
+  GstAppSrc* appsrc {nullptr};
+  guint64 frame_count {0};
+  std::atomic<bool> blocked {false};
+  std::atomic<guint64> pushed {0};
+  std::atomic<guint64> backpressure_events {0};
+  std::atomic<guint64> skipped {0};
+};
+
+RefPtr<Glib::MainLoop> mainloop;
+RefPtr<Gst::Pipeline> pipeline;
+std::vector<Stream> streams;
+std::vector<GstBuffer*> ring;
+GstBufferPool* pool {nullptr};
+GstVideoInfo video_info;
+gint64 report_time {0};
+
+std::atomic<bool> running {false};
+std::mutex wake_mutex;
+std::condition_variable wake_cond;
+
+// appsrc has room again: resume pushing to this stream.
+void on_need_data(GstAppSrc*, guint, gpointer user_data)
+{
+  Stream* stream {static_cast<Stream*>(user_data)};
+  if (stream->blocked.exchange(false))
+  {
+    std::lock_guard<std::mutex> lock {wake_mutex};
+    wake_cond.notify_one();
+  }
+}
+
+// appsrc queue is full: downstream can not keep up with us.
+void on_enough_data(GstAppSrc*, gpointer user_data)
+{
+  Stream* stream {static_cast<Stream*>(user_data)};
+  if (!stream->blocked.exchange(true))
+    stream->backpressure_events.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Allocate the ring from a video buffer pool and render a moving gradient into each frame.
+bool prepare_ring(GstCaps* caps)
+{
+  pool = gst_video_buffer_pool_new();
+  GstStructure* config {gst_buffer_pool_get_config(pool)};
+  gst_buffer_pool_config_set_params(config, caps, GST_VIDEO_INFO_SIZE(&video_info), opt_ring, opt_ring);
+  gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+  if (!gst_buffer_pool_set_config(pool, config) || !gst_buffer_pool_set_active(pool, TRUE))
+    return false;
+
+  for (gint i = 0; i < opt_ring; i++)
+  {
+    GstBuffer* buffer {nullptr};
+    if (gst_buffer_pool_acquire_buffer(pool, &buffer, nullptr) != GST_FLOW_OK)
+      return false;
+
+    GstVideoFrame frame;
+    if (!gst_video_frame_map(&frame, &video_info, buffer, GST_MAP_WRITE))
+    {
+      gst_buffer_unref(buffer);
+      return false;
+    }
+    for (guint plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(&frame); plane++)
+    {
+      guint8* data {static_cast<guint8*>(GST_VIDEO_FRAME_PLANE_DATA(&frame, plane))};
+      gint stride {GST_VIDEO_FRAME_PLANE_STRIDE(&frame, plane)};
+      gint rows {GST_VIDEO_FRAME_COMP_HEIGHT(&frame, plane)};
+      for (gint y = 0; y < rows; y++)
+      {
+        guint8* line {data + y * stride};
+        if (plane == 0)
+          for (gint x = 0; x < stride; x++)
+            line[x] = static_cast<guint8>(x + y + i * 256 / opt_ring);
+        else
+          std::fill(line, line + stride, 128);
+      }
+    }
+    gst_video_frame_unmap(&frame);
+    ring.push_back(buffer);
+  }
+  return true;
+}
+
+// Push the next frame of a stream. The pushed buffer shares the memory of the ring entry,
+// only the metadata (timestamps) is new.
+bool push_frame(Stream& stream)
+{
+  GstBuffer* buffer {gst_buffer_copy(ring[stream.frame_count % ring.size()])};
+  GST_BUFFER_PTS(buffer) = gst_util_uint64_scale(stream.frame_count,
+      GST_SECOND * GST_VIDEO_INFO_FPS_D(&video_info), GST_VIDEO_INFO_FPS_N(&video_info));
+  GST_BUFFER_DURATION(buffer) = gst_util_uint64_scale(GST_SECOND,
+      GST_VIDEO_INFO_FPS_D(&video_info), GST_VIDEO_INFO_FPS_N(&video_info));
+  GST_BUFFER_OFFSET(buffer) = stream.frame_count;
+  stream.frame_count++;
+
+  if (gst_app_src_push_buffer(stream.appsrc, buffer) != GST_FLOW_OK)
+    return false;
+  stream.pushed.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+// Streaming loop: either paced to the target frame rate, or unthrottled where the only
+// limit is the back-pressure reported by appsrc.
+void pusher()
+{
+  using clock = std::chrono::steady_clock;
+  const auto interval {std::chrono::nanoseconds(GST_SECOND / opt_fps)};
+  auto deadline {clock::now()};
+
+  while (running)
+  {
+    bool any_pushed {false};
+    for (Stream& stream : streams)
+    {
+      if (stream.blocked.load(std::memory_order_relaxed))
+      {
+        // In paced mode a blocked stream misses its slot instead of drifting
+        if (!opt_unthrottled)
+        {
+          stream.skipped.fetch_add(1, std::memory_order_relaxed);
+          stream.frame_count++;
+        }
+        continue;
+      }
+      if (!push_frame(stream))
+      {
+        running = false;
+        break;
+      }
+      any_pushed = true;
+    }
+
+    if (!opt_unthrottled)
+    {
+      deadline += interval;
+      std::this_thread::sleep_until(deadline);
+    }
+    else if (!any_pushed)
+    {
+      // Every stream is blocked, wait for the next need-data
+      std::unique_lock<std::mutex> lock {wake_mutex};
+      wake_cond.wait_for(lock, std::chrono::milliseconds(10));
+    }
+  }
+}
+
+// Print the achieved push rate and back-pressure events once per second.
+bool on_report()
+{
+  static guint64 last_pushed {0};
+  static guint64 last_backpressure {0};
+
+  guint64 pushed {0}, backpressure {0}, skipped {0};
+  for (const Stream& stream : streams)
+  {
+    pushed += stream.pushed.load(std::memory_order_relaxed);
+    backpressure += stream.backpressure_events.load(std::memory_order_relaxed);
+    skipped += stream.skipped.load(std::memory_order_relaxed);
+  }
+
+  gint64 now {g_get_monotonic_time()};
+  double seconds {(now - report_time) / 1e6};
+  double rate {(pushed - last_pushed) / seconds};
+
+  std::cout << std::fixed << std::setprecision(1) <<
+    "pushed " << rate << " frames/s (" << rate / streams.size() << " per stream, " <<
+    rate * GST_VIDEO_INFO_SIZE(&video_info) / (1024.0 * 1024.0) << " MiB/s), " <<
+    "back-pressure events " << backpressure - last_backpressure << ", " <<
+    "skipped frames " << skipped << std::endl;
+
+  last_pushed = pushed;
+  last_backpressure = backpressure;
+  report_time = now;
+  return true;
+}
+
+// Stop pushing and let the pipeline drain.
+bool on_stop()
+{
+  running = false;
+  wake_cond.notify_all();
+  for (Stream& stream : streams)
+    gst_app_src_end_of_stream(stream.appsrc);
+  return false;
+}
+
+bool on_bus_message(const RefPtr<Gst::Bus>&, const RefPtr<Gst::Message>& message)
+{
+  switch (message->get_message_type())
+  {
+    case Gst::MESSAGE_EOS:
+      std::cout << std::endl << "End of stream" << std::endl;
+      mainloop->quit();
+      return false;
+    case Gst::MESSAGE_ERROR:
+    {
+      RefPtr<Gst::MessageError> msgError {RefPtr<Gst::MessageError>::cast_static(message)};
+      if (msgError)
+      {
+        Glib::Error err {msgError->parse_error()};
+        std::string debug_info {msgError->parse_debug()};
+        std::cerr << "Error received from element " << message->get_source()->get_name() << ": " <<
+            err.what() << std::endl;
+        if (!debug_info.empty())
+          std::cout << "Debugging information: " << debug_info << std::endl;
+      }
+      else
+      {
+        std::cerr << "Error." << std::endl;
+      }
+      mainloop->quit();
+      return false;
+    }
+    default:
+      break;
+  }
+
+  return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("- synthetic frame injector")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  // Initialize gstreamermm:
+  Gst::init(argc, argv);
+
+  if (opt_width <= 0 || opt_height <= 0 || opt_fps <= 0 || opt_streams <= 0 || opt_ring <= 0 || opt_queue <= 0)
+  {
+    std::cerr << "Sizes, rates and counts must be positive." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  GstVideoFormat format {gst_video_format_from_string(opt_format ? opt_format : "I420")};
+  if (format == GST_VIDEO_FORMAT_UNKNOWN)
+  {
+    std::cerr << "Unknown video format " << opt_format << std::endl;
+    return EXIT_FAILURE;
+  }
+  gst_video_info_set_format(&video_info, format, opt_width, opt_height);
+  GST_VIDEO_INFO_FPS_N(&video_info) = opt_fps;
+  GST_VIDEO_INFO_FPS_D(&video_info) = 1;
+  GstCaps* caps {gst_video_info_to_caps(&video_info)};
+
+  if (!prepare_ring(caps))
+  {
+    std::cerr << "Could not allocate the frame ring." << std::endl;
+    gst_caps_unref(caps);
+    return EXIT_FAILURE;
+  }
+
+  // One appsrc and one downstream bin per stream
+  pipeline = Gst::Pipeline::create("injector-pipeline");
+  streams = std::vector<Stream>(opt_streams);
+  const gchar* downstream {opt_downstream ? opt_downstream : "fakesink sync=false"};
+
+  for (gint i = 0; i < opt_streams; i++)
+  {
+    GstElement* appsrc {gst_element_factory_make("appsrc", nullptr)};
+    GstElement* bin {gst_parse_bin_from_description(downstream, TRUE, &error)};
+    if (!appsrc || !bin)
+    {
+      std::cerr << "Could not create stream " << i << ": " << (error ? error->message : "no appsrc") << std::endl;
+      g_clear_error(&error);
+      gst_caps_unref(caps);
+      return EXIT_FAILURE;
+    }
+
+    g_object_set(appsrc,
+        "caps", caps,
+        "format", GST_FORMAT_TIME,
+        "is-live", !opt_unthrottled,
+        "max-bytes", static_cast<guint64>(opt_queue) * GST_VIDEO_INFO_SIZE(&video_info),
+        nullptr);
+
+    GstAppSrcCallbacks callbacks {};
+    callbacks.need_data = on_need_data;
+    callbacks.enough_data = on_enough_data;
+    gst_app_src_set_callbacks(GST_APP_SRC(appsrc), &callbacks, &streams[i], nullptr);
+    streams[i].appsrc = GST_APP_SRC(appsrc);
+
+    gst_bin_add_many(GST_BIN(pipeline->gobj()), appsrc, bin, nullptr);
+    if (!gst_element_link(appsrc, bin))
+    {
+      std::cerr << "Could not link stream " << i << " to its downstream bin." << std::endl;
+      gst_caps_unref(caps);
+      return EXIT_FAILURE;
+    }
+  }
+  gst_caps_unref(caps);
+
+  // Create the main loop.
+  mainloop = Glib::MainLoop::create();
+
+  // Get the bus and watch the messages
+  RefPtr<Gst::Bus> bus {pipeline->get_bus()};
+  bus->add_watch(sigc::ptr_fun(&on_bus_message));
+
+  if (pipeline->set_state(Gst::STATE_PLAYING) == Gst::STATE_CHANGE_FAILURE)
+  {
+    std::cerr << "Unable to set the pipeline to the playing state." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Injecting " << opt_streams << " stream(s) of " << opt_width << "x" << opt_height <<
+    (opt_unthrottled ? " unthrottled" : " at " + std::to_string(opt_fps) + " fps") << std::endl;
+
+  running = true;
+  report_time = g_get_monotonic_time();
+  std::thread pusher_thread {pusher};
+
+  Glib::signal_timeout().connect(sigc::ptr_fun(&on_report), 1000);
+  if (opt_duration > 0)
+    Glib::signal_timeout().connect_seconds(sigc::ptr_fun(&on_stop), opt_duration);
+
+  std::cout << "Running." << std::endl;
+  mainloop->run();
+
+  // Clean up nicely:
+  running = false;
+  wake_cond.notify_all();
+  pusher_thread.join();
+
+  guint64 pushed {0}, backpressure {0};
+  for (const Stream& stream : streams)
+  {
+    pushed += stream.pushed;
+    backpressure += stream.backpressure_events;
+  }
+  std::cout << "Total pushed " << pushed << " frames, " << backpressure << " back-pressure events." << std::endl;
+
+  std::cout << "Returned. Stopping pipeline." << std::endl;
+  pipeline->set_state(Gst::STATE_NULL);
+
+  for (GstBuffer* buffer : ring)
+    gst_buffer_unref(buffer);
+  gst_buffer_pool_set_active(pool, FALSE);
+  gst_object_unref(pool);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,281 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 2: Frame statistics for output QC
+ *
+ * Drops the framestats element into the videotestsrc -> sink chain of the tutorial, or into
+ * playbin's video-filter with --uri, writing the per-frame records to --output and printing the
+ * scene changes posted on the bus. --dump prints a record file written earlier, and --bench
+ * measures the cost per 4K frame of the scalar and the AVX2 kernel, net of an identity stage.
+ */
+
+#include <gstreamermm.h>
+#include <glibmm/main.h>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <sys/resource.h>
+#include "gstframestats.h"
+
+using Glib::RefPtr;
+
+namespace
+{
+
+// Command line options
+gchar* opt_uri {nullptr};
+gchar* opt_output {nullptr};
+gchar* opt_dump {nullptr};
+gint opt_stride {1};
+gdouble opt_threshold {0.5};
+gboolean opt_histogram {FALSE};
+gboolean opt_no_simd {FALSE};
+gboolean opt_bench {FALSE};
+gint opt_frames {600};
+
+GOptionEntry entries[] =
+{
+  { "uri", 'u', 0, G_OPTION_ARG_STRING, &opt_uri, "Analyze the video of this uri with playbin", "URI" },
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &opt_output, "Write the binary records to FILE", "FILE" },
+  { "stride", 's', 0, G_OPTION_ARG_INT, &opt_stride, "Analyze every Nth frame (default 1)", "N" },
+  { "threshold", 't', 0, G_OPTION_ARG_DOUBLE, &opt_threshold, "Scene-change threshold (default 0.5)", "SCORE" },
+  { "histogram", 'H', 0, G_OPTION_ARG_NONE, &opt_histogram, "Append the luma histogram to the records", nullptr },
+  { "no-simd", 0, 0, G_OPTION_ARG_NONE, &opt_no_simd, "Use the scalar kernel", nullptr },
+  { "dump", 'd', 0, G_OPTION_ARG_FILENAME, &opt_dump, "Print the records of FILE and exit", "FILE" },
+  { "bench", 'b', 0, G_OPTION_ARG_NONE, &opt_bench, "Measure the cost per 3840x2160 I420 frame", nullptr },
+  { "frames", 'n', 0, G_OPTION_ARG_INT, &opt_frames, "Frames per benchmark run (default 600)", "N" },
+  { nullptr }
+};
+
+RefPtr<Glib::MainLoop> mainloop;
+
+double cpu_time()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+std::string framestats_description()
+{
+  std::ostringstream description;
+  description << "framestats frame-stride=" << opt_stride << " threshold=" << opt_threshold <<
+    " histogram=" << (opt_histogram ? "true" : "false") << " simd=" << (opt_no_simd ? "false" : "true");
+  if (opt_output)
+    description << " location=\"" << opt_output << "\"";
+  return description.str();
+}
+
+bool on_bus_message(const RefPtr<Gst::Bus>&, const RefPtr<Gst::Message>& message)
+{
+  switch (message->get_message_type())
+  {
+    case Gst::MESSAGE_EOS:
+      std::cout << "End of stream" << std::endl;
+      mainloop->quit();
+      return false;
+    case Gst::MESSAGE_ERROR:
+      std::cerr << "Error: " << RefPtr<Gst::MessageError>::cast_static(message)->parse_error().what() << std::endl;
+      mainloop->quit();
+      return false;
+    case Gst::MESSAGE_ELEMENT:
+    {
+      guint64 frame {0}, timestamp {0};
+      gdouble score {0.0};
+      const GstStructure* structure {gst_message_get_structure(message->gobj())};
+      if (gst_structure_has_name(structure, "framestats") &&
+          gst_structure_get_uint64(structure, "frame", &frame) &&
+          gst_structure_get_uint64(structure, "timestamp", &timestamp) &&
+          gst_structure_get_double(structure, "score", &score))
+      {
+        std::cout << "Scene change at frame " << frame << ", " << timestamp / GST_MSECOND << " ms, score " <<
+          std::fixed << std::setprecision(3) << score << std::endl;
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  return true;
+}
+
+int dump(const char* path)
+{
+  FILE* file {fopen(path, "rb")};
+  if (!file)
+  {
+    std::cerr << "Could not open " << path << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << std::setw(8) << "frame" << std::setw(14) << "pts ms" << std::setw(10) << "mean" <<
+    std::setw(10) << "variance" << std::setw(8) << "mad" << std::setw(8) << "hist" << std::setw(8) << "score" << std::endl;
+
+  GstFrameStatsRecord record;
+  std::vector<guint32> histogram(256);
+  int status {EXIT_SUCCESS};
+  while (fread(&record, sizeof(record), 1, file) == 1)
+  {
+    if (record.magic != GST_FRAME_STATS_MAGIC)
+    {
+      std::cerr << "Not a framestats record file, or written on a different byte order" << std::endl;
+      status = EXIT_FAILURE;
+      break;
+    }
+    if ((record.flags & GST_FRAME_STATS_FLAG_HISTOGRAM) &&
+        fread(histogram.data(), sizeof(guint32), histogram.size(), file) != histogram.size())
+      break;
+
+    std::cout << std::setw(8) << record.frame << std::setw(14) << record.pts / GST_MSECOND <<
+      std::fixed << std::setprecision(1) << std::setw(10) << record.mean << std::setw(10) << record.variance;
+    if (record.flags & GST_FRAME_STATS_FLAG_COMPARED)
+      std::cout << std::setw(8) << record.mad << std::setprecision(3) << std::setw(8) << record.histogram_diff <<
+        std::setw(8) << record.score;
+    if (record.flags & GST_FRAME_STATS_FLAG_SCENE_CHANGE)
+      std::cout << "  scene change";
+    std::cout << std::endl;
+  }
+
+  fclose(file);
+  return status;
+}
+
+// Run one stage on 4K frames and return the CPU seconds it took, or a negative value
+double bench_run(const std::string& stage)
+{
+  std::ostringstream description;
+  description << "videotestsrc num-buffers=" << opt_frames << " pattern=ball ! "
+    "video/x-raw,format=I420,width=3840,height=2160,framerate=60/1 ! " << stage << " ! fakesink sync=false";
+
+  RefPtr<Gst::Element> pipeline;
+  try
+  {
+    pipeline = Gst::Parse::launch(description.str());
+  }
+  catch (const Glib::Error& ex)
+  {
+    std::cerr << "Could not create the pipeline: " << ex.what() << std::endl;
+    return -1.0;
+  }
+
+  // Pre-roll first, so negotiation and the first frame are not counted
+  Gst::State state, pending;
+  pipeline->set_state(Gst::STATE_PAUSED);
+  pipeline->get_state(state, pending, Gst::CLOCK_TIME_NONE);
+
+  RefPtr<Gst::Bus> bus {pipeline->get_bus()};
+  double start {cpu_time()};
+  pipeline->set_state(Gst::STATE_PLAYING);
+  RefPtr<Gst::Message> message {bus->pop(Gst::CLOCK_TIME_NONE, Gst::MESSAGE_EOS | Gst::MESSAGE_ERROR)};
+  double seconds {cpu_time() - start};
+  pipeline->set_state(Gst::STATE_NULL);
+
+  if (message->get_message_type() == Gst::MESSAGE_ERROR)
+  {
+    std::cerr << "Error: " << RefPtr<Gst::MessageError>::cast_static(message)->parse_error().what() << std::endl;
+    return -1.0;
+  }
+  return seconds;
+}
+
+int bench()
+{
+  const std::vector<std::pair<const char*, std::string>> stages {
+    {"identity", "identity"},
+    {"framestats scalar", "framestats simd=false"},
+    {"framestats AVX2", "framestats simd=true"},
+    {"framestats AVX2 hist", "framestats simd=true histogram=true location=/dev/null"}
+  };
+
+  std::cout << opt_frames << " frames of 3840x2160 I420" << std::endl;
+  std::cout << std::setw(22) << "stage" << std::setw(10) << "CPU s" << std::setw(14) << "net ms/frame" <<
+    std::setw(12) << "max fps" << std::endl;
+
+  double baseline {0.0};
+  for (const auto& stage : stages)
+  {
+    double seconds {bench_run(stage.second)};
+    if (seconds < 0.0)
+      return EXIT_FAILURE;
+    if (stage.second == "identity")
+      baseline = seconds;
+
+    // 4K60 on one core leaves 16.7 ms per frame for the whole stage
+    double net {std::max(seconds - baseline, 0.0) / opt_frames};
+    std::cout << std::setw(22) << stage.first << std::fixed << std::setprecision(3) << std::setw(10) << seconds <<
+      std::setw(14) << 1000.0 * net;
+    if (net > 0.0)
+      std::cout << std::setprecision(0) << std::setw(12) << 1.0 / net << (net < 1.0 / 60 ? "  keeps up with 60 fps" : "");
+    std::cout << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("- frame statistics and scene-change detection")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  if (opt_dump)
+    return dump(opt_dump);
+
+  // Initialize gstreamermm and register our element
+  Gst::init(argc, argv);
+  gst_frame_stats_register();
+
+  if (opt_bench)
+    return bench();
+
+  RefPtr<Gst::Element> pipeline;
+  try
+  {
+    if (opt_uri)
+    {
+      // playbin's video-filter sees whatever the decoder outputs, so convert to a format we take
+      pipeline = Gst::ElementFactory::create_element("playbin");
+      RefPtr<Gst::Bin> filter {Gst::Parse::create_bin("videoconvert ! " + framestats_description(), true)};
+      pipeline->set_property("uri", Glib::ustring(opt_uri));
+      pipeline->set_property("video-filter", RefPtr<Gst::Element>::cast_static(filter));
+    }
+    else
+    {
+      pipeline = Gst::Parse::launch("videotestsrc num-buffers=600 pattern=ball ! " + framestats_description() +
+          " ! videoconvert ! autovideosink");
+    }
+  }
+  catch (const Glib::Error& ex)
+  {
+    std::cerr << "Could not create the pipeline: " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  mainloop = Glib::MainLoop::create();
+  pipeline->get_bus()->add_watch(sigc::ptr_fun(&on_bus_message));
+
+  if (pipeline->set_state(Gst::STATE_PLAYING) == Gst::STATE_CHANGE_FAILURE)
+  {
+    std::cerr << "Unable to set the pipeline to the playing state." << std::endl;
+    return EXIT_FAILURE;
+  }
+  mainloop->run();
+  pipeline->set_state(Gst::STATE_NULL);
+
+  return EXIT_SUCCESS;
+}
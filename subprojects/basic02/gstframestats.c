@@ -0,0 +1,442 @@
+/* GStreamer
+ *
+ * Supplement to Basic Tutorial 2: video frame statistics and scene-change detection
+ *
+ * The luma plane is read once per analyzed frame. Each row is compared with the same row of
+ * the previous frame 32 pixels at a time with _mm256_sad_epu8 and copied over it in the same
+ * pass, then counted into the histogram while it is still in the L1 cache. The histogram uses
+ * four sub-tables for interleaved pixels, so runs of equal values do not serialize on a single
+ * counter; mean and variance are derived from the merged histogram.
+ *
+ * The scene-change score averages the saturated mean absolute difference (motion and cuts)
+ * with the histogram difference (cuts and flashes), so steady motion alone stays below the
+ * threshold. Records are written through a stdio buffer, one fwrite per frame.
+ */
+
+#include "gstframestats.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <gst/video/video.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FRAME_STATS_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+GST_DEBUG_CATEGORY_STATIC (gst_frame_stats_debug);
+#define GST_CAT_DEFAULT gst_frame_stats_debug
+
+#define DEFAULT_LOCATION NULL
+#define DEFAULT_FRAME_STRIDE 1
+#define DEFAULT_THRESHOLD 0.5
+#define DEFAULT_HISTOGRAM FALSE
+#define DEFAULT_SIMD TRUE
+
+/* Mean absolute difference that counts as a full change */
+#define MAD_SATURATION 48.0
+
+#define VIDEO_CAPS GST_VIDEO_CAPS_MAKE ("{ I420, YV12, NV12, NV21 }")
+
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_FRAME_STRIDE,
+  PROP_THRESHOLD,
+  PROP_HISTOGRAM,
+  PROP_SIMD
+};
+
+typedef guint64 (*GstFrameStatsRowFunc) (const guint8 * current, guint8 * previous,
+    guint width);
+
+struct _GstFrameStats
+{
+  GstVideoFilter parent;
+
+  /* properties */
+  gchar *location;
+  guint frame_stride;
+  gdouble threshold;
+  gboolean histogram;
+  gboolean simd;
+
+  /* streaming state */
+  FILE *file;
+  GstFrameStatsRowFunc row_func;
+  guint8 *previous;
+  gboolean have_previous;
+  guint32 previous_histogram[256];
+  guint64 frame;
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (VIDEO_CAPS));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (VIDEO_CAPS));
+
+#define gst_frame_stats_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE (GstFrameStats, gst_frame_stats, GST_TYPE_VIDEO_FILTER,
+    GST_DEBUG_CATEGORY_INIT (gst_frame_stats_debug, "framestats", 0,
+        "video frame statistics"));
+
+static void gst_frame_stats_finalize (GObject * object);
+static void gst_frame_stats_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_frame_stats_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static gboolean gst_frame_stats_start (GstBaseTransform * trans);
+static gboolean gst_frame_stats_stop (GstBaseTransform * trans);
+static gboolean gst_frame_stats_set_info (GstVideoFilter * filter,
+    GstCaps * incaps, GstVideoInfo * in_info, GstCaps * outcaps,
+    GstVideoInfo * out_info);
+static GstFlowReturn gst_frame_stats_transform_frame_ip (GstVideoFilter *
+    filter, GstVideoFrame * frame);
+
+static void
+gst_frame_stats_class_init (GstFrameStatsClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseTransformClass *trans_class = GST_BASE_TRANSFORM_CLASS (klass);
+  GstVideoFilterClass *filter_class = GST_VIDEO_FILTER_CLASS (klass);
+
+  gobject_class->finalize = gst_frame_stats_finalize;
+  gobject_class->set_property = gst_frame_stats_set_property;
+  gobject_class->get_property = gst_frame_stats_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+      g_param_spec_string ("location", "File Location",
+          "File to write the binary records to, truncated on start "
+          "(NULL = no records)",
+          DEFAULT_LOCATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_FRAME_STRIDE,
+      g_param_spec_uint ("frame-stride", "Frame Stride",
+          "Analyze every Nth frame", 1, G_MAXUINT, DEFAULT_FRAME_STRIDE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_THRESHOLD,
+      g_param_spec_double ("threshold", "Threshold",
+          "Scene-change score above which a scene change is reported", 0.0,
+          1.0, DEFAULT_THRESHOLD, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_HISTOGRAM,
+      g_param_spec_boolean ("histogram", "Histogram",
+          "Append the 256 bin luma histogram to every record",
+          DEFAULT_HISTOGRAM,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_SIMD,
+      g_param_spec_boolean ("simd", "SIMD",
+          "Use the AVX2 kernel when the CPU supports it", DEFAULT_SIMD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  gst_element_class_add_static_pad_template (element_class, &sink_template);
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+  gst_element_class_set_static_metadata (element_class, "Frame Statistics",
+      "Filter/Analyzer/Video",
+      "Luma histogram, mean, variance and scene-change score per frame",
+      "gst-tutorial");
+
+  trans_class->start = GST_DEBUG_FUNCPTR (gst_frame_stats_start);
+  trans_class->stop = GST_DEBUG_FUNCPTR (gst_frame_stats_stop);
+  trans_class->passthrough_on_same_caps = TRUE;
+  trans_class->transform_ip_on_passthrough = TRUE;
+  filter_class->set_info = GST_DEBUG_FUNCPTR (gst_frame_stats_set_info);
+  filter_class->transform_frame_ip =
+      GST_DEBUG_FUNCPTR (gst_frame_stats_transform_frame_ip);
+}
+
+static void
+gst_frame_stats_init (GstFrameStats * self)
+{
+  self->location = g_strdup (DEFAULT_LOCATION);
+  self->frame_stride = DEFAULT_FRAME_STRIDE;
+  self->threshold = DEFAULT_THRESHOLD;
+  self->histogram = DEFAULT_HISTOGRAM;
+  self->simd = DEFAULT_SIMD;
+}
+
+static void
+gst_frame_stats_finalize (GObject * object)
+{
+  GstFrameStats *self = GST_FRAME_STATS (object);
+
+  g_free (self->location);
+  g_free (self->previous);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_frame_stats_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstFrameStats *self = GST_FRAME_STATS (object);
+
+  GST_OBJECT_LOCK (self);
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_free (self->location);
+      self->location = g_value_dup_string (value);
+      break;
+    case PROP_FRAME_STRIDE:
+      self->frame_stride = g_value_get_uint (value);
+      break;
+    case PROP_THRESHOLD:
+      self->threshold = g_value_get_double (value);
+      break;
+    case PROP_HISTOGRAM:
+      self->histogram = g_value_get_boolean (value);
+      break;
+    case PROP_SIMD:
+      self->simd = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+gst_frame_stats_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstFrameStats *self = GST_FRAME_STATS (object);
+
+  GST_OBJECT_LOCK (self);
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_value_set_string (value, self->location);
+      break;
+    case PROP_FRAME_STRIDE:
+      g_value_set_uint (value, self->frame_stride);
+      break;
+    case PROP_THRESHOLD:
+      g_value_set_double (value, self->threshold);
+      break;
+    case PROP_HISTOGRAM:
+      g_value_set_boolean (value, self->histogram);
+      break;
+    case PROP_SIMD:
+      g_value_set_boolean (value, self->simd);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (self);
+}
+
+/* Sum of absolute differences of one row, replacing the previous row with the current one */
+static guint64
+gst_frame_stats_row_scalar (const guint8 * current, guint8 * previous,
+    guint width)
+{
+  guint64 sad = 0;
+  guint x;
+
+  for (x = 0; x < width; x++) {
+    sad += ABS ((gint) current[x] - (gint) previous[x]);
+    previous[x] = current[x];
+  }
+  return sad;
+}
+
+#ifdef FRAME_STATS_HAVE_AVX2
+__attribute__ ((target ("avx2")))
+static guint64
+gst_frame_stats_row_avx2 (const guint8 * current, guint8 * previous,
+    guint width)
+{
+  __m256i sum = _mm256_setzero_si256 ();
+  guint64 lanes[4];
+  guint x;
+
+  for (x = 0; x + 32 <= width; x += 32) {
+    __m256i c = _mm256_loadu_si256 ((const __m256i *) (current + x));
+    __m256i p = _mm256_loadu_si256 ((const __m256i *) (previous + x));
+
+    /* four 64 bit partial sums, one per group of eight bytes */
+    sum = _mm256_add_epi64 (sum, _mm256_sad_epu8 (c, p));
+    _mm256_storeu_si256 ((__m256i *) (previous + x), c);
+  }
+  _mm256_storeu_si256 ((__m256i *) lanes, sum);
+
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+      gst_frame_stats_row_scalar (current + x, previous + x, width - x);
+}
+#endif
+
+static void
+gst_frame_stats_histogram_row (const guint8 * row, guint width,
+    guint32 tables[4][256])
+{
+  guint x;
+
+  for (x = 0; x + 4 <= width; x += 4) {
+    tables[0][row[x]]++;
+    tables[1][row[x + 1]]++;
+    tables[2][row[x + 2]]++;
+    tables[3][row[x + 3]]++;
+  }
+  for (; x < width; x++)
+    tables[0][row[x]]++;
+}
+
+static gboolean
+gst_frame_stats_start (GstBaseTransform * trans)
+{
+  GstFrameStats *self = GST_FRAME_STATS (trans);
+
+  self->frame = 0;
+  self->have_previous = FALSE;
+
+  if (self->location == NULL)
+    return TRUE;
+
+  self->file = fopen (self->location, "wb");
+  if (self->file == NULL) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_WRITE,
+        ("Could not open file \"%s\" for writing.", self->location),
+        GST_ERROR_SYSTEM);
+    return FALSE;
+  }
+  setvbuf (self->file, NULL, _IOFBF, 256 * 1024);
+  return TRUE;
+}
+
+static gboolean
+gst_frame_stats_stop (GstBaseTransform * trans)
+{
+  GstFrameStats *self = GST_FRAME_STATS (trans);
+
+  if (self->file) {
+    fclose (self->file);
+    self->file = NULL;
+  }
+  return TRUE;
+}
+
+static gboolean
+gst_frame_stats_set_info (GstVideoFilter * filter, GstCaps * incaps,
+    GstVideoInfo * in_info, GstCaps * outcaps, GstVideoInfo * out_info)
+{
+  GstFrameStats *self = GST_FRAME_STATS (filter);
+
+  /* The previous luma plane, without the stride padding */
+  g_free (self->previous);
+  self->previous = g_malloc (GST_VIDEO_INFO_WIDTH (in_info) *
+      GST_VIDEO_INFO_HEIGHT (in_info));
+  self->have_previous = FALSE;
+
+  self->row_func = gst_frame_stats_row_scalar;
+#ifdef FRAME_STATS_HAVE_AVX2
+  if (self->simd && __builtin_cpu_supports ("avx2"))
+    self->row_func = gst_frame_stats_row_avx2;
+#endif
+
+  GST_DEBUG_OBJECT (self, "%dx%d, %s kernel", GST_VIDEO_INFO_WIDTH (in_info),
+      GST_VIDEO_INFO_HEIGHT (in_info),
+      self->row_func == gst_frame_stats_row_scalar ? "scalar" : "AVX2");
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_frame_stats_transform_frame_ip (GstVideoFilter * filter,
+    GstVideoFrame * frame)
+{
+  GstFrameStats *self = GST_FRAME_STATS (filter);
+  guint width = GST_VIDEO_FRAME_WIDTH (frame);
+  guint height = GST_VIDEO_FRAME_HEIGHT (frame);
+  const guint8 *luma = GST_VIDEO_FRAME_PLANE_DATA (frame, 0);
+  gint stride = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0);
+  guint32 tables[4][256];
+  guint32 histogram[256];
+  GstFrameStatsRecord record;
+  guint64 sad = 0, number, pixels = (guint64) width * height;
+  gdouble sum = 0.0, square_sum = 0.0, diff = 0.0, threshold;
+  gboolean write_histogram;
+  guint frame_stride, y, i;
+
+  GST_OBJECT_LOCK (self);
+  frame_stride = self->frame_stride;
+  threshold = self->threshold;
+  write_histogram = self->histogram;
+  GST_OBJECT_UNLOCK (self);
+
+  number = self->frame++;
+  if (number % frame_stride != 0)
+    return GST_FLOW_OK;
+
+  memset (tables, 0, sizeof (tables));
+  for (y = 0; y < height; y++) {
+    const guint8 *row = luma + (gsize) y * stride;
+
+    sad += self->row_func (row, self->previous + (gsize) y * width, width);
+    gst_frame_stats_histogram_row (row, width, tables);
+  }
+
+  for (i = 0; i < 256; i++) {
+    histogram[i] = tables[0][i] + tables[1][i] + tables[2][i] + tables[3][i];
+    sum += (gdouble) i * histogram[i];
+    square_sum += (gdouble) i * i * histogram[i];
+    if (self->have_previous)
+      diff += ABS ((gint64) histogram[i] - (gint64) self->previous_histogram[i]);
+  }
+
+  memset (&record, 0, sizeof (record));
+  record.magic = GST_FRAME_STATS_MAGIC;
+  record.frame = number;
+  record.pts = GST_BUFFER_PTS (frame->buffer);
+  record.width = width;
+  record.height = height;
+  record.mean = sum / pixels;
+  record.variance = square_sum / pixels - record.mean * record.mean;
+
+  if (self->have_previous) {
+    record.flags |= GST_FRAME_STATS_FLAG_COMPARED;
+    record.mad = (gdouble) sad / pixels;
+    record.histogram_diff = diff / (2.0 * pixels);
+    record.score = (MIN (1.0, record.mad / MAD_SATURATION) +
+        record.histogram_diff) / 2.0;
+    if (record.score > threshold) {
+      record.flags |= GST_FRAME_STATS_FLAG_SCENE_CHANGE;
+      gst_element_post_message (GST_ELEMENT (self),
+          gst_message_new_element (GST_OBJECT (self),
+              gst_structure_new ("framestats",
+                  "frame", G_TYPE_UINT64, number,
+                  "timestamp", G_TYPE_UINT64, record.pts,
+                  "score", G_TYPE_DOUBLE, (gdouble) record.score, NULL)));
+    }
+  }
+  memcpy (self->previous_histogram, histogram, sizeof (histogram));
+  self->have_previous = TRUE;
+
+  if (self->file) {
+    if (write_histogram)
+      record.flags |= GST_FRAME_STATS_FLAG_HISTOGRAM;
+    if (fwrite (&record, sizeof (record), 1, self->file) != 1 ||
+        (write_histogram && fwrite (histogram, sizeof (histogram), 1,
+                self->file) != 1)) {
+      GST_ELEMENT_ERROR (self, RESOURCE, WRITE,
+          ("Error while writing to file \"%s\".", self->location),
+          GST_ERROR_SYSTEM);
+      return GST_FLOW_ERROR;
+    }
+  }
+
+  return GST_FLOW_OK;
+}
+
+gboolean
+gst_frame_stats_register (void)
+{
+  return gst_element_register (NULL, "framestats", GST_RANK_NONE,
+      GST_TYPE_FRAME_STATS);
+}
@@ -0,0 +1,52 @@
+/* GStreamer
+ *
+ * Supplement to Basic Tutorial 2: video frame statistics and scene-change detection
+ *
+ * framestats is an in-place passthrough for planar and semi-planar 4:2:0 video. For every
+ * frame-stride'th frame it computes the luma histogram, mean and variance, and a scene-change
+ * score against the previously analyzed frame, and appends one GstFrameStatsRecord (followed
+ * by the 256 bin histogram when histogram=true) to the file given by location. Only detected
+ * scene changes are posted on the bus, as "framestats" element messages.
+ *
+ * The element is registered by the application with gst_frame_stats_register().
+ */
+
+#ifndef __GST_FRAME_STATS_H__
+#define __GST_FRAME_STATS_H__
+
+#include <gst/gst.h>
+#include <gst/video/gstvideofilter.h>
+
+G_BEGIN_DECLS
+
+#define GST_FRAME_STATS_MAGIC 0x53544146    /* "FATS" read little-endian */
+
+#define GST_FRAME_STATS_FLAG_COMPARED       (1 << 0)  /* there was a previous frame */
+#define GST_FRAME_STATS_FLAG_SCENE_CHANGE   (1 << 1)
+#define GST_FRAME_STATS_FLAG_HISTOGRAM      (1 << 2)  /* 256 guint32 bins follow */
+
+/* One record per analyzed frame, in host byte order */
+typedef struct
+{
+  guint32 magic;
+  guint32 flags;
+  guint64 frame;                /* number of the frame since start */
+  guint64 pts;
+  guint32 width;
+  guint32 height;
+  gfloat mean;                  /* luma, 0..255 */
+  gfloat variance;
+  gfloat mad;                   /* mean absolute luma difference to the previous frame */
+  gfloat histogram_diff;        /* 0..1, half the L1 distance of the normalized histograms */
+  gfloat score;                 /* 0..1, scene change when above the threshold */
+  guint32 reserved;
+} GstFrameStatsRecord;
+
+#define GST_TYPE_FRAME_STATS (gst_frame_stats_get_type ())
+G_DECLARE_FINAL_TYPE (GstFrameStats, gst_frame_stats, GST, FRAME_STATS, GstVideoFilter)
+
+gboolean gst_frame_stats_register (void);
+
+G_END_DECLS
+
+#endif /* __GST_FRAME_STATS_H__ */
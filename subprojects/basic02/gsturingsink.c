@@ -0,0 +1,605 @@
+/* GStreamer
+ *
+ * Supplement to Basic Tutorial 2: io_uring batched file sink
+ *
+ * filesink issues one write() per buffer, with small buffers the syscalls saturate long
+ * before the disk does. uringsink copies buffers into a ring of queue-depth chunks of
+ * chunk-size bytes each, and submits every full chunk as a single io_uring write at its file
+ * offset. The streaming thread only blocks when it wraps around to a chunk that is still in
+ * flight.
+ *
+ * Chunks are page aligned and registered with the ring as fixed buffers when the memlock
+ * limit allows it, which also satisfies O_DIRECT. With direct=true the last partial chunk is
+ * padded to the alignment and the file is truncated back to the real size afterwards.
+ *
+ * Writes are sequential, seeking (as used by some muxers to rewrite headers) is not supported.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "gsturingsink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <liburing.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_uring_sink_debug);
+#define GST_CAT_DEFAULT gst_uring_sink_debug
+
+/* O_DIRECT needs buffers, lengths and offsets aligned to the logical block size, a page
+ * covers every common device */
+#define URING_SINK_ALIGN 4096
+
+#define DEFAULT_LOCATION NULL
+#define DEFAULT_CHUNK_SIZE (4 * 1024 * 1024)
+#define DEFAULT_QUEUE_DEPTH 8
+#define DEFAULT_DIRECT FALSE
+
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_CHUNK_SIZE,
+  PROP_QUEUE_DEPTH,
+  PROP_DIRECT,
+  PROP_STATS
+};
+
+typedef struct
+{
+  guint8 *data;
+  gsize filled;                 /* bytes copied in from buffers */
+  gsize length;                 /* bytes submitted, filled plus O_DIRECT padding */
+  gsize done;                   /* bytes the kernel reported as written */
+  guint64 offset;               /* file offset of the first byte */
+  gint64 submit_time;
+  gboolean busy;
+} GstUringChunk;
+
+struct _GstUringSink
+{
+  GstBaseSink parent;
+
+  /* properties */
+  gchar *location;
+  guint chunk_size;
+  guint queue_depth;
+  gboolean direct;
+
+  /* streaming state */
+  gint fd;
+  struct io_uring ring;
+  gboolean ring_ready;
+  gboolean fixed_buffers;
+  GstUringChunk *chunks;
+  guint n_chunks;
+  guint current;
+  guint64 write_offset;
+
+  /* statistics, protected by the object lock */
+  gint64 start_time;
+  gint64 end_time;
+  guint64 bytes_written;
+  guint64 writes;
+  guint inflight;
+  guint max_inflight;
+  guint64 latency_total;
+  guint64 latency_max;
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+#define gst_uring_sink_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE (GstUringSink, gst_uring_sink, GST_TYPE_BASE_SINK,
+    GST_DEBUG_CATEGORY_INIT (gst_uring_sink_debug, "uringsink", 0,
+        "io_uring file sink"));
+
+static void gst_uring_sink_finalize (GObject * object);
+static void gst_uring_sink_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_uring_sink_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static gboolean gst_uring_sink_start (GstBaseSink * sink);
+static gboolean gst_uring_sink_stop (GstBaseSink * sink);
+static gboolean gst_uring_sink_event (GstBaseSink * sink, GstEvent * event);
+static GstFlowReturn gst_uring_sink_render (GstBaseSink * sink,
+    GstBuffer * buffer);
+
+static void
+gst_uring_sink_class_init (GstUringSinkClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS (klass);
+
+  gobject_class->finalize = gst_uring_sink_finalize;
+  gobject_class->set_property = gst_uring_sink_set_property;
+  gobject_class->get_property = gst_uring_sink_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+      g_param_spec_string ("location", "File Location",
+          "Location of the file to write", DEFAULT_LOCATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_CHUNK_SIZE,
+      g_param_spec_uint ("chunk-size", "Chunk Size",
+          "Bytes per write, rounded up to 4 KiB", URING_SINK_ALIGN, G_MAXINT,
+          DEFAULT_CHUNK_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_QUEUE_DEPTH,
+      g_param_spec_uint ("queue-depth", "Queue Depth",
+          "Maximum number of chunks in flight", 1, 4096, DEFAULT_QUEUE_DEPTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_DIRECT,
+      g_param_spec_boolean ("direct", "Direct I/O",
+          "Open the file with O_DIRECT and bypass the page cache",
+          DEFAULT_DIRECT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "bytes-written, bytes-per-second, queue-depth, max-queue-depth, writes, "
+          "average-write-latency and max-write-latency (microseconds)",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &sink_template);
+  gst_element_class_set_static_metadata (element_class, "io_uring File Sink",
+      "Sink/File", "Write a stream to a file in large chunks through io_uring",
+      "gst-tutorial");
+
+  basesink_class->start = GST_DEBUG_FUNCPTR (gst_uring_sink_start);
+  basesink_class->stop = GST_DEBUG_FUNCPTR (gst_uring_sink_stop);
+  basesink_class->event = GST_DEBUG_FUNCPTR (gst_uring_sink_event);
+  basesink_class->render = GST_DEBUG_FUNCPTR (gst_uring_sink_render);
+}
+
+static void
+gst_uring_sink_init (GstUringSink * self)
+{
+  self->location = g_strdup (DEFAULT_LOCATION);
+  self->chunk_size = DEFAULT_CHUNK_SIZE;
+  self->queue_depth = DEFAULT_QUEUE_DEPTH;
+  self->direct = DEFAULT_DIRECT;
+  self->fd = -1;
+
+  /* Like filesink, write as fast as data arrives */
+  gst_base_sink_set_sync (GST_BASE_SINK (self), FALSE);
+}
+
+static void
+gst_uring_sink_finalize (GObject * object)
+{
+  GstUringSink *self = GST_URING_SINK (object);
+
+  g_free (self->location);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static GstStructure *
+gst_uring_sink_get_stats (GstUringSink * self)
+{
+  GstStructure *stats;
+  gint64 end;
+  gdouble seconds;
+
+  GST_OBJECT_LOCK (self);
+  end = self->end_time ? self->end_time : g_get_monotonic_time ();
+  seconds = self->start_time ? (end - self->start_time) / 1e6 : 0.0;
+  stats = gst_structure_new ("uringsink-stats",
+      "bytes-written", G_TYPE_UINT64, self->bytes_written,
+      "bytes-per-second", G_TYPE_DOUBLE,
+      seconds > 0.0 ? self->bytes_written / seconds : 0.0,
+      "queue-depth", G_TYPE_UINT, self->inflight,
+      "max-queue-depth", G_TYPE_UINT, self->max_inflight,
+      "writes", G_TYPE_UINT64, self->writes,
+      "average-write-latency", G_TYPE_UINT64,
+      self->writes ? self->latency_total / self->writes : 0,
+      "max-write-latency", G_TYPE_UINT64, self->latency_max, NULL);
+  GST_OBJECT_UNLOCK (self);
+
+  return stats;
+}
+
+static void
+gst_uring_sink_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstUringSink *self = GST_URING_SINK (object);
+
+  GST_OBJECT_LOCK (self);
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_free (self->location);
+      self->location = g_value_dup_string (value);
+      break;
+    case PROP_CHUNK_SIZE:
+      self->chunk_size = GST_ROUND_UP_N (g_value_get_uint (value),
+          URING_SINK_ALIGN);
+      break;
+    case PROP_QUEUE_DEPTH:
+      self->queue_depth = g_value_get_uint (value);
+      break;
+    case PROP_DIRECT:
+      self->direct = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+gst_uring_sink_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstUringSink *self = GST_URING_SINK (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      GST_OBJECT_LOCK (self);
+      g_value_set_string (value, self->location);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_CHUNK_SIZE:
+      g_value_set_uint (value, self->chunk_size);
+      break;
+    case PROP_QUEUE_DEPTH:
+      g_value_set_uint (value, self->queue_depth);
+      break;
+    case PROP_DIRECT:
+      g_value_set_boolean (value, self->direct);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, gst_uring_sink_get_stats (self));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static gboolean
+gst_uring_sink_start (GstBaseSink * sink)
+{
+  GstUringSink *self = GST_URING_SINK (sink);
+  struct iovec *iovecs;
+  gint flags, ret;
+  guint i;
+
+  if (self->location == NULL || self->location[0] == '\0') {
+    GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND,
+        ("No file name specified for writing."), (NULL));
+    return FALSE;
+  }
+
+  flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  if (self->direct)
+    flags |= O_DIRECT;
+  self->fd = open (self->location, flags, 0644);
+  if (self->fd < 0) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_WRITE,
+        ("Could not open file \"%s\" for writing.", self->location),
+        GST_ERROR_SYSTEM);
+    return FALSE;
+  }
+
+  ret = io_uring_queue_init (self->queue_depth, &self->ring, 0);
+  if (ret < 0) {
+    GST_ELEMENT_ERROR (self, RESOURCE, FAILED,
+        ("Could not set up io_uring."),
+        ("io_uring_queue_init: %s", g_strerror (-ret)));
+    close (self->fd);
+    self->fd = -1;
+    return FALSE;
+  }
+  self->ring_ready = TRUE;
+
+  self->n_chunks = self->queue_depth;
+  self->chunks = g_new0 (GstUringChunk, self->n_chunks);
+  iovecs = g_new0 (struct iovec, self->n_chunks);
+  for (i = 0; i < self->n_chunks; i++) {
+    void *data = NULL;
+    if (posix_memalign (&data, URING_SINK_ALIGN, self->chunk_size) != 0) {
+      GST_ELEMENT_ERROR (self, RESOURCE, FAILED,
+          ("Could not allocate %u bytes of write buffers.",
+              self->chunk_size * self->n_chunks), (NULL));
+      g_free (iovecs);
+      gst_uring_sink_stop (sink);
+      return FALSE;
+    }
+    self->chunks[i].data = data;
+    iovecs[i].iov_base = data;
+    iovecs[i].iov_len = self->chunk_size;
+  }
+
+  /* Fixed buffers spare the kernel from mapping the pages on every write, they count
+   * against RLIMIT_MEMLOCK so plain writes remain the fallback */
+  ret = io_uring_register_buffers (&self->ring, iovecs, self->n_chunks);
+  self->fixed_buffers = (ret == 0);
+  if (!self->fixed_buffers)
+    GST_INFO_OBJECT (self, "not using fixed buffers: %s", g_strerror (-ret));
+  g_free (iovecs);
+
+  self->current = 0;
+  self->write_offset = 0;
+
+  GST_OBJECT_LOCK (self);
+  self->start_time = 0;
+  self->end_time = 0;
+  self->bytes_written = 0;
+  self->writes = 0;
+  self->inflight = 0;
+  self->max_inflight = 0;
+  self->latency_total = 0;
+  self->latency_max = 0;
+  GST_OBJECT_UNLOCK (self);
+
+  GST_DEBUG_OBJECT (self, "writing %s with %u chunks of %u bytes%s",
+      self->location, self->n_chunks, self->chunk_size,
+      self->direct ? ", O_DIRECT" : "");
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_uring_sink_queue_write (GstUringSink * self, GstUringChunk * chunk)
+{
+  struct io_uring_sqe *sqe;
+  gint ret;
+
+  /* One submission per busy chunk at most, the ring has an entry for each chunk */
+  sqe = io_uring_get_sqe (&self->ring);
+  if (sqe == NULL) {
+    GST_ELEMENT_ERROR (self, RESOURCE, WRITE, (NULL),
+        ("io_uring submission queue is full"));
+    return GST_FLOW_ERROR;
+  }
+
+  if (self->fixed_buffers)
+    io_uring_prep_write_fixed (sqe, self->fd, chunk->data + chunk->done,
+        chunk->length - chunk->done, chunk->offset + chunk->done,
+        (gint) (chunk - self->chunks));
+  else
+    io_uring_prep_write (sqe, self->fd, chunk->data + chunk->done,
+        chunk->length - chunk->done, chunk->offset + chunk->done);
+  io_uring_sqe_set_data (sqe, chunk);
+
+  ret = io_uring_submit (&self->ring);
+  if (ret < 0) {
+    GST_ELEMENT_ERROR (self, RESOURCE, WRITE, (NULL),
+        ("io_uring_submit: %s", g_strerror (-ret)));
+    return GST_FLOW_ERROR;
+  }
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_uring_sink_submit (GstUringSink * self, GstUringChunk * chunk)
+{
+  chunk->length = chunk->filled;
+  if (self->direct && chunk->length % URING_SINK_ALIGN) {
+    /* Only the last chunk can be partial, pad it and truncate the file in the end */
+    chunk->length = GST_ROUND_UP_N (chunk->filled, URING_SINK_ALIGN);
+    memset (chunk->data + chunk->filled, 0, chunk->length - chunk->filled);
+  }
+  chunk->done = 0;
+  chunk->offset = self->write_offset;
+  chunk->submit_time = g_get_monotonic_time ();
+  chunk->busy = TRUE;
+  self->write_offset += chunk->filled;
+
+  GST_OBJECT_LOCK (self);
+  self->inflight++;
+  self->max_inflight = MAX (self->max_inflight, self->inflight);
+  GST_OBJECT_UNLOCK (self);
+
+  return gst_uring_sink_queue_write (self, chunk);
+}
+
+static GstFlowReturn
+gst_uring_sink_complete (GstUringSink * self, struct io_uring_cqe *cqe)
+{
+  GstUringChunk *chunk = io_uring_cqe_get_data (cqe);
+  gint res = cqe->res;
+  guint64 latency;
+
+  io_uring_cqe_seen (&self->ring, cqe);
+
+  if (res < 0 || (res == 0 && chunk->length > chunk->done)) {
+    GST_ELEMENT_ERROR (self, RESOURCE, WRITE,
+        ("Error while writing to file \"%s\".", self->location),
+        ("%s", g_strerror (res < 0 ? -res : ENOSPC)));
+    return GST_FLOW_ERROR;
+  }
+
+  /* Short write, queue the remainder */
+  chunk->done += res;
+  if (chunk->done < chunk->length)
+    return gst_uring_sink_queue_write (self, chunk);
+
+  latency = g_get_monotonic_time () - chunk->submit_time;
+  GST_OBJECT_LOCK (self);
+  self->bytes_written += chunk->filled;
+  self->writes++;
+  self->inflight--;
+  self->latency_total += latency;
+  self->latency_max = MAX (self->latency_max, latency);
+  GST_OBJECT_UNLOCK (self);
+
+  chunk->filled = 0;
+  chunk->busy = FALSE;
+  return GST_FLOW_OK;
+}
+
+/* Handle all available completions, waiting for the first one if wait is set */
+static GstFlowReturn
+gst_uring_sink_reap (GstUringSink * self, gboolean wait)
+{
+  struct io_uring_cqe *cqe;
+  GstFlowReturn flow;
+  gint ret;
+
+  while (TRUE) {
+    ret = wait ? io_uring_wait_cqe (&self->ring, &cqe)
+        : io_uring_peek_cqe (&self->ring, &cqe);
+    if (ret == -EAGAIN)
+      return GST_FLOW_OK;
+    if (ret == -EINTR)
+      continue;
+    if (ret < 0) {
+      GST_ELEMENT_ERROR (self, RESOURCE, WRITE, (NULL),
+          ("io_uring completion: %s", g_strerror (-ret)));
+      return GST_FLOW_ERROR;
+    }
+
+    flow = gst_uring_sink_complete (self, cqe);
+    if (flow != GST_FLOW_OK)
+      return flow;
+    wait = FALSE;
+  }
+}
+
+/* Submit the partial chunk and wait until everything is on its way to disk */
+static GstFlowReturn
+gst_uring_sink_flush (GstUringSink * self)
+{
+  GstUringChunk *chunk;
+  GstFlowReturn flow = GST_FLOW_OK;
+  guint i;
+
+  if (!self->ring_ready)
+    return GST_FLOW_OK;
+
+  chunk = &self->chunks[self->current];
+  if (!chunk->busy && chunk->filled > 0) {
+    flow = gst_uring_sink_submit (self, chunk);
+    self->current = (self->current + 1) % self->n_chunks;
+  }
+
+  for (i = 0; i < self->n_chunks && flow == GST_FLOW_OK; i++) {
+    while (self->chunks[i].busy && flow == GST_FLOW_OK)
+      flow = gst_uring_sink_reap (self, TRUE);
+  }
+
+  if (flow == GST_FLOW_OK && self->direct
+      && ftruncate (self->fd, self->write_offset) < 0) {
+    GST_ELEMENT_ERROR (self, RESOURCE, WRITE,
+        ("Error while writing to file \"%s\".", self->location),
+        GST_ERROR_SYSTEM);
+    flow = GST_FLOW_ERROR;
+  }
+
+  GST_OBJECT_LOCK (self);
+  self->end_time = g_get_monotonic_time ();
+  GST_OBJECT_UNLOCK (self);
+
+  return flow;
+}
+
+static gboolean
+gst_uring_sink_stop (GstBaseSink * sink)
+{
+  GstUringSink *self = GST_URING_SINK (sink);
+  guint i;
+
+  if (self->ring_ready) {
+    gst_uring_sink_flush (self);
+    io_uring_queue_exit (&self->ring);
+    self->ring_ready = FALSE;
+  }
+
+  if (self->fd >= 0) {
+    close (self->fd);
+    self->fd = -1;
+  }
+
+  if (self->chunks) {
+    for (i = 0; i < self->n_chunks; i++)
+      free (self->chunks[i].data);
+    g_clear_pointer (&self->chunks, g_free);
+  }
+  return TRUE;
+}
+
+static gboolean
+gst_uring_sink_event (GstBaseSink * sink, GstEvent * event)
+{
+  GstUringSink *self = GST_URING_SINK (sink);
+
+  /* Complete all writes before the EOS message is posted */
+  if (GST_EVENT_TYPE (event) == GST_EVENT_EOS
+      && gst_uring_sink_flush (self) != GST_FLOW_OK) {
+    gst_event_unref (event);
+    return FALSE;
+  }
+
+  return GST_BASE_SINK_CLASS (parent_class)->event (sink, event);
+}
+
+static GstFlowReturn
+gst_uring_sink_render (GstBaseSink * sink, GstBuffer * buffer)
+{
+  GstUringSink *self = GST_URING_SINK (sink);
+  GstFlowReturn flow = GST_FLOW_OK;
+  GstMapInfo map;
+  const guint8 *data;
+  gsize remaining;
+
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ)) {
+    GST_ELEMENT_ERROR (self, RESOURCE, FAILED, (NULL),
+        ("Failed to map buffer"));
+    return GST_FLOW_ERROR;
+  }
+
+  if (self->start_time == 0) {
+    GST_OBJECT_LOCK (self);
+    self->start_time = g_get_monotonic_time ();
+    GST_OBJECT_UNLOCK (self);
+  }
+
+  data = map.data;
+  remaining = map.size;
+  while (remaining > 0 && flow == GST_FLOW_OK) {
+    GstUringChunk *chunk = &self->chunks[self->current];
+    gsize n;
+
+    /* Wrapped around to a chunk still in flight, this is the only place we block */
+    while (chunk->busy && flow == GST_FLOW_OK)
+      flow = gst_uring_sink_reap (self, TRUE);
+    if (flow != GST_FLOW_OK)
+      break;
+
+    n = MIN (remaining, self->chunk_size - chunk->filled);
+    memcpy (chunk->data + chunk->filled, data, n);
+    chunk->filled += n;
+    data += n;
+    remaining -= n;
+
+    if (chunk->filled == self->chunk_size) {
+      flow = gst_uring_sink_submit (self, chunk);
+      self->current = (self->current + 1) % self->n_chunks;
+    }
+  }
+
+  /* Recycle whatever completed meanwhile without waiting */
+  if (flow == GST_FLOW_OK)
+    flow = gst_uring_sink_reap (self, FALSE);
+
+  gst_buffer_unmap (buffer, &map);
+  return flow;
+}
+
+gboolean
+gst_uring_sink_register (void)
+{
+  return gst_element_register (NULL, "uringsink", GST_RANK_NONE,
+      GST_TYPE_URING_SINK);
+}
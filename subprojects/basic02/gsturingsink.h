@@ -0,0 +1,27 @@
+/* GStreamer
+ *
+ * Supplement to Basic Tutorial 2: io_uring batched file sink
+ *
+ * uringsink aggregates incoming buffers into large aligned chunks and writes them to a file
+ * asynchronously through io_uring, keeping up to queue-depth chunks in flight. With
+ * direct=true the file is opened with O_DIRECT and bypasses the page cache.
+ *
+ * The element is registered by the application with gst_uring_sink_register().
+ */
+
+#ifndef __GST_URING_SINK_H__
+#define __GST_URING_SINK_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_URING_SINK (gst_uring_sink_get_type ())
+G_DECLARE_FINAL_TYPE (GstUringSink, gst_uring_sink, GST, URING_SINK, GstBaseSink)
+
+gboolean gst_uring_sink_register (void);
+
+G_END_DECLS
+
+#endif /* __GST_URING_SINK_H__ */
@@ -0,0 +1,293 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 2: RTP loopback receiver
+ *
+ * Receives the stream of rtp_sender on 127.0.0.1 through rtpjitterbuffer and reports, once
+ * per second, the packet loss, the RFC 3550 inter-arrival jitter and the end-to-end latency
+ * from frame capture in the sender to the output of the jitter buffer.
+ *  - How to receive RTP with udpsrc and rtpjitterbuffer.
+ *  - How the latency, drop-on-latency and socket buffer-size knobs trade latency for loss.
+ */
+
+#include <gstreamermm.h>
+#include <glibmm/main.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <mutex>
+#include <string>
+#include <cstdlib>
+#include "rtp_timestamp.h"
+
+using Glib::RefPtr;
+
+namespace
+{
+
+// Command line options
+gint opt_port {5000};
+gint opt_latency {20};
+gboolean opt_drop_on_latency {FALSE};
+gint opt_buffer_size {0};
+gint opt_width {1280};
+gint opt_height {720};
+gboolean opt_no_display {FALSE};
+gchar* opt_codec {nullptr};
+
+GOptionEntry entries[] =
+{
+  { "port", 'p', 0, G_OPTION_ARG_INT, &opt_port, "UDP port on 127.0.0.1 (default 5000)", "PORT" },
+  { "latency", 'l', 0, G_OPTION_ARG_INT, &opt_latency, "Jitter buffer latency in ms (default 20)", "MS" },
+  { "drop-on-latency", 'd', 0, G_OPTION_ARG_NONE, &opt_drop_on_latency,
+    "Drop packets that would exceed the jitter buffer latency", nullptr },
+  { "buffer-size", 's', 0, G_OPTION_ARG_INT, &opt_buffer_size,
+    "UDP socket receive buffer size in bytes (default 0, system default)", "BYTES" },
+  { "width", 'w', 0, G_OPTION_ARG_INT, &opt_width, "Frame width, raw codec only (default 1280)", "W" },
+  { "height", 'h', 0, G_OPTION_ARG_INT, &opt_height, "Frame height, raw codec only (default 720)", "H" },
+  { "no-display", 'n', 0, G_OPTION_ARG_NONE, &opt_no_display, "Decode into a fakesink", nullptr },
+  { "codec", 'c', 0, G_OPTION_ARG_STRING, &opt_codec, "h264, vp8 or raw (default h264)", "CODEC" },
+  { nullptr }
+};
+
+RefPtr<Glib::MainLoop> mainloop;
+RefPtr<Gst::Element> jitterbuffer;
+
+// Statistics of the current report interval, updated from the streaming threads
+struct Statistics
+{
+  guint64 received {0};
+  guint64 lost {0};
+  gint64 latency_sum {0};
+  gint64 latency_max {0};
+  guint64 latency_count {0};
+};
+
+std::mutex stats_mutex;
+Statistics stats;
+double jitter {0.0};
+gint64 last_transit {0};
+gint last_seqnum {-1};
+
+// Arrival side: sequence gaps and inter-arrival jitter, measured before the jitter buffer.
+GstPadProbeReturn on_arrival(GstPad*, GstPadProbeInfo* info, gpointer)
+{
+  gint64 now {g_get_monotonic_time()};
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  if (!gst_rtp_buffer_map(GST_PAD_PROBE_INFO_BUFFER(info), GST_MAP_READ, &rtp))
+    return GST_PAD_PROBE_OK;
+
+  RtpTimestamp timestamp;
+  bool stamped {rtp_timestamp_read(&rtp, timestamp)};
+  guint16 seqnum {gst_rtp_buffer_get_seq(&rtp)};
+  gst_rtp_buffer_unmap(&rtp);
+
+  std::lock_guard<std::mutex> lock {stats_mutex};
+  stats.received++;
+  if (last_seqnum >= 0)
+  {
+    // Packets reordered on loopback are rare, count forward gaps as lost
+    guint16 expected {static_cast<guint16>(last_seqnum + 1)};
+    guint16 gap {static_cast<guint16>(seqnum - expected)};
+    if (gap < 0x8000)
+      stats.lost += gap;
+  }
+  last_seqnum = seqnum;
+
+  if (stamped)
+  {
+    // J(i) = J(i-1) + (|D(i-1,i)| - J(i-1)) / 16
+    gint64 transit {now - timestamp.send};
+    if (last_transit)
+      jitter += (std::abs(transit - last_transit) - jitter) / 16.0;
+    last_transit = transit;
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+// Departure side: capture-to-jitter-buffer-output latency.
+GstPadProbeReturn on_departure(GstPad*, GstPadProbeInfo* info, gpointer)
+{
+  gint64 now {g_get_monotonic_time()};
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  if (!gst_rtp_buffer_map(GST_PAD_PROBE_INFO_BUFFER(info), GST_MAP_READ, &rtp))
+    return GST_PAD_PROBE_OK;
+
+  RtpTimestamp timestamp;
+  bool stamped {rtp_timestamp_read(&rtp, timestamp)};
+  gst_rtp_buffer_unmap(&rtp);
+
+  if (stamped)
+  {
+    gint64 latency {now - timestamp.capture};
+    std::lock_guard<std::mutex> lock {stats_mutex};
+    stats.latency_sum += latency;
+    stats.latency_max = std::max(stats.latency_max, latency);
+    stats.latency_count++;
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+bool on_report()
+{
+  Statistics current;
+  double current_jitter;
+  {
+    std::lock_guard<std::mutex> lock {stats_mutex};
+    current = stats;
+    current_jitter = jitter;
+    stats = Statistics();
+  }
+
+  // The jitter buffer's own view: packets lost, late or dropped for exceeding the latency
+  guint64 jb_lost {0}, jb_late {0};
+  GstStructure* jb_stats {nullptr};
+  g_object_get(jitterbuffer->gobj(), "stats", &jb_stats, nullptr);
+  if (jb_stats)
+  {
+    gst_structure_get_uint64(jb_stats, "num-lost", &jb_lost);
+    gst_structure_get_uint64(jb_stats, "num-late", &jb_late);
+    gst_structure_free(jb_stats);
+  }
+
+  guint64 expected {current.received + current.lost};
+  std::cout << std::fixed << std::setprecision(2) <<
+    "received " << current.received << " packets, loss " <<
+    (expected ? 100.0 * current.lost / expected : 0.0) << "%, jitter " << current_jitter / 1000.0 << " ms";
+  if (current.latency_count)
+  {
+    std::cout << ", latency avg " << current.latency_sum / 1000.0 / current.latency_count <<
+      " ms max " << current.latency_max / 1000.0 << " ms";
+  }
+  std::cout << " (jitterbuffer total lost " << jb_lost << ", late " << jb_late << ")" << std::endl;
+  return true;
+}
+
+bool on_bus_message(const RefPtr<Gst::Bus>&, const RefPtr<Gst::Message>& message)
+{
+  switch (message->get_message_type())
+  {
+    case Gst::MESSAGE_EOS:
+      std::cout << std::endl << "End of stream" << std::endl;
+      mainloop->quit();
+      return false;
+    case Gst::MESSAGE_ERROR:
+    {
+      RefPtr<Gst::MessageError> msgError {RefPtr<Gst::MessageError>::cast_static(message)};
+      if (msgError)
+      {
+        Glib::Error err {msgError->parse_error()};
+        std::string debug_info {msgError->parse_debug()};
+        std::cerr << "Error received from element " << message->get_source()->get_name() << ": " <<
+            err.what() << std::endl;
+        if (!debug_info.empty())
+          std::cout << "Debugging information: " << debug_info << std::endl;
+      }
+      else
+      {
+        std::cerr << "Error." << std::endl;
+      }
+      mainloop->quit();
+      return false;
+    }
+    default:
+      break;
+  }
+
+  return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("- RTP loopback receiver")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  // Initialize gstreamermm:
+  Gst::init(argc, argv);
+
+  // RTP caps and the depayloader/decoder matching rtp_sender's codec
+  std::string codec {opt_codec ? opt_codec : "h264"};
+  std::string caps {"application/x-rtp,media=video,clock-rate=90000,payload=96,encoding-name="};
+  std::string decoder;
+  if (codec == "h264")
+  {
+    caps += "H264";
+    decoder = "rtph264depay ! avdec_h264";
+  }
+  else if (codec == "vp8")
+  {
+    caps += "VP8";
+    decoder = "rtpvp8depay ! vp8dec";
+  }
+  else if (codec == "raw")
+  {
+    caps += "RAW,sampling=YCbCr-4:2:0,depth=(string)8,colorimetry=BT601-5,width=(string)" +
+      std::to_string(opt_width) + ",height=(string)" + std::to_string(opt_height);
+    decoder = "rtpvrawdepay";
+  }
+  else
+  {
+    std::cerr << "Unknown codec " << codec << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::string description {"udpsrc name=source address=127.0.0.1 port=" + std::to_string(opt_port) +
+    " buffer-size=" + std::to_string(opt_buffer_size) + " caps=\"" + caps + "\" ! "
+    "rtpjitterbuffer name=jitterbuffer latency=" + std::to_string(opt_latency) +
+    " drop-on-latency=" + (opt_drop_on_latency ? "true" : "false") + " ! " + decoder + " ! " +
+    (opt_no_display ? "fakesink sync=false" : "videoconvert ! autovideosink")};
+
+  RefPtr<Gst::Element> pipeline;
+  try
+  {
+    pipeline = Gst::Parse::launch(description);
+  }
+  catch (const Glib::Error& ex)
+  {
+    std::cerr << "Could not create the receiver pipeline: " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  RefPtr<Gst::Bin> bin {RefPtr<Gst::Bin>::cast_dynamic(pipeline)};
+  jitterbuffer = bin->get_element("jitterbuffer");
+  gst_pad_add_probe(bin->get_element("source")->get_static_pad("src")->gobj(),
+      GST_PAD_PROBE_TYPE_BUFFER, &on_arrival, nullptr, nullptr);
+  gst_pad_add_probe(jitterbuffer->get_static_pad("src")->gobj(),
+      GST_PAD_PROBE_TYPE_BUFFER, &on_departure, nullptr, nullptr);
+
+  // Create the main loop.
+  mainloop = Glib::MainLoop::create();
+
+  // Get the bus and watch the messages
+  RefPtr<Gst::Bus> bus {pipeline->get_bus()};
+  bus->add_watch(sigc::ptr_fun(&on_bus_message));
+
+  if (pipeline->set_state(Gst::STATE_PLAYING) == Gst::STATE_CHANGE_FAILURE)
+  {
+    std::cerr << "Unable to set the pipeline to the playing state." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  Glib::signal_timeout().connect_seconds(sigc::ptr_fun(&on_report), 1);
+
+  std::cout << "Receiving " << codec << " from rtp://127.0.0.1:" << opt_port << std::endl;
+  mainloop->run();
+
+  // Clean up nicely:
+  std::cout << "Returned. Stopping pipeline." << std::endl;
+  pipeline->set_state(Gst::STATE_NULL);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,238 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 2: RTP loopback sender
+ *
+ * Streams the videotestsrc output as RTP over UDP to 127.0.0.1, to be received by
+ * rtp_receiver on the same machine. Each packet carries the capture time of its frame and
+ * its own send time in an RTP header extension, see rtp_timestamp.h.
+ *  - How to packetize a live stream with an RTP payloader and send it with udpsink.
+ *  - How to modify buffers and buffer lists in a pad probe.
+ */
+
+#include <gstreamermm.h>
+#include <glibmm/main.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <cstdlib>
+#include "rtp_timestamp.h"
+
+using Glib::RefPtr;
+
+namespace
+{
+
+// Command line options
+gint opt_port {5000};
+gint opt_width {1280};
+gint opt_height {720};
+gint opt_fps {30};
+gint opt_bitrate {4000};
+gint opt_mtu {1400};
+gchar* opt_codec {nullptr};
+
+GOptionEntry entries[] =
+{
+  { "port", 'p', 0, G_OPTION_ARG_INT, &opt_port, "UDP port on 127.0.0.1 (default 5000)", "PORT" },
+  { "width", 'w', 0, G_OPTION_ARG_INT, &opt_width, "Frame width (default 1280)", "W" },
+  { "height", 'h', 0, G_OPTION_ARG_INT, &opt_height, "Frame height (default 720)", "H" },
+  { "fps", 'f', 0, G_OPTION_ARG_INT, &opt_fps, "Frame rate (default 30)", "FPS" },
+  { "bitrate", 'b', 0, G_OPTION_ARG_INT, &opt_bitrate, "Encoder bitrate in kbit/s (default 4000)", "KBPS" },
+  { "mtu", 'm', 0, G_OPTION_ARG_INT, &opt_mtu, "Maximum RTP packet size (default 1400)", "BYTES" },
+  { "codec", 'c', 0, G_OPTION_ARG_STRING, &opt_codec, "h264, vp8 or raw (default h264)", "CODEC" },
+  { nullptr }
+};
+
+RefPtr<Glib::MainLoop> mainloop;
+
+// Capture time of each frame by its PTS, from the source until the payloader
+std::mutex capture_mutex;
+std::map<GstClockTime, gint64> capture_times;
+std::atomic<guint64> packets_sent {0};
+std::atomic<guint64> bytes_sent {0};
+
+GstPadProbeReturn on_captured(GstPad*, GstPadProbeInfo* info, gpointer)
+{
+  GstBuffer* buffer {GST_PAD_PROBE_INFO_BUFFER(info)};
+  std::lock_guard<std::mutex> lock {capture_mutex};
+  capture_times[GST_BUFFER_PTS(buffer)] = g_get_monotonic_time();
+  // Frames are packetized in order, a few seconds of history is plenty
+  while (capture_times.size() > 256)
+    capture_times.erase(capture_times.begin());
+  return GST_PAD_PROBE_OK;
+}
+
+void stamp_packet(GstBuffer* buffer, gint64 now)
+{
+  RtpTimestamp timestamp;
+  timestamp.send = now;
+  {
+    std::lock_guard<std::mutex> lock {capture_mutex};
+    auto found = capture_times.find(GST_BUFFER_PTS(buffer));
+    timestamp.capture = (found != capture_times.end()) ? found->second : now;
+  }
+
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  if (gst_rtp_buffer_map(buffer, GST_MAP_READWRITE, &rtp))
+  {
+    rtp_timestamp_write(&rtp, timestamp);
+    gst_rtp_buffer_unmap(&rtp);
+  }
+  packets_sent.fetch_add(1, std::memory_order_relaxed);
+  bytes_sent.fetch_add(gst_buffer_get_size(buffer), std::memory_order_relaxed);
+}
+
+// Add the timestamps to every packet leaving the payloader. Payloaders may push single
+// buffers or buffer lists.
+GstPadProbeReturn on_packet(GstPad*, GstPadProbeInfo* info, gpointer)
+{
+  gint64 now {g_get_monotonic_time()};
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER)
+  {
+    GstBuffer* buffer {gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info))};
+    GST_PAD_PROBE_INFO_DATA(info) = buffer;
+    stamp_packet(buffer, now);
+  }
+  else if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST)
+  {
+    GstBufferList* list {gst_buffer_list_make_writable(GST_PAD_PROBE_INFO_BUFFER_LIST(info))};
+    GST_PAD_PROBE_INFO_DATA(info) = list;
+    for (guint i = 0; i < gst_buffer_list_length(list); i++)
+      stamp_packet(gst_buffer_list_get_writable(list, i), now);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+bool on_report()
+{
+  static guint64 last_packets {0}, last_bytes {0};
+  guint64 packets {packets_sent.load()}, bytes {bytes_sent.load()};
+  std::cout << "sent " << packets - last_packets << " packets/s, " <<
+    (bytes - last_bytes) * 8 / 1000 << " kbit/s" << std::endl;
+  last_packets = packets;
+  last_bytes = bytes;
+  return true;
+}
+
+bool on_bus_message(const RefPtr<Gst::Bus>&, const RefPtr<Gst::Message>& message)
+{
+  switch (message->get_message_type())
+  {
+    case Gst::MESSAGE_EOS:
+      std::cout << std::endl << "End of stream" << std::endl;
+      mainloop->quit();
+      return false;
+    case Gst::MESSAGE_ERROR:
+    {
+      RefPtr<Gst::MessageError> msgError {RefPtr<Gst::MessageError>::cast_static(message)};
+      if (msgError)
+      {
+        Glib::Error err {msgError->parse_error()};
+        std::string debug_info {msgError->parse_debug()};
+        std::cerr << "Error received from element " << message->get_source()->get_name() << ": " <<
+            err.what() << std::endl;
+        if (!debug_info.empty())
+          std::cout << "Debugging information: " << debug_info << std::endl;
+      }
+      else
+      {
+        std::cerr << "Error." << std::endl;
+      }
+      mainloop->quit();
+      return false;
+    }
+    default:
+      break;
+  }
+
+  return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("- RTP loopback sender")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  // Initialize gstreamermm:
+  Gst::init(argc, argv);
+
+  // The encoder and payloader for the selected codec, tuned for latency
+  std::string codec {opt_codec ? opt_codec : "h264"};
+  std::string encoder;
+  if (codec == "h264")
+    encoder = "x264enc tune=zerolatency speed-preset=ultrafast bitrate=" + std::to_string(opt_bitrate) +
+      " key-int-max=" + std::to_string(opt_fps) + " ! rtph264pay config-interval=-1";
+  else if (codec == "vp8")
+    encoder = "vp8enc deadline=1 cpu-used=8 end-usage=cbr target-bitrate=" +
+      std::to_string(opt_bitrate * 1000) + " keyframe-max-dist=" + std::to_string(opt_fps) + " ! rtpvp8pay";
+  else if (codec == "raw")
+    encoder = "rtpvrawpay";
+  else
+  {
+    std::cerr << "Unknown codec " << codec << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::string description {"videotestsrc name=source is-live=true pattern=ball ! "
+    "video/x-raw,format=I420,width=" + std::to_string(opt_width) + ",height=" + std::to_string(opt_height) +
+    ",framerate=" + std::to_string(opt_fps) + "/1 ! " + encoder +
+    " name=pay pt=96 mtu=" + std::to_string(opt_mtu) +
+    " ! udpsink host=127.0.0.1 sync=false async=false port=" + std::to_string(opt_port)};
+
+  RefPtr<Gst::Element> pipeline;
+  try
+  {
+    pipeline = Gst::Parse::launch(description);
+  }
+  catch (const Glib::Error& ex)
+  {
+    std::cerr << "Could not create the sender pipeline: " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  RefPtr<Gst::Bin> bin {RefPtr<Gst::Bin>::cast_dynamic(pipeline)};
+  gst_pad_add_probe(bin->get_element("source")->get_static_pad("src")->gobj(),
+      GST_PAD_PROBE_TYPE_BUFFER, &on_captured, nullptr, nullptr);
+  gst_pad_add_probe(bin->get_element("pay")->get_static_pad("src")->gobj(),
+      static_cast<GstPadProbeType>(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+      &on_packet, nullptr, nullptr);
+
+  // Create the main loop.
+  mainloop = Glib::MainLoop::create();
+
+  // Get the bus and watch the messages
+  RefPtr<Gst::Bus> bus {pipeline->get_bus()};
+  bus->add_watch(sigc::ptr_fun(&on_bus_message));
+
+  if (pipeline->set_state(Gst::STATE_PLAYING) == Gst::STATE_CHANGE_FAILURE)
+  {
+    std::cerr << "Unable to set the pipeline to the playing state." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  Glib::signal_timeout().connect_seconds(sigc::ptr_fun(&on_report), 1);
+
+  std::cout << "Sending " << codec << " to rtp://127.0.0.1:" << opt_port << std::endl;
+  mainloop->run();
+
+  // Clean up nicely:
+  std::cout << "Returned. Stopping pipeline." << std::endl;
+  pipeline->set_state(Gst::STATE_NULL);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,54 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 2: RTP loopback streaming
+ *
+ * Timestamps shared by rtp_sender and rtp_receiver. The sender stores the capture time of the
+ * frame and the send time of the packet in a one-byte RTP header extension. Both are read from
+ * g_get_monotonic_time(), which is the same clock for all processes of one machine, so the
+ * receiver can compute end-to-end latency and inter-arrival jitter on loopback.
+ */
+
+#ifndef RTP_TIMESTAMP_H
+#define RTP_TIMESTAMP_H
+
+#include <gst/rtp/gstrtpbuffer.h>
+#include <cstring>
+
+// Header extension id, any free id from 1 to 14 works as long as both ends agree
+constexpr guint8 RTP_TIMESTAMP_EXT_ID {1};
+
+struct RtpTimestamp
+{
+  gint64 capture {0};
+  gint64 send {0};
+};
+
+// Store the timestamps in a mapped, writable RTP packet.
+inline bool rtp_timestamp_write(GstRTPBuffer* rtp, const RtpTimestamp& timestamp)
+{
+  guint8 data[sizeof(gint64) * 2];
+  gint64 capture {GINT64_TO_BE(timestamp.capture)};
+  gint64 send {GINT64_TO_BE(timestamp.send)};
+  std::memcpy(data, &capture, sizeof(capture));
+  std::memcpy(data + sizeof(capture), &send, sizeof(send));
+  return gst_rtp_buffer_add_extension_onebyte_header(rtp, RTP_TIMESTAMP_EXT_ID, data, sizeof(data));
+}
+
+// Read the timestamps from a mapped RTP packet.
+inline bool rtp_timestamp_read(GstRTPBuffer* rtp, RtpTimestamp& timestamp)
+{
+  gpointer data {nullptr};
+  guint size {0};
+  if (!gst_rtp_buffer_get_extension_onebyte_header(rtp, RTP_TIMESTAMP_EXT_ID, 0, &data, &size) ||
+      size != sizeof(gint64) * 2)
+    return false;
+
+  gint64 capture, send;
+  std::memcpy(&capture, data, sizeof(capture));
+  std::memcpy(&send, static_cast<guint8*>(data) + sizeof(capture), sizeof(send));
+  timestamp.capture = GINT64_FROM_BE(capture);
+  timestamp.send = GINT64_FROM_BE(send);
+  return true;
+}
+
+#endif // RTP_TIMESTAMP_H
@@ -0,0 +1,217 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 2: File sink benchmark
+ *
+ * Writes the same stream of fixed size buffers with filesink and with uringsink, buffered and
+ * with O_DIRECT, into each given directory (by default a tmpfs and a disk backed one), and
+ * prints the throughput and the user/system CPU time of each run.
+ *
+ *   fakesrc num-buffers=N sizetype=fixed sizemax=B filltype=nothing ! <sink> location=...
+ *
+ * Unless --no-sync is given, the time includes an fdatasync() of the written file, so
+ * buffered writes that are still in the page cache are not counted as written.
+ */
+
+#include <gstreamermm.h>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "gsturingsink.h"
+
+using Glib::RefPtr;
+
+namespace
+{
+
+// Command line options
+gint opt_size {1024};
+gint opt_buffer_size {64};
+gint opt_chunk_size {4096};
+gint opt_queue_depth {8};
+gboolean opt_no_sync {FALSE};
+gchar* opt_dirs {nullptr};
+
+GOptionEntry entries[] =
+{
+  { "size", 's', 0, G_OPTION_ARG_INT, &opt_size, "MiB to write per run (default 1024)", "MIB" },
+  { "buffer-size", 'b', 0, G_OPTION_ARG_INT, &opt_buffer_size, "Size of each buffer in KiB (default 64)", "KIB" },
+  { "chunk-size", 'c', 0, G_OPTION_ARG_INT, &opt_chunk_size, "uringsink chunk size in KiB (default 4096)", "KIB" },
+  { "queue-depth", 'q', 0, G_OPTION_ARG_INT, &opt_queue_depth, "uringsink queue depth (default 8)", "N" },
+  { "no-sync", 'n', 0, G_OPTION_ARG_NONE, &opt_no_sync, "Do not include fdatasync() in the time", nullptr },
+  { "dirs", 'd', 0, G_OPTION_ARG_STRING, &opt_dirs,
+    "Comma separated output directories (default /dev/shm,/var/tmp)", "LIST" },
+  { nullptr }
+};
+
+struct Variant
+{
+  const char* name;
+  std::string sink;
+};
+
+struct Result
+{
+  double seconds {0.0};
+  double user_seconds {0.0};
+  double system_seconds {0.0};
+  std::string stats;
+};
+
+void cpu_time(double& user, double& system)
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+  system = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+bool run(const std::string& sink, const std::string& path, gint64 buffers, gsize buffer_size, Result& result)
+{
+  std::ostringstream description;
+  description << "fakesrc num-buffers=" << buffers << " sizetype=fixed sizemax=" << buffer_size <<
+    " filltype=nothing ! " << sink << " name=sink location=\"" << path << "\"";
+
+  RefPtr<Gst::Element> pipeline;
+  try
+  {
+    pipeline = Gst::Parse::launch(description.str());
+  }
+  catch (const Glib::Error& ex)
+  {
+    std::cerr << "Could not create the pipeline: " << ex.what() << std::endl;
+    return false;
+  }
+
+  // Open the file and preroll first so that is not part of the measurement
+  pipeline->set_state(Gst::STATE_PAUSED);
+  Gst::State state, pending;
+  bool prerolled {pipeline->get_state(state, pending, Gst::CLOCK_TIME_NONE) != Gst::STATE_CHANGE_FAILURE};
+
+  double user_start, system_start;
+  cpu_time(user_start, system_start);
+  gint64 start {g_get_monotonic_time()};
+  if (prerolled)
+    pipeline->set_state(Gst::STATE_PLAYING);
+
+  RefPtr<Gst::Message> message {pipeline->get_bus()->pop(Gst::CLOCK_TIME_NONE,
+      Gst::MESSAGE_EOS | Gst::MESSAGE_ERROR)};
+  bool ok {message->get_message_type() == Gst::MESSAGE_EOS};
+
+  if (ok && !opt_no_sync)
+  {
+    int fd {open(path.c_str(), O_WRONLY)};
+    if (fd >= 0)
+    {
+      fdatasync(fd);
+      close(fd);
+    }
+  }
+
+  result.seconds = (g_get_monotonic_time() - start) / 1e6;
+  double user_end, system_end;
+  cpu_time(user_end, system_end);
+  result.user_seconds = user_end - user_start;
+  result.system_seconds = system_end - system_start;
+
+  RefPtr<Gst::Element> element {RefPtr<Gst::Bin>::cast_dynamic(pipeline)->get_element("sink")};
+  if (element->get_factory()->get_name() == "uringsink")
+  {
+    GstStructure* stats {nullptr};
+    g_object_get(element->gobj(), "stats", &stats, nullptr);
+    guint max_depth {0};
+    guint64 average {0}, max {0};
+    gst_structure_get_uint(stats, "max-queue-depth", &max_depth);
+    gst_structure_get_uint64(stats, "average-write-latency", &average);
+    gst_structure_get_uint64(stats, "max-write-latency", &max);
+    gst_structure_free(stats);
+    result.stats = "depth " + std::to_string(max_depth) + ", write latency avg " + std::to_string(average) +
+      " us max " + std::to_string(max) + " us";
+  }
+  pipeline->set_state(Gst::STATE_NULL);
+
+  if (!ok)
+  {
+    std::cerr << "Error: " << RefPtr<Gst::MessageError>::cast_static(message)->parse_error().what() << std::endl;
+    unlink(path.c_str());
+    return false;
+  }
+
+  struct stat info;
+  if (stat(path.c_str(), &info) == 0 && static_cast<guint64>(info.st_size) != buffers * buffer_size)
+    std::cerr << "Warning: " << path << " has " << info.st_size << " bytes, expected " <<
+      buffers * buffer_size << std::endl;
+  unlink(path.c_str());
+  return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("- filesink versus uringsink benchmark")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  // Initialize gstreamermm and register our element
+  Gst::init(argc, argv);
+  gst_uring_sink_register();
+
+  gsize buffer_size {static_cast<gsize>(opt_buffer_size) * 1024};
+  gint64 buffers {static_cast<gint64>(opt_size) * 1024 * 1024 / buffer_size};
+  std::string uring {"uringsink chunk-size=" + std::to_string(opt_chunk_size * 1024) +
+    " queue-depth=" + std::to_string(opt_queue_depth)};
+  std::vector<Variant> variants {
+    {"filesink", "filesink"},
+    {"uringsink", uring},
+    {"uringsink direct", uring + " direct=true"}
+  };
+
+  std::cout << buffers << " buffers of " << opt_buffer_size << " KiB per run" <<
+    (opt_no_sync ? "" : ", fdatasync included") << std::endl;
+
+  std::istringstream list {opt_dirs ? opt_dirs : "/dev/shm,/var/tmp"};
+  std::string dir;
+  while (std::getline(list, dir, ','))
+  {
+    std::cout << std::endl << dir << std::endl;
+    std::cout << std::setw(18) << "sink" << std::setw(10) << "MiB/s" << std::setw(10) << "user s" <<
+      std::setw(10) << "system s" << std::endl;
+
+    std::string path {dir + "/sink-bench-" + std::to_string(getpid()) + ".bin"};
+    for (const Variant& variant : variants)
+    {
+      // O_DIRECT is not available everywhere (older tmpfs), report it and carry on
+      Result result;
+      if (!run(variant.sink, path, buffers, buffer_size, result))
+      {
+        std::cout << std::setw(18) << variant.name << "    failed" << std::endl;
+        continue;
+      }
+
+      std::cout << std::setw(18) << variant.name << std::fixed << std::setprecision(1) <<
+        std::setw(10) << buffers * buffer_size / (1024.0 * 1024.0) / result.seconds <<
+        std::setprecision(2) << std::setw(10) << result.user_seconds << std::setw(10) << result.system_seconds;
+      if (!result.stats.empty())
+        std::cout << "   " << result.stats;
+      std::cout << std::endl;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
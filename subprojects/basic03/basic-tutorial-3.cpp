@@ -6,11 +6,27 @@
 #include <gstreamermm.h>
 #include <glibmm/main.h>
 #include <glibmm/stringutils.h>
+#include <glibmm/convert.h>
+#include <glibmm/fileutils.h>
+#include "graph_snapshot.h"
+#include "gstmmapsrc.h"
+#include "gstaudiometer.h"
+#include <algorithm>
 #include <iostream>
+#include <iomanip>
 #include <cstdlib>
 
 Glib::RefPtr<Glib::MainLoop> mainloop;
 
+// Command line options
+gboolean opt_mmap {FALSE};
+
+GOptionEntry entries[] =
+{
+  { "mmap", 'm', 0, G_OPTION_ARG_NONE, &opt_mmap, "Read local files through mmapsrc instead of filesrc", nullptr },
+  { nullptr }
+};
+
 // This function is used to receive asynchronous messages in the main loop.
 bool on_bus_message(const Glib::RefPtr<Gst::Bus>& /* bus */,
     const Glib::RefPtr<Gst::Message>& message)
@@ -58,6 +74,23 @@ bool on_bus_message(const Glib::RefPtr<Gst::Bus>& /* bus */,
       }
       break;
     }
+    case Gst::MESSAGE_ELEMENT:
+    {
+      // Loudness and the highest peak over all channels, posted by the meter every 100 ms
+      const GstStructure* structure {gst_message_get_structure(message->gobj())};
+      if (gst_structure_has_name(structure, "audiometer"))
+      {
+        gdouble momentary {0.0}, short_term {0.0}, peak {-120.0};
+        gst_structure_get_double(structure, "momentary", &momentary);
+        gst_structure_get_double(structure, "short-term", &short_term);
+        const GValue* peaks {gst_structure_get_value(structure, "peak")};
+        for (guint i = 0; peaks && i < gst_value_array_get_size(peaks); i++)
+          peak = std::max(peak, g_value_get_double(gst_value_array_get_value(peaks, i)));
+        std::cout << std::fixed << std::setprecision(1) << "momentary " << momentary <<
+          " LUFS, short-term " << short_term << " LUFS, peak " << peak << " dBFS   \r" << std::flush;
+      }
+      break;
+    }
     default:
         //std::cout << "Unhandled message type: " << message->get_message_type() << std::endl;
       break;
@@ -68,30 +101,53 @@ bool on_bus_message(const Glib::RefPtr<Gst::Bus>& /* bus */,
 
 int main(int argc, char** argv)
 {
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("[uri or local file]")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
   // Initialize gstreamermm:
   Gst::init(argc, argv);
 
+  // Rank mmapsrc above filesrc, so uridecodebin picks it for file:// URIs
+  if (opt_mmap)
+    gst_mmap_src_register(TRUE);
+  gst_audio_meter_register();
+
   // default uri
   Glib::ustring uri {"https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm"};
 
   // Take the commandline argument and ensure that it is a uri:
   if (argc < 2)
   {
-    std::cout << "Usage: " << argv[0] << " <uri>" << std::endl;
+    std::cout << "Usage: " << argv[0] << " [--mmap] <uri or local file>" << std::endl;
     std::cout << "missing uri argument, use default uri instead." << std::endl;
   }
   else if (Gst::URIHandler::uri_is_valid(argv[1]))
   {
     uri = argv[1];
   }
+  else if (Glib::file_test(argv[1], Glib::FILE_TEST_IS_REGULAR))
+  {
+    uri = Glib::filename_to_uri(argv[1]);
+  }
 
   // Create elements
   Glib::RefPtr<Gst::Element> source {Gst::ElementFactory::create_element("uridecodebin", "source")},
     convert {Gst::ElementFactory::create_element("audioconvert", "convert")},
+    meter {Gst::ElementFactory::create_element("audiometer", "meter")},
     resample {Gst::ElementFactory::create_element("audioresample", "resample")},
     sink {Gst::ElementFactory::create_element("autoaudiosink", "sink")};
 
-  if (!source || !convert || !resample || !sink)
+  if (!source || !convert || !meter || !resample || !sink)
   {
     std::cerr << "One of the elements could not be created." << std::endl;
     return EXIT_FAILURE;
@@ -103,7 +159,7 @@ int main(int argc, char** argv)
   // add the elements to the pipeline before linking them
   try
   {
-    pipeline->add(source)->add(convert)->add(resample)->add(sink);
+    pipeline->add(source)->add(convert)->add(meter)->add(resample)->add(sink);
   }
   catch (std::runtime_error& ex)
   {
@@ -114,9 +170,10 @@ int main(int argc, char** argv)
   // Link the elements
   try
   {
-    // We link the elements converter, resample and sink, but we DO NOT link them with the source,
-    // since at this point it contains no source pads. We do it later in a pad-added signal handler.
-    convert->link(resample)->link(sink);
+    // We link the elements converter, meter, resample and sink, but we DO NOT link them with the
+    // source, since at this point it contains no source pads. We do it later in a pad-added signal
+    // handler. The meter measures float samples, the converter provides them.
+    convert->link(meter)->link(resample)->link(sink);
   }
   catch(const std::runtime_error& ex)
   {
@@ -160,6 +217,10 @@ int main(int argc, char** argv)
   // Create the main loop.
   mainloop = Glib::MainLoop::create();
 
+  // Dump an annotated graph of the pipeline on request, including the pads linked later
+  GraphSnapshot snapshot {pipeline};
+  snapshot.dump_on_request();
+
   // Get the bus and watch the messages
   Glib::RefPtr<Gst::Bus> bus {pipeline->get_bus()};
   bus->add_watch(sigc::ptr_fun(&on_bus_message));
@@ -4,30 +4,80 @@
  *
  * Simple example to demonstrate dynamically adding and removing source elements
  * to a playing pipeline.
+ *
+ * With --record the stream is also split with a tee and encoded to a Matroska file in a
+ * software-only recording branch (x264enc). Press Ctrl+C to finish the file and quit.
+ *
+ * With --mosaic=N, N live sources are composited into a 1920x1080 grid instead, and every
+ * second the source of the next tile is replaced. Each tile keeps its capsfilter and its
+ * compositor pad, only the source is swapped, and the live compositor goes on with the other
+ * tiles while a new source starts.
  */
 
 #include <gstreamermm.h>
 #include <glibmm/main.h>
+#include <glib-unix.h>
 #include <iostream>
+#include <sstream>
+#include <vector>
 #include <cstdlib>
+#include <csignal>
+#include "encoder_presets.h"
+#include "graph_snapshot.h"
+#include "pipeline_template.h"
+#include "mosaic_layout.h"
 
 using Glib::RefPtr;
 
-// Expose objects to be used in callbacks
-Glib::RefPtr<Glib::MainLoop> mainloop;
-RefPtr<Gst::Element> source;
-RefPtr<Gst::Element> sink;
-RefPtr<Gst::Pipeline> pipeline;
+// CustomData contains all the information needed to pass to callbacks
+struct CustomData
+{
+  RefPtr<Glib::MainLoop> mainloop;
+  RefPtr<Gst::Element> source;
+  RefPtr<Gst::Element> sink;
+  RefPtr<Gst::Pipeline> pipeline;
+  // The element every new source is linked to, the sink or the tee of the recording branch
+  RefPtr<Gst::Element> source_peer;
+  sigc::connection swap_connection;
+  // The videotestsrc factory resolved once, for the source created every second
+  PipelineTemplate source_template;
+  int pattern {0};
+  // Mosaic mode: the source and the capsfilter of each tile, and the next tile to swap
+  std::vector<RefPtr<Gst::Element>> tile_sources;
+  std::vector<RefPtr<Gst::Element>> tile_filters;
+  guint next_tile {0};
+};
+
+// Command line options
+gchar* opt_record {nullptr};
+gchar* opt_preset {nullptr};
+gint opt_threads {0};
+gint opt_slices {0};
+gint opt_mosaic {0};
+gint opt_compositor_threads {0};
+
+GOptionEntry entries[] =
+{
+  { "record", 'r', 0, G_OPTION_ARG_FILENAME, &opt_record, "Also encode the stream into a Matroska file", "FILE" },
+  { "preset", 'p', 0, G_OPTION_ARG_STRING, &opt_preset,
+    "Encoder preset, zerolatency or throughput (default zerolatency)", "PRESET" },
+  { "threads", 't', 0, G_OPTION_ARG_INT, &opt_threads, "Encoder threads (default 0, automatic)", "N" },
+  { "slices", 's', 0, G_OPTION_ARG_INT, &opt_slices, "Slices per frame (default 0, encoder default)", "N" },
+  { "mosaic", 'm', 0, G_OPTION_ARG_INT, &opt_mosaic, "Composite N live sources in a grid (default 0, one source)", "N" },
+  { "compositor-threads", 'c', 0, G_OPTION_ARG_INT, &opt_compositor_threads,
+    "Threads for blending the mosaic (default 0, compositor default)", "N" },
+  { nullptr }
+};
 
 // This function is used to receive asynchronous messages in the main loop.
 bool on_bus_message(const RefPtr<Gst::Bus>&,
-    const RefPtr<Gst::Message>& message)
+    const RefPtr<Gst::Message>& message, CustomData* data)
 {
   switch(message->get_message_type())
   {
     case Gst::MESSAGE_EOS:
       std::cout << std::endl << "End of stream" << std::endl;
-      mainloop->quit();
+      data->mainloop->quit();
       return false;
     case Gst::MESSAGE_ERROR:
     {
@@ -47,7 +97,7 @@ bool on_bus_message(const RefPtr<Gst::Bus>&,
       {
         std::cerr << "Error." << std::endl;
       }
-      mainloop->quit();
+      data->mainloop->quit();
       return false;
     }
     case Gst::MESSAGE_STATE_CHANGED:
@@ -75,38 +125,174 @@ bool on_bus_message(const RefPtr<Gst::Bus>&,
   return true;
 }
 
-bool on_timeout()
+// A live source for a mosaic tile, linked to the tile's capsfilter
+RefPtr<Gst::Element> add_tile_source(CustomData* data, guint index, int pattern)
+{
+  RefPtr<Gst::Element> tile_source {Glib::wrap(data->source_template.create(0))};
+  tile_source->set_name("tile" + std::to_string(index));
+  tile_source->set_property("pattern", pattern);
+  tile_source->set_property("is-live", true);
+  data->pipeline->add(tile_source);
+  tile_source->link(data->tile_filters[index]);
+  return tile_source;
+}
+
+// Replace the source of one tile per call, going round the grid
+bool swap_tile(CustomData* data)
+{
+  guint index {data->next_tile};
+  data->next_tile = (index + 1) % data->tile_sources.size();
+  data->tile_sources[index]->set_state(Gst::STATE_NULL);
+  data->pipeline->remove(data->tile_sources[index]);
+  data->pattern = (data->pattern < 25) ? (data->pattern + 1) : 0;
+  data->tile_sources[index] = add_tile_source(data, index, data->pattern);
+  data->tile_sources[index]->sync_state_with_parent();
+
+  return true;
+}
+
+bool on_timeout(CustomData* data)
 {
-	static int pattern = 0;
-
-	source->set_state(Gst::STATE_NULL);
-  pipeline->remove(source);
-  // Create a new source
-  source = Gst::ElementFactory::create_element("videotestsrc", "source");
-  pattern = (pattern < 25) ? (pattern + 1) : 0;
-  source->set_property("pattern", pattern);
-  source->set_property("is_live", true);
+  if (!data->tile_sources.empty())
+    return swap_tile(data);
+
+	data->source->set_state(Gst::STATE_NULL);
+  data->pipeline->remove(data->source);
+  // Create a new source from the cached factory
+  data->source = Glib::wrap(data->source_template.create(0));
+  data->pattern = (data->pattern < 25) ? (data->pattern + 1) : 0;
+  data->source->set_property("pattern", data->pattern);
+  data->source->set_property("is_live", true);
   // Rebuild the pipeline
-  pipeline->add(source);
-  source->link(sink);
-	source->set_state(Gst::STATE_PLAYING);
+  data->pipeline->add(data->source);
+  data->source->link(data->source_peer);
+	data->source->set_state(Gst::STATE_PLAYING);
 
 	return true;
 }
 
+// Add "tee ! queue ! videoconvert ! x264enc ! h264parse ! matroskamux ! filesink" next to the
+// display sink. Returns the tee, new sources are linked to it.
+RefPtr<Gst::Element> add_record_branch(CustomData* data)
+{
+  RefPtr<Gst::Element> tee {Gst::ElementFactory::create_element("tee", "tee")},
+    display_queue {Gst::ElementFactory::create_element("queue", "display-queue")},
+    record_queue {Gst::ElementFactory::create_element("queue", "record-queue")},
+    convert {Gst::ElementFactory::create_element("videoconvert", "convert")},
+    encoder {Gst::ElementFactory::create_element("x264enc", "encoder")},
+    parser {Gst::ElementFactory::create_element("h264parse", "parser")},
+    muxer {Gst::ElementFactory::create_element("matroskamux", "muxer")},
+    filesink {Gst::ElementFactory::create_element("filesink", "filesink")};
+
+  if (!tee || !display_queue || !record_queue || !convert || !encoder || !parser || !muxer || !filesink)
+    throw std::runtime_error("one of the recording elements could not be created");
+
+  if (!configure_encoder(encoder, opt_preset ? opt_preset : "zerolatency", opt_threads, opt_slices))
+    throw std::runtime_error(std::string {"unknown encoder preset "} + opt_preset);
+  filesink->set_property("location", std::string {opt_record});
+
+  data->pipeline->add(tee)->add(display_queue)->add(record_queue)->add(convert)->add(encoder)->add(parser)->
+    add(muxer)->add(filesink);
+  tee->link(display_queue)->link(data->sink);
+  tee->link(record_queue)->link(convert)->link(encoder)->link(parser)->link(muxer)->link(filesink);
+  return tee;
+}
+
+// Add "compositor ! capsfilter" fed by one "videotestsrc ! capsfilter" per tile. Returns the
+// output capsfilter, to be linked to the sink or the tee.
+RefPtr<Gst::Element> add_mosaic(CustomData* data, guint tiles)
+{
+  const gint width {1920}, height {1080};
+  RefPtr<Gst::Element> compositor {Gst::ElementFactory::create_element("compositor", "mosaic")},
+    output {Gst::ElementFactory::create_element("capsfilter", "mosaic-caps")};
+  if (!compositor || !output)
+    throw std::runtime_error("the compositor could not be created");
+
+  if (opt_compositor_threads > 0 && !set_compositor_threads(compositor->gobj(), opt_compositor_threads))
+    std::cerr << "This compositor can not blend in parallel, using one thread." << std::endl;
+  std::ostringstream output_caps;
+  output_caps << "video/x-raw,width=" << width << ",height=" << height << ",framerate=30/1";
+  output->set_property("caps", Gst::Caps::create_from_string(output_caps.str()));
+  data->pipeline->add(compositor)->add(output);
+  compositor->link(output);
+
+  for (const MosaicTile& tile : mosaic_layout(tiles, width, height))
+  {
+    // The tile size is produced by the source, the pad position places it
+    std::ostringstream caps;
+    caps << "video/x-raw,format=I420,width=" << tile.width << ",height=" << tile.height << ",framerate=30/1";
+    RefPtr<Gst::Element> filter {Gst::ElementFactory::create_element("capsfilter")};
+    filter->set_property("caps", Gst::Caps::create_from_string(caps.str()));
+    data->pipeline->add(filter);
+
+    RefPtr<Gst::Pad> pad {compositor->get_request_pad("sink_%u")};
+    pad->set_property("xpos", tile.x);
+    pad->set_property("ypos", tile.y);
+    pad->set_property("width", tile.width);
+    pad->set_property("height", tile.height);
+    if (filter->get_static_pad("src")->link(pad) != Gst::PAD_LINK_OK)
+      throw std::runtime_error("could not link a tile to the compositor");
+
+    data->tile_filters.push_back(filter);
+    data->tile_sources.push_back(add_tile_source(data, data->tile_sources.size(), data->tile_sources.size() % 26));
+  }
+  return output;
+}
+
+// Stop swapping sources and send EOS, so the muxer can finish the file before we quit.
+gboolean on_interrupt(gpointer user_data)
+{
+  CustomData* data {static_cast<CustomData*>(user_data)};
+  std::cout << std::endl << "Interrupted, finishing the recording." << std::endl;
+  data->swap_connection.disconnect();
+  data->pipeline->send_event(Gst::EventEos::create());
+  return G_SOURCE_REMOVE;
+}
+
 int main(int argc, char** argv)
 {
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("- dynamic source")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  // The encoder takes unsigned counts
+  if (opt_threads < 0 || opt_slices < 0)
+  {
+    std::cerr << "Invalid thread or slice count, it must be 0 or more" << std::endl;
+    return EXIT_FAILURE;
+  }
+
   // Initialize gstreamermm:
   Gst::init(argc, argv);
 
+  CustomData data;
+
   // Create elements
-  source = Gst::ElementFactory::create_element("videotestsrc", "source");
-  sink = Gst::ElementFactory::create_element("autovideosink", "sink");
+  try
+  {
+    data.source_template.add("videotestsrc", "source");
+    data.source = Glib::wrap(data.source_template.create(0));
+  }
+  catch (const std::exception& ex)
+  {
+    std::cerr << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  data.sink = Gst::ElementFactory::create_element("autovideosink", "sink");
 
   // Create the empty pipeline
-  pipeline = Gst::Pipeline::create("test-pipeline");
+  data.pipeline = Gst::Pipeline::create("test-pipeline");
 
-  if (!source || !sink || !pipeline)
+  if (!data.source || !data.sink || !data.pipeline)
   {
     std::cerr << "Pipeline or one of the elements could not be created." << std::endl;
     return EXIT_FAILURE;
@@ -115,9 +301,18 @@ int main(int argc, char** argv)
   try
   {
     // add the elements to the pipeline before linking them
-    pipeline->add(source)->add(sink);
-    // Link the source and sink
-    source->link(sink);
+    data.pipeline->add(data.sink);
+    // Link the source and sink, through the tee of the recording branch when recording
+    data.source_peer = opt_record ? add_record_branch(&data) : data.sink;
+    if (opt_mosaic > 0)
+    {
+      add_mosaic(&data, opt_mosaic)->link(data.source_peer);
+    }
+    else
+    {
+      data.pipeline->add(data.source);
+      data.source->link(data.source_peer);
+    }
   }
 	catch (const std::exception& ex)
   {
@@ -126,31 +321,37 @@ int main(int argc, char** argv)
   }
 
   // Set the URI to play
-  source->set_property("pattern", 0);
+  data.source->set_property("pattern", 0);
 
   // Create the main loop.
-  mainloop = Glib::MainLoop::create();
+  data.mainloop = Glib::MainLoop::create();
+
+  // Dump an annotated graph of the pipeline on request, including the swapped sources
+  GraphSnapshot snapshot {data.pipeline};
+  snapshot.dump_on_request();
 
   // Get the bus and watch the messages
-  RefPtr<Gst::Bus> bus {pipeline->get_bus()};
-  bus->add_watch(sigc::ptr_fun(&on_bus_message));
+  RefPtr<Gst::Bus> bus {data.pipeline->get_bus()};
+  bus->add_watch(sigc::bind(sigc::ptr_fun(&on_bus_message), &data));
 
   // start play back and listen to events
-  if (pipeline->set_state(Gst::STATE_PLAYING) == Gst::STATE_CHANGE_FAILURE)
+  if (data.pipeline->set_state(Gst::STATE_PLAYING) == Gst::STATE_CHANGE_FAILURE)
   {
     std::cerr << "Unable to set the pipeline to the playing state." << std::endl;
     return EXIT_FAILURE;
   }
 
-	Glib::signal_timeout().connect(sigc::ptr_fun(&on_timeout), 1000);
+	data.swap_connection = Glib::signal_timeout().connect(sigc::bind(sigc::ptr_fun(&on_timeout), &data), 1000);
+  if (opt_record)
+    g_unix_signal_add(SIGINT, &on_interrupt, &data);
 
   // Now set the playbin to the PLAYING state and start the main loop:
   std::cout << "Running." << std::endl;
-  mainloop->run();
+  data.mainloop->run();
 
   // Clean up nicely:
   std::cout << "Returned. Stopping pipeline." << std::endl;
-  pipeline->set_state(Gst::STATE_NULL);
+  data.pipeline->set_state(Gst::STATE_NULL);
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,187 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 3: Software encoder CPU scaling benchmark
+ *
+ * Encodes a fixed number of frames at 1080p and 4K with 1..N encoder threads, using the same
+ * presets as dynamic_src's recording branch, and prints frames per second, CPU cores used and
+ * the speedup over one thread. Everything runs on the CPU.
+ *
+ *   videotestsrc num-buffers=F ! video/x-raw,... ! queue ! x264enc ! fakesink
+ *
+ * The source runs in its own thread behind the queue. Its own rate is measured first and
+ * printed as the ceiling, results close to it are limited by the source, not the encoder.
+ * Each run is timed from the state change to EOS, so the encoder's setup is included.
+ */
+
+#include <gstreamermm.h>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <sys/resource.h>
+#include "encoder_presets.h"
+
+using Glib::RefPtr;
+
+namespace
+{
+
+// Command line options
+gint opt_frames {300};
+gint opt_max_threads {0};
+gint opt_slices {0};
+gchar* opt_preset {nullptr};
+gchar* opt_resolutions {nullptr};
+
+GOptionEntry entries[] =
+{
+  { "frames", 'f', 0, G_OPTION_ARG_INT, &opt_frames, "Frames to encode per run (default 300)", "N" },
+  { "max-threads", 't', 0, G_OPTION_ARG_INT, &opt_max_threads,
+    "Highest thread count to test (default number of CPUs)", "N" },
+  { "slices", 's', 0, G_OPTION_ARG_INT, &opt_slices, "Slices per frame (default 0, encoder default)", "N" },
+  { "preset", 'p', 0, G_OPTION_ARG_STRING, &opt_preset,
+    "Encoder preset, zerolatency or throughput (default throughput)", "PRESET" },
+  { "resolutions", 'r', 0, G_OPTION_ARG_STRING, &opt_resolutions,
+    "Comma separated WIDTHxHEIGHT list (default 1920x1080,3840x2160)", "LIST" },
+  { nullptr }
+};
+
+struct Result
+{
+  double seconds {0.0};
+  double cpu_seconds {0.0};
+};
+
+double cpu_time()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// Run a pipeline until EOS and measure wall and CPU time. Encoder threads 0 runs the source only.
+bool run(int width, int height, int threads, Result& result)
+{
+  std::ostringstream description;
+  description << "videotestsrc num-buffers=" << opt_frames << " pattern=ball ! " <<
+    "video/x-raw,format=I420,width=" << width << ",height=" << height << ",framerate=60/1 ! " <<
+    "queue max-size-buffers=8 ! " << (threads > 0 ? "x264enc name=encoder ! " : "") << "fakesink sync=false";
+
+  RefPtr<Gst::Element> pipeline;
+  try
+  {
+    pipeline = Gst::Parse::launch(description.str());
+  }
+  catch (const Glib::Error& ex)
+  {
+    std::cerr << "Could not create the pipeline: " << ex.what() << std::endl;
+    return false;
+  }
+
+  if (threads > 0)
+  {
+    RefPtr<Gst::Element> encoder {RefPtr<Gst::Bin>::cast_dynamic(pipeline)->get_element("encoder")};
+    if (!configure_encoder(encoder, opt_preset ? opt_preset : "throughput", threads, opt_slices))
+    {
+      std::cerr << "Unknown encoder preset " << opt_preset << std::endl;
+      return false;
+    }
+  }
+
+  // Timed from the start, prerolling already feeds the encoder's lookahead and frame threads
+  // and the queue, a good part of the frames with many threads
+  gint64 start {g_get_monotonic_time()};
+  double cpu_start {cpu_time()};
+  pipeline->set_state(Gst::STATE_PLAYING);
+
+  RefPtr<Gst::Message> message {pipeline->get_bus()->pop(Gst::CLOCK_TIME_NONE,
+      Gst::MESSAGE_EOS | Gst::MESSAGE_ERROR)};
+  result.seconds = (g_get_monotonic_time() - start) / 1e6;
+  result.cpu_seconds = cpu_time() - cpu_start;
+  pipeline->set_state(Gst::STATE_NULL);
+
+  if (message->get_message_type() == Gst::MESSAGE_ERROR)
+  {
+    std::cerr << "Error: " << RefPtr<Gst::MessageError>::cast_static(message)->parse_error().what() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("- software encoder CPU scaling benchmark")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  // The encoder takes unsigned counts
+  if (opt_frames <= 0 || opt_max_threads < 0 || opt_slices < 0)
+  {
+    std::cerr << "Invalid frame, thread or slice count" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Initialize gstreamermm:
+  Gst::init(argc, argv);
+
+  int max_threads {opt_max_threads > 0 ? opt_max_threads : static_cast<int>(std::thread::hardware_concurrency())};
+  std::string resolutions {opt_resolutions ? opt_resolutions : "1920x1080,3840x2160"};
+
+  std::cout << "preset " << (opt_preset ? opt_preset : "throughput") << ", " << opt_frames <<
+    " frames per run" << std::endl;
+
+  std::istringstream list {resolutions};
+  std::string resolution;
+  while (std::getline(list, resolution, ','))
+  {
+    int width {0}, height {0};
+    if (sscanf(resolution.c_str(), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+    {
+      std::cerr << "Invalid resolution " << resolution << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    Result source;
+    if (!run(width, height, 0, source))
+      return EXIT_FAILURE;
+
+    std::cout << std::endl << resolution << " (source alone: " << std::fixed << std::setprecision(1) <<
+      opt_frames / source.seconds << " fps)" << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(10) << "fps" << std::setw(10) << "cores" <<
+      std::setw(10) << "speedup" << std::setw(12) << "efficiency" << std::endl;
+
+    double single_fps {0.0};
+    for (int threads = 1; threads <= max_threads; threads++)
+    {
+      Result result;
+      if (!run(width, height, threads, result))
+        return EXIT_FAILURE;
+
+      double fps {opt_frames / result.seconds};
+      if (threads == 1)
+        single_fps = fps;
+      double speedup {fps / single_fps};
+      std::cout << std::setw(8) << threads << std::setw(10) << fps <<
+        std::setw(10) << result.cpu_seconds / result.seconds << std::setw(10) << speedup <<
+        std::setw(11) << 100.0 * speedup / threads << "%" << std::endl;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
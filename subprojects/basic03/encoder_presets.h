@@ -0,0 +1,47 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 3: Software encoder presets
+ *
+ * Shared by dynamic_src's recording branch and encode_bench, so the benchmark measures the
+ * same encoder configuration that is used for recording.
+ *  - "zerolatency": no lookahead or B-frames, threads split each frame into slices
+ *    (sliced threads), every frame leaves the encoder as soon as it is encoded.
+ *  - "throughput": frame-parallel threads with lookahead and B-frames, the highest frames
+ *    per second per core at the cost of several frames of latency.
+ */
+
+#ifndef ENCODER_PRESETS_H
+#define ENCODER_PRESETS_H
+
+#include <gstreamermm.h>
+#include <string>
+
+// Apply a preset and the thread/slice counts to an x264enc. 0 threads lets x264 decide,
+// 0 slices keeps x264's default slicing. Returns false for an unknown preset.
+inline bool configure_encoder(const Glib::RefPtr<Gst::Element>& encoder, const std::string& preset,
+    guint threads, guint slices)
+{
+  GObject* object {G_OBJECT(encoder->gobj())};
+  if (preset == "zerolatency")
+  {
+    gst_util_set_object_arg(object, "tune", "zerolatency");
+    gst_util_set_object_arg(object, "speed-preset", "superfast");
+    g_object_set(object, "sliced-threads", TRUE, "rc-lookahead", 0, "b-frames", 0, nullptr);
+  }
+  else if (preset == "throughput")
+  {
+    gst_util_set_object_arg(object, "speed-preset", "veryfast");
+    g_object_set(object, "sliced-threads", FALSE, nullptr);
+  }
+  else
+  {
+    return false;
+  }
+
+  g_object_set(object, "threads", threads, nullptr);
+  if (slices > 0)
+    g_object_set(object, "option-string", ("slices=" + std::to_string(slices)).c_str(), nullptr);
+  return true;
+}
+
+#endif // ENCODER_PRESETS_H
@@ -0,0 +1,481 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 3: Pipeline graph snapshots
+ */
+
+#include "graph_snapshot.h"
+#include <glibmm/main.h>
+#include <glib-unix.h>
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <csignal>
+#include <unistd.h>
+
+namespace
+{
+
+// Entry times of buffers into elements on the current streaming thread. A small ring is
+// enough because a chain function pushes downstream before the next buffer enters.
+struct EntryTime
+{
+  GstElement* element {nullptr};
+  GstClockTime time {0};
+};
+thread_local std::array<EntryTime, 16> entry_times;
+thread_local unsigned entry_index {0};
+
+std::string object_path(GstObject* object)
+{
+  gchar* path {gst_object_get_path_string(object)};
+  std::string result {path};
+  g_free(path);
+  return result;
+}
+
+// DOT identifiers may not contain the path separators of GStreamer objects
+std::string node_id(const std::string& path)
+{
+  std::string id {path};
+  std::replace_if(id.begin(), id.end(), [] (char c) { return !g_ascii_isalnum(c); }, '_');
+  return id;
+}
+
+std::string format_byte_rate(double value)
+{
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(1);
+  if (value >= 1024.0 * 1024.0)
+    oss << value / (1024.0 * 1024.0) << " MiB/s";
+  else if (value >= 1024.0)
+    oss << value / 1024.0 << " KiB/s";
+  else
+    oss << value << " B/s";
+  return oss.str();
+}
+
+// Follow a link from a src pad through ghost and proxy pads to the element and pad that
+// actually receive the buffers. Returns a new reference to the element, or nullptr.
+GstElement* resolve_peer(GstPad* src, std::string& peer_name)
+{
+  GstPad* peer {gst_pad_get_peer(src)};
+  for (int hops = 0; peer && hops < 16; hops++)
+  {
+    if (GST_IS_GHOST_PAD(peer))
+    {
+      // Entering a bin: continue at the ghost pad's target inside it
+      GstPad* target {gst_ghost_pad_get_target(GST_GHOST_PAD(peer))};
+      gst_object_unref(peer);
+      peer = target;
+      continue;
+    }
+
+    GstObject* parent {gst_object_get_parent(GST_OBJECT(peer))};
+    if (parent && GST_IS_ELEMENT(parent))
+    {
+      peer_name = GST_OBJECT_NAME(peer);
+      gst_object_unref(peer);
+      return GST_ELEMENT(parent);
+    }
+
+    // Leaving a bin: the peer is the internal pad of a ghost src pad, continue outside
+    GstPad* outer {parent && GST_IS_GHOST_PAD(parent) ? gst_pad_get_peer(GST_PAD(parent)) : nullptr};
+    if (parent)
+      gst_object_unref(parent);
+    gst_object_unref(peer);
+    peer = outer;
+  }
+  if (peer)
+    gst_object_unref(peer);
+  return nullptr;
+}
+
+std::vector<GstElement*> sorted_children(GstBin* bin)
+{
+  std::vector<GstElement*> children;
+  GST_OBJECT_LOCK(bin);
+  for (GList* l = bin->children; l; l = l->next)
+    children.push_back(GST_ELEMENT(gst_object_ref(l->data)));
+  GST_OBJECT_UNLOCK(bin);
+  std::sort(children.begin(), children.end(), [] (GstElement* a, GstElement* b) {
+    return g_strcmp0(GST_OBJECT_NAME(a), GST_OBJECT_NAME(b)) < 0;
+  });
+  return children;
+}
+
+std::vector<GstPad*> sorted_pads(GstElement* element)
+{
+  std::vector<GstPad*> pads;
+  GST_OBJECT_LOCK(element);
+  for (GList* l = element->pads; l; l = l->next)
+    pads.push_back(GST_PAD(gst_object_ref(l->data)));
+  GST_OBJECT_UNLOCK(element);
+  std::sort(pads.begin(), pads.end(), [] (GstPad* a, GstPad* b) {
+    return g_strcmp0(GST_OBJECT_NAME(a), GST_OBJECT_NAME(b)) < 0;
+  });
+  return pads;
+}
+
+bool has_property(GstElement* element, const char* name)
+{
+  return g_object_class_find_property(G_OBJECT_GET_CLASS(element), name) != nullptr;
+}
+
+} // anonymous namespace
+
+GraphSnapshot::GraphSnapshot(const Glib::RefPtr<Gst::Pipeline>& pipeline)
+  : m_pipeline{ pipeline }
+  , m_last_time{ g_get_monotonic_time() }
+  , m_sequence{ 0 }
+  , m_signal_source{ 0 }
+{
+  GstBin* bin {GST_BIN(m_pipeline->gobj())};
+  g_signal_connect(bin, "deep-element-added", G_CALLBACK(&GraphSnapshot::on_deep_element_added), this);
+  g_signal_connect(bin, "deep-element-removed", G_CALLBACK(&GraphSnapshot::on_deep_element_removed), this);
+
+  // Watch the elements that are already in the pipeline
+  GstIterator* it {gst_bin_iterate_recurse(bin)};
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next(it, &item) == GST_ITERATOR_OK)
+  {
+    watch_element(GST_ELEMENT(g_value_get_object(&item)));
+    g_value_reset(&item);
+  }
+  g_value_unset(&item);
+  gst_iterator_free(it);
+}
+
+GraphSnapshot::~GraphSnapshot()
+{
+  if (m_signal_source)
+    g_source_remove(m_signal_source);
+  m_stdin_connection.disconnect();
+
+  g_signal_handlers_disconnect_by_data(m_pipeline->gobj(), this);
+  GstIterator* it {gst_bin_iterate_recurse(GST_BIN(m_pipeline->gobj()))};
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next(it, &item) == GST_ITERATOR_OK)
+  {
+    g_signal_handlers_disconnect_by_data(g_value_get_object(&item), this);
+    g_value_reset(&item);
+  }
+  g_value_unset(&item);
+  gst_iterator_free(it);
+
+  std::vector<PadStats*> watched;
+  {
+    std::lock_guard<std::mutex> lock {m_mutex};
+    watched.swap(m_pads);
+  }
+  for (PadStats* stats : watched)
+  {
+    // Removing the probe may free the stats
+    GstPad* pad {stats->pad};
+    gst_pad_remove_probe(pad, stats->probe_id);
+    gst_object_unref(pad);
+  }
+}
+
+void GraphSnapshot::dump_on_request()
+{
+  m_signal_source = g_unix_signal_add(SIGUSR1, [] (gpointer user_data) -> gboolean {
+    static_cast<GraphSnapshot*>(user_data)->dump();
+    return G_SOURCE_CONTINUE;
+  }, this);
+
+  m_stdin_connection = Glib::signal_io().connect([this] (Glib::IOCondition) -> bool {
+    char line[256];
+    if (read(STDIN_FILENO, line, sizeof(line)) <= 0)
+      return false;
+    dump();
+    return true;
+  }, STDIN_FILENO, Glib::IO_IN);
+
+  std::cout << "Send SIGUSR1 to pid " << getpid() << " or press Enter to dump a pipeline snapshot." << std::endl;
+}
+
+GstPadProbeReturn GraphSnapshot::on_pad_probe(GstPad*, GstPadProbeInfo* info, gpointer user_data)
+{
+  PadStats* stats {static_cast<PadStats*>(user_data)};
+  guint buffers {0};
+  gsize bytes {0};
+
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER)
+  {
+    buffers = 1;
+    bytes = gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info));
+  }
+  else if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST)
+  {
+    buffers = gst_buffer_list_length(GST_PAD_PROBE_INFO_BUFFER_LIST(info));
+    bytes = gst_buffer_list_calculate_size(GST_PAD_PROBE_INFO_BUFFER_LIST(info));
+  }
+  stats->buffers.fetch_add(buffers, std::memory_order_relaxed);
+  stats->bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+  // Processing time is the time between a buffer entering the element on a sink pad and the
+  // element pushing its result on a src pad from the same thread.
+  GstClockTime now {gst_util_get_timestamp()};
+  if (GST_PAD_IS_SINK(stats->pad))
+  {
+    entry_times[entry_index++ % entry_times.size()] = EntryTime{ stats->element, now };
+  }
+  else
+  {
+    for (EntryTime& entry : entry_times)
+    {
+      if (entry.element == stats->element)
+      {
+        stats->element_stats->process_time.fetch_add(now - entry.time, std::memory_order_relaxed);
+        stats->element_stats->processed.fetch_add(1, std::memory_order_relaxed);
+        entry.element = nullptr;
+        break;
+      }
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+void GraphSnapshot::on_deep_element_added(GstBin*, GstBin*, GstElement* element, gpointer user_data)
+{
+  static_cast<GraphSnapshot*>(user_data)->watch_element(element);
+}
+
+void GraphSnapshot::on_deep_element_removed(GstBin*, GstBin*, GstElement* element, gpointer user_data)
+{
+  static_cast<GraphSnapshot*>(user_data)->unwatch_element(element);
+}
+
+void GraphSnapshot::on_pad_added(GstElement* element, GstPad* pad, gpointer user_data)
+{
+  static_cast<GraphSnapshot*>(user_data)->watch_pad(element, pad);
+}
+
+void GraphSnapshot::watch_element(GstElement* element)
+{
+  // Bins only forward buffers between their children, those are watched directly
+  if (GST_IS_BIN(element))
+    return;
+
+  {
+    // Probes of pads already watched keep pointing to the stats, never replace them
+    std::lock_guard<std::mutex> lock {m_mutex};
+    std::shared_ptr<ElementStats>& stats {m_elements[element]};
+    if (!stats)
+      stats = std::make_shared<ElementStats>();
+  }
+
+  g_signal_connect(element, "pad-added", G_CALLBACK(&GraphSnapshot::on_pad_added), this);
+  for (GstPad* pad : sorted_pads(element))
+  {
+    watch_pad(element, pad);
+    gst_object_unref(pad);
+  }
+}
+
+void GraphSnapshot::unwatch_element(GstElement* element)
+{
+  if (GST_IS_BIN(element))
+    return;
+  g_signal_handlers_disconnect_by_data(element, this);
+
+  // Elements are freed after removal, one created later at the same address starts over
+  std::vector<PadStats*> removed;
+  {
+    std::lock_guard<std::mutex> lock {m_mutex};
+    m_elements.erase(element);
+    auto kept = std::stable_partition(m_pads.begin(), m_pads.end(),
+        [element] (PadStats* stats) { return stats->element != element; });
+    removed.assign(kept, m_pads.end());
+    m_pads.erase(kept, m_pads.end());
+  }
+  for (PadStats* stats : removed)
+  {
+    GstPad* pad {stats->pad};
+    gst_pad_remove_probe(pad, stats->probe_id);
+    gst_object_unref(pad);
+  }
+}
+
+void GraphSnapshot::watch_pad(GstElement* element, GstPad* pad)
+{
+  std::lock_guard<std::mutex> lock {m_mutex};
+  auto found = m_elements.find(element);
+  if (found == m_elements.end())
+    return;
+  for (PadStats* stats : m_pads)
+  {
+    if (stats->pad == pad)
+      return;
+  }
+
+  PadStats* stats {new PadStats};
+  stats->pad = GST_PAD(gst_object_ref(pad));
+  stats->element = element;
+  stats->element_stats = found->second;
+  stats->probe_id = gst_pad_add_probe(pad,
+      static_cast<GstPadProbeType>(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+      &GraphSnapshot::on_pad_probe, stats, [] (gpointer data) { delete static_cast<PadStats*>(data); });
+  m_pads.push_back(stats);
+}
+
+std::string GraphSnapshot::dump()
+{
+  const gchar* directory {g_getenv("GST_DEBUG_DUMP_DOT_DIR")};
+  std::ostringstream name;
+  name << (directory ? directory : ".") << G_DIR_SEPARATOR_S << "snapshot-" <<
+    std::setw(4) << std::setfill('0') << ++m_sequence;
+  std::string dot_path {name.str() + ".dot"};
+
+  gint64 now {g_get_monotonic_time()};
+  double seconds {std::max((now - m_last_time) / 1e6, 1e-6)};
+
+  std::ofstream out {dot_path};
+  if (!out)
+  {
+    std::cerr << "Could not write snapshot " << dot_path << std::endl;
+    return {};
+  }
+
+  GstState state, pending;
+  gst_element_get_state(GST_ELEMENT(m_pipeline->gobj()), &state, &pending, 0);
+
+  out << "digraph pipeline {" << std::endl;
+  out << "  // snapshot " << m_sequence << ", interval " << std::fixed << std::setprecision(3) <<
+    seconds << " s" << std::endl;
+  out << "  rankdir=LR;" << std::endl;
+  out << "  node [shape=box, style=\"filled,rounded\", fillcolor=\"#eeeeee\", fontname=\"monospace\", fontsize=10];" << std::endl;
+  out << "  edge [fontname=\"monospace\", fontsize=8];" << std::endl;
+  out << "  label=\"" << m_pipeline->get_name() << " (" << gst_element_state_get_name(state) << ")\";" << std::endl;
+
+  std::vector<std::string> edges;
+  {
+    std::lock_guard<std::mutex> lock {m_mutex};
+    write_bin(out, GST_BIN(m_pipeline->gobj()), 1, seconds, edges);
+  }
+
+  std::sort(edges.begin(), edges.end());
+  for (const std::string& edge : edges)
+    out << edge << std::endl;
+  out << "}" << std::endl;
+  out.close();
+
+  m_last_time = now;
+
+  // Render to SVG in the background when graphviz is available
+  gchar* dot {g_find_program_in_path("dot")};
+  if (dot)
+  {
+    std::string svg_path {name.str() + ".svg"};
+    gchar* argv[] {dot, const_cast<gchar*>("-Tsvg"), const_cast<gchar*>(dot_path.c_str()),
+      const_cast<gchar*>("-o"), const_cast<gchar*>(svg_path.c_str()), nullptr};
+    g_spawn_async(nullptr, argv, nullptr, G_SPAWN_DEFAULT, nullptr, nullptr, nullptr, nullptr);
+    g_free(dot);
+  }
+
+  std::cout << "Pipeline snapshot written to " << dot_path << std::endl;
+  return dot_path;
+}
+
+void GraphSnapshot::write_bin(std::ostream& out, GstBin* bin, int depth, double seconds,
+    std::vector<std::string>& edges)
+{
+  std::string indent(depth * 2, ' ');
+  for (GstElement* child : sorted_children(bin))
+  {
+    if (GST_IS_BIN(child))
+    {
+      std::string path {object_path(GST_OBJECT(child))};
+      out << indent << "subgraph cluster_" << node_id(path) << " {" << std::endl;
+      out << indent << "  label=\"" << GST_OBJECT_NAME(child) << " [" <<
+        GST_OBJECT_NAME(gst_element_get_factory(child)) << "]\";" << std::endl;
+      write_bin(out, GST_BIN(child), depth + 1, seconds, edges);
+      out << indent << "}" << std::endl;
+    }
+    else
+    {
+      write_element(out, child, depth, seconds, edges);
+    }
+    gst_object_unref(child);
+  }
+}
+
+void GraphSnapshot::write_element(std::ostream& out, GstElement* element, int depth, double seconds,
+    std::vector<std::string>& edges)
+{
+  std::string path {object_path(GST_OBJECT(element))};
+  GstElementFactory* factory {gst_element_get_factory(element)};
+
+  std::ostringstream label;
+  label << GST_OBJECT_NAME(element) << " [" << (factory ? GST_OBJECT_NAME(factory) : "?") << "]";
+
+  // Average time spent between entering the element and leaving it downstream
+  auto element_stats = m_elements.find(element);
+  if (element_stats != m_elements.end() && element_stats->second->processed > 0)
+  {
+    label << "\\lavg process " << std::fixed << std::setprecision(1) <<
+      element_stats->second->process_time / 1000.0 / element_stats->second->processed << " us";
+  }
+
+  // Fill level of queue-like elements
+  if (has_property(element, "current-level-buffers") && has_property(element, "max-size-buffers"))
+  {
+    guint level_buffers {0}, max_buffers {0}, level_bytes {0}, max_bytes {0};
+    guint64 level_time {0}, max_time {0};
+    g_object_get(element, "current-level-buffers", &level_buffers, "max-size-buffers", &max_buffers,
+        "current-level-bytes", &level_bytes, "max-size-bytes", &max_bytes,
+        "current-level-time", &level_time, "max-size-time", &max_time, nullptr);
+    label << "\\lqueue " << level_buffers << "/" << max_buffers << " buffers, " <<
+      level_bytes << "/" << max_bytes << " bytes, " <<
+      level_time / GST_MSECOND << "/" << max_time / GST_MSECOND << " ms";
+  }
+
+  std::map<GstPad*, PadStats*> pad_stats;
+  for (PadStats* stats : m_pads)
+    pad_stats[stats->pad] = stats;
+
+  for (GstPad* pad : sorted_pads(element))
+  {
+    auto found = pad_stats.find(pad);
+    if (found != pad_stats.end())
+    {
+      Sample current {found->second->buffers.load(), found->second->bytes.load()};
+      Sample& last {found->second->last};
+      label << "\\l" << GST_OBJECT_NAME(pad) << ": " <<
+        std::fixed << std::setprecision(1) << (current.buffers - last.buffers) / seconds << " buf/s, " <<
+        format_byte_rate((current.bytes - last.bytes) / seconds);
+      last = current;
+    }
+
+    // Describe each link once, from its src pad, with the negotiated caps
+    std::string peer_name;
+    GstElement* peer_element {GST_PAD_IS_SRC(pad) ? resolve_peer(pad, peer_name) : nullptr};
+    if (peer_element)
+    {
+      GstCaps* caps {gst_pad_get_current_caps(pad)};
+      gchar* caps_str {caps ? gst_caps_to_string(caps) : g_strdup("not negotiated")};
+      std::string caps_label {caps_str};
+      std::replace(caps_label.begin(), caps_label.end(), '"', '\'');
+      for (std::string::size_type pos = 0; (pos = caps_label.find(", ", pos)) != std::string::npos; )
+        caps_label.replace(pos, 2, "\\l");
+
+      std::ostringstream edge;
+      edge << "  " << node_id(path) << " -> " << node_id(object_path(GST_OBJECT(peer_element))) <<
+        " [taillabel=\"" << GST_OBJECT_NAME(pad) << "\", headlabel=\"" << peer_name <<
+        "\", label=\"" << caps_label << "\\l\"];";
+      edges.push_back(edge.str());
+
+      g_free(caps_str);
+      if (caps)
+        gst_caps_unref(caps);
+      gst_object_unref(peer_element);
+    }
+    gst_object_unref(pad);
+  }
+
+  out << std::string(depth * 2, ' ') << node_id(path) << " [label=\"" << label.str() << "\\l\"];" << std::endl;
+}
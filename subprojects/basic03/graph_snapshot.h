@@ -0,0 +1,89 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 3: Pipeline graph snapshots
+ *
+ * Dumps the current topology of a pipeline as a DOT graph (and SVG when graphviz is
+ * installed), annotated with live counters gathered by pad probes: buffers/s and bytes/s
+ * per pad, average processing time per element, queue fill levels and negotiated caps.
+ * Nodes are named after the element paths and written in sorted order, so consecutive
+ * snapshots can be compared with diff.
+ */
+
+#ifndef GRAPH_SNAPSHOT_H
+#define GRAPH_SNAPSHOT_H
+
+#include <gstreamermm.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class GraphSnapshot
+{
+public:
+  explicit GraphSnapshot(const Glib::RefPtr<Gst::Pipeline>& pipeline);
+  ~GraphSnapshot();
+
+  GraphSnapshot(const GraphSnapshot&) = delete;
+  GraphSnapshot& operator=(const GraphSnapshot&) = delete;
+
+  // Write the next snapshot and return the path of the DOT file.
+  std::string dump();
+
+  // Dump a snapshot on SIGUSR1 and whenever a line is entered on stdin.
+  void dump_on_request();
+
+private:
+  struct ElementStats
+  {
+    std::atomic<guint64> process_time {0};
+    std::atomic<guint64> processed {0};
+  };
+
+  // Counter values of a pad at the previous snapshot
+  struct Sample
+  {
+    guint64 buffers {0};
+    guint64 bytes {0};
+  };
+
+  // Owned by the pad probe, freed once the probe is removed and no longer running
+  struct PadStats
+  {
+    GstPad* pad {nullptr};
+    gulong probe_id {0};
+    GstElement* element {nullptr};
+    std::shared_ptr<ElementStats> element_stats;
+    std::atomic<guint64> buffers {0};
+    std::atomic<guint64> bytes {0};
+    Sample last;
+  };
+
+  static GstPadProbeReturn on_pad_probe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+  static void on_deep_element_added(GstBin* bin, GstBin* sub_bin, GstElement* element, gpointer user_data);
+  static void on_deep_element_removed(GstBin* bin, GstBin* sub_bin, GstElement* element, gpointer user_data);
+  static void on_pad_added(GstElement* element, GstPad* pad, gpointer user_data);
+
+  void watch_element(GstElement* element);
+  void unwatch_element(GstElement* element);
+  void watch_pad(GstElement* element, GstPad* pad);
+
+  void write_bin(std::ostream& out, GstBin* bin, int depth, double seconds,
+      std::vector<std::string>& edges);
+  void write_element(std::ostream& out, GstElement* element, int depth, double seconds,
+      std::vector<std::string>& edges);
+
+private:
+  Glib::RefPtr<Gst::Pipeline> m_pipeline;
+  std::mutex m_mutex;
+  std::vector<PadStats*> m_pads;
+  std::map<GstElement*, std::shared_ptr<ElementStats>> m_elements;
+  gint64 m_last_time;
+  guint m_sequence;
+  guint m_signal_source;
+  sigc::connection m_stdin_connection;
+};
+
+#endif // GRAPH_SNAPSHOT_H
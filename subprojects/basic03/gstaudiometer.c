@@ -0,0 +1,604 @@
+/* GStreamer
+ *
+ * Supplement to Basic Tutorial 3: audio level and loudness meter
+ *
+ * The loudness follows EBU R128 / ITU-R BS.1770: every channel goes through the K-weighting
+ * filter (a high shelf followed by the RLB high pass, coefficients computed for the actual
+ * rate as libebur128 does), the weighted mean square is collected in 100 ms sub-blocks, and
+ * momentary and short-term loudness are the mean over the last 4 and 30 sub-blocks. LFE is
+ * ignored and surround channels are weighted with 1.41.
+ *
+ * The filters are recursive, so instead of vectorizing over time the AVX2 kernel runs four
+ * channels side by side in double precision, keeping their filter state in registers for the
+ * whole buffer. Layouts with fewer than four channels, the remaining channels and CPUs
+ * without AVX2 use the scalar kernel. The element works in place and passes buffers through
+ * unmodified, it never needs a writable buffer.
+ */
+
+#include "gstaudiometer.h"
+
+#include <math.h>
+#include <string.h>
+#include <gst/audio/audio.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AUDIO_METER_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+GST_DEBUG_CATEGORY_STATIC (gst_audio_meter_debug);
+#define GST_CAT_DEFAULT gst_audio_meter_debug
+
+#define DEFAULT_INTERVAL (100 * GST_MSECOND)
+#define DEFAULT_POST_MESSAGES TRUE
+#define DEFAULT_SIMD TRUE
+
+/* 100 ms sub-blocks: momentary is 400 ms, short-term 3 s */
+#define MOMENTARY_BLOCKS 4
+#define SHORT_TERM_BLOCKS 30
+
+/* Reported instead of minus infinity for silence */
+#define FLOOR_DB -120.0
+
+enum
+{
+  PROP_0,
+  PROP_INTERVAL,
+  PROP_POST_MESSAGES,
+  PROP_SIMD
+};
+
+typedef struct
+{
+  gdouble b0, b1, b2, a1, a2;
+} GstAudioMeterBiquad;
+
+struct _GstAudioMeter
+{
+  GstBaseTransform parent;
+
+  /* properties */
+  guint64 interval;
+  gboolean post_messages;
+  gboolean simd;
+
+  GstAudioInfo info;
+  void (*process) (GstAudioMeter * self, const gfloat * data, guint frames);
+  GstAudioMeterBiquad shelf;
+  GstAudioMeterBiquad highpass;
+
+  /* per channel, one array each so that four neighbours load as a vector */
+  gdouble *memory;
+  gdouble *z[4];                /* shelf z1, z2, high pass z1, z2 */
+  gdouble *weight;
+  gdouble *peak;
+  gdouble *square_sum;
+  gdouble *block_sum;
+
+  guint block_frames;
+  guint block_pos;
+  gdouble blocks[SHORT_TERM_BLOCKS];
+  guint block_index;
+  guint block_count;
+
+  guint64 interval_frames;
+  guint64 interval_pos;
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("audio/x-raw, format = (string) " GST_AUDIO_NE (F32) ", "
+        "layout = (string) interleaved, rate = (int) [ 1, MAX ], "
+        "channels = (int) [ 1, MAX ]"));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("audio/x-raw, format = (string) " GST_AUDIO_NE (F32) ", "
+        "layout = (string) interleaved, rate = (int) [ 1, MAX ], "
+        "channels = (int) [ 1, MAX ]"));
+
+#define gst_audio_meter_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE (GstAudioMeter, gst_audio_meter,
+    GST_TYPE_BASE_TRANSFORM,
+    GST_DEBUG_CATEGORY_INIT (gst_audio_meter_debug, "audiometer", 0,
+        "audio level and loudness meter"));
+
+static void gst_audio_meter_finalize (GObject * object);
+static void gst_audio_meter_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_audio_meter_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static gboolean gst_audio_meter_set_caps (GstBaseTransform * trans,
+    GstCaps * incaps, GstCaps * outcaps);
+static gboolean gst_audio_meter_start (GstBaseTransform * trans);
+static GstFlowReturn gst_audio_meter_transform_ip (GstBaseTransform * trans,
+    GstBuffer * buffer);
+
+static void
+gst_audio_meter_class_init (GstAudioMeterClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseTransformClass *trans_class = GST_BASE_TRANSFORM_CLASS (klass);
+
+  gobject_class->finalize = gst_audio_meter_finalize;
+  gobject_class->set_property = gst_audio_meter_set_property;
+  gobject_class->get_property = gst_audio_meter_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_INTERVAL,
+      g_param_spec_uint64 ("interval", "Interval",
+          "Interval of time between message posts (in nanoseconds)",
+          GST_MSECOND, G_MAXUINT64, DEFAULT_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_POST_MESSAGES,
+      g_param_spec_boolean ("post-messages", "Post Messages",
+          "Post an audiometer element message every interval",
+          DEFAULT_POST_MESSAGES, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_SIMD,
+      g_param_spec_boolean ("simd", "SIMD",
+          "Use the AVX2 kernel when the CPU supports it", DEFAULT_SIMD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  gst_element_class_add_static_pad_template (element_class, &sink_template);
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+  gst_element_class_set_static_metadata (element_class, "Audio Meter",
+      "Filter/Analyzer/Audio",
+      "Peak, RMS and EBU R128 loudness of interleaved float audio",
+      "gst-tutorial");
+
+  trans_class->set_caps = GST_DEBUG_FUNCPTR (gst_audio_meter_set_caps);
+  trans_class->start = GST_DEBUG_FUNCPTR (gst_audio_meter_start);
+  trans_class->transform_ip = GST_DEBUG_FUNCPTR (gst_audio_meter_transform_ip);
+  trans_class->passthrough_on_same_caps = TRUE;
+  trans_class->transform_ip_on_passthrough = TRUE;
+}
+
+static void
+gst_audio_meter_init (GstAudioMeter * self)
+{
+  self->interval = DEFAULT_INTERVAL;
+  self->post_messages = DEFAULT_POST_MESSAGES;
+  self->simd = DEFAULT_SIMD;
+  gst_audio_info_init (&self->info);
+}
+
+static void
+gst_audio_meter_finalize (GObject * object)
+{
+  GstAudioMeter *self = GST_AUDIO_METER (object);
+
+  g_free (self->memory);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_audio_meter_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstAudioMeter *self = GST_AUDIO_METER (object);
+
+  GST_OBJECT_LOCK (self);
+  switch (prop_id) {
+    case PROP_INTERVAL:
+      self->interval = g_value_get_uint64 (value);
+      if (GST_AUDIO_INFO_RATE (&self->info))
+        self->interval_frames = MAX (1, gst_util_uint64_scale_round
+            (self->interval, GST_AUDIO_INFO_RATE (&self->info), GST_SECOND));
+      break;
+    case PROP_POST_MESSAGES:
+      self->post_messages = g_value_get_boolean (value);
+      break;
+    case PROP_SIMD:
+      self->simd = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+gst_audio_meter_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstAudioMeter *self = GST_AUDIO_METER (object);
+
+  switch (prop_id) {
+    case PROP_INTERVAL:
+      g_value_set_uint64 (value, self->interval);
+      break;
+    case PROP_POST_MESSAGES:
+      g_value_set_boolean (value, self->post_messages);
+      break;
+    case PROP_SIMD:
+      g_value_set_boolean (value, self->simd);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+/* K-weighting filters for any sample rate, as computed by libebur128 */
+static void
+gst_audio_meter_init_filters (GstAudioMeter * self, gdouble rate)
+{
+  gdouble f0, gain, q, k, vh, vb, a0;
+
+  f0 = 1681.974450955533;
+  gain = 3.999843853973347;
+  q = 0.7071752369554196;
+  k = tan (G_PI * f0 / rate);
+  vh = pow (10.0, gain / 20.0);
+  vb = pow (vh, 0.4996667741545416);
+  a0 = 1.0 + k / q + k * k;
+  self->shelf.b0 = (vh + vb * k / q + k * k) / a0;
+  self->shelf.b1 = 2.0 * (k * k - vh) / a0;
+  self->shelf.b2 = (vh - vb * k / q + k * k) / a0;
+  self->shelf.a1 = 2.0 * (k * k - 1.0) / a0;
+  self->shelf.a2 = (1.0 - k / q + k * k) / a0;
+
+  f0 = 38.13547087602444;
+  q = 0.5003270373238773;
+  k = tan (G_PI * f0 / rate);
+  a0 = 1.0 + k / q + k * k;
+  self->highpass.b0 = 1.0;
+  self->highpass.b1 = -2.0;
+  self->highpass.b2 = 1.0;
+  self->highpass.a1 = 2.0 * (k * k - 1.0) / a0;
+  self->highpass.a2 = (1.0 - k / q + k * k) / a0;
+}
+
+static gdouble
+gst_audio_meter_channel_weight (GstAudioChannelPosition position)
+{
+  switch (position) {
+    case GST_AUDIO_CHANNEL_POSITION_LFE1:
+    case GST_AUDIO_CHANNEL_POSITION_LFE2:
+      return 0.0;
+    case GST_AUDIO_CHANNEL_POSITION_REAR_LEFT:
+    case GST_AUDIO_CHANNEL_POSITION_REAR_RIGHT:
+    case GST_AUDIO_CHANNEL_POSITION_SIDE_LEFT:
+    case GST_AUDIO_CHANNEL_POSITION_SIDE_RIGHT:
+      return 1.41;
+    default:
+      return 1.0;
+  }
+}
+
+/* One channel at a time, direct form II transposed biquads */
+static void
+gst_audio_meter_process_channel (GstAudioMeter * self, const gfloat * data,
+    guint frames, guint channel)
+{
+  const GstAudioMeterBiquad *s = &self->shelf, *h = &self->highpass;
+  guint channels = GST_AUDIO_INFO_CHANNELS (&self->info);
+  gdouble z0 = self->z[0][channel], z1 = self->z[1][channel];
+  gdouble z2 = self->z[2][channel], z3 = self->z[3][channel];
+  gdouble peak = self->peak[channel];
+  gdouble square_sum = 0.0, block_sum = 0.0;
+  guint i;
+
+  data += channel;
+  for (i = 0; i < frames; i++, data += channels) {
+    gdouble x = *data, y1, y2;
+
+    peak = MAX (peak, fabs (x));
+    square_sum += x * x;
+
+    y1 = s->b0 * x + z0;
+    z0 = s->b1 * x - s->a1 * y1 + z1;
+    z1 = s->b2 * x - s->a2 * y1;
+    y2 = h->b0 * y1 + z2;
+    z2 = h->b1 * y1 - h->a1 * y2 + z3;
+    z3 = h->b2 * y1 - h->a2 * y2;
+    block_sum += y2 * y2;
+  }
+
+  self->z[0][channel] = z0;
+  self->z[1][channel] = z1;
+  self->z[2][channel] = z2;
+  self->z[3][channel] = z3;
+  self->peak[channel] = peak;
+  self->square_sum[channel] += square_sum;
+  self->block_sum[channel] += block_sum;
+}
+
+static void
+gst_audio_meter_process_scalar (GstAudioMeter * self, const gfloat * data,
+    guint frames)
+{
+  guint c;
+
+  for (c = 0; c < GST_AUDIO_INFO_CHANNELS (&self->info); c++)
+    gst_audio_meter_process_channel (self, data, frames, c);
+}
+
+#ifdef AUDIO_METER_HAVE_AVX2
+/* Four channels per vector, the same arithmetic as the scalar kernel */
+__attribute__ ((target ("avx2")))
+static void
+gst_audio_meter_process_avx2 (GstAudioMeter * self, const gfloat * data,
+    guint frames)
+{
+  const GstAudioMeterBiquad *s = &self->shelf, *h = &self->highpass;
+  guint channels = GST_AUDIO_INFO_CHANNELS (&self->info);
+  const __m256d sign = _mm256_set1_pd (-0.0);
+  const __m256d sb0 = _mm256_set1_pd (s->b0), sb1 = _mm256_set1_pd (s->b1);
+  const __m256d sb2 = _mm256_set1_pd (s->b2), sa1 = _mm256_set1_pd (s->a1);
+  const __m256d sa2 = _mm256_set1_pd (s->a2);
+  const __m256d hb0 = _mm256_set1_pd (h->b0), hb1 = _mm256_set1_pd (h->b1);
+  const __m256d hb2 = _mm256_set1_pd (h->b2), ha1 = _mm256_set1_pd (h->a1);
+  const __m256d ha2 = _mm256_set1_pd (h->a2);
+  guint c, i;
+
+  for (c = 0; c + 4 <= channels; c += 4) {
+    __m256d z0 = _mm256_loadu_pd (self->z[0] + c);
+    __m256d z1 = _mm256_loadu_pd (self->z[1] + c);
+    __m256d z2 = _mm256_loadu_pd (self->z[2] + c);
+    __m256d z3 = _mm256_loadu_pd (self->z[3] + c);
+    __m256d peak = _mm256_loadu_pd (self->peak + c);
+    __m256d square_sum = _mm256_setzero_pd ();
+    __m256d block_sum = _mm256_setzero_pd ();
+    const gfloat *frame = data + c;
+
+    for (i = 0; i < frames; i++, frame += channels) {
+      __m256d x = _mm256_cvtps_pd (_mm_loadu_ps (frame));
+      __m256d y1, y2;
+
+      peak = _mm256_max_pd (peak, _mm256_andnot_pd (sign, x));
+      square_sum = _mm256_add_pd (square_sum, _mm256_mul_pd (x, x));
+
+      y1 = _mm256_add_pd (_mm256_mul_pd (sb0, x), z0);
+      z0 = _mm256_add_pd (_mm256_sub_pd (_mm256_mul_pd (sb1, x),
+              _mm256_mul_pd (sa1, y1)), z1);
+      z1 = _mm256_sub_pd (_mm256_mul_pd (sb2, x), _mm256_mul_pd (sa2, y1));
+      y2 = _mm256_add_pd (_mm256_mul_pd (hb0, y1), z2);
+      z2 = _mm256_add_pd (_mm256_sub_pd (_mm256_mul_pd (hb1, y1),
+              _mm256_mul_pd (ha1, y2)), z3);
+      z3 = _mm256_sub_pd (_mm256_mul_pd (hb2, y1), _mm256_mul_pd (ha2, y2));
+      block_sum = _mm256_add_pd (block_sum, _mm256_mul_pd (y2, y2));
+    }
+
+    _mm256_storeu_pd (self->z[0] + c, z0);
+    _mm256_storeu_pd (self->z[1] + c, z1);
+    _mm256_storeu_pd (self->z[2] + c, z2);
+    _mm256_storeu_pd (self->z[3] + c, z3);
+    _mm256_storeu_pd (self->peak + c, peak);
+    _mm256_storeu_pd (self->square_sum + c, _mm256_add_pd (square_sum,
+            _mm256_loadu_pd (self->square_sum + c)));
+    _mm256_storeu_pd (self->block_sum + c, _mm256_add_pd (block_sum,
+            _mm256_loadu_pd (self->block_sum + c)));
+  }
+
+  for (; c < channels; c++)
+    gst_audio_meter_process_channel (self, data, frames, c);
+}
+#endif
+
+static void
+gst_audio_meter_reset (GstAudioMeter * self)
+{
+  guint channels = GST_AUDIO_INFO_CHANNELS (&self->info);
+
+  if (self->memory)
+    memset (self->memory, 0, sizeof (gdouble) * 4 * channels);
+  if (self->peak) {
+    memset (self->peak, 0, sizeof (gdouble) * channels);
+    memset (self->square_sum, 0, sizeof (gdouble) * channels);
+    memset (self->block_sum, 0, sizeof (gdouble) * channels);
+  }
+  self->block_pos = 0;
+  self->block_index = 0;
+  self->block_count = 0;
+  self->interval_pos = 0;
+}
+
+static gboolean
+gst_audio_meter_set_caps (GstBaseTransform * trans, GstCaps * incaps,
+    GstCaps * outcaps)
+{
+  GstAudioMeter *self = GST_AUDIO_METER (trans);
+  guint channels, rate, c;
+
+  if (!gst_audio_info_from_caps (&self->info, incaps))
+    return FALSE;
+  channels = GST_AUDIO_INFO_CHANNELS (&self->info);
+  rate = GST_AUDIO_INFO_RATE (&self->info);
+
+  g_free (self->memory);
+  self->memory = g_new0 (gdouble, 8 * channels);
+  self->z[0] = self->memory;
+  self->z[1] = self->memory + channels;
+  self->z[2] = self->memory + 2 * channels;
+  self->z[3] = self->memory + 3 * channels;
+  self->peak = self->memory + 4 * channels;
+  self->square_sum = self->memory + 5 * channels;
+  self->block_sum = self->memory + 6 * channels;
+  self->weight = self->memory + 7 * channels;
+
+  for (c = 0; c < channels; c++)
+    self->weight[c] = GST_AUDIO_INFO_IS_UNPOSITIONED (&self->info) ? 1.0 :
+        gst_audio_meter_channel_weight (GST_AUDIO_INFO_POSITION (&self->info,
+            c));
+
+  gst_audio_meter_init_filters (self, rate);
+  self->block_frames = MAX (1, rate / 10);
+  GST_OBJECT_LOCK (self);
+  self->interval_frames = MAX (1, gst_util_uint64_scale_round (self->interval,
+          rate, GST_SECOND));
+  GST_OBJECT_UNLOCK (self);
+  gst_audio_meter_reset (self);
+
+  self->process = gst_audio_meter_process_scalar;
+#ifdef AUDIO_METER_HAVE_AVX2
+  if (self->simd && channels >= 4 && __builtin_cpu_supports ("avx2"))
+    self->process = gst_audio_meter_process_avx2;
+#endif
+
+  GST_DEBUG_OBJECT (self, "%u channels at %u Hz, %s kernel", channels, rate,
+      self->process == gst_audio_meter_process_scalar ? "scalar" : "AVX2");
+  return TRUE;
+}
+
+static gboolean
+gst_audio_meter_start (GstBaseTransform * trans)
+{
+  gst_audio_meter_reset (GST_AUDIO_METER (trans));
+  return TRUE;
+}
+
+/* The weighted mean square of the last 100 ms goes into the sub-block ring */
+static void
+gst_audio_meter_end_block (GstAudioMeter * self)
+{
+  guint channels = GST_AUDIO_INFO_CHANNELS (&self->info);
+  gdouble sum = 0.0;
+  guint c, i;
+
+  for (c = 0; c < channels; c++) {
+    sum += self->weight[c] * self->block_sum[c];
+    self->block_sum[c] = 0.0;
+
+    /* Decaying filter state would turn denormal in silence, which is very slow */
+    for (i = 0; i < 4; i++)
+      if (fabs (self->z[i][c]) < 1e-30)
+        self->z[i][c] = 0.0;
+  }
+
+  self->blocks[self->block_index] = sum / self->block_frames;
+  self->block_index = (self->block_index + 1) % SHORT_TERM_BLOCKS;
+  self->block_count = MIN (self->block_count + 1, SHORT_TERM_BLOCKS);
+  self->block_pos = 0;
+}
+
+static gdouble
+gst_audio_meter_loudness (GstAudioMeter * self, guint blocks)
+{
+  gdouble sum = 0.0;
+  guint i;
+
+  if (self->block_count < blocks)
+    return FLOOR_DB;
+
+  for (i = 1; i <= blocks; i++)
+    sum += self->blocks[(self->block_index + SHORT_TERM_BLOCKS - i)
+        % SHORT_TERM_BLOCKS];
+  sum /= blocks;
+
+  return sum > 0.0 ? MAX (FLOOR_DB, -0.691 + 10.0 * log10 (sum)) : FLOOR_DB;
+}
+
+static void
+gst_audio_meter_append_db (GValue * array, gdouble db)
+{
+  GValue value = G_VALUE_INIT;
+
+  g_value_init (&value, G_TYPE_DOUBLE);
+  g_value_set_double (&value, MAX (FLOOR_DB, db));
+  gst_value_array_append_value (array, &value);
+  g_value_unset (&value);
+}
+
+static void
+gst_audio_meter_post (GstAudioMeter * self, GstClockTime timestamp)
+{
+  guint channels = GST_AUDIO_INFO_CHANNELS (&self->info);
+  GValue peak = G_VALUE_INIT, rms = G_VALUE_INIT;
+  GstStructure *s;
+  guint c;
+
+  g_value_init (&peak, GST_TYPE_ARRAY);
+  g_value_init (&rms, GST_TYPE_ARRAY);
+  for (c = 0; c < channels; c++) {
+    gdouble mean_square = self->square_sum[c] / self->interval_pos;
+
+    gst_audio_meter_append_db (&peak, self->peak[c] > 0.0 ?
+        20.0 * log10 (self->peak[c]) : FLOOR_DB);
+    gst_audio_meter_append_db (&rms, mean_square > 0.0 ?
+        10.0 * log10 (mean_square) : FLOOR_DB);
+    self->peak[c] = 0.0;
+    self->square_sum[c] = 0.0;
+  }
+
+  s = gst_structure_new ("audiometer",
+      "timestamp", G_TYPE_UINT64, timestamp,
+      "momentary", G_TYPE_DOUBLE,
+      gst_audio_meter_loudness (self, MOMENTARY_BLOCKS),
+      "short-term", G_TYPE_DOUBLE,
+      gst_audio_meter_loudness (self, SHORT_TERM_BLOCKS), NULL);
+  gst_structure_take_value (s, "peak", &peak);
+  gst_structure_take_value (s, "rms", &rms);
+
+  gst_element_post_message (GST_ELEMENT (self),
+      gst_message_new_element (GST_OBJECT (self), s));
+}
+
+static GstFlowReturn
+gst_audio_meter_transform_ip (GstBaseTransform * trans, GstBuffer * buffer)
+{
+  GstAudioMeter *self = GST_AUDIO_METER (trans);
+  guint channels = GST_AUDIO_INFO_CHANNELS (&self->info);
+  guint rate = GST_AUDIO_INFO_RATE (&self->info);
+  GstClockTime pts = GST_BUFFER_PTS (buffer);
+  guint64 interval_frames, done = 0;
+  gboolean post_messages;
+  const gfloat *data;
+  GstMapInfo map;
+  guint frames;
+
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ))
+    return GST_FLOW_ERROR;
+
+  GST_OBJECT_LOCK (self);
+  interval_frames = self->interval_frames;
+  post_messages = self->post_messages;
+  GST_OBJECT_UNLOCK (self);
+
+  data = (const gfloat *) map.data;
+  frames = map.size / GST_AUDIO_INFO_BPF (&self->info);
+
+  /* Split the buffer at sub-block and interval boundaries */
+  while (frames > 0) {
+    guint n = MIN (frames, self->block_frames - self->block_pos);
+
+    if (self->interval_pos < interval_frames)
+      n = MIN (n, interval_frames - self->interval_pos);
+
+    self->process (self, data, n);
+    data += n * channels;
+    frames -= n;
+    done += n;
+    self->block_pos += n;
+    self->interval_pos += n;
+
+    if (self->block_pos == self->block_frames)
+      gst_audio_meter_end_block (self);
+
+    if (self->interval_pos >= interval_frames) {
+      if (post_messages)
+        gst_audio_meter_post (self, GST_CLOCK_TIME_IS_VALID (pts) ?
+            pts + gst_util_uint64_scale_int (done, GST_SECOND, rate) :
+            GST_CLOCK_TIME_NONE);
+      else {
+        memset (self->peak, 0, sizeof (gdouble) * channels);
+        memset (self->square_sum, 0, sizeof (gdouble) * channels);
+      }
+      self->interval_pos = 0;
+    }
+  }
+
+  gst_buffer_unmap (buffer, &map);
+  return GST_FLOW_OK;
+}
+
+gboolean
+gst_audio_meter_register (void)
+{
+  return gst_element_register (NULL, "audiometer", GST_RANK_NONE,
+      GST_TYPE_AUDIO_METER);
+}
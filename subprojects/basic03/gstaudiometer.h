@@ -0,0 +1,28 @@
+/* GStreamer
+ *
+ * Supplement to Basic Tutorial 3: audio level and loudness meter
+ *
+ * audiometer is an in-place passthrough for interleaved F32 audio. It measures the peak and
+ * RMS level of every channel and the EBU R128 momentary (400 ms) and short-term (3 s)
+ * loudness, and posts them as one "audiometer" element message per interval instead of one
+ * per buffer.
+ *
+ * The element is registered by the application with gst_audio_meter_register().
+ */
+
+#ifndef __GST_AUDIO_METER_H__
+#define __GST_AUDIO_METER_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_AUDIO_METER (gst_audio_meter_get_type ())
+G_DECLARE_FINAL_TYPE (GstAudioMeter, gst_audio_meter, GST, AUDIO_METER, GstBaseTransform)
+
+gboolean gst_audio_meter_register (void);
+
+G_END_DECLS
+
+#endif /* __GST_AUDIO_METER_H__ */
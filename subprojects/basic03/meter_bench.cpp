@@ -0,0 +1,174 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 3: audiometer versus level benchmark
+ *
+ * Runs the same multichannel F32 stream through identity, level, and audiometer with the
+ * scalar and the AVX2 kernel, all posting messages every 100 ms, and prints the cost of each
+ * analysis stage per second of audio, net of the identity baseline.
+ *
+ *   audiotestsrc num-buffers=N ! audio/x-raw,format=F32LE,channels=C ! <stage> ! fakesink
+ */
+
+#include <gstreamermm.h>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <sys/resource.h>
+#include "gstaudiometer.h"
+
+using Glib::RefPtr;
+
+namespace
+{
+
+// Command line options
+gint opt_channels {8};
+gint opt_rate {48000};
+gint opt_seconds {600};
+gint opt_samples {1024};
+gint opt_runs {3};
+
+GOptionEntry entries[] =
+{
+  { "channels", 'c', 0, G_OPTION_ARG_INT, &opt_channels, "Channels, up to 8 (default 8)", "N" },
+  { "rate", 'r', 0, G_OPTION_ARG_INT, &opt_rate, "Sample rate (default 48000)", "HZ" },
+  { "seconds", 's', 0, G_OPTION_ARG_INT, &opt_seconds, "Seconds of audio per run (default 600)", "S" },
+  { "samples", 'b', 0, G_OPTION_ARG_INT, &opt_samples, "Samples per buffer (default 1024)", "N" },
+  { "runs", 'n', 0, G_OPTION_ARG_INT, &opt_runs, "Runs per stage, the fastest is reported (default 3)", "N" },
+  { nullptr }
+};
+
+struct Stage
+{
+  const char* name;
+  const char* description;
+};
+
+double cpu_time()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// Standard layouts above stereo, so both elements weight and name the channels the same way
+std::string channel_mask(int channels)
+{
+  static const char* masks[] = {"0x7", "0x33", "0x37", "0x3f", "0x13f", "0xc3f"};
+  return channels > 2 ? std::string(",channel-mask=(bitmask)") + masks[channels - 3] : std::string();
+}
+
+// Run the stage on the test stream and return the CPU seconds it took, or a negative value
+double run(const Stage& stage)
+{
+  // The source is cheap and the same for every stage, a sine with one sin() per sample
+  std::ostringstream description;
+  description << "audiotestsrc num-buffers=" << (gint64(opt_seconds) * opt_rate / opt_samples) <<
+    " samplesperbuffer=" << opt_samples << " wave=sine ! audio/x-raw,format=F32LE,layout=interleaved,rate=" <<
+    opt_rate << ",channels=" << opt_channels << channel_mask(opt_channels) <<
+    " ! " << stage.description << " ! fakesink sync=false";
+
+  RefPtr<Gst::Element> pipeline;
+  try
+  {
+    pipeline = Gst::Parse::launch(description.str());
+  }
+  catch (const Glib::Error& ex)
+  {
+    std::cerr << "Could not create the pipeline: " << ex.what() << std::endl;
+    return -1.0;
+  }
+
+  // Drain the messages of the stage as an application would, without printing them
+  RefPtr<Gst::Bus> bus {pipeline->get_bus()};
+  double start {cpu_time()};
+  pipeline->set_state(Gst::STATE_PLAYING);
+
+  RefPtr<Gst::Message> message;
+  do
+  {
+    message = bus->pop(Gst::CLOCK_TIME_NONE, Gst::MESSAGE_EOS | Gst::MESSAGE_ERROR | Gst::MESSAGE_ELEMENT);
+  } while (message->get_message_type() == Gst::MESSAGE_ELEMENT);
+
+  double seconds {cpu_time() - start};
+  pipeline->set_state(Gst::STATE_NULL);
+
+  if (message->get_message_type() == Gst::MESSAGE_ERROR)
+  {
+    std::cerr << "Error: " << RefPtr<Gst::MessageError>::cast_static(message)->parse_error().what() << std::endl;
+    return -1.0;
+  }
+  return seconds;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("- audiometer versus level benchmark")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  if (opt_channels < 1 || opt_channels > 8)
+  {
+    std::cerr << "Channels must be between 1 and 8" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Initialize gstreamermm and register our element
+  Gst::init(argc, argv);
+  gst_audio_meter_register();
+
+  std::vector<Stage> stages {
+    {"identity", "identity"},
+    {"level", "level interval=100000000 post-messages=true"},
+    {"audiometer scalar", "audiometer interval=100000000 simd=false"},
+    {"audiometer AVX2", "audiometer interval=100000000 simd=true"}
+  };
+
+  std::cout << opt_seconds << " s of " << opt_channels << " channel F32 at " << opt_rate << " Hz, " <<
+    opt_samples << " samples per buffer, best of " << opt_runs << std::endl;
+  std::cout << std::setw(20) << "stage" << std::setw(12) << "CPU s" << std::setw(14) << "net ms/s" <<
+    std::setw(14) << "ns/frame" << std::setw(12) << "realtime" << std::endl;
+
+  double baseline {0.0};
+  for (const Stage& stage : stages)
+  {
+    double best {-1.0};
+    for (int i = 0; i < opt_runs; i++)
+    {
+      double seconds {run(stage)};
+      if (seconds < 0.0)
+        return EXIT_FAILURE;
+      if (best < 0.0 || seconds < best)
+        best = seconds;
+    }
+    if (stage.name == std::string("identity"))
+      baseline = best;
+
+    // Cost of the stage alone: per second of audio, per frame, and how many streams one core keeps up with
+    double net {std::max(best - baseline, 0.0)};
+    std::cout << std::setw(20) << stage.name << std::fixed << std::setprecision(3) << std::setw(12) << best <<
+      std::setw(14) << 1000.0 * net / opt_seconds <<
+      std::setprecision(2) << std::setw(14) << 1e9 * net / (double(opt_seconds) * opt_rate);
+    if (net > 0.0)
+      std::cout << std::setprecision(0) << std::setw(11) << opt_seconds / net << "x";
+    std::cout << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,239 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 3: filesrc versus mmapsrc benchmark
+ *
+ * Demuxes and decodes a local file as fast as possible with playbin into fakesinks, once with
+ * filesrc and once with mmapsrc, and prints the throughput, the CPU time, the page faults and
+ * how much of the file is in the page cache before and after each run.
+ *
+ * With --cold the file is evicted from the page cache before every run with
+ * posix_fadvise(POSIX_FADV_DONTNEED), which needs no privileges but only drops clean pages
+ * that no other process has mapped.
+ */
+
+#include <gstreamermm.h>
+#include <glibmm/convert.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "gstmmapsrc.h"
+
+using Glib::RefPtr;
+
+namespace
+{
+
+// Command line options
+gint opt_runs {3};
+gboolean opt_cold {FALSE};
+gboolean opt_no_decode {FALSE};
+
+GOptionEntry entries[] =
+{
+  { "runs", 'r', 0, G_OPTION_ARG_INT, &opt_runs, "Runs per source, the best one is reported (default 3)", "N" },
+  { "cold", 'c', 0, G_OPTION_ARG_NONE, &opt_cold, "Evict the file from the page cache before every run", nullptr },
+  { "no-decode", 'n', 0, G_OPTION_ARG_NONE, &opt_no_decode,
+    "Stop after the demuxer, measuring the source and demuxer alone", nullptr },
+  { nullptr }
+};
+
+struct Result
+{
+  double seconds {0.0};
+  double user_seconds {0.0};
+  double system_seconds {0.0};
+  long major_faults {0};
+  long minor_faults {0};
+  double resident_before {0.0};
+  double resident_after {0.0};
+};
+
+struct Usage
+{
+  double user;
+  double system;
+  long major_faults;
+  long minor_faults;
+};
+
+Usage usage_now()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return {usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6,
+    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6, usage.ru_majflt, usage.ru_minflt};
+}
+
+// Fraction of the file's pages that are in the page cache
+double resident_fraction(const std::string& path)
+{
+  int fd {open(path.c_str(), O_RDONLY)};
+  if (fd < 0)
+    return 0.0;
+
+  double fraction {0.0};
+  struct stat info;
+  if (fstat(fd, &info) == 0 && info.st_size > 0)
+  {
+    void* data {mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0)};
+    if (data != MAP_FAILED)
+    {
+      long page {sysconf(_SC_PAGESIZE)};
+      std::vector<unsigned char> pages((info.st_size + page - 1) / page);
+      if (mincore(data, info.st_size, pages.data()) == 0)
+      {
+        size_t resident {0};
+        for (unsigned char flags : pages)
+          resident += flags & 1;
+        fraction = static_cast<double>(resident) / pages.size();
+      }
+      munmap(data, info.st_size);
+    }
+  }
+  close(fd);
+  return fraction;
+}
+
+void evict(const std::string& path)
+{
+  int fd {open(path.c_str(), O_RDONLY)};
+  if (fd < 0)
+    return;
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
+// mmapsrc takes part in the URI lookup only while ranked above filesrc
+void prefer_mmap(bool prefer)
+{
+  GstPluginFeature* feature {gst_registry_lookup_feature(gst_registry_get(), "mmapsrc")};
+  gst_plugin_feature_set_rank(feature, prefer ? GST_RANK_PRIMARY + 1 : GST_RANK_NONE);
+  gst_object_unref(feature);
+}
+
+bool run(const std::string& path, const Glib::ustring& uri, Result& result)
+{
+  if (opt_cold)
+    evict(path);
+  result.resident_before = resident_fraction(path);
+
+  // Decode everything with playbin, or stop after the demuxer by asking uridecodebin for
+  // encoded caps. Only the first stream is linked then, multiqueue keeps the others going.
+  std::string description;
+  if (opt_no_decode)
+    description = "uridecodebin uri=\"" + uri + "\" caps=\"video/x-h264;video/x-h265;video/x-vp8;video/x-vp9;"
+      "video/x-av1;audio/mpeg;audio/x-opus;audio/x-vorbis;audio/x-ac3\" expose-all-streams=true ! fakesink sync=false";
+  else
+    description = "playbin uri=\"" + uri + "\" video-sink=\"fakesink sync=false\" audio-sink=\"fakesink sync=false\" "
+      "text-sink=\"fakesink sync=false\"";
+
+  RefPtr<Gst::Element> pipeline;
+  try
+  {
+    pipeline = Gst::Parse::launch(description);
+  }
+  catch (const Glib::Error& ex)
+  {
+    std::cerr << "Could not create the pipeline: " << ex.what() << std::endl;
+    return false;
+  }
+
+  Usage start_usage {usage_now()};
+  gint64 start {g_get_monotonic_time()};
+  pipeline->set_state(Gst::STATE_PLAYING);
+
+  RefPtr<Gst::Message> message {pipeline->get_bus()->pop(Gst::CLOCK_TIME_NONE,
+      Gst::MESSAGE_EOS | Gst::MESSAGE_ERROR)};
+  result.seconds = (g_get_monotonic_time() - start) / 1e6;
+  Usage end_usage {usage_now()};
+  pipeline->set_state(Gst::STATE_NULL);
+
+  result.user_seconds = end_usage.user - start_usage.user;
+  result.system_seconds = end_usage.system - start_usage.system;
+  result.major_faults = end_usage.major_faults - start_usage.major_faults;
+  result.minor_faults = end_usage.minor_faults - start_usage.minor_faults;
+  result.resident_after = resident_fraction(path);
+
+  if (message->get_message_type() == Gst::MESSAGE_ERROR)
+  {
+    std::cerr << "Error: " << RefPtr<Gst::MessageError>::cast_static(message)->parse_error().what() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("<local media file> - filesrc versus mmapsrc benchmark")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  if (argc < 2)
+  {
+    std::cout << "Usage: " << argv[0] << " [options] <local media file>" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Initialize gstreamermm and register mmapsrc, ranked per run
+  Gst::init(argc, argv);
+  gst_mmap_src_register(FALSE);
+
+  std::string path {argv[1]};
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+  {
+    std::cerr << path << " is not a regular file" << std::endl;
+    return EXIT_FAILURE;
+  }
+  Glib::ustring uri {Glib::filename_to_uri(path)};
+  double mib {info.st_size / (1024.0 * 1024.0)};
+
+  std::cout << path << ", " << std::fixed << std::setprecision(1) << mib << " MiB, " <<
+    (opt_no_decode ? "demux only" : "demux and decode") << (opt_cold ? ", cold cache" : ", warm cache") <<
+    ", best of " << opt_runs << std::endl;
+  std::cout << std::setw(10) << "source" << std::setw(10) << "MiB/s" << std::setw(10) << "user s" <<
+    std::setw(10) << "system s" << std::setw(10) << "majflt" << std::setw(10) << "minflt" <<
+    std::setw(16) << "cached before" << std::setw(14) << "cached after" << std::endl;
+
+  for (const char* source : {"filesrc", "mmapsrc"})
+  {
+    prefer_mmap(std::string(source) == "mmapsrc");
+
+    Result best;
+    for (int i = 0; i < opt_runs; i++)
+    {
+      Result result;
+      if (!run(path, uri, result))
+        return EXIT_FAILURE;
+      if (i == 0 || result.seconds < best.seconds)
+        best = result;
+    }
+
+    std::cout << std::setw(10) << source << std::setprecision(1) << std::setw(10) << mib / best.seconds <<
+      std::setprecision(2) << std::setw(10) << best.user_seconds << std::setw(10) << best.system_seconds <<
+      std::setw(10) << best.major_faults << std::setw(10) << best.minor_faults <<
+      std::setprecision(0) << std::setw(15) << 100.0 * best.resident_before << "%" <<
+      std::setw(13) << 100.0 * best.resident_after << "%" << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,189 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 3: Mosaic compositing benchmark
+ *
+ * Composites N sources into a 1920x1080 grid with the layout of dynamic_src's mosaic mode,
+ * for each tile count and compositor thread count, and prints the output frames per second
+ * and the CPU cores used. The sources are not live, so the pipeline runs as fast as it can;
+ * an output rate of at least 30 fps means a live mosaic of that size keeps up.
+ *
+ *   videotestsrc ! video/x-raw,width=W/cols,height=H/rows ! compositor name=mosaic sink_i::xpos=... ! fakesink
+ */
+
+#include <gstreamermm.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <sys/resource.h>
+#include "mosaic_layout.h"
+
+using Glib::RefPtr;
+
+namespace
+{
+
+// Command line options
+gint opt_frames {300};
+gchar* opt_tiles {nullptr};
+gchar* opt_threads {nullptr};
+
+GOptionEntry entries[] =
+{
+  { "frames", 'f', 0, G_OPTION_ARG_INT, &opt_frames, "Output frames per run (default 300)", "N" },
+  { "tiles", 'n', 0, G_OPTION_ARG_STRING, &opt_tiles, "Comma separated tile counts (default 1,4,16,36,64)", "LIST" },
+  { "threads", 't', 0, G_OPTION_ARG_STRING, &opt_threads,
+    "Comma separated compositor thread counts (default 1 and the number of CPUs)", "LIST" },
+  { nullptr }
+};
+
+const gint width {1920};
+const gint height {1080};
+
+double cpu_time()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+std::vector<guint> parse_list(const gchar* list, const std::vector<guint>& fallback)
+{
+  if (!list)
+    return fallback;
+
+  std::vector<guint> values;
+  std::istringstream in {list};
+  std::string item;
+  while (std::getline(in, item, ','))
+  {
+    gint value {atoi(item.c_str())};
+    if (value > 0)
+      values.push_back(value);
+  }
+  return values;
+}
+
+std::string description(guint tiles)
+{
+  std::ostringstream out;
+  out << "compositor name=mosaic background=black";
+  std::vector<MosaicTile> layout {mosaic_layout(tiles, width, height)};
+  for (gsize i = 0; i < layout.size(); i++)
+    out << " sink_" << i << "::xpos=" << layout[i].x << " sink_" << i << "::ypos=" << layout[i].y;
+  out << " ! video/x-raw,width=" << width << ",height=" << height << ",framerate=30/1 ! fakesink sync=false";
+
+  // Every tile moves, so no source can hand out the same frame twice
+  for (gsize i = 0; i < layout.size(); i++)
+    out << " videotestsrc num-buffers=" << opt_frames << " pattern=ball ! video/x-raw,format=I420,width=" <<
+      layout[i].width << ",height=" << layout[i].height << ",framerate=30/1 ! mosaic.sink_" << i;
+  return out.str();
+}
+
+enum RunResult { RUN_OK, RUN_FAILED, RUN_NO_THREADS };
+
+// RUN_NO_THREADS when the compositor has no max-threads property for a thread count above 1
+RunResult run(guint tiles, guint threads, double& seconds, double& cpu_seconds)
+{
+  RefPtr<Gst::Element> pipeline;
+  try
+  {
+    pipeline = Gst::Parse::launch(description(tiles));
+  }
+  catch (const Glib::Error& ex)
+  {
+    std::cerr << "Could not create the pipeline: " << ex.what() << std::endl;
+    return RUN_FAILED;
+  }
+
+  GstElement* compositor {gst_bin_get_by_name(GST_BIN(pipeline->gobj()), "mosaic")};
+  bool threaded {set_compositor_threads(compositor, threads)};
+  gst_object_unref(compositor);
+  if (!threaded && threads > 1)
+    return RUN_NO_THREADS;
+
+  // Pre-roll first, so the setup of all the sources is not counted
+  Gst::State state, pending;
+  pipeline->set_state(Gst::STATE_PAUSED);
+  pipeline->get_state(state, pending, Gst::CLOCK_TIME_NONE);
+
+  RefPtr<Gst::Bus> bus {pipeline->get_bus()};
+  double cpu_start {cpu_time()};
+  auto start = std::chrono::steady_clock::now();
+  pipeline->set_state(Gst::STATE_PLAYING);
+  RefPtr<Gst::Message> message {bus->pop(Gst::CLOCK_TIME_NONE, Gst::MESSAGE_EOS | Gst::MESSAGE_ERROR)};
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  cpu_seconds = cpu_time() - cpu_start;
+  pipeline->set_state(Gst::STATE_NULL);
+
+  if (message->get_message_type() == Gst::MESSAGE_ERROR)
+  {
+    std::cerr << "Error: " << RefPtr<Gst::MessageError>::cast_static(message)->parse_error().what() << std::endl;
+    return RUN_FAILED;
+  }
+  return RUN_OK;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("- mosaic compositing benchmark")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  // Initialize gstreamermm:
+  Gst::init(argc, argv);
+
+  guint cpus {std::max(std::thread::hardware_concurrency(), 1u)};
+  std::vector<guint> tile_counts {parse_list(opt_tiles, {1, 4, 16, 36, 64})};
+  std::vector<guint> thread_counts {parse_list(opt_threads, cpus > 1 ? std::vector<guint> {1, cpus} : std::vector<guint> {1})};
+
+  std::cout << opt_frames << " frames at " << width << "x" << height << ", " << cpus << " CPUs" << std::endl;
+  std::cout << std::setw(8) << "tiles" << std::setw(10) << "threads" << std::setw(10) << "fps" <<
+    std::setw(12) << "CPU cores" << std::setw(10) << "live" << std::endl;
+
+  bool warned {false};
+  for (guint tiles : tile_counts)
+  {
+    for (guint threads : thread_counts)
+    {
+      double seconds {0.0}, cpu_seconds {0.0};
+      RunResult result {run(tiles, threads, seconds, cpu_seconds)};
+      if (result == RUN_NO_THREADS)
+      {
+        if (!warned)
+          std::cerr << "This compositor can not blend in parallel, multi-threaded runs are skipped." << std::endl;
+        warned = true;
+        continue;
+      }
+      if (result == RUN_FAILED)
+      {
+        std::cerr << "Run with " << tiles << " tiles and " << threads << " threads failed." << std::endl;
+        continue;
+      }
+
+      double fps {opt_frames / seconds};
+      std::cout << std::setw(8) << tiles << std::setw(10) << threads << std::fixed << std::setprecision(1) <<
+        std::setw(10) << fps << std::setprecision(2) << std::setw(12) << cpu_seconds / seconds <<
+        std::setw(10) << (fps >= 30.0 ? "yes" : "no") << std::endl;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
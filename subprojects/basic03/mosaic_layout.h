@@ -0,0 +1,50 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 3: Mosaic grid layout
+ *
+ * Shared by dynamic_src's mosaic mode and mosaic_bench. N tiles are laid out in the smallest
+ * square-ish grid, ceil(sqrt(N)) columns, left to right and top to bottom. Each tile has the
+ * same size, rounded down to even numbers for 4:2:0 formats, and the sources produce exactly
+ * that size, so compositor only blends and never scales.
+ */
+
+#ifndef MOSAIC_LAYOUT_H
+#define MOSAIC_LAYOUT_H
+
+#include <gst/gst.h>
+#include <cmath>
+#include <vector>
+
+struct MosaicTile
+{
+  gint x;
+  gint y;
+  gint width;
+  gint height;
+};
+
+inline std::vector<MosaicTile> mosaic_layout(guint tiles, gint width, gint height)
+{
+  guint columns {static_cast<guint>(std::ceil(std::sqrt(static_cast<double>(tiles))))};
+  guint rows {(tiles + columns - 1) / columns};
+  gint tile_width {(width / static_cast<gint>(columns)) & ~1};
+  gint tile_height {(height / static_cast<gint>(rows)) & ~1};
+
+  std::vector<MosaicTile> layout;
+  for (guint i = 0; i < tiles; i++)
+    layout.push_back(MosaicTile {static_cast<gint>(i % columns) * tile_width,
+        static_cast<gint>(i / columns) * tile_height, tile_width, tile_height});
+  return layout;
+}
+
+// compositor blends with a task pool from 1.20 on, older versions have no such property.
+// Returns false when the number of threads can not be set.
+inline bool set_compositor_threads(GstElement* compositor, guint threads)
+{
+  if (!g_object_class_find_property(G_OBJECT_GET_CLASS(compositor), "max-threads"))
+    return false;
+  g_object_set(compositor, "max-threads", threads, nullptr);
+  return true;
+}
+
+#endif // MOSAIC_LAYOUT_H
@@ -0,0 +1,179 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 3: Pipeline construction benchmark
+ *
+ * Builds the same short job pipeline over and over in three ways and prints pipelines per
+ * second:
+ *  - parse_launch: Gst::Parse::launch() of the description, parsed every time
+ *  - create_element: Gst::ElementFactory::create_element() by name, set_property() and link(),
+ *    as the tutorials do
+ *  - template: PipelineTemplate::build() from cached factories and pre-parsed values
+ *
+ *   videotestsrc num-buffers=N ! capsfilter caps=video/x-raw,width=320,height=240 ! videoconvert ! fakesink
+ *
+ * By default only construction and destruction are timed. With --run every pipeline also
+ * runs its few buffers to EOS, which is what a short job costs end to end.
+ */
+
+#include <gstreamermm.h>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include "pipeline_template.h"
+
+using Glib::RefPtr;
+
+namespace
+{
+
+// Command line options
+gint opt_jobs {2000};
+gint opt_buffers {1};
+gboolean opt_run {FALSE};
+
+GOptionEntry entries[] =
+{
+  { "jobs", 'j', 0, G_OPTION_ARG_INT, &opt_jobs, "Pipelines to build per method (default 2000)", "N" },
+  { "buffers", 'b', 0, G_OPTION_ARG_INT, &opt_buffers, "Buffers per job with --run (default 1)", "N" },
+  { "run", 'r', 0, G_OPTION_ARG_NONE, &opt_run, "Also run every pipeline to EOS", nullptr },
+  { nullptr }
+};
+
+const char* caps {"video/x-raw,width=320,height=240"};
+
+// Play to EOS, false on error
+bool run(GstElement* pipeline)
+{
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+  GstBus* bus {gst_element_get_bus(pipeline)};
+  GstMessage* message {gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+      static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR))};
+  bool done {GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS};
+  gst_message_unref(message);
+  gst_object_unref(bus);
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  return done;
+}
+
+bool job_parse_launch(const std::string& description)
+{
+  RefPtr<Gst::Element> pipeline {Gst::Parse::launch(description)};
+  return !opt_run || run(pipeline->gobj());
+}
+
+bool job_create_element()
+{
+  RefPtr<Gst::Pipeline> pipeline {Gst::Pipeline::create()};
+  RefPtr<Gst::Element> source {Gst::ElementFactory::create_element("videotestsrc")},
+    filter {Gst::ElementFactory::create_element("capsfilter")},
+    convert {Gst::ElementFactory::create_element("videoconvert")},
+    sink {Gst::ElementFactory::create_element("fakesink")};
+  source->set_property("num-buffers", opt_buffers);
+  filter->set_property("caps", Gst::Caps::create_from_string(caps));
+  sink->set_property("sync", false);
+  pipeline->add(source)->add(filter)->add(convert)->add(sink);
+  source->link(filter)->link(convert)->link(sink);
+  return !opt_run || run(GST_ELEMENT(pipeline->gobj()));
+}
+
+bool job_template(const PipelineTemplate& job)
+{
+  GstElement* pipeline {job.build()};
+  bool done {!opt_run || run(pipeline)};
+  gst_object_unref(pipeline);
+  return done;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("- pipeline construction benchmark")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  // Initialize gstreamermm:
+  Gst::init(argc, argv);
+
+  std::ostringstream description;
+  description << "videotestsrc num-buffers=" << opt_buffers << " ! capsfilter caps=" << caps <<
+    " ! videoconvert ! fakesink sync=false";
+
+  // The template is written and checked once, before the clock starts
+  PipelineTemplate job;
+  try
+  {
+    gsize source {job.add("videotestsrc")}, filter {job.add("capsfilter")}, convert {job.add("videoconvert")},
+      sink {job.add("fakesink")};
+    job.set(source, "num-buffers", std::to_string(opt_buffers));
+    job.set(filter, "caps", caps);
+    job.set(sink, "sync", "false");
+    job.link(source, filter);
+    job.link(filter, convert);
+    job.link(convert, sink);
+    job.validate();
+  }
+  catch (const std::exception& ex)
+  {
+    std::cerr << "Could not prepare the template: " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const std::vector<std::pair<const char*, std::function<bool()>>> methods {
+    {"parse_launch", [&description] { return job_parse_launch(description.str()); }},
+    {"create_element", [] { return job_create_element(); }},
+    {"template", [&job] { return job_template(job); }}
+  };
+
+  std::cout << opt_jobs << " jobs" << (opt_run ? ", each run to EOS" : ", construction only") << std::endl;
+  std::cout << std::setw(16) << "method" << std::setw(14) << "pipelines/s" << std::setw(12) << "us/job" <<
+    std::setw(10) << "speedup" << std::endl;
+
+  double baseline {0.0};
+  for (const auto& method : methods)
+  {
+    // One untimed job, so plugin loading and first-use costs are not counted for anyone
+    double seconds {0.0};
+    try
+    {
+      if (!method.second())
+      {
+        std::cerr << method.first << ": the job failed" << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      for (gint i = 0; i < opt_jobs; i++)
+        method.second();
+      seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    catch (const Glib::Error& ex)
+    {
+      std::cerr << method.first << ": " << ex.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    double rate {opt_jobs / seconds};
+    if (baseline == 0.0)
+      baseline = rate;
+    std::cout << std::setw(16) << method.first << std::fixed << std::setprecision(0) << std::setw(14) << rate <<
+      std::setprecision(1) << std::setw(12) << 1e6 * seconds / opt_jobs <<
+      std::setprecision(2) << std::setw(9) << rate / baseline << "x" << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
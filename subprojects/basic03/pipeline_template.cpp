@@ -0,0 +1,205 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 3: Factory-cached pipeline templates
+ */
+
+#include "pipeline_template.h"
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+namespace
+{
+
+std::mutex factories_mutex;
+std::map<std::string, GstElementFactory*> factories;
+
+// A static pad, or a new one from a request pad template
+GstPad* get_pad(GstElement* element, const std::string& name)
+{
+  GstPad* pad {gst_element_get_static_pad(element, name.c_str())};
+  if (pad)
+    return pad;
+
+  GstPadTemplate* templ {gst_element_class_get_pad_template(GST_ELEMENT_GET_CLASS(element), name.c_str())};
+  if (!templ || GST_PAD_TEMPLATE_PRESENCE(templ) != GST_PAD_REQUEST)
+    return nullptr;
+  return gst_element_request_pad(element, templ, nullptr, nullptr);
+}
+
+} // anonymous namespace
+
+PipelineTemplate::PipelineTemplate(const PipelineTemplate& other)
+{
+  *this = other;
+}
+
+PipelineTemplate& PipelineTemplate::operator=(const PipelineTemplate& other)
+{
+  if (this == &other)
+    return *this;
+
+  clear();
+  for (const Element& element : other.elements)
+  {
+    Element copy {GST_ELEMENT_FACTORY(gst_object_ref(element.factory)), element.name, element.properties,
+      std::vector<GValue>(element.values.size())};
+    for (gsize i = 0; i < element.values.size(); i++)
+    {
+      g_value_init(&copy.values[i], G_VALUE_TYPE(&element.values[i]));
+      g_value_copy(&element.values[i], &copy.values[i]);
+    }
+    elements.push_back(std::move(copy));
+  }
+  links = other.links;
+  return *this;
+}
+
+PipelineTemplate::~PipelineTemplate()
+{
+  clear();
+}
+
+void PipelineTemplate::clear()
+{
+  for (Element& element : elements)
+  {
+    for (GValue& value : element.values)
+      g_value_unset(&value);
+    gst_object_unref(element.factory);
+  }
+  elements.clear();
+  links.clear();
+}
+
+GstElementFactory* PipelineTemplate::find_factory(const std::string& name)
+{
+  std::lock_guard<std::mutex> lock {factories_mutex};
+  auto it = factories.find(name);
+  if (it != factories.end())
+    return it->second;
+
+  // Load the plugin now, so the element type is registered and creating it never has to
+  GstElementFactory* factory {gst_element_factory_find(name.c_str())};
+  if (factory)
+  {
+    GstPluginFeature* loaded {gst_plugin_feature_load(GST_PLUGIN_FEATURE(factory))};
+    gst_object_unref(factory);
+    factory = loaded ? GST_ELEMENT_FACTORY(loaded) : nullptr;
+  }
+  if (factory)
+    factories[name] = factory;
+  return factory;
+}
+
+gsize PipelineTemplate::add(const std::string& factory_name, const std::string& name)
+{
+  GstElementFactory* factory {find_factory(factory_name)};
+  if (!factory)
+    throw std::runtime_error("no such element factory: " + factory_name);
+
+  elements.push_back(Element {GST_ELEMENT_FACTORY(gst_object_ref(factory)), name, {}, {}});
+  return elements.size() - 1;
+}
+
+void PipelineTemplate::set(gsize index, const std::string& property, const std::string& value)
+{
+  Element& element {elements.at(index)};
+  GObjectClass* klass {G_OBJECT_CLASS(g_type_class_ref(gst_element_factory_get_element_type(element.factory)))};
+  GParamSpec* pspec {g_object_class_find_property(klass, property.c_str())};
+  g_type_class_unref(klass);
+  if (!pspec || !(pspec->flags & G_PARAM_WRITABLE))
+    throw std::runtime_error("no writable property " + property + " in " + GST_OBJECT_NAME(element.factory));
+
+  GValue parsed = G_VALUE_INIT;
+  g_value_init(&parsed, G_PARAM_SPEC_VALUE_TYPE(pspec));
+  if (!gst_value_deserialize(&parsed, value.c_str()))
+  {
+    g_value_unset(&parsed);
+    throw std::runtime_error("invalid value " + value + " for " + property);
+  }
+
+  // The interned name of the param spec outlives the template
+  for (gsize i = 0; i < element.properties.size(); i++)
+  {
+    if (element.properties[i] == pspec->name)
+    {
+      g_value_unset(&element.values[i]);
+      element.values[i] = parsed;
+      return;
+    }
+  }
+  element.properties.push_back(pspec->name);
+  element.values.push_back(parsed);
+}
+
+void PipelineTemplate::link(gsize from, gsize to, const std::string& src_pad, const std::string& sink_pad)
+{
+  if (from >= elements.size() || to >= elements.size())
+    throw std::out_of_range("no such element in the template");
+  links.push_back(Link {from, to, src_pad, sink_pad});
+}
+
+GstElement* PipelineTemplate::instantiate(const Element& element) const
+{
+  GstElement* instance {gst_element_factory_create(element.factory,
+      element.name.empty() ? nullptr : element.name.c_str())};
+  if (instance && !element.values.empty())
+    g_object_setv(G_OBJECT(instance), element.values.size(),
+        const_cast<const gchar**>(element.properties.data()), element.values.data());
+  return instance;
+}
+
+GstElement* PipelineTemplate::create(gsize index) const
+{
+  GstElement* instance {instantiate(elements.at(index))};
+  return instance ? GST_ELEMENT(gst_object_ref_sink(instance)) : nullptr;
+}
+
+GstElement* PipelineTemplate::build() const
+{
+  return build(GST_PAD_LINK_CHECK_NOTHING);
+}
+
+void PipelineTemplate::validate() const
+{
+  gst_object_unref(build(GST_PAD_LINK_CHECK_DEFAULT));
+}
+
+GstElement* PipelineTemplate::build(GstPadLinkCheck checks) const
+{
+  GstElement* pipeline {GST_ELEMENT(gst_object_ref_sink(gst_pipeline_new(nullptr)))};
+  std::vector<GstElement*> instances;
+  instances.reserve(elements.size());
+  for (const Element& element : elements)
+  {
+    GstElement* instance {instantiate(element)};
+    if (!instance)
+    {
+      gst_object_unref(pipeline);
+      throw std::runtime_error(std::string("could not create ") + GST_OBJECT_NAME(element.factory));
+    }
+    gst_bin_add(GST_BIN(pipeline), instance);
+    instances.push_back(instance);
+  }
+
+  for (const Link& link : links)
+  {
+    GstPad* src {get_pad(instances[link.from], link.src_pad)};
+    GstPad* sink {get_pad(instances[link.to], link.sink_pad)};
+    GstPadLinkReturn result {src && sink ? gst_pad_link_full(src, sink, checks) : GST_PAD_LINK_NOFORMAT};
+    if (src)
+      gst_object_unref(src);
+    if (sink)
+      gst_object_unref(sink);
+    if (GST_PAD_LINK_FAILED(result))
+    {
+      std::string message {std::string("could not link ") + GST_OBJECT_NAME(instances[link.from]) + ":" +
+        link.src_pad + " to " + GST_OBJECT_NAME(instances[link.to]) + ":" + link.sink_pad + ", " +
+        gst_pad_link_get_name(result)};
+      gst_object_unref(pipeline);
+      throw std::runtime_error(message);
+    }
+  }
+  return pipeline;
+}
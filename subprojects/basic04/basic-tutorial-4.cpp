@@ -9,143 +9,173 @@
 
 #include <gstreamermm.h>
 #include <glibmm/main.h>
+#include <glibmm/convert.h>
+#include <glibmm/fileutils.h>
+#include <glib-unix.h>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <iomanip>
+#include <memory>
 #include <cstdlib>
+#include <csignal>
+#include "file_prefetch.h"
+#include "metrics.h"
+#include "player_engine.h"
 
 using Glib::RefPtr;
 
-// Expose objects to be used in callbacks
-RefPtr<Glib::MainLoop> mainloop;
-RefPtr<Gst::Element> playbin;
-static bool playing {false};
-static bool seekable {false};
-static bool seek_done {false};
-static gint64 duration {(gint64)Gst::CLOCK_TIME_NONE};
+// Command line options
+static gint opt_prefetch {0};
+static gboolean opt_evict {FALSE};
+static gchar* opt_metrics {nullptr};
+static gboolean opt_track_position {FALSE};
+static gboolean opt_compare_position {FALSE};
+static gchar* opt_loop {nullptr};
 
-static std::ostringstream format_gst_time(gint64 gst_time)
+static GOptionEntry entries[] =
 {
-  std::ostringstream oss_gst_time (std::ostringstream::out);
-
-  oss_gst_time << std::right << std::setfill('0') <<
-    std::setw(3) << Gst::get_hours(gst_time) << ":" <<
-    std::setw(2) << Gst::get_minutes(gst_time) << ":" <<
-    std::setw(2) << Gst::get_seconds(gst_time) << "." <<
-    std::setw(9) << std::left << Gst::get_fractional_seconds(gst_time);
-  return oss_gst_time;
-}
+  { "prefetch", 'p', 0, G_OPTION_ARG_INT, &opt_prefetch,
+    "Prefetch the header, index and first SECONDS of a local file at startup (default 0, disabled)", "SECONDS" },
+  { "evict", 'e', 0, G_OPTION_ARG_NONE, &opt_evict,
+    "Drop a local file from the page cache first, to measure a cold start", nullptr },
+  { "metrics", 'm', 0, G_OPTION_ARG_FILENAME, &opt_metrics,
+    "Serve metrics in the Prometheus text format on the Unix socket PATH", "PATH" },
+  { "track-position", 't', 0, G_OPTION_ARG_NONE, &opt_track_position,
+    "Interpolate the position from the pipeline clock instead of querying it", nullptr },
+  { "compare-position", 'c', 0, G_OPTION_ARG_NONE, &opt_compare_position,
+    "Compare the interpolated position with a query on every update, and report error and cost", nullptr },
+  { "loop", 'l', 0, G_OPTION_ARG_STRING, &opt_loop,
+    "Loop the range from A to B seconds without gaps, B may be left out to loop to the end", "A-B" },
+  { nullptr }
+};
 
-// This function is used to receive asynchronous messages in the main loop.
-bool on_bus_message(const RefPtr<Gst::Bus>&,
-    const RefPtr<Gst::Message>& message)
+// First frame timing and metrics, the player handles the rest of the messages itself
+static void on_bus_message(GstMessage* message, PipelineMetrics* metrics)
 {
-  switch (message->get_message_type()) {
-    case Gst::MESSAGE_EOS:
-      std::cout << std::endl << "End of stream" << std::endl;
-      mainloop->quit();
-      return false;
-    case Gst::MESSAGE_ERROR:
-    {
-      RefPtr<Gst::MessageError> msgError {RefPtr<Gst::MessageError>::cast_static(message)};
-      if (msgError)
-      {
-        Glib::Error err {msgError->parse_error()};
-        std::string debug_info {msgError->parse_debug()};
-        std::cerr << "Error received from element " << message->get_source()->get_name() << ": " <<
-            err.what() << std::endl;
-        if (!debug_info.empty())
-          std::cout << "Debugging information: " << debug_info << std::endl;
-      }
-      else
-      {
-        std::cerr << "Error." << std::endl;
-      }
-      mainloop->quit();
-      return false;
-    }
-    case Gst::MESSAGE_DURATION_CHANGED:
-      /* The duration has changed, mark the current one as invalid */
-      duration = Gst::CLOCK_TIME_NONE;
-      break;
-    case Gst::MESSAGE_STATE_CHANGED:
-    {
-      // We are only interested in state-changed messages from the playbin 
-      if (RefPtr<Gst::Element>::cast_dynamic(message->get_source()) == playbin)
-      {
-        auto state_get_name = [] (Gst::State state) -> std::string {
-          return gst_element_state_get_name(static_cast<GstState>(state));
-        };
-        RefPtr<Gst::MessageStateChanged> msgSC {RefPtr<Gst::MessageStateChanged>::cast_static(message)};
-        Gst::State old_state {msgSC->parse_old_state()};
-        Gst::State new_state {msgSC->parse_new_state()};
-        std::cout << "Pipeline state changed: " <<
-            state_get_name(old_state) << " -> " <<
-            state_get_name(new_state) << std::endl;
-        /* Remember whether we are in the PLAYING state or not */
-        playing = (new_state == Gst::STATE_PLAYING);
-        if (playing)
-        {
-          /* We just moved to PLAYING. Check if seeking is possible */
-          Gst::Format format {Gst::FORMAT_TIME};
-          RefPtr<Gst::Query> query {Gst::Query::create_seeking(format)};
-          if (playbin->query(query))
-          {
-            gint64 segment_start {0}, segment_end {0};
-            RefPtr<Gst::QuerySeeking> seek_query = RefPtr<Gst::QuerySeeking>::cast_static(query);
-            seek_query->parse(format, seekable, segment_start, segment_end);
-            if (seekable)
-              std::cout << "Seeking is ENABLED from " << format_gst_time(segment_start).str() <<
-                " to " << format_gst_time(segment_end).str() << std::endl;
-            else
-              std::cout << "Seeking is DISABLED for this stream." << std::endl;
-          }
-        }
-      }
-      break;
-    }
-    default:
-        //std::cout << "Unhandled message type: " << message->get_message_type() << std::endl;
-      break;
-  }
+  if (metrics)
+    metrics->handle_message(message);
 
-  return true;
+  // Time from startup until the first frame reached the video sink
+  guint64 time {0};
+  const GstStructure* structure {gst_message_get_structure(message)};
+  if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ELEMENT && gst_structure_has_name(structure, "first-frame") &&
+      gst_structure_get_uint64(structure, "time", &time))
+    std::cout << "First frame after " << time / GST_MSECOND << " ms" << std::endl;
 }
 
-bool on_timeout()
+// Interpolated against queried positions, sampled back to back on every update
+struct PositionComparison
 {
-  // only if playing
-  if (playing)
-  {
-    /* Query the current position of the stream */
-    gint64 position {0};
-    if (!playbin->query_position(Gst::FORMAT_TIME, position))
-      std::cerr << "Could not query current position." << std::endl;
+  guint64 samples {0};
+  gint64 total_error {0};
+  gint64 max_error {0};
+  double tracker_seconds {0.0};
+  double query_seconds {0.0};
+};
 
-    /* If we didn't know it yet, query the stream duration */
-    if (duration == (gint64)Gst::CLOCK_TIME_NONE)
-    {
-      if (!playbin->query_duration(Gst::FORMAT_TIME, duration))
-        std::cerr << "Could not query current duration." << std::endl;
-    }
+static void compare_position(const PlayerEngine* player, PositionComparison* comparison)
+{
+  gint64 tracked {0}, queried {0};
+  auto start = std::chrono::steady_clock::now();
+  bool tracked_ok {player->get_tracker()->position(tracked)};
+  auto middle = std::chrono::steady_clock::now();
+  bool queried_ok {player->get_playbin()->query_position(Gst::FORMAT_TIME, queried)};
+  auto end = std::chrono::steady_clock::now();
+  if (!tracked_ok || !queried_ok)
+    return;
 
-    /* Print current position and total duration */
-    std::cout << format_gst_time(position).str() << "/" <<
-      format_gst_time(duration).str() << "\r" << std::flush;
+  gint64 error {std::abs(tracked - queried)};
+  comparison->samples++;
+  comparison->total_error += error;
+  comparison->max_error = std::max(comparison->max_error, error);
+  comparison->tracker_seconds += std::chrono::duration<double>(middle - start).count();
+  comparison->query_seconds += std::chrono::duration<double>(end - middle).count();
+}
 
-    // If seeking is enabled, we have not done it yet, and the time is right, seek
-    if (seekable && !seek_done && position > 10 * (gint64)Gst::SECOND)
-    {
-      std::cout << "Reached 10s, performing seek..." << std::endl;
-      playbin->seek(Gst::FORMAT_TIME, Gst::SEEK_FLAG_FLUSH | Gst::SEEK_FLAG_KEY_UNIT, 30 * Gst::SECOND);
-      seek_done = true;
-    }
+static void report_comparison(const PlayerEngine* player, const PositionComparison& comparison)
+{
+  if (comparison.samples == 0)
+    return;
+  std::cout << "Position tracker: " << comparison.samples << " samples, error mean " << std::fixed <<
+    std::setprecision(3) << comparison.total_error / 1e6 / comparison.samples << " ms, max " <<
+    comparison.max_error / 1e6 << " ms" << std::endl;
+  std::cout << "  " << std::setprecision(0) << 1e9 * comparison.tracker_seconds / comparison.samples <<
+    " ns per interpolated position, " << 1e9 * comparison.query_seconds / comparison.samples <<
+    " ns per query; " << player->get_tracker()->get_interpolated() << " interpolated, " <<
+    player->get_tracker()->get_queried() << " fell back to a query" << std::endl;
+}
+
+// Gaps and margins at the loop points, worst of all sinks
+struct LoopSummary
+{
+  guint64 points {0};
+  gint64 max_gap {0};
+  gint64 min_margin {G_MAXINT64};
+};
+
+static void report_loop_points(const PlayerEngine* player, LoopSummary* summary)
+{
+  for (const LoopMeter::LoopPoint& point : player->get_loop_meter()->take_loop_points())
+  {
+    std::cout << std::endl << "Loop point, " << point.sink << ": gap " << std::fixed <<
+      std::setprecision(3) << point.gap / 1e6 << " ms, arrived " << point.margin / 1e6 << " ms before its time" <<
+      std::endl;
+    summary->points++;
+    summary->max_gap = std::max(summary->max_gap, std::abs(point.gap));
+    summary->min_margin = std::min(summary->min_margin, point.margin);
   }
+}
 
-	return true;
+// Loop range in seconds, "A-B" or "A-"
+static bool parse_loop(const gchar* range, PlayerOptions& options)
+{
+  gchar* end {nullptr};
+  gdouble start {g_ascii_strtod(range, &end)};
+  if (end == range || *end != '-' || start < 0.0)
+    return false;
+  options.loop_start = static_cast<GstClockTime>(start * GST_SECOND);
+  if (*(++end) == '\0')
+    return true;
+  gchar* stop_end {nullptr};
+  gdouble stop {g_ascii_strtod(end, &stop_end)};
+  if (stop_end == end || *stop_end != '\0' || stop <= start)
+    return false;
+  options.loop_stop = static_cast<GstClockTime>(stop * GST_SECOND);
+  return true;
+}
+
+static void on_tick(const PlayerEngine* player, PipelineMetrics* metrics, PositionComparison* comparison,
+    LoopSummary* loops)
+{
+  if (metrics)
+    metrics->update();
+  if (comparison && player->is_playing())
+    compare_position(player, comparison);
+  if (loops)
+    report_loop_points(player, loops);
+
+  /* Print current position and total duration */
+  if (player->is_playing())
+    std::cout << PlayerEngine::format_time(player->get_position()) << "/" <<
+      PlayerEngine::format_time(player->get_duration()) << "\r" << std::flush;
 }
 
 int main(int argc, char** argv)
 {
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("[uri or local file]")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
   // Initialize gstreamermm:
   Gst::init(argc, argv);
 
@@ -155,49 +185,95 @@ int main(int argc, char** argv)
   // Take the commandline argument and ensure that it is a uri:
   if (argc < 2)
   {
-    std::cout << "Usage: " << argv[0] << " <uri>" << std::endl;
+    std::cout << "Usage: " << argv[0] << " [options] <uri or local file>" << std::endl;
     std::cout << "missing uri argument, use default uri instead." << std::endl;
   }
   else if (Gst::URIHandler::uri_is_valid(argv[1]))
   {
     uri = argv[1];
   }
+  else if (Glib::file_test(argv[1], Glib::FILE_TEST_IS_REGULAR))
+  {
+    uri = Glib::filename_to_uri(argv[1]);
+  }
 
-  playbin = Gst::ElementFactory::create_element("playbin");
-
-  if (!playbin)
+  // The player keeps all the playback state, its bus watch and timer run on the default context
+  std::unique_ptr<PlayerEngine> player;
+  try
+  {
+    PlayerOptions options;
+    options.track_position = opt_track_position || opt_compare_position;
+    if (opt_loop && !parse_loop(opt_loop, options))
+    {
+      std::cerr << "Invalid loop range " << opt_loop << ", expected START-STOP in seconds." << std::endl;
+      return EXIT_FAILURE;
+    }
+    player.reset(new PlayerEngine(uri, Glib::MainContext::get_default(), options));
+  }
+  catch (const std::exception& ex)
   {
-    std::cerr << "The playbin element could not be created." << std::endl;
+    std::cerr << ex.what() << std::endl;
     return EXIT_FAILURE;
   }
+  GstElement* playbin {player->get_playbin()->gobj()};
 
-  // Set the URI to play
-  playbin->set_property("uri", uri);
+  // Start reading the file before the playbin asks for it, and time the first frame from here
+  if (opt_evict && !FilePrefetch::evict(uri))
+    std::cerr << "Could not evict " << uri << " from the page cache." << std::endl;
+  gint64 start_time {g_get_monotonic_time()};
+  std::unique_ptr<FilePrefetch> prefetch;
+  if (opt_prefetch > 0)
+    prefetch.reset(new FilePrefetch(uri, opt_prefetch));
+  watch_first_frame(playbin, start_time);
 
-  // Create the main loop.
-  mainloop = Glib::MainLoop::create();
+  // Export the pipeline metrics for as long as the pipeline lives
+  Metrics::Registry registry;
+  std::unique_ptr<Metrics::Server> server;
+  std::unique_ptr<PipelineMetrics> metrics;
+  if (opt_metrics)
+  {
+    metrics.reset(new PipelineMetrics(registry, playbin));
+    server.reset(new Metrics::Server(registry, opt_metrics));
+    if (server->is_listening())
+      std::cout << "Serving metrics on " << opt_metrics << std::endl;
+  }
 
-  // Get the bus and watch the messages
-  RefPtr<Gst::Bus> bus {playbin->get_bus()};
-  bus->add_watch(sigc::ptr_fun(&on_bus_message));
+  // Create the main loop, it ends with the stream
+  RefPtr<Glib::MainLoop> mainloop {Glib::MainLoop::create()};
+  player->signal_message().connect(sigc::bind(sigc::ptr_fun(&on_bus_message), metrics.get()));
+  PositionComparison comparison;
+  LoopSummary loops;
+  player->signal_tick().connect(sigc::bind(sigc::ptr_fun(&on_tick), player.get(), metrics.get(),
+      opt_compare_position ? &comparison : nullptr, player->get_loop_meter() ? &loops : nullptr));
+  player->signal_finished().connect([&mainloop] (bool) { mainloop->quit(); });
+
+  // A loop never ends by itself, Ctrl-C stops it with a summary
+  if (player->get_loop_meter())
+    g_unix_signal_add(SIGINT, [] (gpointer user_data) -> gboolean {
+      static_cast<Glib::MainLoop*>(user_data)->quit();
+      return G_SOURCE_REMOVE;
+    }, mainloop.operator->());
 
   // start play back and listen to events
-  if (playbin->set_state(Gst::STATE_PLAYING) == Gst::STATE_CHANGE_FAILURE)
+  if (!player->start())
   {
     std::cerr << "Unable to set the pipeline to the playing state." << std::endl;
     return EXIT_FAILURE;
   }
 
-  // timeout of 100 milliseconds
-	Glib::signal_timeout().connect(sigc::ptr_fun(&on_timeout), 100);
-
   // Now set the playbin to the PLAYING state and start the main loop:
   std::cout << "Running." << std::endl;
   mainloop->run();
 
   // Clean up nicely:
   std::cout << "Returned. Stopping pipeline." << std::endl;
-  playbin->set_state(Gst::STATE_NULL);
+  report_comparison(player.get(), comparison);
+  if (loops.points > 0)
+    std::cout << player->get_loops() << " loop passes, " << loops.points << " loop points: largest gap " <<
+      std::fixed << std::setprecision(3) << loops.max_gap / 1e6 << " ms, smallest margin " <<
+      loops.min_margin / 1e6 << " ms" << std::endl;
+  player->stop();
+  metrics.reset();
 
   return EXIT_SUCCESS;
 }
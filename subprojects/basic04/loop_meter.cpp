@@ -0,0 +1,133 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 4: Loop point measurement
+ */
+
+#include "loop_meter.h"
+#include <cstring>
+
+LoopMeter::LoopMeter(GstElement* pipeline)
+  : pipeline {pipeline}
+{
+  // The sinks of a playbin are created when it starts, older ones are looked up now
+  if (!GST_IS_BIN(pipeline))
+    return;
+  added_id = g_signal_connect(pipeline, "deep-element-added", G_CALLBACK(&on_element_added), this);
+  GstIterator* it {gst_bin_iterate_recurse(GST_BIN(pipeline))};
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next(it, &item) == GST_ITERATOR_OK)
+  {
+    watch_sink(GST_ELEMENT(g_value_get_object(&item)));
+    g_value_reset(&item);
+  }
+  g_value_unset(&item);
+  gst_iterator_free(it);
+}
+
+LoopMeter::~LoopMeter()
+{
+  if (added_id)
+    g_signal_handler_disconnect(pipeline, added_id);
+
+  std::vector<std::unique_ptr<SinkPad>> watched;
+  {
+    std::lock_guard<std::mutex> lock {mutex};
+    watched.swap(sinks);
+  }
+  for (std::unique_ptr<SinkPad>& sink : watched)
+  {
+    gst_pad_remove_probe(sink->pad, sink->probe_id);
+    gst_object_unref(sink->pad);
+  }
+}
+
+std::vector<LoopMeter::LoopPoint> LoopMeter::take_loop_points()
+{
+  std::vector<LoopPoint> points;
+  std::lock_guard<std::mutex> lock {mutex};
+  points.swap(loop_points);
+  return points;
+}
+
+void LoopMeter::on_element_added(GstBin*, GstBin*, GstElement* element, gpointer user_data)
+{
+  static_cast<LoopMeter*>(user_data)->watch_sink(element);
+}
+
+void LoopMeter::watch_sink(GstElement* element)
+{
+  // Sink bins carry the flag as well, their child sink is enough
+  if (GST_IS_BIN(element) || !GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK))
+    return;
+  GstPad* pad {gst_element_get_static_pad(element, "sink")};
+  if (!pad)
+    return;
+
+  const gchar* klass {gst_element_get_metadata(element, GST_ELEMENT_METADATA_KLASS)};
+  std::string name {klass && strstr(klass, "Audio") ? "audio" : klass && strstr(klass, "Video") ? "video" :
+    GST_OBJECT_NAME(element)};
+  std::unique_ptr<SinkPad> sink {new SinkPad {this, name, pad, 0, {}, false, false, GST_CLOCK_TIME_NONE}};
+  gst_segment_init(&sink->segment, GST_FORMAT_UNDEFINED);
+  sink->probe_id = gst_pad_add_probe(pad, static_cast<GstPadProbeType>(GST_PAD_PROBE_TYPE_BUFFER |
+      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH), &on_sink_data, sink.get(), nullptr);
+  std::lock_guard<std::mutex> lock {mutex};
+  sinks.push_back(std::move(sink));
+}
+
+GstPadProbeReturn LoopMeter::on_sink_data(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+  SinkPad* sink {static_cast<SinkPad*>(user_data)};
+
+  if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_BOTH)
+  {
+    GstEvent* event {GST_PAD_PROBE_INFO_EVENT(info)};
+    if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT)
+    {
+      // A segment without a flush before it starts the next pass of a loop
+      const GstSegment* segment {nullptr};
+      gst_event_parse_segment(event, &segment);
+      sink->new_pass = sink->have_segment && GST_CLOCK_TIME_IS_VALID(sink->last_end);
+      gst_segment_copy_into(segment, &sink->segment);
+      sink->have_segment = (segment->format == GST_FORMAT_TIME);
+    }
+    else if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP)
+    {
+      sink->have_segment = false;
+      sink->new_pass = false;
+      sink->last_end = GST_CLOCK_TIME_NONE;
+    }
+    return GST_PAD_PROBE_OK;
+  }
+
+  GstBuffer* buffer {GST_PAD_PROBE_INFO_BUFFER(info)};
+  if (!sink->have_segment || !GST_BUFFER_PTS_IS_VALID(buffer))
+    return GST_PAD_PROBE_OK;
+  guint64 running_time {gst_segment_to_running_time(&sink->segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer))};
+  if (!GST_CLOCK_TIME_IS_VALID(running_time))
+    return GST_PAD_PROBE_OK;
+
+  if (sink->new_pass)
+  {
+    sink->meter->add_loop_point(sink, GST_ELEMENT(GST_PAD_PARENT(pad)), running_time);
+    sink->new_pass = false;
+  }
+  sink->last_end = running_time + (GST_BUFFER_DURATION_IS_VALID(buffer) ? GST_BUFFER_DURATION(buffer) : 0);
+  return GST_PAD_PROBE_OK;
+}
+
+void LoopMeter::add_loop_point(const SinkPad* sink, GstElement* element, GstClockTime running_time)
+{
+  LoopPoint point {sink->name, GST_CLOCK_DIFF(sink->last_end, running_time), 0};
+
+  // Only known while PLAYING, when the sink has a clock
+  GstClock* clock {gst_element_get_clock(element)};
+  if (clock)
+  {
+    GstClockTime now {gst_clock_get_time(clock)};
+    point.margin = GST_CLOCK_DIFF(now, gst_element_get_base_time(element) + running_time);
+    gst_object_unref(clock);
+  }
+
+  std::lock_guard<std::mutex> lock {mutex};
+  loop_points.push_back(point);
+}
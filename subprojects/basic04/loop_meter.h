@@ -0,0 +1,72 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 4: Loop point measurement
+ *
+ * A loop with segment seeks never flushes: each new pass starts with a new segment event
+ * whose base continues the running time where the last pass ended, so in a gapless loop
+ * the first buffer of a pass starts exactly where the last buffer of the previous pass
+ * ended. LoopMeter checks this on every sink of a pipeline, with a probe that remembers the
+ * running time at the end of each buffer. At every loop point it records:
+ *  - the gap, the running time from the end of the last buffer to the start of the first
+ *    one, positive for silence or a held frame, negative for overlapping buffers
+ *  - the margin, how long before its render time the first buffer reached the sink, which
+ *    varies from loop to loop with the time the application took to queue the next pass;
+ *    a negative margin is a late buffer and an audible or visible gap after all
+ */
+
+#ifndef LOOP_METER_H
+#define LOOP_METER_H
+
+#include <gst/gst.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class LoopMeter
+{
+public:
+  struct LoopPoint
+  {
+    // "audio", "video" or the sink's name
+    std::string sink;
+    gint64 gap;
+    gint64 margin;
+  };
+
+  explicit LoopMeter(GstElement* pipeline);
+  ~LoopMeter();
+
+  LoopMeter(const LoopMeter&) = delete;
+  LoopMeter& operator=(const LoopMeter&) = delete;
+
+  // The loop points measured since the last call
+  std::vector<LoopPoint> take_loop_points();
+
+private:
+  // The state of one sink pad, only touched by its streaming thread
+  struct SinkPad
+  {
+    LoopMeter* meter;
+    std::string name;
+    GstPad* pad;
+    gulong probe_id;
+    GstSegment segment;
+    bool have_segment;
+    bool new_pass;
+    GstClockTime last_end;
+  };
+
+  static void on_element_added(GstBin*, GstBin*, GstElement* element, gpointer user_data);
+  static GstPadProbeReturn on_sink_data(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+  void watch_sink(GstElement* element);
+  void add_loop_point(const SinkPad* sink, GstElement* element, GstClockTime running_time);
+
+  GstElement* pipeline;
+  gulong added_id {0};
+  std::mutex mutex;
+  std::vector<std::unique_ptr<SinkPad>> sinks;
+  std::vector<LoopPoint> loop_points;
+};
+
+#endif // LOOP_METER_H
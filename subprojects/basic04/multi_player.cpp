@@ -0,0 +1,239 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 4: Many players in one process
+ *
+ * Runs N independent PlayerEngine instances of the same media for a while, spread over a
+ * few main contexts, each iterated by a thread of its own, and prints for each N:
+ *  - how many players are PLAYING at the end, the others failed or are still buffering
+ *  - the lateness of the players' 100 ms timers behind schedule, mean and worst, which is
+ *    the latency of the shared main loops
+ *  - resident memory and threads per player, measured from /proc/self/status against the
+ *    process before the players were created
+ *  - CPU cores used
+ * The players render to fakesinks that keep the clock, so the cost is decoding and the
+ * control plane, not the display.
+ */
+
+#include <gstreamermm.h>
+#include <glibmm.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <sys/resource.h>
+#include "player_engine.h"
+
+using Glib::RefPtr;
+
+namespace
+{
+
+// Command line options
+gchar* opt_players {nullptr};
+gint opt_contexts {0};
+gint opt_seconds {5};
+gboolean opt_track_position {FALSE};
+
+GOptionEntry entries[] =
+{
+  { "players", 'n', 0, G_OPTION_ARG_STRING, &opt_players,
+    "Comma separated player counts (default 1,10,50,100,200)", "LIST" },
+  { "contexts", 'c', 0, G_OPTION_ARG_INT, &opt_contexts,
+    "Main contexts, each in a thread of its own (default 0, one per CPU)", "N" },
+  { "seconds", 's', 0, G_OPTION_ARG_INT, &opt_seconds, "Seconds to run each player count (default 5)", "N" },
+  { "track-position", 't', 0, G_OPTION_ARG_NONE, &opt_track_position,
+    "Interpolate the players' positions from their clocks instead of querying them", nullptr },
+  { nullptr }
+};
+
+double cpu_time()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// VmRSS in kB and Threads from /proc/self/status
+void process_status(long& rss_kb, long& threads)
+{
+  std::ifstream status {"/proc/self/status"};
+  std::string line;
+  while (std::getline(status, line))
+  {
+    std::istringstream fields {line};
+    std::string key;
+    fields >> key;
+    if (key == "VmRSS:")
+      fields >> rss_kb;
+    else if (key == "Threads:")
+      fields >> threads;
+  }
+}
+
+std::vector<guint> parse_list(const gchar* list, const std::vector<guint>& fallback)
+{
+  if (!list)
+    return fallback;
+
+  std::vector<guint> values;
+  std::istringstream in {list};
+  std::string item;
+  while (std::getline(in, item, ','))
+  {
+    gint value {atoi(item.c_str())};
+    if (value > 0)
+      values.push_back(value);
+  }
+  return values;
+}
+
+// A main context iterated by a thread of its own until quit()
+class ContextThread
+{
+public:
+  ContextThread()
+    : context {Glib::MainContext::create()}, loop {Glib::MainLoop::create(context)}
+  {
+    thread = std::thread([this] {
+      // The streaming threads' bus messages are dispatched here
+      g_main_context_push_thread_default(context->gobj());
+      loop->run();
+      g_main_context_pop_thread_default(context->gobj());
+    });
+  }
+
+  ~ContextThread()
+  {
+    quit();
+  }
+
+  void quit()
+  {
+    if (!thread.joinable())
+      return;
+    // The loop may not run yet, so quit it from inside its context
+    RefPtr<Glib::MainLoop> running {loop};
+    context->invoke([running] { running->quit(); return false; });
+    thread.join();
+  }
+
+  const RefPtr<Glib::MainContext>& get_context() const { return context; }
+
+private:
+  RefPtr<Glib::MainContext> context;
+  RefPtr<Glib::MainLoop> loop;
+  std::thread thread;
+};
+
+void run(const Glib::ustring& uri, guint count, guint contexts)
+{
+  long rss_before {0}, threads_before {0};
+  process_status(rss_before, threads_before);
+
+  std::vector<std::unique_ptr<ContextThread>> threads;
+  for (guint i = 0; i < contexts; i++)
+    threads.emplace_back(new ContextThread);
+
+  PlayerOptions options;
+  options.demo_seek = false;
+  options.verbose = false;
+  options.track_position = opt_track_position;
+
+  std::vector<std::unique_ptr<PlayerEngine>> players;
+  for (guint i = 0; i < count; i++)
+  {
+    players.emplace_back(new PlayerEngine(uri, threads[i % contexts]->get_context(), options));
+    RefPtr<Gst::Element> playbin {players.back()->get_playbin()};
+    playbin->set_property("video-sink", Gst::ElementFactory::create_element("fakesink"));
+    playbin->set_property("audio-sink", Gst::ElementFactory::create_element("fakesink"));
+    players.back()->start();
+  }
+
+  double cpu_start {cpu_time()};
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::seconds(opt_seconds));
+  long rss_after {0}, threads_after {0};
+  process_status(rss_after, threads_after);
+
+  // Stop the loops before looking at the players, they are only touched from their context
+  for (std::unique_ptr<ContextThread>& thread : threads)
+    thread->quit();
+  double seconds {std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+  double cpu_seconds {cpu_time() - cpu_start};
+
+  guint playing {0};
+  double lateness {0.0};
+  gint64 max_lateness {0};
+  for (const std::unique_ptr<PlayerEngine>& player : players)
+  {
+    if (player->is_playing())
+      playing++;
+    lateness += player->get_mean_lateness();
+    max_lateness = std::max(max_lateness, player->get_max_lateness());
+  }
+  players.clear();
+
+  std::cout << std::setw(8) << count << std::setw(9) << playing << std::fixed <<
+    std::setprecision(2) << std::setw(12) << lateness / count / 1000.0 << std::setw(12) << max_lateness / 1000.0 <<
+    std::setprecision(1) << std::setw(12) << (rss_after - rss_before) / 1024.0 / count <<
+    std::setw(12) << static_cast<double>(threads_after - threads_before - contexts) / count <<
+    std::setprecision(2) << std::setw(8) << cpu_seconds / seconds << std::endl;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("[uri or local file] - many players in one process")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  // Initialize gstreamermm:
+  Gst::init(argc, argv);
+
+  // A local file is best, hundreds of players would otherwise stream it over the network
+  Glib::ustring uri {"https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm"};
+  if (argc >= 2 && Gst::URIHandler::uri_is_valid(argv[1]))
+    uri = argv[1];
+  else if (argc >= 2 && Glib::file_test(argv[1], Glib::FILE_TEST_IS_REGULAR))
+    uri = Glib::filename_to_uri(argv[1]);
+
+  guint contexts {opt_contexts > 0 ? static_cast<guint>(opt_contexts) : std::max(std::thread::hardware_concurrency(), 1u)};
+  std::vector<guint> counts {parse_list(opt_players, {1, 10, 50, 100, 200})};
+
+  std::cout << uri << ", " << contexts << " main contexts, " << opt_seconds << " s per run" << std::endl;
+  std::cout << std::setw(8) << "players" << std::setw(9) << "playing" <<
+    std::setw(12) << "late ms" << std::setw(12) << "max ms" << std::setw(12) << "MiB/player" <<
+    std::setw(12) << "thr/player" << std::setw(8) << "cores" << std::endl;
+  for (guint count : counts)
+  {
+    try
+    {
+      run(uri, count, contexts);
+    }
+    catch (const std::exception& ex)
+    {
+      std::cerr << ex.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
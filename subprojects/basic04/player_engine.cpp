@@ -0,0 +1,221 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 4: Player engine
+ */
+
+#include "player_engine.h"
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+using Glib::RefPtr;
+
+PlayerEngine::PlayerEngine(const Glib::ustring& uri, const RefPtr<Glib::MainContext>& context,
+    const PlayerOptions& options)
+  : options {options}
+{
+  playbin = Gst::ElementFactory::create_element("playbin");
+  if (!playbin)
+    throw std::runtime_error("the playbin element could not be created");
+  playbin->set_property("uri", uri);
+  if (options.track_position)
+    tracker.reset(new PositionTracker(GST_ELEMENT(playbin->gobj())));
+  if (GST_CLOCK_TIME_IS_VALID(options.loop_start))
+    loop_meter.reset(new LoopMeter(GST_ELEMENT(playbin->gobj())));
+
+  // gstreamermm's add_watch() only knows the default context
+  GMainContext* main_context {context ? context->gobj() : nullptr};
+  bus_watch = gst_bus_create_watch(playbin->get_bus()->gobj());
+  g_source_set_callback(bus_watch, reinterpret_cast<GSourceFunc>(&PlayerEngine::on_bus_message), this, nullptr);
+  g_source_attach(bus_watch, main_context);
+
+  timer = Glib::TimeoutSource::create(options.interval);
+  timer->connect(sigc::mem_fun(*this, &PlayerEngine::on_timeout));
+  timer->attach(context ? context : Glib::MainContext::get_default());
+}
+
+PlayerEngine::~PlayerEngine()
+{
+  // The context may be iterated by another thread, destroying the sources is thread safe.
+  // Destroy a player only while its context is not running, or from that context itself.
+  timer->destroy();
+  g_source_destroy(bus_watch);
+  g_source_unref(bus_watch);
+  playbin->set_state(Gst::STATE_NULL);
+  tracker.reset();
+  loop_meter.reset();
+}
+
+bool PlayerEngine::start()
+{
+  return playbin->set_state(Gst::STATE_PLAYING) != Gst::STATE_CHANGE_FAILURE;
+}
+
+void PlayerEngine::stop()
+{
+  playbin->set_state(Gst::STATE_NULL);
+  playing = false;
+}
+
+std::string PlayerEngine::format_time(gint64 time)
+{
+  std::ostringstream out;
+  out << std::right << std::setfill('0') <<
+    std::setw(3) << Gst::get_hours(time) << ":" <<
+    std::setw(2) << Gst::get_minutes(time) << ":" <<
+    std::setw(2) << Gst::get_seconds(time) << "." <<
+    std::setw(9) << std::left << Gst::get_fractional_seconds(time);
+  return out.str();
+}
+
+gboolean PlayerEngine::on_bus_message(GstBus*, GstMessage* message, gpointer user_data)
+{
+  PlayerEngine* player {static_cast<PlayerEngine*>(user_data)};
+  player->message_signal.emit(message);
+  if (player->tracker)
+    player->tracker->handle_message(message);
+  return player->handle_message(message);
+}
+
+bool PlayerEngine::handle_message(GstMessage* message)
+{
+  switch (GST_MESSAGE_TYPE(message)) {
+    case GST_MESSAGE_EOS:
+      if (options.verbose)
+        std::cout << std::endl << "End of stream" << std::endl;
+      finished = true;
+      finished_signal.emit(true);
+      return false;
+    case GST_MESSAGE_ERROR:
+    {
+      if (options.verbose)
+      {
+        GError* error {nullptr};
+        gchar* debug_info {nullptr};
+        gst_message_parse_error(message, &error, &debug_info);
+        std::cerr << "Error received from element " << GST_OBJECT_NAME(GST_MESSAGE_SRC(message)) << ": " <<
+            error->message << std::endl;
+        if (debug_info)
+          std::cout << "Debugging information: " << debug_info << std::endl;
+        g_clear_error(&error);
+        g_free(debug_info);
+      }
+      finished = true;
+      finished_signal.emit(false);
+      return false;
+    }
+    case GST_MESSAGE_SEGMENT_DONE:
+      /* The demuxer reached the end of the range, queue the next pass while the queues drain */
+      if (loops > 0)
+        seek_loop(false);
+      break;
+    case GST_MESSAGE_DURATION_CHANGED:
+      /* The duration has changed, mark the current one as invalid */
+      duration = Gst::CLOCK_TIME_NONE;
+      break;
+    case GST_MESSAGE_STATE_CHANGED:
+    {
+      // We are only interested in state-changed messages from the playbin
+      if (GST_MESSAGE_SRC(message) != GST_OBJECT(playbin->gobj()))
+        break;
+
+      GstState old_state, new_state;
+      gst_message_parse_state_changed(message, &old_state, &new_state, nullptr);
+      if (options.verbose)
+        std::cout << "Pipeline state changed: " << gst_element_state_get_name(old_state) << " -> " <<
+            gst_element_state_get_name(new_state) << std::endl;
+
+      /* Remember whether we are in the PLAYING state or not */
+      playing = (new_state == GST_STATE_PLAYING);
+      if (playing)
+      {
+        /* We just moved to PLAYING. Check if seeking is possible */
+        Gst::Format format {Gst::FORMAT_TIME};
+        RefPtr<Gst::Query> query {Gst::Query::create_seeking(format)};
+        if (playbin->query(query))
+        {
+          gint64 segment_start {0}, segment_end {0};
+          RefPtr<Gst::QuerySeeking> seek_query = RefPtr<Gst::QuerySeeking>::cast_static(query);
+          seek_query->parse(format, seekable, segment_start, segment_end);
+          /* The first pass of a loop flushes whatever played before it */
+          if (seekable && loop_meter && loops == 0)
+            seek_loop(true);
+          if (!options.verbose)
+            break;
+          if (seekable)
+            std::cout << "Seeking is ENABLED from " << format_time(segment_start) <<
+              " to " << format_time(segment_end) << std::endl;
+          else
+            std::cout << "Seeking is DISABLED for this stream." << std::endl;
+        }
+      }
+      break;
+    }
+    default:
+      break;
+  }
+
+  return true;
+}
+
+bool PlayerEngine::on_timeout()
+{
+  // The next tick is scheduled one interval after this one was dispatched
+  gint64 now {g_get_monotonic_time()};
+  if (ticks > 0)
+  {
+    gint64 lateness {std::max<gint64>(now - last_tick - options.interval * G_TIME_SPAN_MILLISECOND, 0)};
+    total_lateness += lateness;
+    max_lateness = std::max(max_lateness, lateness);
+  }
+  last_tick = now;
+  ticks++;
+
+  // only if playing
+  if (playing)
+  {
+    /* Query the current position of the stream, or interpolate it */
+    bool known {tracker ? tracker->position(position) : playbin->query_position(Gst::FORMAT_TIME, position)};
+    if (!known && options.verbose)
+      std::cerr << "Could not query current position." << std::endl;
+
+    /* If we didn't know it yet, query the stream duration */
+    if (duration == (gint64)Gst::CLOCK_TIME_NONE)
+    {
+      if (!playbin->query_duration(Gst::FORMAT_TIME, duration) && options.verbose)
+        std::cerr << "Could not query current duration." << std::endl;
+    }
+
+    // If seeking is enabled, we have not done it yet, and the time is right, seek
+    if (options.demo_seek && !loop_meter && seekable && !seek_done && position > 10 * (gint64)Gst::SECOND)
+    {
+      if (options.verbose)
+        std::cout << "Reached 10s, performing seek..." << std::endl;
+      playbin->seek(Gst::FORMAT_TIME, Gst::SEEK_FLAG_FLUSH | Gst::SEEK_FLAG_KEY_UNIT, 30 * Gst::SECOND);
+      seek_done = true;
+    }
+  }
+
+  tick_signal.emit();
+  return true;
+}
+
+void PlayerEngine::seek_loop(bool flush)
+{
+  // SEGMENT makes the pipeline post SEGMENT_DONE instead of EOS at the stop position, and the
+  // accurate start cuts the first frame and audio sample exactly at the loop point
+  Gst::SeekFlags flags {Gst::SEEK_FLAG_SEGMENT | Gst::SEEK_FLAG_ACCURATE};
+  if (flush)
+    flags |= Gst::SEEK_FLAG_FLUSH;
+  bool bounded {GST_CLOCK_TIME_IS_VALID(options.loop_stop)};
+  if (!playbin->seek(1.0, Gst::FORMAT_TIME, flags, Gst::SEEK_TYPE_SET, options.loop_start,
+      bounded ? Gst::SEEK_TYPE_SET : Gst::SEEK_TYPE_NONE, bounded ? options.loop_stop : -1))
+  {
+    if (options.verbose)
+      std::cerr << "Could not seek to the loop start." << std::endl;
+    return;
+  }
+  loops++;
+}
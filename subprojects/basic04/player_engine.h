@@ -0,0 +1,119 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 4: Player engine
+ *
+ * The player logic of the tutorial, a playbin with a bus watch and a position timer, in a
+ * class without any global state, so one process can run many independent players. The bus
+ * watch and the timer of a player are attached to the GMainContext given at construction,
+ * which may be shared by any number of players or run in a thread of its own; all the
+ * signals of a player are emitted from that context.
+ *
+ * A player also measures how late its timer fires behind schedule, which is the latency of
+ * the main loop it runs on.
+ *
+ * With a loop range, the player plays it over and over without a gap: a flushing segment
+ * seek to the range starts the first pass, and each SEGMENT_DONE queues the next pass with a
+ * non-flushing segment seek while the current one still drains through the queues.
+ */
+
+#ifndef PLAYER_ENGINE_H
+#define PLAYER_ENGINE_H
+
+#include <gstreamermm.h>
+#include <glibmm/main.h>
+#include <memory>
+#include "position_tracker.h"
+#include "loop_meter.h"
+
+struct PlayerOptions
+{
+  // Milliseconds between position updates
+  guint interval {100};
+  // Seek to 30 s once the position passed 10 s, as the tutorial does
+  bool demo_seek {true};
+  // Print state changes, seeking ranges and errors
+  bool verbose {true};
+  // Interpolate the position from the clock instead of querying it on every tick
+  bool track_position {false};
+  // Loop from loop_start to loop_stop, or to the end when it is GST_CLOCK_TIME_NONE, once the
+  // stream is seekable; no loop unless loop_start is set. Replaces the demo seek.
+  GstClockTime loop_start {GST_CLOCK_TIME_NONE};
+  GstClockTime loop_stop {GST_CLOCK_TIME_NONE};
+};
+
+class PlayerEngine
+{
+public:
+  // A null context is the global default one
+  PlayerEngine(const Glib::ustring& uri, const Glib::RefPtr<Glib::MainContext>& context,
+      const PlayerOptions& options);
+  ~PlayerEngine();
+
+  PlayerEngine(const PlayerEngine&) = delete;
+  PlayerEngine& operator=(const PlayerEngine&) = delete;
+
+  // Set the playbin to PLAYING, false on failure
+  bool start();
+  // Set the playbin to NULL
+  void stop();
+
+  const Glib::RefPtr<Gst::Element>& get_playbin() const { return playbin; }
+  // nullptr unless PlayerOptions::track_position is set
+  PositionTracker* get_tracker() const { return tracker.get(); }
+  // nullptr unless PlayerOptions::loop_start is set
+  LoopMeter* get_loop_meter() const { return loop_meter.get(); }
+  // Passes of the loop queued so far, the first one included
+  guint64 get_loops() const { return loops; }
+  bool is_playing() const { return playing; }
+  bool is_seekable() const { return seekable; }
+  bool is_finished() const { return finished; }
+  gint64 get_position() const { return position; }
+  gint64 get_duration() const { return duration; }
+
+  // Every bus message, before the player handles it
+  sigc::signal<void, GstMessage*>& signal_message() { return message_signal; }
+  // Every timer tick, after the position and duration were updated
+  sigc::signal<void>& signal_tick() { return tick_signal; }
+  // End of stream (true) or an error (false), the bus is not watched any more after it
+  sigc::signal<void, bool>& signal_finished() { return finished_signal; }
+
+  // Timer lateness behind schedule, in microseconds
+  guint64 get_ticks() const { return ticks; }
+  gint64 get_max_lateness() const { return max_lateness; }
+  double get_mean_lateness() const { return ticks > 1 ? static_cast<double>(total_lateness) / (ticks - 1) : 0.0; }
+
+  // HHH:MM:SS.NNNNNNNNN
+  static std::string format_time(gint64 time);
+
+private:
+  static gboolean on_bus_message(GstBus*, GstMessage* message, gpointer user_data);
+  bool handle_message(GstMessage* message);
+  bool on_timeout();
+  void seek_loop(bool flush);
+
+  PlayerOptions options;
+  Glib::RefPtr<Gst::Element> playbin;
+  GSource* bus_watch {nullptr};
+  Glib::RefPtr<Glib::TimeoutSource> timer;
+  std::unique_ptr<PositionTracker> tracker;
+  std::unique_ptr<LoopMeter> loop_meter;
+
+  bool playing {false};
+  bool seekable {false};
+  bool seek_done {false};
+  bool finished {false};
+  guint64 loops {0};
+  gint64 position {0};
+  gint64 duration {static_cast<gint64>(GST_CLOCK_TIME_NONE)};
+
+  gint64 last_tick {0};
+  guint64 ticks {0};
+  gint64 total_lateness {0};
+  gint64 max_lateness {0};
+
+  sigc::signal<void, GstMessage*> message_signal;
+  sigc::signal<void> tick_signal;
+  sigc::signal<void, bool> finished_signal;
+};
+
+#endif // PLAYER_ENGINE_H
@@ -0,0 +1,230 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 4: Clock-interpolated position tracking
+ */
+
+#include "position_tracker.h"
+
+PositionTracker::PositionTracker(GstElement* pipeline)
+  : pipeline {pipeline}
+{
+  gst_segment_init(&segment, GST_FORMAT_UNDEFINED);
+  if (!GST_IS_BIN(pipeline))
+    return;
+
+  // The sinks of a playbin are created when it starts, older ones are looked up now
+  added_id = g_signal_connect(pipeline, "deep-element-added", G_CALLBACK(&on_element_added), this);
+  GstIterator* it {gst_bin_iterate_recurse(GST_BIN(pipeline))};
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next(it, &item) == GST_ITERATOR_OK)
+  {
+    watch_sink(GST_ELEMENT(g_value_get_object(&item)));
+    g_value_reset(&item);
+  }
+  g_value_unset(&item);
+  gst_iterator_free(it);
+}
+
+PositionTracker::~PositionTracker()
+{
+  if (added_id)
+    g_signal_handler_disconnect(pipeline, added_id);
+
+  std::vector<std::pair<GstPad*, gulong>> watched;
+  {
+    std::lock_guard<std::mutex> lock {mutex};
+    watched.swap(probes);
+  }
+  for (auto& probe : watched)
+  {
+    gst_pad_remove_probe(probe.first, probe.second);
+    gst_object_unref(probe.first);
+  }
+  if (clock)
+    gst_object_unref(clock);
+}
+
+void PositionTracker::on_element_added(GstBin*, GstBin*, GstElement* element, gpointer user_data)
+{
+  static_cast<PositionTracker*>(user_data)->watch_sink(element);
+}
+
+void PositionTracker::watch_sink(GstElement* element)
+{
+  // Sink bins such as autovideosink carry the flag as well, their child sink is enough
+  if (GST_IS_BIN(element) || !GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK))
+    return;
+  GstPad* pad {gst_element_get_static_pad(element, "sink")};
+  if (!pad)
+    return;
+
+  gulong id {gst_pad_add_probe(pad,
+      static_cast<GstPadProbeType>(GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+      &on_sink_event, this, nullptr)};
+  std::lock_guard<std::mutex> lock {mutex};
+  probes.emplace_back(pad, id);
+}
+
+GstPadProbeReturn PositionTracker::on_sink_event(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+  PositionTracker* self {static_cast<PositionTracker*>(user_data)};
+  GstEvent* event {GST_PAD_PROBE_INFO_EVENT(info)};
+
+  switch (GST_EVENT_TYPE(event))
+  {
+    case GST_EVENT_FLUSH_START:
+    case GST_EVENT_FLUSH_STOP:
+    {
+      std::lock_guard<std::mutex> lock {self->mutex};
+      if (pad == self->tracked_pad)
+      {
+        self->have_segment = false;
+        self->invalidate();
+      }
+      break;
+    }
+    case GST_EVENT_SEGMENT:
+    {
+      // The first sink with a time segment is followed, the position query reports the
+      // furthest of all sinks, which differ by less than a buffer
+      const GstSegment* new_segment {nullptr};
+      gst_event_parse_segment(event, &new_segment);
+      if (new_segment->format != GST_FORMAT_TIME)
+        break;
+
+      std::lock_guard<std::mutex> lock {self->mutex};
+      if (!self->tracked_pad)
+        self->tracked_pad = pad;
+      if (pad == self->tracked_pad)
+      {
+        gst_segment_copy_into(new_segment, &self->segment);
+        self->have_segment = true;
+        self->invalidate();
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+// With the mutex held
+void PositionTracker::invalidate()
+{
+  valid = false;
+  generation++;
+}
+
+void PositionTracker::handle_message(GstMessage* message)
+{
+  switch (GST_MESSAGE_TYPE(message))
+  {
+    case GST_MESSAGE_STATE_CHANGED:
+    {
+      if (GST_MESSAGE_SRC(message) != GST_OBJECT(pipeline))
+        break;
+      GstState new_state;
+      gst_message_parse_state_changed(message, nullptr, &new_state, nullptr);
+      std::lock_guard<std::mutex> lock {mutex};
+      // A new base time is distributed on every change to PLAYING
+      playing = (new_state == GST_STATE_PLAYING);
+      invalidate();
+      break;
+    }
+    case GST_MESSAGE_ASYNC_DONE:
+    case GST_MESSAGE_NEW_CLOCK:
+    case GST_MESSAGE_CLOCK_LOST:
+    case GST_MESSAGE_LATENCY:
+    {
+      std::lock_guard<std::mutex> lock {mutex};
+      invalidate();
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+bool PositionTracker::position(gint64& position)
+{
+  {
+    std::lock_guard<std::mutex> lock {mutex};
+    if (valid && !playing)
+    {
+      position = paused_position;
+      interpolated++;
+      return true;
+    }
+    if (valid)
+    {
+      // Running time of what the sink renders now, mapped through its segment
+      GstClockTime now {gst_clock_get_time(clock)};
+      if (now >= base_time + latency)
+      {
+        guint64 stream_position {gst_segment_position_from_running_time(&segment, GST_FORMAT_TIME,
+            now - base_time - latency)};
+        if (GST_CLOCK_TIME_IS_VALID(stream_position))
+          stream_position = gst_segment_to_stream_time(&segment, GST_FORMAT_TIME, stream_position);
+        if (GST_CLOCK_TIME_IS_VALID(stream_position))
+        {
+          position = stream_position;
+          interpolated++;
+          return true;
+        }
+      }
+      // Before the first frame or past the end of the segment, let the sink answer
+      valid = false;
+    }
+  }
+  return query(position);
+}
+
+// The latency the sinks were configured with: the pipeline's fixed one if it has one, else
+// the minimum latency of a live pipeline, as GstBin distributes it; nothing when not live
+GstClockTime PositionTracker::configured_latency()
+{
+  if (GST_IS_PIPELINE(pipeline))
+  {
+    GstClockTime fixed {gst_pipeline_get_latency(GST_PIPELINE(pipeline))};
+    if (GST_CLOCK_TIME_IS_VALID(fixed))
+      return fixed;
+  }
+
+  GstClockTime min_latency {0};
+  gboolean live {FALSE};
+  GstQuery* query {gst_query_new_latency()};
+  if (gst_element_query(pipeline, query))
+    gst_query_parse_latency(query, &live, &min_latency, nullptr);
+  gst_query_unref(query);
+  return live && GST_CLOCK_TIME_IS_VALID(min_latency) ? min_latency : 0;
+}
+
+// The fallback: a real query, then capture the clock relationship again
+bool PositionTracker::query(gint64& position)
+{
+  guint query_generation;
+  {
+    std::lock_guard<std::mutex> lock {mutex};
+    query_generation = generation;
+  }
+
+  bool answered {gst_element_query_position(pipeline, GST_FORMAT_TIME, &position) != FALSE};
+  GstClock* pipeline_clock {gst_element_get_clock(pipeline)};
+  GstClockTime pipeline_base_time {gst_element_get_base_time(pipeline)};
+  GstClockTime pipeline_latency {configured_latency()};
+
+  std::lock_guard<std::mutex> lock {mutex};
+  queried++;
+  if (clock)
+    gst_object_unref(clock);
+  clock = pipeline_clock;
+  base_time = pipeline_base_time;
+  latency = pipeline_latency;
+  paused_position = answered ? position : -1;
+
+  // Anything that happened during the query makes the capture stale
+  if (generation == query_generation)
+    valid = answered && have_segment && (playing ? clock != nullptr : true);
+  return answered;
+}
@@ -0,0 +1,81 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 4: Clock-interpolated position tracking
+ *
+ * A position query travels from the pipeline down to every sink and takes their locks, so
+ * polling it for hundreds of players adds up. While a pipeline is PLAYING, its position is
+ * a pure function of the clock, though: a sink renders the buffer with running time R when
+ * the clock reaches base_time + R + latency, and the segment it received maps R to a stream
+ * position. PositionTracker keeps these pieces, the segment from an event probe on a sink,
+ * and the clock, base time and latency from the bus messages that change them, and computes
+ * the position from a single clock read.
+ *
+ * Discontinuities, a flush, a state change, a new clock or latency, or a segment the running
+ * time does not fall into, invalidate the interpolation. The next position() then asks the
+ * pipeline with a real query and captures the pieces again. While PAUSED the position of
+ * that one query is kept.
+ *
+ * The sink pads keep probes that point to the tracker until it is destroyed, destroy it only
+ * after the pipeline was stopped.
+ */
+
+#ifndef POSITION_TRACKER_H
+#define POSITION_TRACKER_H
+
+#include <gst/gst.h>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+class PositionTracker
+{
+public:
+  explicit PositionTracker(GstElement* pipeline);
+  ~PositionTracker();
+
+  PositionTracker(const PositionTracker&) = delete;
+  PositionTracker& operator=(const PositionTracker&) = delete;
+
+  // Feed state, clock and latency changes, call it from the application's bus handler
+  void handle_message(GstMessage* message);
+
+  // The stream position in nanoseconds, like a position query in GST_FORMAT_TIME
+  bool position(gint64& position);
+
+  // How often position() was answered from the clock and with a real query
+  guint64 get_interpolated() const { return interpolated; }
+  guint64 get_queried() const { return queried; }
+
+private:
+  static void on_element_added(GstBin*, GstBin*, GstElement* element, gpointer user_data);
+  static GstPadProbeReturn on_sink_event(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+  void watch_sink(GstElement* element);
+  void invalidate();
+  bool query(gint64& position);
+  GstClockTime configured_latency();
+
+  GstElement* pipeline;
+  gulong added_id {0};
+
+  // Written by the streaming threads and the main loop
+  std::mutex mutex;
+  std::vector<std::pair<GstPad*, gulong>> probes;
+  GstPad* tracked_pad {nullptr};
+  GstSegment segment;
+  bool have_segment {false};
+  bool valid {false};
+  bool playing {false};
+  // Counts invalidations, a capture racing with one is not valid
+  guint generation {0};
+
+  // The captured clock relationship
+  GstClock* clock {nullptr};
+  GstClockTime base_time {0};
+  GstClockTime latency {0};
+  gint64 paused_position {-1};
+
+  guint64 interpolated {0};
+  guint64 queried {0};
+};
+
+#endif // POSITION_TRACKER_H
@@ -0,0 +1,436 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 4: Parallel segmented decoding
+ *
+ * One pipeline decodes a file from start to end on one or two cores. For offline analysis
+ * the frames need not come in real time, only in order, so the file can be cut into K
+ * ranges that K pipelines decode at the same time:
+ *  - The duration is queried as in the tutorial, then the nominal cut points i * duration / K
+ *    are moved back to the keyframe before them, with a KEY_UNIT | SNAP_BEFORE seek of a
+ *    prerolled probe pipeline, so that no pipeline decodes frames only to throw them away.
+ *  - Every range [start, end) is decoded by a pipeline of its own, after a flushing,
+ *    accurate seek with a start and a stop position. The stop lies a little past the end:
+ *    the demuxer stops at the first keyframe past the stop position, so without the
+ *    overlap the frames shown before a keyframe but stored after it, as in open GOPs, would
+ *    be missing from both ranges.
+ *  - Each frame is analyzed in its pipeline's thread, here with a checksum of its contents,
+ *    and kept when its stream time lies within the range, which assigns every frame to
+ *    exactly one range. The ranges' results are stitched in order.
+ * Every K is checked against the single pipeline run: the same frames with the same
+ * timestamps and checksums must come out, and the speedup and CPU cores used are reported.
+ */
+
+#include <gstreamermm.h>
+#include <glibmm/convert.h>
+#include <glibmm/fileutils.h>
+#include <gst/app/gstappsink.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <sys/resource.h>
+
+namespace
+{
+
+// Command line options
+gchar* opt_segments {nullptr};
+gint opt_overlap {1000};
+gchar* opt_output {nullptr};
+
+GOptionEntry entries[] =
+{
+  { "segments", 'k', 0, G_OPTION_ARG_STRING, &opt_segments,
+    "Comma separated numbers of parallel pipelines (default 1,2,4 and one per CPU)", "LIST" },
+  { "overlap", 'o', 0, G_OPTION_ARG_INT, &opt_overlap,
+    "Milliseconds each range is decoded past its end (default 1000)", "MS" },
+  { "output", 'w', 0, G_OPTION_ARG_FILENAME, &opt_output,
+    "Write the stitched time and checksum of every frame of the last run to FILE", "FILE" },
+  { nullptr }
+};
+
+// The result of analyzing one frame
+struct Frame
+{
+  GstClockTime time;
+  guint64 checksum;
+
+  bool operator==(const Frame& other) const { return time == other.time && checksum == other.checksum; }
+};
+
+// One range of the file and the frames decoded for it
+struct Segment
+{
+  GstClockTime start;
+  // GST_CLOCK_TIME_NONE for the last range, up to the end of the stream
+  GstClockTime end;
+  std::vector<Frame> frames;
+  guint64 decoded {0};
+  std::string error;
+};
+
+double cpu_time()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+std::vector<guint> parse_list(const gchar* list, const std::vector<guint>& fallback)
+{
+  if (!list)
+    return fallback;
+
+  std::vector<guint> values;
+  std::istringstream in {list};
+  std::string item;
+  while (std::getline(in, item, ','))
+  {
+    gint value {atoi(item.c_str())};
+    if (value > 0)
+      values.push_back(value);
+  }
+  return values;
+}
+
+// FNV-1a over 64 bit words, fast enough not to hide the decoding cost
+guint64 checksum(const guint8* data, gsize size)
+{
+  guint64 hash {G_GUINT64_CONSTANT(14695981039346656037)};
+  gsize i {0};
+  for (; i + sizeof(guint64) <= size; i += sizeof(guint64))
+  {
+    guint64 word;
+    memcpy(&word, data + i, sizeof(word));
+    hash = (hash ^ word) * G_GUINT64_CONSTANT(1099511628211);
+  }
+  for (; i < size; i++)
+    hash = (hash ^ data[i]) * G_GUINT64_CONSTANT(1099511628211);
+  return hash;
+}
+
+// A uridecodebin decoding the video only, into an appsink that is pulled as fast as it decodes
+class DecodePipeline
+{
+public:
+  explicit DecodePipeline(const Glib::ustring& uri)
+  {
+    pipeline = gst_pipeline_new(nullptr);
+    GstElement* decodebin {gst_element_factory_make("uridecodebin", nullptr)};
+    sink = gst_element_factory_make("appsink", nullptr);
+    if (!decodebin || !sink)
+      throw std::runtime_error("uridecodebin or appsink could not be created");
+
+    // Other streams stay undecoded and unlinked
+    GstCaps* caps {gst_caps_new_empty_simple("video/x-raw")};
+    g_object_set(decodebin, "uri", uri.c_str(), "caps", caps, nullptr);
+    g_object_set(sink, "caps", caps, "sync", FALSE, "max-buffers", 4u, nullptr);
+    gst_caps_unref(caps);
+    gst_bin_add_many(GST_BIN(pipeline), decodebin, sink, nullptr);
+    g_signal_connect(decodebin, "pad-added", G_CALLBACK(&on_pad_added), sink);
+  }
+
+  ~DecodePipeline()
+  {
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+  }
+
+  DecodePipeline(const DecodePipeline&) = delete;
+  DecodePipeline& operator=(const DecodePipeline&) = delete;
+
+  // Go to PAUSED, or after a flushing seek wait for the new preroll
+  bool preroll()
+  {
+    if (gst_element_set_state(pipeline, GST_STATE_PAUSED) == GST_STATE_CHANGE_FAILURE)
+      return false;
+    return gst_element_get_state(pipeline, nullptr, nullptr, GST_CLOCK_TIME_NONE) == GST_STATE_CHANGE_SUCCESS;
+  }
+
+  bool seek(GstSeekFlags flags, GstClockTime start, GstClockTime stop)
+  {
+    if (!gst_element_seek(pipeline, 1.0, GST_FORMAT_TIME, static_cast<GstSeekFlags>(GST_SEEK_FLAG_FLUSH | flags),
+        GST_SEEK_TYPE_SET, start, GST_CLOCK_TIME_IS_VALID(stop) ? GST_SEEK_TYPE_SET : GST_SEEK_TYPE_NONE, stop))
+      return false;
+    return preroll();
+  }
+
+  bool play()
+  {
+    return gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE;
+  }
+
+  gint64 query_duration()
+  {
+    gint64 duration {-1};
+    gst_element_query_duration(pipeline, GST_FORMAT_TIME, &duration);
+    return duration;
+  }
+
+  // The stream time of the prerolled frame
+  GstClockTime preroll_time()
+  {
+    GstSample* sample {gst_app_sink_try_pull_preroll(GST_APP_SINK(sink), 10 * GST_SECOND)};
+    if (!sample)
+      return GST_CLOCK_TIME_NONE;
+    GstClockTime time {stream_time(sample)};
+    gst_sample_unref(sample);
+    return time;
+  }
+
+  // nullptr at the end of the stream or on an error
+  GstSample* pull()
+  {
+    return gst_app_sink_pull_sample(GST_APP_SINK(sink));
+  }
+
+  static GstClockTime stream_time(GstSample* sample)
+  {
+    GstBuffer* buffer {gst_sample_get_buffer(sample)};
+    const GstSegment* segment {gst_sample_get_segment(sample)};
+    if (!buffer || !GST_BUFFER_PTS_IS_VALID(buffer))
+      return GST_CLOCK_TIME_NONE;
+    if (!segment || segment->format != GST_FORMAT_TIME)
+      return GST_BUFFER_PTS(buffer);
+    return gst_segment_to_stream_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+  }
+
+  // The error that stopped the pipeline, if any
+  std::string get_error()
+  {
+    GstBus* bus {gst_element_get_bus(pipeline)};
+    GstMessage* message {gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR)};
+    gst_object_unref(bus);
+    if (!message)
+      return std::string();
+
+    GError* error {nullptr};
+    gst_message_parse_error(message, &error, nullptr);
+    std::string text {std::string(GST_OBJECT_NAME(GST_MESSAGE_SRC(message))) + ": " + error->message};
+    g_clear_error(&error);
+    gst_message_unref(message);
+    return text;
+  }
+
+private:
+  static void on_pad_added(GstElement*, GstPad* pad, gpointer user_data)
+  {
+    GstPad* sink_pad {gst_element_get_static_pad(GST_ELEMENT(user_data), "sink")};
+    GstCaps* caps {gst_pad_get_current_caps(pad)};
+    if (caps && !gst_pad_is_linked(sink_pad) &&
+        g_str_has_prefix(gst_structure_get_name(gst_caps_get_structure(caps, 0)), "video/x-raw"))
+      gst_pad_link(pad, sink_pad);
+    if (caps)
+      gst_caps_unref(caps);
+    gst_object_unref(sink_pad);
+  }
+
+  GstElement* pipeline;
+  GstElement* sink;
+};
+
+// Decode one range and keep the frames that belong to it, runs in a thread of its own
+void decode_segment(const Glib::ustring& uri, Segment& segment)
+{
+  try
+  {
+    DecodePipeline decoder {uri};
+    GstClockTime stop {GST_CLOCK_TIME_IS_VALID(segment.end) ? segment.end + opt_overlap * GST_MSECOND :
+      GST_CLOCK_TIME_NONE};
+    if (!decoder.preroll() || !decoder.seek(GST_SEEK_FLAG_ACCURATE, segment.start, stop) || !decoder.play())
+    {
+      segment.error = decoder.get_error();
+      if (segment.error.empty())
+        segment.error = "could not start decoding";
+      return;
+    }
+
+    while (GstSample* sample = decoder.pull())
+    {
+      segment.decoded++;
+      GstClockTime time {DecodePipeline::stream_time(sample)};
+      if (GST_CLOCK_TIME_IS_VALID(time) && time >= segment.start &&
+          (!GST_CLOCK_TIME_IS_VALID(segment.end) || time < segment.end))
+      {
+        GstMapInfo map;
+        GstBuffer* buffer {gst_sample_get_buffer(sample)};
+        if (gst_buffer_map(buffer, &map, GST_MAP_READ))
+        {
+          segment.frames.push_back(Frame {time, checksum(map.data, map.size)});
+          gst_buffer_unmap(buffer, &map);
+        }
+      }
+      gst_sample_unref(sample);
+    }
+    segment.error = decoder.get_error();
+  }
+  catch (const std::exception& ex)
+  {
+    segment.error = ex.what();
+  }
+}
+
+// The keyframes at or before the nominal cut points, unique and in order, 0 first
+std::vector<GstClockTime> find_cuts(DecodePipeline& probe, gint64 duration, guint count)
+{
+  std::set<GstClockTime> cuts {0};
+  for (guint i = 1; i < count; i++)
+  {
+    GstClockTime nominal {gst_util_uint64_scale(duration, i, count)};
+    if (!probe.seek(static_cast<GstSeekFlags>(GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_BEFORE), nominal,
+        GST_CLOCK_TIME_NONE))
+      continue;
+    GstClockTime keyframe {probe.preroll_time()};
+    if (GST_CLOCK_TIME_IS_VALID(keyframe))
+      cuts.insert(keyframe);
+  }
+  return std::vector<GstClockTime>(cuts.begin(), cuts.end());
+}
+
+// Where the stitched frames differ from the reference, or nothing if they do not
+std::string compare(const std::vector<Frame>& frames, const std::vector<Frame>& reference)
+{
+  if (frames == reference)
+    return "identical";
+
+  std::ostringstream out;
+  auto mismatch = std::mismatch(frames.begin(), frames.end(), reference.begin(), reference.end());
+  out << static_cast<gint64>(frames.size()) - static_cast<gint64>(reference.size()) << " frames, first at ";
+  if (mismatch.first != frames.end())
+    out << static_cast<double>(mismatch.first->time) / GST_SECOND << " s";
+  else
+    out << static_cast<double>(mismatch.second->time) / GST_SECOND << " s";
+  return out.str();
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("<uri or local file> - parallel segmented decoding")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  // Initialize gstreamermm:
+  Gst::init(argc, argv);
+
+  // A local file is best, the network would otherwise be the bottleneck
+  Glib::ustring uri {"https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm"};
+  if (argc >= 2 && Gst::URIHandler::uri_is_valid(argv[1]))
+    uri = argv[1];
+  else if (argc >= 2 && Glib::file_test(argv[1], Glib::FILE_TEST_IS_REGULAR))
+    uri = Glib::filename_to_uri(argv[1]);
+
+  // The single pipeline run is the reference for the speedup and the frames
+  guint cpus {std::max(std::thread::hardware_concurrency(), 1u)};
+  std::vector<guint> counts {parse_list(opt_segments, {1, 2, 4, cpus})};
+  std::sort(counts.begin(), counts.end());
+  counts.erase(std::unique(counts.begin(), counts.end()), counts.end());
+  if (counts.empty() || counts.front() != 1)
+    counts.insert(counts.begin(), 1);
+
+  gint64 duration {-1};
+  std::unique_ptr<DecodePipeline> probe;
+  try
+  {
+    probe.reset(new DecodePipeline(uri));
+    if (probe->preroll())
+      duration = probe->query_duration();
+  }
+  catch (const std::exception& ex)
+  {
+    std::cerr << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (duration <= 0)
+  {
+    std::cerr << "Could not query the duration of " << uri << " " << probe->get_error() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << uri << ", " << static_cast<double>(duration) / GST_SECOND << " s, " << cpus << " CPUs" << std::endl;
+  std::cout << std::setw(4) << "K" << std::setw(7) << "cuts" << std::setw(9) << "frames" << std::setw(9) <<
+    "decoded" << std::setw(10) << "seconds" << std::setw(10) << "fps" << std::setw(9) << "speedup" <<
+    std::setw(7) << "cores" << "  frames vs K=1" << std::endl;
+
+  std::vector<Frame> reference;
+  double reference_seconds {0.0};
+  std::vector<Frame> stitched;
+  for (guint count : counts)
+  {
+    std::vector<GstClockTime> cuts {find_cuts(*probe, duration, count)};
+    std::vector<Segment> segments(cuts.size());
+    for (gsize i = 0; i < cuts.size(); i++)
+    {
+      segments[i].start = cuts[i];
+      segments[i].end = i + 1 < cuts.size() ? cuts[i + 1] : GST_CLOCK_TIME_NONE;
+    }
+
+    double cpu_start {cpu_time()};
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (Segment& segment : segments)
+      threads.emplace_back(&decode_segment, std::cref(uri), std::ref(segment));
+    for (std::thread& thread : threads)
+      thread.join();
+    double seconds {std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+    double cpu_seconds {cpu_time() - cpu_start};
+
+    // Stitch the ranges in order, each frame belongs to exactly one
+    stitched.clear();
+    guint64 decoded {0};
+    bool failed {false};
+    for (Segment& segment : segments)
+    {
+      if (!segment.error.empty())
+      {
+        std::cerr << "Range at " << static_cast<double>(segment.start) / GST_SECOND << " s: " << segment.error <<
+          std::endl;
+        failed = true;
+      }
+      stitched.insert(stitched.end(), segment.frames.begin(), segment.frames.end());
+      decoded += segment.decoded;
+    }
+    if (count == 1)
+    {
+      reference = stitched;
+      reference_seconds = seconds;
+    }
+
+    std::cout << std::setw(4) << count << std::setw(7) << cuts.size() << std::setw(9) << stitched.size() <<
+      std::setw(9) << decoded << std::fixed << std::setprecision(2) << std::setw(10) << seconds <<
+      std::setprecision(1) << std::setw(10) << stitched.size() / seconds << std::setprecision(2) <<
+      std::setw(9) << reference_seconds / seconds << std::setw(7) << cpu_seconds / seconds << "  " <<
+      (failed ? "failed" : count == 1 ? "reference" : compare(stitched, reference)) << std::endl;
+  }
+
+  if (opt_output)
+  {
+    std::ofstream output {opt_output};
+    for (const Frame& frame : stitched)
+      output << frame.time << "\t" << std::hex << frame.checksum << std::dec << "\n";
+  }
+
+  return EXIT_SUCCESS;
+}
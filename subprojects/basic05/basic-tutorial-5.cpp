@@ -10,8 +10,15 @@
 #include <gstreamermm.h>
 #include <glibmm.h>
 #include <gtkmm.h>
+#include <algorithm>
 #include <iostream>
+#include <iomanip>
 #include <sstream>
+#include <memory>
+#include "qos_controller.h"
+#include "event_mailbox.h"
+#include "render_path.h"
+#include "native_video.h"
 
 using Glib::RefPtr;
 using Gst::Element;
@@ -25,6 +32,20 @@ using Gtk::HScale;
 using Gtk::Box;
 using Gtk::TextView;
 
+// Command line options
+static gboolean opt_leaky {FALSE};
+static gboolean opt_native {FALSE};
+
+static GOptionEntry entries[] =
+{
+  { "leaky", 'l', 0, G_OPTION_ARG_NONE, &opt_leaky,
+    "Hand frames to the GTK sink through a leaky one frame queue, so that a busy GUI drops frames "
+    "instead of stalling the pipeline", nullptr },
+  { "native", 'n', 0, G_OPTION_ARG_NONE, &opt_native,
+    "Negotiate the sink's native format, with at most one converter instead of playsink's chain", nullptr },
+  { nullptr }
+};
+
 static void PlayBin_signal_tags_changed_callback(Element* self, gint p0, void* data)
 {
   using SlotType = sigc::slot<void, int>;
@@ -68,22 +89,47 @@ static const Glib::SignalProxyInfo PlayBin_signal_text_tags_changed_info =
 };
 
 
+/* Streaming threads report to the main thread through a mailbox of these, which does not
+ * allocate or wake the main loop per event like an application message on the bus would */
+struct PlayerEvent
+{
+  enum Type { VIDEO_TAGS, AUDIO_TAGS, TEXT_TAGS };
+
+  Type type;
+  gint stream;
+};
+
+
 class PlayerWindow: public Gtk::Window
 {
 public:
-  PlayerWindow(const RefPtr<Element>& playbin);
+  PlayerWindow(const RefPtr<Element>& playbin, bool leaky, bool native);
   ~PlayerWindow();
 
 protected:
+  /* What the refresh timer is doing, its wakeups are counted per state for a report at exit */
+  enum RefreshState { REFRESH_PLAYING, REFRESH_PAUSED, REFRESH_HIDDEN, N_REFRESH_STATES };
+
   bool on_delete_event(GdkEventAny* any_event);
-  void on_tags_changed();
+  bool on_window_state_event(GdkEventWindowState* event);
+  void on_tags_changed(gint stream, PlayerEvent::Type type);
+  void on_player_events(const std::vector<PlayerEvent>& batch);
   void on_button_play();
   void on_button_pause();
   void on_button_stop();
   void on_slider_value_changed();
 
   void create_ui();
-  bool refresh_ui();
+  void refresh_ui();
+  void refresh_now();
+  bool on_refresh_timeout();
+  void evaluate_qos();
+  bool schedule_refresh();
+  guint get_refresh_interval() const;
+  void account_refresh_state(RefreshState state);
+  void report_refresh_wakeups();
+  void report_render_path();
+  void report_conversion();
   void analyze_streams();
   bool on_bus_message(const RefPtr<Bus>& bus, const RefPtr<Message>& message);
 
@@ -104,10 +150,29 @@ protected:
   guint watch_id;
   State stream_state;
   gint64 stream_duration;
+  std::unique_ptr<QosController> qos;
+  EventMailbox<PlayerEvent> events;
+  std::unique_ptr<LeakyRender> leaky_render;
+  std::unique_ptr<AudioUnderrunCounter> audio_underruns;
+  std::unique_ptr<NativeVideoSink> native_sink;
+  std::unique_ptr<ConversionCounter> conversions;
+
+protected:
+  /* The refresh timer only runs while playing and visible, at the rate the slider's thumb
+   * moves a pixel. QoS is evaluated on QoS messages, and on refreshes while degraded. */
+  sigc::connection refresh_timer;
+  guint refresh_interval;
+  gint slider_pixel;
+  gint64 last_qos_update;
+  bool hidden;
+  RefreshState refresh_state;
+  gint64 refresh_state_since;
+  guint64 refresh_wakeups[N_REFRESH_STATES];
+  gint64 refresh_state_time[N_REFRESH_STATES];
 };
 
 
-PlayerWindow::PlayerWindow(const RefPtr<Element>& playbin)
+PlayerWindow::PlayerWindow(const RefPtr<Element>& playbin, bool leaky, bool native)
   : play_button{}
   , pause_button{}
   , stop_button{}
@@ -119,6 +184,15 @@ PlayerWindow::PlayerWindow(const RefPtr<Element>& playbin)
   , m_playbin{ playbin }
   , stream_state{ Gst::STATE_NULL}
   , stream_duration{ (gint64)Gst::CLOCK_TIME_NONE }
+  , events{ 64, [this] (const std::vector<PlayerEvent>& batch) { on_player_events(batch); } }
+  , refresh_interval{ 0 }
+  , slider_pixel{ -1 }
+  , last_qos_update{ 0 }
+  , hidden{ false }
+  , refresh_state{ REFRESH_PAUSED }
+  , refresh_state_since{ g_get_monotonic_time() }
+  , refresh_wakeups{}
+  , refresh_state_time{}
 {
   m_playbin = playbin;
 
@@ -143,15 +217,34 @@ PlayerWindow::PlayerWindow(const RefPtr<Element>& playbin)
     video_sink->get_property("widget", sink_widget);
   }
 
+  /* Optionally negotiate the sink's format ourselves, playsink then adds no converters */
+  if (native)
+  {
+    native_sink.reset(new NativeVideoSink(video_sink->gobj()));
+    video_sink = Glib::wrap(native_sink->get_bin(), true);
+    NativeVideoSink::set_native_flag(m_playbin->gobj());
+  }
+
+  /* Optionally decouple the sink from the streaming thread, which then never waits for the GUI */
+  if (leaky)
+  {
+    leaky_render.reset(new LeakyRender(video_sink->gobj()));
+    video_sink = Glib::wrap(leaky_render->get_bin(), true);
+  }
   m_playbin->set_property("video-sink", video_sink);
+  audio_underruns.reset(new AudioUnderrunCounter(m_playbin->gobj()));
+  conversions.reset(new ConversionCounter(m_playbin->gobj()));
+
+  // Degrade decoding and post-processing in steps while the sink drops frames
+  qos.reset(new QosController(m_playbin->gobj()));
 
   /* Connect to interesting signals in m_playbin */
-  Glib::SignalProxy<void>(m_playbin.operator->(), &PlayBin_signal_video_tags_changed_info).connect(
-      sigc::mem_fun(*this, &PlayerWindow::on_tags_changed));
-  Glib::SignalProxy<void>(m_playbin.operator->(), &PlayBin_signal_audio_tags_changed_info).connect(
-      sigc::mem_fun(*this, &PlayerWindow::on_tags_changed));
-  Glib::SignalProxy<void>(m_playbin.operator->(), &PlayBin_signal_text_tags_changed_info).connect(
-      sigc::mem_fun(*this, &PlayerWindow::on_tags_changed));
+  Glib::SignalProxy<void, gint>(m_playbin.operator->(), &PlayBin_signal_video_tags_changed_info).connect(
+      sigc::bind(sigc::mem_fun(*this, &PlayerWindow::on_tags_changed), PlayerEvent::VIDEO_TAGS));
+  Glib::SignalProxy<void, gint>(m_playbin.operator->(), &PlayBin_signal_audio_tags_changed_info).connect(
+      sigc::bind(sigc::mem_fun(*this, &PlayerWindow::on_tags_changed), PlayerEvent::AUDIO_TAGS));
+  Glib::SignalProxy<void, gint>(m_playbin.operator->(), &PlayBin_signal_text_tags_changed_info).connect(
+      sigc::bind(sigc::mem_fun(*this, &PlayerWindow::on_tags_changed), PlayerEvent::TEXT_TAGS));
 
   create_ui();
 
@@ -167,8 +260,8 @@ PlayerWindow::PlayerWindow(const RefPtr<Element>& playbin)
     close();
   }
 
-  // timeout of 500 milliseconds
-	Glib::signal_timeout().connect(sigc::mem_fun(*this, &PlayerWindow::refresh_ui), 500);
+  /* The refresh timer starts with the PLAYING state, and follows the slider's width */
+  slider.signal_size_allocate().connect([this] (Gtk::Allocation&) { schedule_refresh(); });
 }
 
 
@@ -176,6 +269,11 @@ PlayerWindow::~PlayerWindow()
 {
   m_playbin->get_bus()->remove_watch(watch_id);
   m_playbin->set_state(Gst::STATE_NULL);
+  refresh_timer.disconnect();
+  account_refresh_state(refresh_state);
+  report_refresh_wakeups();
+  report_render_path();
+  report_conversion();
 }
 
 
@@ -187,12 +285,34 @@ bool PlayerWindow::on_delete_event(GdkEventAny* any_event)
 }
 
 
+/* This function is called when the window is minimized, restored, shown or hidden */
+bool PlayerWindow::on_window_state_event(GdkEventWindowState* event)
+{
+  bool was_hidden {hidden};
+  hidden = (event->new_window_state & (GDK_WINDOW_STATE_ICONIFIED | GDK_WINDOW_STATE_WITHDRAWN)) != 0;
+  if (was_hidden && !hidden)
+    refresh_now();
+  else
+    schedule_refresh();
+  return Gtk::Window::on_window_state_event(event);
+}
+
+
 /* This function is called when new metadata is discovered in the stream */
-void PlayerWindow::on_tags_changed()
+void PlayerWindow::on_tags_changed(gint stream, PlayerEvent::Type type)
 {
   /* We are possibly in a GStreamer working thread, so we notify the main
-   * thread of this event through a message in the bus */
-  m_playbin->post_message(Gst::MessageApplication::create(m_playbin, Gst::Structure("tag-changed")));
+   * thread of this event through the mailbox. When it is full, the main thread
+   * has tag updates pending anyway and reads all the tags again. */
+  events.push(PlayerEvent {type, stream});
+}
+
+
+/* This function is called in the main thread with the events pushed since the last call */
+void PlayerWindow::on_player_events(const std::vector<PlayerEvent>& batch)
+{
+  /* Every stream's tags are read again, so one pass covers the whole batch */
+  analyze_streams();
 }
 
 
@@ -266,11 +386,13 @@ void PlayerWindow::on_slider_value_changed()
 }
 
 
-bool PlayerWindow::refresh_ui()
+void PlayerWindow::refresh_ui()
 {
   /* We do not want to update anything unless we are in the PAUSED or PLAYING states */
   if (stream_state < Gst::STATE_PAUSED)
-    return true;
+    return;
+
+  evaluate_qos();
 
   /* If we didn't know it yet, query the stream duration */
   if (stream_duration == (gint64)Gst::CLOCK_TIME_NONE)
@@ -285,16 +407,147 @@ bool PlayerWindow::refresh_ui()
     }
   }
 
-  /* Query the current position of the stream */
+  /* Query the current position of the stream, and move the slider only if its thumb moves a pixel */
   gint64 current {0};
-  if (m_playbin->query_position(Gst::FORMAT_TIME, current))
+  gint width {slider.get_allocated_width()};
+  if (m_playbin->query_position(Gst::FORMAT_TIME, current) && stream_duration > 0 && width > 0)
   {
-    slider_value_changed_sigconn.block();
-    slider.set_value((double)current / Gst::SECOND);
-    slider_value_changed_sigconn.unblock();
+    gint pixel {static_cast<gint>(current * width / stream_duration)};
+    if (pixel != slider_pixel)
+    {
+      slider_pixel = pixel;
+      slider_value_changed_sigconn.block();
+      slider.set_value((double)current / Gst::SECOND);
+      slider_value_changed_sigconn.unblock();
+    }
   }
+}
 
-  return true;
+
+/* Refresh right away after a state change or a seek, whatever the timer's schedule */
+void PlayerWindow::refresh_now()
+{
+  slider_pixel = -1;
+  refresh_ui();
+  schedule_refresh();
+}
+
+
+bool PlayerWindow::on_refresh_timeout()
+{
+  refresh_wakeups[refresh_state]++;
+  refresh_ui();
+  /* A known duration changes the rate, keep this timer only if nothing changed */
+  return schedule_refresh();
+}
+
+
+/* The QoS controller evaluates intervals of about 500 ms. Overload announces itself with QoS
+ * messages, so no timer is needed for it; only the way back up is found by the refresh timer,
+ * which runs at least that often while the level is raised. */
+void PlayerWindow::evaluate_qos()
+{
+  gint64 now {g_get_monotonic_time()};
+  if (stream_state != Gst::STATE_PLAYING || now - last_qos_update < 500 * G_TIME_SPAN_MILLISECOND)
+    return;
+  last_qos_update = now;
+  if (qos->update())
+  {
+    std::ostringstream title;
+    title << "QoS level " << qos->get_level() << ": " << QosController::get_level_name(qos->get_level()) <<
+      ", " << qos->get_sink_dropped() << " frames dropped";
+    set_title(title.str());
+    std::cout << title.str() << std::endl;
+  }
+}
+
+
+/* The time the stream takes to move the slider's thumb by one pixel, no faster than a frame
+ * at 60 Hz. The trough is a little narrower than the widget, so this errs on the fast side.
+ * While QoS has degraded playback, no slower than the QoS interval. */
+guint PlayerWindow::get_refresh_interval() const
+{
+  gint width {slider.get_allocated_width()};
+  if (stream_duration <= 0 || stream_duration == (gint64)Gst::CLOCK_TIME_NONE || width <= 1)
+    return 500;
+  guint interval {static_cast<guint>(std::max<gint64>(stream_duration / width / Gst::MSECOND, 16))};
+  return qos->get_level() > 0 ? std::min(interval, 500u) : interval;
+}
+
+
+/* Start, stop or change the refresh timer to what the current state needs. Returns true
+ * when the running timer is kept, so that it can be returned from the timer itself. */
+bool PlayerWindow::schedule_refresh()
+{
+  RefreshState state {hidden ? REFRESH_HIDDEN :
+    stream_state == Gst::STATE_PLAYING ? REFRESH_PLAYING : REFRESH_PAUSED};
+  account_refresh_state(state);
+
+  guint interval {state == REFRESH_PLAYING ? get_refresh_interval() : 0};
+  if (refresh_timer.connected() && interval == refresh_interval)
+    return true;
+
+  refresh_timer.disconnect();
+  refresh_interval = interval;
+  if (interval > 0)
+    refresh_timer = Glib::signal_timeout().connect(sigc::mem_fun(*this, &PlayerWindow::on_refresh_timeout), interval);
+  return false;
+}
+
+
+/* Add the time since the last call to the state left, and enter the new one */
+void PlayerWindow::account_refresh_state(RefreshState state)
+{
+  gint64 now {g_get_monotonic_time()};
+  refresh_state_time[refresh_state] += now - refresh_state_since;
+  refresh_state_since = now;
+  refresh_state = state;
+}
+
+
+void PlayerWindow::report_refresh_wakeups()
+{
+  static const char* names[N_REFRESH_STATES] {"playing", "paused", "hidden"};
+  std::cout << "Refresh wakeups per minute:";
+  for (int i = 0; i < N_REFRESH_STATES; i++)
+  {
+    double minutes {refresh_state_time[i] / 60e6};
+    std::cout << " " << names[i] << " ";
+    if (minutes > 0.0)
+      std::cout << std::fixed << std::setprecision(1) << refresh_wakeups[i] / minutes;
+    else
+      std::cout << "-";
+    std::cout << " (" << std::setprecision(0) << minutes * 60.0 << " s)";
+  }
+  std::cout << std::endl;
+}
+
+
+/* Frames dropped between the streaming thread and the GUI, and the audio glitches in return */
+void PlayerWindow::report_render_path()
+{
+  std::cout << "Render path: " << (leaky_render ? "leaky" : "direct");
+  if (leaky_render)
+    std::cout << ", " << leaky_render->get_dropped() << " of " << leaky_render->get_frames() <<
+      " frames dropped at the UI";
+  std::cout << ", " << qos->get_sink_dropped() << " dropped late by the sink, " <<
+    audio_underruns->get_underruns() << " audio underruns (" << audio_underruns->get_late_buffers() <<
+    " late buffers)" << std::endl;
+}
+
+
+/* The video conversions between the decoders and the sink, and what they cost per frame */
+void PlayerWindow::report_conversion()
+{
+  std::cout << "Video conversion: ";
+  if (native_sink)
+    std::cout << "sink-native, " << native_sink->get_decision();
+  else
+    std::cout << "playsink";
+  guint64 frames {conversions->get_frames()};
+  std::cout << ", " << conversions->get_converters() << " converters, " << std::fixed << std::setprecision(0) <<
+    (frames ? static_cast<double>(conversions->get_bytes_copied()) / frames : 0.0) << " bytes copied per frame over " <<
+    frames << " frames" << std::endl;
 }
 
 
@@ -372,6 +625,8 @@ void PlayerWindow::analyze_streams()
 
 bool PlayerWindow::on_bus_message(const RefPtr<Gst::Bus>& bus, const RefPtr<Message>& message)
 {
+  qos->handle_message(message->gobj());
+
   switch (message->get_message_type()) {
     case Gst::MESSAGE_EOS:
     {
@@ -413,17 +668,27 @@ bool PlayerWindow::on_bus_message(const RefPtr<Gst::Bus>& bus, const RefPtr<Mess
             state_get_name(old_state) << " -> " <<
             state_get_name(new_state) << std::endl;
         stream_state = new_state;
-        if (old_state == Gst::STATE_READY && new_state == Gst::STATE_PAUSED) {
-          /* For extra responsiveness, we refresh the GUI as soon as we reach the PAUSED state */
-          refresh_ui();
-        }
+        /* For extra responsiveness, we refresh the GUI as soon as the state changed, and
+         * start or stop the refresh timer */
+        if (new_state >= Gst::STATE_PAUSED)
+          refresh_now();
+        else
+          schedule_refresh();
       }
       break;
     }
-    case Gst::MESSAGE_APPLICATION:
+    case Gst::MESSAGE_QOS:
+    {
+      /* Frames are late or dropped, the level may have to go down, and the refresh rate
+       * follows the level */
+      evaluate_qos();
+      schedule_refresh();
+      break;
+    }
+    case Gst::MESSAGE_ASYNC_DONE:
     {
-      if ("tag-changed" == message->get_structure().get_name())
-        analyze_streams();
+      /* A seek completed, show the new position right away */
+      refresh_now();
       break;
     }
     default:
@@ -437,6 +702,19 @@ bool PlayerWindow::on_bus_message(const RefPtr<Gst::Bus>& bus, const RefPtr<Mess
 
 int main (int argc, char **argv)
 {
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("[uri]")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
   // Initialize gstreamermm:
   Gst::init(argc, argv);
 
@@ -446,7 +724,7 @@ int main (int argc, char **argv)
   // Take the commandline argument and ensure that it is a uri:
   if (argc < 2)
   {
-    std::cout << "Usage: " << argv[0] << " <uri>" << std::endl;
+    std::cout << "Usage: " << argv[0] << " [options] <uri>" << std::endl;
     std::cout << "missing uri argument, use default uri instead." << std::endl;
   }
   else if (Gst::URIHandler::uri_is_valid(argv[1]))
@@ -469,7 +747,7 @@ int main (int argc, char **argv)
   auto app {Application::create(argc, argv, "org.gtkmm.gstreamermm.player")};
 
   // create a Gtk::Window object
-  PlayerWindow player {playbin};
+  PlayerWindow player {playbin, opt_leaky != FALSE, opt_native != FALSE};
 
   // enter gtkmm main processing loop and show the player window object
   return app->run(player);
@@ -0,0 +1,204 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 5: Cross-thread event delivery benchmark
+ *
+ * Producer threads stand in for streaming threads and send small events to the main loop,
+ * either as the tutorial did, an application message with a Gst::Structure posted on a bus
+ * and handled by a bus watch, or pushed into an EventMailbox. Prints events per second until
+ * the main loop handled all of them, and how often the main loop woke up from poll() and
+ * dispatched, counted with a poll function wrapper on the main context.
+ */
+
+#include <gstreamermm.h>
+#include <glibmm.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include "event_mailbox.h"
+
+using Glib::RefPtr;
+
+namespace
+{
+
+// Command line options
+gint opt_producers {4};
+gint opt_events {100000};
+gint opt_capacity {1024};
+
+GOptionEntry entries[] =
+{
+  { "producers", 'p', 0, G_OPTION_ARG_INT, &opt_producers, "Producer threads (default 4)", "N" },
+  { "events", 'n', 0, G_OPTION_ARG_INT, &opt_events, "Events per producer (default 100000)", "N" },
+  { "capacity", 'c', 0, G_OPTION_ARG_INT, &opt_capacity, "Mailbox capacity (default 1024)", "N" },
+  { nullptr }
+};
+
+struct BenchEvent
+{
+  gint producer;
+  gint sequence;
+};
+
+std::atomic<guint64> polls {0};
+GPollFunc default_poll {nullptr};
+
+gint counting_poll(GPollFD* fds, guint nfds, gint timeout)
+{
+  polls++;
+  return default_poll(fds, nfds, timeout);
+}
+
+struct Result
+{
+  double seconds;
+  guint64 wakeups;
+  guint64 dispatches;
+  guint64 retries;
+  bool ordered;
+};
+
+// Run the producers against a main loop until it has received every event
+Result run(const std::function<void(gint producer, std::atomic<guint64>& retries)>& produce,
+    const RefPtr<Glib::MainLoop>& loop)
+{
+  std::atomic<guint64> retries {0};
+  guint64 polls_start {polls.load()};
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> producers;
+  for (gint i = 0; i < opt_producers; i++)
+    producers.emplace_back([&produce, &retries, i] { produce(i, retries); });
+  loop->run();
+
+  double seconds {std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+  for (std::thread& producer : producers)
+    producer.join();
+  return Result {seconds, polls.load() - polls_start, 0, retries.load(), true};
+}
+
+Result bench_bus(const RefPtr<Glib::MainLoop>& loop)
+{
+  RefPtr<Gst::Bus> bus {Gst::Bus::create()};
+  RefPtr<Gst::Object> source {Gst::Bin::create("producer")};
+  guint64 total {static_cast<guint64>(opt_producers) * opt_events}, received {0}, dispatches {0};
+  std::vector<gint> next(opt_producers, 0);
+  bool ordered {true};
+
+  guint watch_id {bus->add_watch([&] (const RefPtr<Gst::Bus>&, const RefPtr<Gst::Message>& message) -> bool {
+    dispatches++;
+    if (message->get_message_type() == Gst::MESSAGE_APPLICATION)
+    {
+      Gst::Structure structure {message->get_structure()};
+      gint producer {0}, sequence {0};
+      structure.get_field("producer", producer);
+      structure.get_field("sequence", sequence);
+      ordered = ordered && sequence == next[producer];
+      next[producer] = sequence + 1;
+      if (++received == total)
+        loop->quit();
+    }
+    return true;
+  })};
+
+  Result result {run([&bus, &source] (gint producer, std::atomic<guint64>&) {
+    for (gint i = 0; i < opt_events; i++)
+    {
+      Gst::Structure structure {"tag-changed"};
+      structure.set_field("producer", producer);
+      structure.set_field("sequence", i);
+      bus->post(Gst::MessageApplication::create(source, structure));
+    }
+  }, loop)};
+
+  bus->remove_watch(watch_id);
+  result.dispatches = dispatches;
+  result.ordered = ordered;
+  return result;
+}
+
+Result bench_mailbox(const RefPtr<Glib::MainLoop>& loop)
+{
+  guint64 total {static_cast<guint64>(opt_producers) * opt_events}, received {0};
+  std::vector<gint> next(opt_producers, 0);
+  bool ordered {true};
+
+  EventMailbox<BenchEvent> mailbox {static_cast<gsize>(opt_capacity), [&] (const std::vector<BenchEvent>& batch) {
+    for (const BenchEvent& event : batch)
+    {
+      ordered = ordered && event.sequence == next[event.producer];
+      next[event.producer] = event.sequence + 1;
+    }
+    received += batch.size();
+    if (received == total)
+      loop->quit();
+  }};
+
+  // A full mailbox makes the producer wait for the main loop, as a bounded queue must
+  Result result {run([&mailbox] (gint producer, std::atomic<guint64>& retries) {
+    for (gint i = 0; i < opt_events; i++)
+    {
+      while (!mailbox.push(BenchEvent {producer, i}))
+      {
+        retries++;
+        std::this_thread::yield();
+      }
+    }
+  }, loop)};
+
+  result.dispatches = mailbox.get_wakeups();
+  result.ordered = ordered;
+  return result;
+}
+
+void report(const char* method, const Result& result)
+{
+  guint64 total {static_cast<guint64>(opt_producers) * opt_events};
+  std::cout << std::setw(10) << method << std::fixed << std::setprecision(0) <<
+    std::setw(14) << total / result.seconds << std::setw(12) << result.wakeups <<
+    std::setw(12) << result.dispatches << std::setprecision(1) <<
+    std::setw(14) << static_cast<double>(total) / std::max<guint64>(result.wakeups, 1) <<
+    std::setw(12) << result.retries << std::setw(10) << (result.ordered ? "yes" : "no") << std::endl;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  // Parse our options together with the GStreamer ones
+  GError* error {nullptr};
+  GOptionContext* context {g_option_context_new("- cross-thread event delivery benchmark")};
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::cerr << "Failed to parse options: " << error->message << std::endl;
+    g_clear_error(&error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  // Initialize gstreamermm:
+  Gst::init(argc, argv);
+
+  // Count the main loop's wakeups from poll()
+  default_poll = g_main_context_get_poll_func(nullptr);
+  g_main_context_set_poll_func(nullptr, &counting_poll);
+  RefPtr<Glib::MainLoop> loop {Glib::MainLoop::create()};
+
+  std::cout << opt_producers << " producers, " << opt_events << " events each, mailbox capacity " <<
+    opt_capacity << std::endl;
+  std::cout << std::setw(10) << "method" << std::setw(14) << "events/s" << std::setw(12) << "wakeups" <<
+    std::setw(12) << "dispatches" << std::setw(14) << "events/wakeup" << std::setw(12) << "full waits" <<
+    std::setw(10) << "ordered" << std::endl;
+  report("bus", bench_bus(loop));
+  report("mailbox", bench_mailbox(loop));
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,234 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 5: Sink-native video negotiation
+ */
+
+#include "native_video.h"
+#include <cstring>
+#include <sstream>
+
+namespace
+{
+
+// GstPlayFlags of playbin
+const guint play_flag_native_video {1 << 6};
+
+// What the capsfilter copies from the decoder's caps when the format has to change
+const char* const kept_fields[] {"width", "height", "framerate", "pixel-aspect-ratio"};
+
+bool has_property(GstElement* element, const char* name)
+{
+  return g_object_class_find_property(G_OBJECT_GET_CLASS(element), name) != nullptr;
+}
+
+} // anonymous namespace
+
+NativeVideoSink::NativeVideoSink(GstElement* video_sink)
+  : sink {video_sink}
+{
+  bin = gst_bin_new("native-video-sink");
+  gst_object_ref_sink(bin);
+  convert = gst_element_factory_make("videoconvert", nullptr);
+  capsfilter = gst_element_factory_make("capsfilter", nullptr);
+  if (has_property(convert, "n-threads"))
+    g_object_set(convert, "n-threads", g_get_num_processors(), nullptr);
+  gst_bin_add_many(GST_BIN(bin), convert, capsfilter, video_sink, nullptr);
+  gst_element_link_many(convert, capsfilter, video_sink, nullptr);
+
+  // The decoder's caps pass the converter's sink pad before it negotiates its output
+  GstPad* sink_pad {gst_element_get_static_pad(convert, "sink")};
+  gst_element_add_pad(bin, gst_ghost_pad_new("sink", sink_pad));
+  gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, &on_caps, this, nullptr);
+  gst_object_unref(sink_pad);
+}
+
+NativeVideoSink::~NativeVideoSink()
+{
+  gst_object_unref(bin);
+}
+
+void NativeVideoSink::set_native_flag(GstElement* playbin)
+{
+  guint flags {0};
+  g_object_get(playbin, "flags", &flags, nullptr);
+  g_object_set(playbin, "flags", flags | play_flag_native_video, nullptr);
+}
+
+std::string NativeVideoSink::get_decision() const
+{
+  std::lock_guard<std::mutex> lock {mutex};
+  return decision;
+}
+
+GstPadProbeReturn NativeVideoSink::on_caps(GstPad*, GstPadProbeInfo* info, gpointer user_data)
+{
+  GstEvent* event {GST_PAD_PROBE_INFO_EVENT(info)};
+  if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS)
+  {
+    GstCaps* caps {nullptr};
+    gst_event_parse_caps(event, &caps);
+    static_cast<NativeVideoSink*>(user_data)->pin(caps);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+void NativeVideoSink::pin(GstCaps* caps)
+{
+  const GstStructure* structure {gst_caps_get_structure(caps, 0)};
+  const gchar* format {gst_structure_get_string(structure, "format")};
+  gint width {0}, height {0};
+  gst_structure_get_int(structure, "width", &width);
+  gst_structure_get_int(structure, "height", &height);
+
+  std::ostringstream text;
+  GstCaps* pinned {nullptr};
+  GstPad* sink_pad {gst_element_get_static_pad(sink, "sink")};
+  if (sink_pad && gst_pad_query_accept_caps(sink_pad, caps))
+  {
+    // The sink renders the decoder's frames as they are
+    pinned = gst_caps_copy(caps);
+    text << "native " << (format ? format : "?") << " " << width << "x" << height << ", passed through";
+  }
+  else
+  {
+    // The sink's own formats, at the decoder's size and rate
+    pinned = gst_caps_make_writable(sink_pad ? gst_pad_query_caps(sink_pad, nullptr) : gst_caps_new_any());
+    for (guint i = 0; i < gst_caps_get_size(pinned); i++)
+    {
+      for (const char* field : kept_fields)
+      {
+        const GValue* value {gst_structure_get_value(structure, field)};
+        if (value)
+          gst_structure_set_value(gst_caps_get_structure(pinned, i), field, value);
+      }
+    }
+    text << "converted once from " << (format ? format : "?") << " " << width << "x" << height;
+  }
+  if (sink_pad)
+    gst_object_unref(sink_pad);
+
+  g_object_set(capsfilter, "caps", pinned, nullptr);
+  gst_caps_unref(pinned);
+
+  std::lock_guard<std::mutex> lock {mutex};
+  decision = text.str();
+}
+
+ConversionCounter::ConversionCounter(GstElement* pipeline)
+  : pipeline {pipeline}
+{
+  // playsink builds its video chain when it starts, older elements are looked up now
+  if (!GST_IS_BIN(pipeline))
+    return;
+  added_id = g_signal_connect(pipeline, "deep-element-added", G_CALLBACK(&on_element_added), this);
+  GstIterator* it {gst_bin_iterate_recurse(GST_BIN(pipeline))};
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next(it, &item) == GST_ITERATOR_OK)
+  {
+    watch(GST_ELEMENT(g_value_get_object(&item)));
+    g_value_reset(&item);
+  }
+  g_value_unset(&item);
+  gst_iterator_free(it);
+}
+
+ConversionCounter::~ConversionCounter()
+{
+  if (added_id)
+    g_signal_handler_disconnect(pipeline, added_id);
+
+  std::vector<std::unique_ptr<Converter>> watched_converters;
+  std::vector<std::pair<GstPad*, gulong>> watched_sinks;
+  {
+    std::lock_guard<std::mutex> lock {mutex};
+    watched_converters.swap(converters);
+    watched_sinks.swap(sinks);
+  }
+  for (std::unique_ptr<Converter>& converter : watched_converters)
+  {
+    gst_pad_remove_probe(converter->sink_pad, converter->sink_probe);
+    gst_pad_remove_probe(converter->src_pad, converter->src_probe);
+    gst_object_unref(converter->sink_pad);
+    gst_object_unref(converter->src_pad);
+  }
+  for (auto& probe : watched_sinks)
+  {
+    gst_pad_remove_probe(probe.first, probe.second);
+    gst_object_unref(probe.first);
+  }
+}
+
+guint ConversionCounter::get_converters() const
+{
+  std::lock_guard<std::mutex> lock {mutex};
+  return converters.size();
+}
+
+void ConversionCounter::on_element_added(GstBin*, GstBin*, GstElement* element, gpointer user_data)
+{
+  static_cast<ConversionCounter*>(user_data)->watch(element);
+}
+
+void ConversionCounter::watch(GstElement* element)
+{
+  const gchar* klass {gst_element_get_metadata(element, GST_ELEMENT_METADATA_KLASS)};
+  if (GST_IS_BIN(element) || !klass || !strstr(klass, "Video"))
+    return;
+
+  if (GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK))
+  {
+    GstPad* pad {gst_element_get_static_pad(element, "sink")};
+    if (!pad)
+      return;
+    gulong id {gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, &on_sink_frame, this, nullptr)};
+    std::lock_guard<std::mutex> lock {mutex};
+    sinks.emplace_back(pad, id);
+  }
+  else if (strstr(klass, "Converter"))
+  {
+    GstPad* sink_pad {gst_element_get_static_pad(element, "sink")};
+    GstPad* src_pad {gst_element_get_static_pad(element, "src")};
+    if (!sink_pad || !src_pad)
+    {
+      if (sink_pad)
+        gst_object_unref(sink_pad);
+      if (src_pad)
+        gst_object_unref(src_pad);
+      return;
+    }
+
+    std::unique_ptr<Converter> converter {new Converter {this, sink_pad, 0, src_pad, 0, nullptr}};
+    converter->sink_probe = gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, &on_converter_input,
+        converter.get(), nullptr);
+    converter->src_probe = gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, &on_converter_output,
+        converter.get(), nullptr);
+    std::lock_guard<std::mutex> lock {mutex};
+    converters.push_back(std::move(converter));
+  }
+}
+
+GstPadProbeReturn ConversionCounter::on_converter_input(GstPad*, GstPadProbeInfo* info, gpointer user_data)
+{
+  // Only compared, never dereferenced
+  GstBuffer* buffer {GST_PAD_PROBE_INFO_BUFFER(info)};
+  static_cast<Converter*>(user_data)->input = gst_buffer_n_memory(buffer) > 0 ?
+    gst_buffer_peek_memory(buffer, 0) : nullptr;
+  return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn ConversionCounter::on_converter_output(GstPad*, GstPadProbeInfo* info, gpointer user_data)
+{
+  // Passthrough and in-place transforms push the memory they were given
+  Converter* converter {static_cast<Converter*>(user_data)};
+  GstBuffer* buffer {GST_PAD_PROBE_INFO_BUFFER(info)};
+  GstMemory* output {gst_buffer_n_memory(buffer) > 0 ? gst_buffer_peek_memory(buffer, 0) : nullptr};
+  if (output != converter->input)
+    converter->counter->bytes_copied.fetch_add(gst_buffer_get_size(buffer), std::memory_order_relaxed);
+  return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn ConversionCounter::on_sink_frame(GstPad*, GstPadProbeInfo*, gpointer user_data)
+{
+  static_cast<ConversionCounter*>(user_data)->frames.fetch_add(1, std::memory_order_relaxed);
+  return GST_PAD_PROBE_OK;
+}
@@ -0,0 +1,104 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 5: Sink-native video negotiation
+ *
+ * Unless GST_PLAY_FLAG_NATIVE_VIDEO is set, playsink puts videoconvert and videoscale in front
+ * of the video sink, and glsinkbin brings a GL upload and color conversion of its own. When
+ * the sink takes the decoder's format, the converters pass frames through, when it does not,
+ * as gtksink with its RGB formats, every frame is converted in software.
+ *
+ * NativeVideoSink replaces that chain by a single videoconvert and a capsfilter in front of
+ * the sink, to be used together with the native video flag. When the decoder's caps arrive,
+ * the capsfilter is pinned: to the decoder's caps when the sink accepts them, the converter
+ * then passes the frames through untouched, else to the sink's formats at the decoder's size
+ * and rate, so the one conversion left changes the format only, never the size. videoconvert
+ * converts with ORC generated SIMD code, in as many threads as there are CPUs where supported.
+ *
+ * ConversionCounter measures the result in any pipeline: every video converter whose output
+ * frame is not its input frame copied it, and the bytes it wrote are added up, next to the
+ * frames the video sinks received.
+ */
+
+#ifndef NATIVE_VIDEO_H
+#define NATIVE_VIDEO_H
+
+#include <gst/gst.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+class NativeVideoSink
+{
+public:
+  // The bin takes a reference to video_sink, set get_bin() as the video-sink of a playbin
+  explicit NativeVideoSink(GstElement* video_sink);
+  ~NativeVideoSink();
+
+  NativeVideoSink(const NativeVideoSink&) = delete;
+  NativeVideoSink& operator=(const NativeVideoSink&) = delete;
+
+  GstElement* get_bin() const { return bin; }
+
+  // Keep playsink from plugging converters of its own, set it before the playbin starts
+  static void set_native_flag(GstElement* playbin);
+
+  // What was pinned for the last caps, empty before the first ones
+  std::string get_decision() const;
+
+private:
+  static GstPadProbeReturn on_caps(GstPad*, GstPadProbeInfo* info, gpointer user_data);
+  void pin(GstCaps* caps);
+
+  GstElement* bin;
+  GstElement* convert;
+  GstElement* capsfilter;
+  GstElement* sink;
+
+  mutable std::mutex mutex;
+  std::string decision;
+};
+
+class ConversionCounter
+{
+public:
+  explicit ConversionCounter(GstElement* pipeline);
+  ~ConversionCounter();
+
+  ConversionCounter(const ConversionCounter&) = delete;
+  ConversionCounter& operator=(const ConversionCounter&) = delete;
+
+  guint get_converters() const;
+  guint64 get_frames() const { return frames.load(std::memory_order_relaxed); }
+  guint64 get_bytes_copied() const { return bytes_copied.load(std::memory_order_relaxed); }
+
+private:
+  // Both pads of a converter, its input and output are seen by the same streaming thread
+  struct Converter
+  {
+    ConversionCounter* counter;
+    GstPad* sink_pad;
+    gulong sink_probe;
+    GstPad* src_pad;
+    gulong src_probe;
+    GstMemory* input;
+  };
+
+  static void on_element_added(GstBin*, GstBin*, GstElement* element, gpointer user_data);
+  static GstPadProbeReturn on_converter_input(GstPad*, GstPadProbeInfo* info, gpointer user_data);
+  static GstPadProbeReturn on_converter_output(GstPad*, GstPadProbeInfo* info, gpointer user_data);
+  static GstPadProbeReturn on_sink_frame(GstPad*, GstPadProbeInfo*, gpointer user_data);
+  void watch(GstElement* element);
+
+  GstElement* pipeline;
+  gulong added_id {0};
+  mutable std::mutex mutex;
+  std::vector<std::unique_ptr<Converter>> converters;
+  std::vector<std::pair<GstPad*, gulong>> sinks;
+  std::atomic<guint64> frames {0};
+  std::atomic<guint64> bytes_copied {0};
+};
+
+#endif // NATIVE_VIDEO_H
@@ -0,0 +1,198 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 5: A leaky render path for GTK sinks
+ */
+
+#include "render_path.h"
+#include <cstring>
+
+namespace
+{
+
+bool has_property(GstElement* element, const char* name)
+{
+  return g_object_class_find_property(G_OBJECT_GET_CLASS(element), name) != nullptr;
+}
+
+// The sink renders whatever the queue hands it, the clock was waited for before the queue
+void disable_sync(GstElement* element)
+{
+  if (GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK) && has_property(element, "sync"))
+    g_object_set(element, "sync", FALSE, nullptr);
+  if (!GST_IS_BIN(element))
+    return;
+
+  // Also the sink inside glsinkbin, or inside the native negotiation bin
+  GstIterator* it {gst_bin_iterate_recurse(GST_BIN(element))};
+  gst_iterator_foreach(it, [] (const GValue* item, gpointer) {
+    GstElement* child {GST_ELEMENT(g_value_get_object(item))};
+    if (GST_OBJECT_FLAG_IS_SET(child, GST_ELEMENT_FLAG_SINK) && has_property(child, "sync"))
+      g_object_set(child, "sync", FALSE, nullptr);
+  }, nullptr);
+  gst_iterator_free(it);
+}
+
+} // anonymous namespace
+
+LeakyRender::LeakyRender(GstElement* video_sink)
+{
+  bin = gst_bin_new("leaky-video-sink");
+  gst_object_ref_sink(bin);
+
+  // Frames are held back until their render time while still upstream of the leak, which
+  // keeps pacing the decoder; clocksync is new in 1.18, identity does the same before
+  GstElement* sync {gst_element_factory_make("clocksync", nullptr)};
+  if (!sync)
+  {
+    sync = gst_element_factory_make("identity", nullptr);
+    g_object_set(sync, "sync", TRUE, nullptr);
+  }
+
+  queue = gst_element_factory_make("queue", nullptr);
+  // Exactly one frame in flight, the oldest makes room for the newest; 2 is downstream
+  g_object_set(queue, "max-size-buffers", 1u, "max-size-bytes", 0u, "max-size-time", G_GUINT64_CONSTANT(0),
+      "leaky", 2, "silent", TRUE, nullptr);
+  disable_sync(video_sink);
+  gst_bin_add_many(GST_BIN(bin), sync, queue, video_sink, nullptr);
+  gst_element_link_many(sync, queue, video_sink, nullptr);
+
+  GstPad* ghost_target {gst_element_get_static_pad(sync, "sink")};
+  gst_element_add_pad(bin, gst_ghost_pad_new("sink", ghost_target));
+  gst_object_unref(ghost_target);
+
+  // Frames that are due count in, a GUI that does not take them in time makes them leak
+  GstPad* sink_pad {gst_element_get_static_pad(queue, "sink")};
+  gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, &on_buffer, &frames_in, nullptr);
+  gst_object_unref(sink_pad);
+
+  GstPad* src_pad {gst_element_get_static_pad(queue, "src")};
+  gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, &on_buffer, &frames_out, nullptr);
+  gst_object_unref(src_pad);
+}
+
+LeakyRender::~LeakyRender()
+{
+  gst_object_unref(bin);
+}
+
+GstPadProbeReturn LeakyRender::on_buffer(GstPad*, GstPadProbeInfo*, gpointer user_data)
+{
+  static_cast<std::atomic<guint64>*>(user_data)->fetch_add(1, std::memory_order_relaxed);
+  return GST_PAD_PROBE_OK;
+}
+
+guint64 LeakyRender::get_dropped() const
+{
+  // The frame still waiting in the queue is not lost
+  guint queued {0};
+  g_object_get(queue, "current-level-buffers", &queued, nullptr);
+  guint64 in {frames_in.load(std::memory_order_relaxed)};
+  guint64 out {frames_out.load(std::memory_order_relaxed)};
+  return in > out + queued ? in - out - queued : 0;
+}
+
+AudioUnderrunCounter::AudioUnderrunCounter(GstElement* pipeline)
+  : pipeline {pipeline}
+{
+  // The audio sink of a playbin is created when it starts, older ones are looked up now
+  if (!GST_IS_BIN(pipeline))
+    return;
+  added_id = g_signal_connect(pipeline, "deep-element-added", G_CALLBACK(&on_element_added), this);
+  GstIterator* it {gst_bin_iterate_recurse(GST_BIN(pipeline))};
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next(it, &item) == GST_ITERATOR_OK)
+  {
+    watch_sink(GST_ELEMENT(g_value_get_object(&item)));
+    g_value_reset(&item);
+  }
+  g_value_unset(&item);
+  gst_iterator_free(it);
+}
+
+AudioUnderrunCounter::~AudioUnderrunCounter()
+{
+  if (added_id)
+    g_signal_handler_disconnect(pipeline, added_id);
+
+  std::vector<std::unique_ptr<SinkPad>> watched;
+  {
+    std::lock_guard<std::mutex> lock {mutex};
+    watched.swap(sinks);
+  }
+  for (std::unique_ptr<SinkPad>& sink : watched)
+  {
+    gst_pad_remove_probe(sink->pad, sink->probe_id);
+    gst_object_unref(sink->pad);
+  }
+}
+
+void AudioUnderrunCounter::on_element_added(GstBin*, GstBin*, GstElement* element, gpointer user_data)
+{
+  static_cast<AudioUnderrunCounter*>(user_data)->watch_sink(element);
+}
+
+void AudioUnderrunCounter::watch_sink(GstElement* element)
+{
+  // autoaudiosink is a bin with the flag as well, its child sink is enough
+  const gchar* klass {gst_element_get_metadata(element, GST_ELEMENT_METADATA_KLASS)};
+  if (GST_IS_BIN(element) || !GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK) ||
+      !klass || !strstr(klass, "Audio"))
+    return;
+  GstPad* pad {gst_element_get_static_pad(element, "sink")};
+  if (!pad)
+    return;
+
+  std::unique_ptr<SinkPad> sink {new SinkPad {this, pad, 0, {}, false, false}};
+  gst_segment_init(&sink->segment, GST_FORMAT_UNDEFINED);
+  sink->probe_id = gst_pad_add_probe(pad, static_cast<GstPadProbeType>(GST_PAD_PROBE_TYPE_BUFFER |
+      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH), &on_sink_data, sink.get(), nullptr);
+  std::lock_guard<std::mutex> lock {mutex};
+  sinks.push_back(std::move(sink));
+}
+
+GstPadProbeReturn AudioUnderrunCounter::on_sink_data(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+  SinkPad* sink {static_cast<SinkPad*>(user_data)};
+
+  if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_BOTH)
+  {
+    GstEvent* event {GST_PAD_PROBE_INFO_EVENT(info)};
+    if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT)
+    {
+      const GstSegment* segment {nullptr};
+      gst_event_parse_segment(event, &segment);
+      gst_segment_copy_into(segment, &sink->segment);
+      sink->have_segment = (segment->format == GST_FORMAT_TIME);
+    }
+    else if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP)
+    {
+      sink->have_segment = false;
+      sink->late = false;
+    }
+    return GST_PAD_PROBE_OK;
+  }
+
+  // Prerolling buffers wait for PLAYING and are never late
+  GstBuffer* buffer {GST_PAD_PROBE_INFO_BUFFER(info)};
+  GstElement* element {GST_ELEMENT(GST_PAD_PARENT(pad))};
+  if (!sink->have_segment || !GST_BUFFER_PTS_IS_VALID(buffer) || GST_STATE(element) != GST_STATE_PLAYING)
+    return GST_PAD_PROBE_OK;
+  GstClock* clock {gst_element_get_clock(element)};
+  if (!clock)
+    return GST_PAD_PROBE_OK;
+
+  GstClockTime now {gst_clock_get_time(clock)};
+  GstClockTime base_time {gst_element_get_base_time(element)};
+  gst_object_unref(clock);
+  guint64 running_time {gst_segment_to_running_time(&sink->segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer))};
+  bool late {GST_CLOCK_TIME_IS_VALID(running_time) && now > base_time && now - base_time > running_time};
+
+  if (late)
+  {
+    sink->counter->late_buffers.fetch_add(1, std::memory_order_relaxed);
+    if (!sink->late)
+      sink->counter->underruns.fetch_add(1, std::memory_order_relaxed);
+  }
+  sink->late = late;
+  return GST_PAD_PROBE_OK;
+}
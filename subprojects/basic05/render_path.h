@@ -0,0 +1,90 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Supplement to Basic Tutorial 5: A leaky render path for GTK sinks
+ *
+ * gtksink and gtkglsink hand every frame to the GTK main thread, so while that thread is busy
+ * redrawing the stream list or resizing, the sink blocks, the video queue of playsink fills
+ * and the back-pressure reaches the demuxer, which starves the audio branch as well.
+ * LeakyRender puts a one buffer queue that leaks downstream in front of the sink: the
+ * streaming thread always replaces the pending frame with the newest one and never waits for
+ * the GUI, the sink draws whatever is newest when it gets to it. The clock is waited for in
+ * front of the queue, by clocksync, and not by the sink, so the decoder is still paced by
+ * the clock and a frame only leaks when the GUI did not draw the previous one before the
+ * next was due. Those frames, replaced before they were drawn, are counted.
+ *
+ * AudioUnderrunCounter measures the other side: an audio buffer reaching its sink after the
+ * clock passed its running time left a gap in the ring buffer, which plays as silence. A run
+ * of late buffers counts as one underrun. It assumes a non-live pipeline, whose latency is 0.
+ */
+
+#ifndef RENDER_PATH_H
+#define RENDER_PATH_H
+
+#include <gst/gst.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class LeakyRender
+{
+public:
+  // The bin takes a reference to video_sink, set get_bin() as the video-sink of a playbin
+  explicit LeakyRender(GstElement* video_sink);
+  ~LeakyRender();
+
+  LeakyRender(const LeakyRender&) = delete;
+  LeakyRender& operator=(const LeakyRender&) = delete;
+
+  GstElement* get_bin() const { return bin; }
+
+  // Frames that entered the bin, and those replaced or flushed before the sink took them
+  guint64 get_frames() const { return frames_in.load(std::memory_order_relaxed); }
+  guint64 get_dropped() const;
+
+private:
+  static GstPadProbeReturn on_buffer(GstPad*, GstPadProbeInfo*, gpointer user_data);
+
+  GstElement* bin;
+  GstElement* queue;
+  std::atomic<guint64> frames_in {0};
+  std::atomic<guint64> frames_out {0};
+};
+
+class AudioUnderrunCounter
+{
+public:
+  explicit AudioUnderrunCounter(GstElement* pipeline);
+  ~AudioUnderrunCounter();
+
+  AudioUnderrunCounter(const AudioUnderrunCounter&) = delete;
+  AudioUnderrunCounter& operator=(const AudioUnderrunCounter&) = delete;
+
+  guint64 get_underruns() const { return underruns.load(std::memory_order_relaxed); }
+  guint64 get_late_buffers() const { return late_buffers.load(std::memory_order_relaxed); }
+
+private:
+  // The state of one audio sink pad, only touched by its streaming thread
+  struct SinkPad
+  {
+    AudioUnderrunCounter* counter;
+    GstPad* pad;
+    gulong probe_id;
+    GstSegment segment;
+    bool have_segment;
+    bool late;
+  };
+
+  static void on_element_added(GstBin*, GstBin*, GstElement* element, gpointer user_data);
+  static GstPadProbeReturn on_sink_data(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+  void watch_sink(GstElement* element);
+
+  GstElement* pipeline;
+  gulong added_id {0};
+  std::mutex mutex;
+  std::vector<std::unique_ptr<SinkPad>> sinks;
+  std::atomic<guint64> underruns {0};
+  std::atomic<guint64> late_buffers {0};
+};
+
+#endif // RENDER_PATH_H
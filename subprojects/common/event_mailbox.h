@@ -0,0 +1,187 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Common: Lock-free cross-thread event mailbox
+ *
+ * Streaming threads often only need to tell the main thread that something happened, and
+ * posting an application message on the bus for that allocates a message and a structure
+ * per event and wakes the main loop once per message. EventMailbox<Event> is a bounded ring
+ * of small, copyable events that any number of threads push into without locking or
+ * allocating (the sequence-numbered cells of D. Vyukov's bounded MPMC queue). Only the push
+ * that finds the mailbox idle wakes the main context, through a GSource made ready with
+ * g_source_set_ready_time(); the dispatch then drains everything pushed so far and hands it
+ * to the handler as one batch.
+ *
+ * push() returns false when the mailbox is full; the event is not queued then.
+ */
+
+#ifndef EVENT_MAILBOX_H
+#define EVENT_MAILBOX_H
+
+#include <glib.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+template <typename Event>
+class EventMailbox
+{
+public:
+  // Called in the main context with the events of one wakeup, oldest first
+  using Handler = std::function<void(const std::vector<Event>& events)>;
+
+  // The capacity is rounded up to a power of two. A nullptr context is the default one.
+  EventMailbox(gsize capacity, const Handler& handler, GMainContext* context = nullptr)
+    : handler {handler}
+  {
+    gsize size {2};
+    while (size < capacity)
+      size <<= 1;
+    cells.reset(new Cell[size]);
+    mask = size - 1;
+    for (gsize i = 0; i < size; i++)
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    batch.reserve(size);
+
+    source = g_source_new(&source_funcs, sizeof(Source));
+    reinterpret_cast<Source*>(source)->mailbox = this;
+    g_source_set_name(source, "EventMailbox");
+    g_source_attach(source, context);
+  }
+
+  ~EventMailbox()
+  {
+    g_source_destroy(source);
+    g_source_unref(source);
+  }
+
+  EventMailbox(const EventMailbox&) = delete;
+  EventMailbox& operator=(const EventMailbox&) = delete;
+
+  // Any thread
+  bool push(const Event& event)
+  {
+    gsize position {tail.load(std::memory_order_relaxed)};
+    Cell* cell;
+    for (;;)
+    {
+      cell = &cells[position & mask];
+      gsize sequence {cell->sequence.load(std::memory_order_acquire)};
+      gssize diff {static_cast<gssize>(sequence - position)};
+      if (diff == 0)
+      {
+        if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+      {
+        overflows.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      else
+      {
+        position = tail.load(std::memory_order_relaxed);
+      }
+    }
+    cell->event = event;
+    cell->sequence.store(position + 1, std::memory_order_release);
+
+    // Only the first event after a drain wakes the main context
+    if (!pending.exchange(true))
+      g_source_set_ready_time(source, 0);
+    return true;
+  }
+
+  guint64 get_wakeups() const { return wakeups; }
+  guint64 get_delivered() const { return delivered; }
+  guint64 get_overflows() const { return overflows.load(std::memory_order_relaxed); }
+
+private:
+  struct Cell
+  {
+    std::atomic<gsize> sequence;
+    Event event;
+  };
+
+  struct Source
+  {
+    GSource base;
+    EventMailbox* mailbox;
+  };
+
+  static gboolean dispatch(GSource* source, GSourceFunc, gpointer)
+  {
+    reinterpret_cast<Source*>(source)->mailbox->drain();
+    return G_SOURCE_CONTINUE;
+  }
+
+  bool pop(Event& event)
+  {
+    gsize position {head.load(std::memory_order_relaxed)};
+    Cell* cell;
+    for (;;)
+    {
+      cell = &cells[position & mask];
+      gsize sequence {cell->sequence.load(std::memory_order_acquire)};
+      gssize diff {static_cast<gssize>(sequence - (position + 1))};
+      if (diff == 0)
+      {
+        if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        position = head.load(std::memory_order_relaxed);
+      }
+    }
+    event = cell->event;
+    cell->sequence.store(position + mask + 1, std::memory_order_release);
+    return true;
+  }
+
+  void drain()
+  {
+    // Rearm before draining: a push that lands after the flag is cleared wakes us again,
+    // one that saw the flag still set is already visible to the pops below
+    g_source_set_ready_time(source, -1);
+    pending.store(false);
+    wakeups++;
+
+    Event event;
+    batch.clear();
+    while (batch.size() <= mask && pop(event))
+      batch.push_back(event);
+    // Producers refilled the ring while it was drained, come back for the rest
+    if (batch.size() > mask && !pending.exchange(true))
+      g_source_set_ready_time(source, 0);
+    if (batch.empty())
+      return;
+    delivered += batch.size();
+    handler(batch);
+  }
+
+  static GSourceFuncs source_funcs;
+
+  std::unique_ptr<Cell[]> cells;
+  gsize mask {0};
+  alignas(64) std::atomic<gsize> head {0};
+  alignas(64) std::atomic<gsize> tail {0};
+  alignas(64) std::atomic<bool> pending {false};
+  std::atomic<guint64> overflows {0};
+
+  // Main context only
+  Handler handler;
+  std::vector<Event> batch;
+  GSource* source {nullptr};
+  guint64 wakeups {0};
+  guint64 delivered {0};
+};
+
+template <typename Event>
+GSourceFuncs EventMailbox<Event>::source_funcs = { nullptr, nullptr, &EventMailbox<Event>::dispatch, nullptr };
+
+#endif // EVENT_MAILBOX_H
@@ -0,0 +1,240 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Common: startup prefetch for local files
+ */
+
+#include "file_prefetch.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace
+{
+
+const guint64 header_bytes {1024 * 1024};
+const guint64 tail_bytes {1024 * 1024};
+// Assumed data rate when the duration is unknown, about 8 Mbit/s
+const guint64 fallback_rate {1024 * 1024};
+
+guint32 read_be32(const guint8* data)
+{
+  return (guint32(data[0]) << 24) | (guint32(data[1]) << 16) | (guint32(data[2]) << 8) | data[3];
+}
+
+guint64 read_be64(const guint8* data)
+{
+  return (guint64(read_be32(data)) << 32) | read_be32(data + 4);
+}
+
+std::string uri_to_path(const std::string& uri)
+{
+  if (!gst_uri_is_valid(uri.c_str()))
+    return uri;
+  if (!gst_uri_has_protocol(uri.c_str(), "file"))
+    return std::string();
+
+  gchar* path {g_filename_from_uri(uri.c_str(), nullptr, nullptr)};
+  std::string result {path ? path : ""};
+  g_free(path);
+  return result;
+}
+
+struct FirstFrame
+{
+  gint64 start_time;
+  std::atomic<bool> seen {false};
+};
+
+GstPadProbeReturn on_first_buffer(GstPad* pad, GstPadProbeInfo*, gpointer user_data)
+{
+  FirstFrame* first {static_cast<FirstFrame*>(user_data)};
+  if (first->seen.exchange(true))
+    return GST_PAD_PROBE_REMOVE;
+
+  guint64 time {static_cast<guint64>(g_get_monotonic_time() - first->start_time) * 1000};
+  GstElement* sink {GST_ELEMENT(GST_PAD_PARENT(pad))};
+  gst_element_post_message(sink, gst_message_new_element(GST_OBJECT(sink),
+      gst_structure_new("first-frame", "time", G_TYPE_UINT64, time, nullptr)));
+  return GST_PAD_PROBE_REMOVE;
+}
+
+void on_element_added(GstBin*, GstBin*, GstElement* element, gpointer user_data)
+{
+  if (GST_IS_BIN(element) || !GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK))
+    return;
+
+  const gchar* klass {gst_element_get_metadata(element, GST_ELEMENT_METADATA_KLASS)};
+  GstPad* pad {gst_element_get_static_pad(element, "sink")};
+  if (pad && klass && strstr(klass, "Video"))
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, &on_first_buffer, user_data, nullptr);
+  if (pad)
+    gst_object_unref(pad);
+}
+
+void free_first_frame(gpointer data, GClosure*)
+{
+  delete static_cast<FirstFrame*>(data);
+}
+
+} // anonymous namespace
+
+FilePrefetch::FilePrefetch(const std::string& uri, guint seconds)
+  : seconds {seconds}
+{
+  std::string path {uri_to_path(uri)};
+  if (path.empty())
+    return;
+
+  fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) < 0 || !S_ISREG(info.st_mode))
+  {
+    if (fd >= 0)
+      close(fd);
+    fd = -1;
+    return;
+  }
+  size = info.st_size;
+
+  // The header and the index in their own threads, so the disk can reorder the requests. The
+  // data read is guessed only when the MP4 index gave no size for it.
+  threads.emplace_back(&FilePrefetch::prefetch_header, this);
+  threads.emplace_back([this] {
+    if (!prefetch_index())
+      prefetch_data();
+  });
+}
+
+FilePrefetch::~FilePrefetch()
+{
+  wait();
+  if (fd >= 0)
+    close(fd);
+}
+
+void FilePrefetch::wait()
+{
+  for (std::thread& thread : threads)
+    thread.join();
+  threads.clear();
+}
+
+bool FilePrefetch::evict(const std::string& uri)
+{
+  std::string path {uri_to_path(uri)};
+  int fd {path.empty() ? -1 : open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (fd < 0)
+    return false;
+
+  bool done {posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0};
+  close(fd);
+  return done;
+}
+
+void FilePrefetch::request(guint64 offset, guint64 length)
+{
+  if (offset >= size)
+    return;
+  length = std::min(length, size - offset);
+
+  // readahead() queues the reads and returns, fadvise is the fallback on filesystems without it
+  if (readahead(fd, offset, length) < 0)
+    posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+}
+
+void FilePrefetch::prefetch_header()
+{
+  request(0, header_bytes);
+}
+
+bool FilePrefetch::prefetch_index()
+{
+  // Walk the top-level MP4 atoms, reading only their 8 or 16 byte headers
+  guint64 offset {0}, moov_offset {0}, moov_size {0}, mdat_offset {0}, mdat_size {0};
+  bool mp4 {false};
+  for (int count = 0; count < 64 && offset + 8 <= size; count++)
+  {
+    guint8 header[16];
+    if (pread(fd, header, sizeof(header), offset) < 8)
+      break;
+
+    guint64 atom_size {read_be32(header)};
+    guint64 header_size {8};
+    if (atom_size == 1)
+    {
+      atom_size = read_be64(header + 8);
+      header_size = 16;
+    }
+    else if (atom_size == 0)
+    {
+      atom_size = size - offset;
+    }
+
+    // Not an atom, so not an MP4 file (or a damaged one)
+    if (atom_size < header_size || !g_ascii_isalnum(header[4]) || !g_ascii_isalnum(header[7]))
+      break;
+    if (count == 0 && memcmp(header + 4, "ftyp", 4) != 0)
+      break;
+    mp4 = true;
+
+    if (memcmp(header + 4, "moov", 4) == 0)
+    {
+      moov_offset = offset;
+      moov_size = atom_size;
+      request(moov_offset, moov_size);
+    }
+    else if (memcmp(header + 4, "mdat", 4) == 0)
+    {
+      mdat_offset = offset + header_size;
+      mdat_size = atom_size - header_size;
+    }
+    offset += atom_size;
+  }
+
+  if (!mp4 || !moov_size)
+  {
+    request(size > tail_bytes ? size - tail_bytes : 0, tail_bytes);
+    return false;
+  }
+
+  // The movie header is normally the first child of moov, it gives the duration to
+  // turn the requested seconds into bytes of mdat
+  guint8 mvhd[40];
+  if (!mdat_size || pread(fd, mvhd, sizeof(mvhd), moov_offset + 8) != sizeof(mvhd) ||
+      memcmp(mvhd + 4, "mvhd", 4) != 0)
+    return false;
+
+  guint64 timescale, duration;
+  if (mvhd[8] == 1)
+  {
+    timescale = read_be32(mvhd + 28);
+    duration = read_be64(mvhd + 32);
+  }
+  else
+  {
+    timescale = read_be32(mvhd + 20);
+    duration = read_be32(mvhd + 24);
+  }
+  if (!timescale || !duration)
+    return false;
+
+  double rate {mdat_size / (static_cast<double>(duration) / timescale)};
+  request(mdat_offset, static_cast<guint64>(rate * seconds));
+  return true;
+}
+
+void FilePrefetch::prefetch_data()
+{
+  request(header_bytes, fallback_rate * seconds);
+}
+
+void watch_first_frame(GstElement* pipeline, gint64 start_time)
+{
+  FirstFrame* first {new FirstFrame};
+  first->start_time = start_time;
+  g_signal_connect_data(pipeline, "deep-element-added", G_CALLBACK(&on_element_added), first,
+      &free_first_frame, static_cast<GConnectFlags>(0));
+}
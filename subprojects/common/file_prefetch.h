@@ -0,0 +1,58 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Common: startup prefetch for local files
+ *
+ * A cold start from a spinning disk is dominated by small random reads: typefinding reads the
+ * head of the file, qtdemux looks for the moov atom that is often at the end, matroskademux
+ * reads the cues. FilePrefetch issues readahead for those regions in parallel threads as soon
+ * as the URI is known, so the reads are already queued when the pipeline goes to PAUSED.
+ *  - header: the first MiB, enough for typefinding and the container headers.
+ *  - index: the moov atom found by walking the top-level MP4 atoms, or the tail of the file
+ *    for other containers (WebM cues).
+ *  - data: the first seconds of media data, sized from the MP4 duration when known, or
+ *    else guessed from a typical bitrate after the header.
+ */
+
+#ifndef FILE_PREFETCH_H
+#define FILE_PREFETCH_H
+
+#include <gst/gst.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+class FilePrefetch
+{
+public:
+  // Start prefetching the file of a file:// URI or local path, nothing is done for other URIs
+  FilePrefetch(const std::string& uri, guint seconds);
+  ~FilePrefetch();
+
+  FilePrefetch(const FilePrefetch&) = delete;
+  FilePrefetch& operator=(const FilePrefetch&) = delete;
+
+  // Wait until all readahead requests are issued
+  void wait();
+
+  // Drop the file from the page cache to measure a cold start. Only clean pages not mapped by
+  // any process are dropped, which needs no privileges unlike /proc/sys/vm/drop_caches.
+  static bool evict(const std::string& uri);
+
+private:
+  void prefetch_header();
+  // True when the first seconds of an MP4 mdat were requested as well
+  bool prefetch_index();
+  void prefetch_data();
+  void request(guint64 offset, guint64 length);
+
+  int fd {-1};
+  guint64 size {0};
+  guint seconds;
+  std::vector<std::thread> threads;
+};
+
+// Post an element message "first-frame" with the field "time" (guint64, nanoseconds since
+// start_time, a g_get_monotonic_time() value) when the first buffer reaches a video sink.
+void watch_first_frame(GstElement* pipeline, gint64 start_time);
+
+#endif // FILE_PREFETCH_H
@@ -0,0 +1,424 @@
+/* GStreamer
+ *
+ * Common: memory-mapped file source
+ *
+ * The whole file is mapped read-only once in start() and wrapped in a single GstMemory, every
+ * buffer holds a shared sub-memory of it. The mapping is released when the element stops and
+ * the last buffer referencing it is gone, so buffers may outlive the element.
+ *
+ * The kernel is told the access is sequential, and the window ahead of the last read offset
+ * is requested with MADV_WILLNEED, so pages are read asynchronously before the demuxer faults
+ * on them. The file must not be truncated while it is mapped, touching pages past the new end
+ * raises SIGBUS.
+ */
+
+#include "gstmmapsrc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_mmap_src_debug);
+#define GST_CAT_DEFAULT gst_mmap_src_debug
+
+#define DEFAULT_LOCATION NULL
+#define DEFAULT_BLOCKSIZE (256 * 1024)
+#define DEFAULT_PREFETCH (8 * 1024 * 1024)
+
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_PREFETCH
+};
+
+typedef struct
+{
+  gpointer data;
+  gsize size;
+} GstMmapRegion;
+
+struct _GstMmapSrc
+{
+  GstBaseSrc parent;
+
+  /* properties */
+  gchar *location;
+  guint prefetch;
+
+  /* streaming state */
+  GstMemory *memory;
+  guint8 *data;
+  guint64 size;
+  guint64 window_start;
+  guint64 prefetched;
+};
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static void gst_mmap_src_uri_handler_init (gpointer g_iface,
+    gpointer iface_data);
+
+#define gst_mmap_src_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE (GstMmapSrc, gst_mmap_src, GST_TYPE_BASE_SRC,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_URI_HANDLER,
+        gst_mmap_src_uri_handler_init);
+    GST_DEBUG_CATEGORY_INIT (gst_mmap_src_debug, "mmapsrc", 0,
+        "memory-mapped file source"));
+
+static void gst_mmap_src_finalize (GObject * object);
+static void gst_mmap_src_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_mmap_src_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static gboolean gst_mmap_src_start (GstBaseSrc * src);
+static gboolean gst_mmap_src_stop (GstBaseSrc * src);
+static gboolean gst_mmap_src_is_seekable (GstBaseSrc * src);
+static gboolean gst_mmap_src_get_size (GstBaseSrc * src, guint64 * size);
+static GstFlowReturn gst_mmap_src_create (GstBaseSrc * src, guint64 offset,
+    guint length, GstBuffer ** buffer);
+
+static void
+gst_mmap_src_class_init (GstMmapSrcClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS (klass);
+
+  gobject_class->finalize = gst_mmap_src_finalize;
+  gobject_class->set_property = gst_mmap_src_set_property;
+  gobject_class->get_property = gst_mmap_src_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+      g_param_spec_string ("location", "File Location",
+          "Location of the file to read", DEFAULT_LOCATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_PREFETCH,
+      g_param_spec_uint ("prefetch", "Prefetch",
+          "Bytes ahead of the read position to request with MADV_WILLNEED "
+          "(0 = only MADV_SEQUENTIAL)", 0, G_MAXINT, DEFAULT_PREFETCH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+  gst_element_class_set_static_metadata (element_class,
+      "Memory-mapped File Source", "Source/File",
+      "Read from a file as zero-copy slices of a memory mapping",
+      "gst-tutorial");
+
+  basesrc_class->start = GST_DEBUG_FUNCPTR (gst_mmap_src_start);
+  basesrc_class->stop = GST_DEBUG_FUNCPTR (gst_mmap_src_stop);
+  basesrc_class->is_seekable = GST_DEBUG_FUNCPTR (gst_mmap_src_is_seekable);
+  basesrc_class->get_size = GST_DEBUG_FUNCPTR (gst_mmap_src_get_size);
+  basesrc_class->create = GST_DEBUG_FUNCPTR (gst_mmap_src_create);
+}
+
+static void
+gst_mmap_src_init (GstMmapSrc * self)
+{
+  self->location = g_strdup (DEFAULT_LOCATION);
+  self->prefetch = DEFAULT_PREFETCH;
+
+  /* Slices cost the same at any size, use fewer and larger buffers in push mode */
+  gst_base_src_set_blocksize (GST_BASE_SRC (self), DEFAULT_BLOCKSIZE);
+}
+
+static void
+gst_mmap_src_finalize (GObject * object)
+{
+  GstMmapSrc *self = GST_MMAP_SRC (object);
+
+  g_free (self->location);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static gboolean
+gst_mmap_src_set_location (GstMmapSrc * self, const gchar * location,
+    GError ** error)
+{
+  GstState state;
+
+  /* The location can only be changed while no file is mapped */
+  GST_OBJECT_LOCK (self);
+  state = GST_STATE (self);
+  if (state != GST_STATE_READY && state != GST_STATE_NULL) {
+    GST_OBJECT_UNLOCK (self);
+    g_set_error (error, GST_URI_ERROR, GST_URI_ERROR_BAD_STATE,
+        "Changing the location property while the element is running is not "
+        "supported");
+    return FALSE;
+  }
+  g_free (self->location);
+  self->location = g_strdup (location);
+  GST_OBJECT_UNLOCK (self);
+
+  g_object_notify (G_OBJECT (self), "location");
+  return TRUE;
+}
+
+static void
+gst_mmap_src_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMmapSrc *self = GST_MMAP_SRC (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      gst_mmap_src_set_location (self, g_value_get_string (value), NULL);
+      break;
+    case PROP_PREFETCH:
+      self->prefetch = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mmap_src_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstMmapSrc *self = GST_MMAP_SRC (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      GST_OBJECT_LOCK (self);
+      g_value_set_string (value, self->location);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_PREFETCH:
+      g_value_set_uint (value, self->prefetch);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mmap_src_unmap (gpointer user_data)
+{
+  GstMmapRegion *region = user_data;
+
+  munmap (region->data, region->size);
+  g_slice_free (GstMmapRegion, region);
+}
+
+static gboolean
+gst_mmap_src_start (GstBaseSrc * src)
+{
+  GstMmapSrc *self = GST_MMAP_SRC (src);
+  GstMmapRegion *region;
+  struct stat info;
+  gpointer data;
+  gint fd;
+
+  if (self->location == NULL || self->location[0] == '\0') {
+    GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND,
+        ("No file name specified for reading."), (NULL));
+    return FALSE;
+  }
+
+  fd = open (self->location, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno == ENOENT)
+      GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND, (NULL),
+          ("No such file \"%s\"", self->location));
+    else
+      GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ,
+          ("Could not open file \"%s\" for reading.", self->location),
+          GST_ERROR_SYSTEM);
+    return FALSE;
+  }
+
+  if (fstat (fd, &info) < 0 || !S_ISREG (info.st_mode) || info.st_size == 0) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ,
+        ("\"%s\" is not a non-empty regular file.", self->location), (NULL));
+    close (fd);
+    return FALSE;
+  }
+
+  /* The mapping keeps the file referenced, the descriptor is not needed anymore */
+  data = mmap (NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ,
+        ("Could not map file \"%s\".", self->location), GST_ERROR_SYSTEM);
+    return FALSE;
+  }
+
+  self->data = data;
+  self->size = info.st_size;
+  self->window_start = 0;
+  self->prefetched = 0;
+  madvise (self->data, self->size, MADV_SEQUENTIAL);
+
+  region = g_slice_new (GstMmapRegion);
+  region->data = data;
+  region->size = self->size;
+  self->memory = gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY, data,
+      self->size, 0, self->size, region, gst_mmap_src_unmap);
+
+  GST_DEBUG_OBJECT (self, "mapped %s, %" G_GUINT64_FORMAT " bytes",
+      self->location, self->size);
+  return TRUE;
+}
+
+static gboolean
+gst_mmap_src_stop (GstBaseSrc * src)
+{
+  GstMmapSrc *self = GST_MMAP_SRC (src);
+
+  /* Buffers still alive downstream keep the mapping */
+  if (self->memory)
+    gst_memory_unref (self->memory);
+  self->memory = NULL;
+  self->data = NULL;
+  self->size = 0;
+  return TRUE;
+}
+
+static gboolean
+gst_mmap_src_is_seekable (GstBaseSrc * src)
+{
+  return TRUE;
+}
+
+static gboolean
+gst_mmap_src_get_size (GstBaseSrc * src, guint64 * size)
+{
+  GstMmapSrc *self = GST_MMAP_SRC (src);
+
+  if (self->memory == NULL)
+    return FALSE;
+
+  *size = self->size;
+  return TRUE;
+}
+
+/* Ask for the pages ahead of the read position, in steps of half the window so the
+ * kernel is not called for every buffer */
+static void
+gst_mmap_src_prefetch (GstMmapSrc * self, guint64 offset)
+{
+  guint64 page = sysconf (_SC_PAGESIZE);
+  gboolean inside;
+  guint64 start, end;
+
+  if (self->prefetch == 0)
+    return;
+
+  inside = offset >= self->window_start && offset < self->prefetched;
+  if (inside && (self->prefetched == self->size
+          || self->prefetched - offset > self->prefetch / 2))
+    return;
+
+  /* Extend the current window, or start a new one after a seek */
+  if (inside) {
+    start = self->prefetched;
+  } else {
+    start = offset;
+    self->window_start = offset;
+  }
+  start -= start % page;
+  end = MIN (offset + self->prefetch, self->size);
+  if (end > start)
+    madvise (self->data + start, end - start, MADV_WILLNEED);
+  self->prefetched = end;
+}
+
+static GstFlowReturn
+gst_mmap_src_create (GstBaseSrc * src, guint64 offset, guint length,
+    GstBuffer ** buffer)
+{
+  GstMmapSrc *self = GST_MMAP_SRC (src);
+  GstBuffer *buf;
+  gsize size;
+
+  if (offset >= self->size)
+    return GST_FLOW_EOS;
+
+  gst_mmap_src_prefetch (self, offset);
+
+  size = MIN ((guint64) length, self->size - offset);
+  buf = gst_buffer_new ();
+  gst_buffer_append_memory (buf, gst_memory_share (self->memory, offset, size));
+  GST_BUFFER_OFFSET (buf) = offset;
+  GST_BUFFER_OFFSET_END (buf) = offset + size;
+
+  *buffer = buf;
+  return GST_FLOW_OK;
+}
+
+static GstURIType
+gst_mmap_src_uri_get_type (GType type)
+{
+  return GST_URI_SRC;
+}
+
+static const gchar *const *
+gst_mmap_src_uri_get_protocols (GType type)
+{
+  static const gchar *protocols[] = { "file", NULL };
+
+  return protocols;
+}
+
+static gchar *
+gst_mmap_src_uri_get_uri (GstURIHandler * handler)
+{
+  GstMmapSrc *self = GST_MMAP_SRC (handler);
+  gchar *uri = NULL;
+
+  GST_OBJECT_LOCK (self);
+  if (self->location)
+    uri = gst_filename_to_uri (self->location, NULL);
+  GST_OBJECT_UNLOCK (self);
+
+  return uri;
+}
+
+static gboolean
+gst_mmap_src_uri_set_uri (GstURIHandler * handler, const gchar * uri,
+    GError ** error)
+{
+  GstMmapSrc *self = GST_MMAP_SRC (handler);
+  gchar *location;
+  gboolean ret;
+
+  location = g_filename_from_uri (uri, NULL, NULL);
+  if (location == NULL) {
+    g_set_error (error, GST_URI_ERROR, GST_URI_ERROR_BAD_URI,
+        "Invalid file URI \"%s\"", uri);
+    return FALSE;
+  }
+
+  ret = gst_mmap_src_set_location (self, location, error);
+  g_free (location);
+  return ret;
+}
+
+static void
+gst_mmap_src_uri_handler_init (gpointer g_iface, gpointer iface_data)
+{
+  GstURIHandlerInterface *iface = (GstURIHandlerInterface *) g_iface;
+
+  iface->get_type = gst_mmap_src_uri_get_type;
+  iface->get_protocols = gst_mmap_src_uri_get_protocols;
+  iface->get_uri = gst_mmap_src_uri_get_uri;
+  iface->set_uri = gst_mmap_src_uri_set_uri;
+}
+
+gboolean
+gst_mmap_src_register (gboolean prefer)
+{
+  return gst_element_register (NULL, "mmapsrc",
+      prefer ? GST_RANK_PRIMARY + 1 : GST_RANK_NONE, GST_TYPE_MMAP_SRC);
+}
@@ -0,0 +1,27 @@
+/* GStreamer
+ *
+ * Common: memory-mapped file source
+ *
+ * mmapsrc maps a local file once and pushes buffers whose memory is a slice of the mapping,
+ * so no data is copied into freshly allocated buffers the way filesrc does with read().
+ *
+ * The element is registered by the application with gst_mmap_src_register(). When preferred,
+ * it ranks above filesrc and playbin/uridecodebin pick it for file:// URIs.
+ */
+
+#ifndef __GST_MMAP_SRC_H__
+#define __GST_MMAP_SRC_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesrc.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MMAP_SRC (gst_mmap_src_get_type ())
+G_DECLARE_FINAL_TYPE (GstMmapSrc, gst_mmap_src, GST, MMAP_SRC, GstBaseSrc)
+
+gboolean gst_mmap_src_register (gboolean prefer);
+
+G_END_DECLS
+
+#endif /* __GST_MMAP_SRC_H__ */
@@ -0,0 +1,534 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Common: metrics registry exported in the Prometheus text format
+ */
+
+#include "metrics.h"
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace Metrics
+{
+
+namespace
+{
+
+std::string format_double(double value)
+{
+  if (std::isinf(value))
+    return value > 0 ? "+Inf" : "-Inf";
+  if (std::isnan(value))
+    return "NaN";
+
+  // Always with a dot, whatever the locale
+  gchar buffer[G_ASCII_DTOSTR_BUF_SIZE];
+  return g_ascii_dtostr(buffer, sizeof(buffer), value);
+}
+
+// name="value" pairs separated by commas, without the braces
+std::string format_labels(const Labels& labels)
+{
+  std::string out;
+  for (const auto& label : labels)
+  {
+    if (!out.empty())
+      out += ',';
+    out += label.first + "=\"";
+    for (char c : label.second)
+    {
+      if (c == '\\' || c == '"')
+        out += '\\';
+      if (c == '\n')
+        out += "\\n";
+      else
+        out += c;
+    }
+    out += '"';
+  }
+  return out;
+}
+
+void atomic_add(std::atomic<double>& value, double delta)
+{
+  double current {value.load(std::memory_order_relaxed)};
+  while (!value.compare_exchange_weak(current, current + delta, std::memory_order_relaxed))
+    ;
+}
+
+} // anonymous namespace
+
+void Gauge::add(double v)
+{
+  atomic_add(value, v);
+}
+
+Histogram::Histogram(const std::vector<double>& bounds)
+  : bounds {bounds}, buckets {new std::atomic<guint64>[bounds.size() + 1]}
+{
+  for (gsize i = 0; i <= bounds.size(); i++)
+    buckets[i].store(0, std::memory_order_relaxed);
+}
+
+void Histogram::observe(double v)
+{
+  gsize i {0};
+  while (i < bounds.size() && v > bounds[i])
+    i++;
+  buckets[i].fetch_add(1, std::memory_order_relaxed);
+  count.fetch_add(1, std::memory_order_relaxed);
+  atomic_add(sum, v);
+}
+
+void Histogram::render(std::string& out, const std::string& name, const std::string& labels) const
+{
+  // Buckets are kept separate so observe() touches one of them, they are cumulative in the output
+  std::string prefix {labels.empty() ? "" : labels + ","};
+  guint64 cumulative {0};
+  for (gsize i = 0; i <= bounds.size(); i++)
+  {
+    cumulative += buckets[i].load(std::memory_order_relaxed);
+    out += name + "_bucket{" + prefix + "le=\"" + (i < bounds.size() ? format_double(bounds[i]) : "+Inf") +
+      "\"} " + std::to_string(cumulative) + "\n";
+  }
+
+  std::string braces {labels.empty() ? "" : "{" + labels + "}"};
+  out += name + "_sum" + braces + " " + format_double(sum.load(std::memory_order_relaxed)) + "\n";
+  out += name + "_count" + braces + " " + std::to_string(count.load(std::memory_order_relaxed)) + "\n";
+}
+
+struct Registry::Family
+{
+  struct Entry
+  {
+    std::string labels;
+    std::unique_ptr<Counter> counter;
+    std::unique_ptr<Gauge> gauge;
+    std::unique_ptr<Histogram> histogram;
+  };
+
+  Entry& entry(const Labels& labels)
+  {
+    std::string formatted {format_labels(labels)};
+    for (const std::unique_ptr<Entry>& entry : entries)
+      if (entry->labels == formatted)
+        return *entry;
+    entries.emplace_back(new Entry);
+    entries.back()->labels = formatted;
+    return *entries.back();
+  }
+
+  std::string name;
+  std::string help;
+  const char* type;
+  std::vector<std::unique_ptr<Entry>> entries;
+};
+
+Registry::Family& Registry::family(const std::string& name, const std::string& help, const char* type)
+{
+  for (const std::unique_ptr<Family>& family : families)
+  {
+    if (family->name != name)
+      continue;
+    if (strcmp(family->type, type) == 0)
+      return *family;
+
+    // Keep the exposition valid, the second type gets its own name
+    g_warning("metric %s registered as %s and %s", name.c_str(), family->type, type);
+    return this->family(name + "_" + type, help, type);
+  }
+
+  families.emplace_back(new Family);
+  families.back()->name = name;
+  families.back()->help = help;
+  families.back()->type = type;
+  return *families.back();
+}
+
+Counter& Registry::counter(const std::string& name, const std::string& help, const Labels& labels)
+{
+  std::lock_guard<std::mutex> lock {mutex};
+  Family::Entry& entry {family(name, help, "counter").entry(labels)};
+  if (!entry.counter)
+    entry.counter.reset(new Counter);
+  return *entry.counter;
+}
+
+Gauge& Registry::gauge(const std::string& name, const std::string& help, const Labels& labels)
+{
+  std::lock_guard<std::mutex> lock {mutex};
+  Family::Entry& entry {family(name, help, "gauge").entry(labels)};
+  if (!entry.gauge)
+    entry.gauge.reset(new Gauge);
+  return *entry.gauge;
+}
+
+Histogram& Registry::histogram(const std::string& name, const std::string& help,
+    const std::vector<double>& bounds, const Labels& labels)
+{
+  std::lock_guard<std::mutex> lock {mutex};
+  Family::Entry& entry {family(name, help, "histogram").entry(labels)};
+  if (!entry.histogram)
+    entry.histogram.reset(new Histogram(bounds));
+  return *entry.histogram;
+}
+
+std::string Registry::render() const
+{
+  std::lock_guard<std::mutex> lock {mutex};
+  std::string out;
+  for (const std::unique_ptr<Family>& family : families)
+  {
+    out += "# HELP " + family->name + " " + family->help + "\n";
+    out += "# TYPE " + family->name + " " + family->type + "\n";
+    for (const std::unique_ptr<Family::Entry>& entry : family->entries)
+    {
+      std::string braces {entry->labels.empty() ? "" : "{" + entry->labels + "}"};
+      if (entry->counter)
+        out += family->name + braces + " " + std::to_string(entry->counter->get()) + "\n";
+      else if (entry->gauge)
+        out += family->name + braces + " " + format_double(entry->gauge->get()) + "\n";
+      else if (entry->histogram)
+        entry->histogram->render(out, family->name, entry->labels);
+    }
+  }
+  return out;
+}
+
+Server::Server(const Registry& registry, const std::string& path)
+  : registry {registry}, path {path}
+{
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+  {
+    g_warning("metrics socket path too long: %s", path.c_str());
+    return;
+  }
+  strcpy(address.sun_path, path.c_str());
+
+  listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  wake_fd = eventfd(0, EFD_CLOEXEC);
+  unlink(path.c_str());
+  if (listen_fd < 0 || wake_fd < 0 ||
+      bind(listen_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0 ||
+      listen(listen_fd, 8) < 0)
+  {
+    g_warning("could not listen on %s: %s", path.c_str(), g_strerror(errno));
+    if (listen_fd >= 0)
+      close(listen_fd);
+    if (wake_fd >= 0)
+      close(wake_fd);
+    listen_fd = wake_fd = -1;
+    return;
+  }
+
+  thread = std::thread(&Server::run, this);
+}
+
+Server::~Server()
+{
+  if (listen_fd < 0)
+    return;
+
+  guint64 one {1};
+  if (write(wake_fd, &one, sizeof(one)) != sizeof(one))
+    g_warning("could not wake the metrics server");
+  thread.join();
+  close(listen_fd);
+  close(wake_fd);
+  unlink(path.c_str());
+}
+
+void Server::run()
+{
+  struct pollfd fds[2] {{listen_fd, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+  for (;;)
+  {
+    if (poll(fds, 2, -1) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (fds[1].revents)
+      break;
+    if (!(fds[0].revents & POLLIN))
+      continue;
+
+    int fd {accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC)};
+    if (fd >= 0)
+    {
+      serve(fd);
+      close(fd);
+    }
+  }
+}
+
+void Server::serve(int fd)
+{
+  // A stalled client must not hold the server forever
+  struct timeval timeout {1, 0};
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  // Give an HTTP client a moment to send its request, a bare connection gets the text directly
+  char request[1024];
+  ssize_t length {0};
+  struct pollfd pfd {fd, POLLIN, 0};
+  if (poll(&pfd, 1, 100) > 0)
+    length = recv(fd, request, sizeof(request), 0);
+  bool http {length >= 4 && memcmp(request, "GET ", 4) == 0};
+
+  std::string body {registry.render()};
+  std::string response;
+  if (http)
+    response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+      std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+  response += body;
+
+  for (gsize sent = 0; sent < response.size();)
+  {
+    ssize_t n {send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL)};
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    sent += n;
+  }
+}
+
+} // namespace Metrics
+
+namespace
+{
+
+const char* const instrumented_key {"pipeline-metrics"};
+const std::vector<double> interval_bounds {0.001, 0.005, 0.01, 0.02, 0.04, 0.08, 0.16, 0.5, 1.0};
+
+struct PadProbe
+{
+  Metrics::Counter* buffers;
+  Metrics::Counter* bytes;
+  Metrics::Histogram* interval;
+  std::atomic<gint64> last {0};
+};
+
+GstPadProbeReturn on_buffer(GstPad*, GstPadProbeInfo* info, gpointer user_data)
+{
+  PadProbe* probe {static_cast<PadProbe*>(user_data)};
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER)
+  {
+    probe->buffers->inc();
+    probe->bytes->inc(gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info)));
+  }
+  else
+  {
+    GstBufferList* list {GST_PAD_PROBE_INFO_BUFFER_LIST(info)};
+    guint length {gst_buffer_list_length(list)};
+    gsize bytes {0};
+    for (guint i = 0; i < length; i++)
+      bytes += gst_buffer_get_size(gst_buffer_list_get(list, i));
+    probe->buffers->inc(length);
+    probe->bytes->inc(bytes);
+  }
+
+  if (probe->interval)
+  {
+    gint64 now {g_get_monotonic_time()};
+    gint64 last {probe->last.exchange(now, std::memory_order_relaxed)};
+    if (last)
+      probe->interval->observe((now - last) / 1e6);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+void free_pad_probe(gpointer data)
+{
+  delete static_cast<PadProbe*>(data);
+}
+
+} // anonymous namespace
+
+PipelineMetrics::PipelineMetrics(Metrics::Registry& registry, GstElement* pipeline)
+  : registry {registry}, pipeline {pipeline},
+    state (registry.gauge("gst_pipeline_state",
+        "Current state of the pipeline, 1 NULL, 2 READY, 3 PAUSED, 4 PLAYING", {{"pipeline", GST_OBJECT_NAME(pipeline)}})),
+    position (registry.gauge("gst_pipeline_position_seconds", "Current playback position",
+        {{"pipeline", GST_OBJECT_NAME(pipeline)}})),
+    duration (registry.gauge("gst_pipeline_duration_seconds", "Duration of the stream, 0 while unknown",
+        {{"pipeline", GST_OBJECT_NAME(pipeline)}}))
+{
+  state.set(GST_STATE(pipeline));
+  if (!GST_IS_BIN(pipeline))
+    return;
+
+  added_id = g_signal_connect(pipeline, "deep-element-added", G_CALLBACK(&on_element_added), this);
+  removed_id = g_signal_connect(pipeline, "deep-element-removed", G_CALLBACK(&on_element_removed), this);
+
+  GstIterator* it {gst_bin_iterate_recurse(GST_BIN(pipeline))};
+  gst_iterator_foreach(it, [] (const GValue* item, gpointer user_data) {
+    static_cast<PipelineMetrics*>(user_data)->instrument(GST_ELEMENT(g_value_get_object(item)));
+  }, this);
+  gst_iterator_free(it);
+}
+
+PipelineMetrics::~PipelineMetrics()
+{
+  if (added_id)
+  {
+    g_signal_handler_disconnect(pipeline, added_id);
+    g_signal_handler_disconnect(pipeline, removed_id);
+
+    // The pad probes stay, they only refer to the registry
+    GstIterator* it {gst_bin_iterate_recurse(GST_BIN(pipeline))};
+    gst_iterator_foreach(it, [] (const GValue* item, gpointer user_data) {
+      g_signal_handlers_disconnect_by_data(g_value_get_object(item), user_data);
+      g_object_set_data(G_OBJECT(g_value_get_object(item)), instrumented_key, nullptr);
+    }, this);
+    gst_iterator_free(it);
+  }
+
+  for (Queue& queue : queues)
+    gst_object_unref(queue.element);
+}
+
+void PipelineMetrics::on_element_added(GstBin*, GstBin*, GstElement* element, gpointer user_data)
+{
+  static_cast<PipelineMetrics*>(user_data)->instrument(element);
+}
+
+void PipelineMetrics::on_element_removed(GstBin*, GstBin*, GstElement* element, gpointer user_data)
+{
+  PipelineMetrics* self {static_cast<PipelineMetrics*>(user_data)};
+  g_signal_handlers_disconnect_by_data(element, self);
+  g_object_set_data(G_OBJECT(element), instrumented_key, nullptr);
+
+  std::lock_guard<std::mutex> lock {self->mutex};
+  for (auto it = self->queues.begin(); it != self->queues.end(); ++it)
+  {
+    if (it->element == element)
+    {
+      gst_object_unref(it->element);
+      self->queues.erase(it);
+      break;
+    }
+  }
+}
+
+void PipelineMetrics::on_pad_added(GstElement* element, GstPad* pad, gpointer user_data)
+{
+  static_cast<PipelineMetrics*>(user_data)->instrument_pad(element, pad);
+}
+
+void PipelineMetrics::instrument(GstElement* element)
+{
+  // Bins only have ghost pads, their children are counted instead
+  if (GST_IS_BIN(element) || g_object_get_data(G_OBJECT(element), instrumented_key))
+    return;
+  g_object_set_data(G_OBJECT(element), instrumented_key, this);
+
+  g_signal_connect(element, "pad-added", G_CALLBACK(&on_pad_added), this);
+  GstIterator* it {gst_element_iterate_pads(element)};
+  gst_iterator_foreach(it, [] (const GValue* item, gpointer user_data) {
+    GstPad* pad {GST_PAD(g_value_get_object(item))};
+    static_cast<PipelineMetrics*>(user_data)->instrument_pad(GST_ELEMENT(GST_PAD_PARENT(pad)), pad);
+  }, this);
+  gst_iterator_free(it);
+
+  // queue and queue2 expose their fill level, multiqueue does not
+  if (g_object_class_find_property(G_OBJECT_GET_CLASS(element), "current-level-buffers"))
+  {
+    Metrics::Labels labels {{"element", GST_OBJECT_NAME(element)}};
+    Queue queue {GST_ELEMENT(gst_object_ref(element)),
+      &registry.gauge("gst_queue_level_buffers", "Buffers in the queue", labels),
+      &registry.gauge("gst_queue_level_bytes", "Bytes in the queue", labels),
+      &registry.gauge("gst_queue_level_seconds", "Duration of the data in the queue", labels)};
+    std::lock_guard<std::mutex> lock {mutex};
+    queues.push_back(queue);
+  }
+}
+
+void PipelineMetrics::instrument_pad(GstElement* element, GstPad* pad)
+{
+  // Every source pad, and the input of the sinks, where the interval shows the render cadence
+  bool sink {GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK) != 0};
+  if (GST_PAD_IS_SINK(pad) && !sink)
+    return;
+
+  Metrics::Labels labels {{"pad", GST_OBJECT_NAME(element) + std::string(":") + GST_OBJECT_NAME(pad)}};
+
+  PadProbe* probe {new PadProbe};
+  probe->buffers = &registry.counter("gst_pad_buffers_total", "Buffers pushed through the pad", labels);
+  probe->bytes = &registry.counter("gst_pad_bytes_total", "Bytes pushed through the pad", labels);
+  probe->interval = GST_PAD_IS_SINK(pad) ? &registry.histogram("gst_sink_buffer_interval_seconds",
+      "Time between buffers arriving at the sink", interval_bounds, labels) : nullptr;
+  gst_pad_add_probe(pad, static_cast<GstPadProbeType>(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+      &on_buffer, probe, &free_pad_probe);
+}
+
+void PipelineMetrics::handle_message(GstMessage* message)
+{
+  switch (GST_MESSAGE_TYPE(message))
+  {
+    case GST_MESSAGE_STATE_CHANGED:
+    {
+      if (GST_MESSAGE_SRC(message) != GST_OBJECT(pipeline))
+        break;
+      GstState new_state;
+      gst_message_parse_state_changed(message, nullptr, &new_state, nullptr);
+      state.set(new_state);
+      break;
+    }
+    case GST_MESSAGE_QOS:
+    {
+      GstFormat format;
+      guint64 processed, dropped;
+      gdouble proportion;
+      gst_message_parse_qos_stats(message, &format, &processed, &dropped);
+      gst_message_parse_qos_values(message, nullptr, &proportion, nullptr);
+
+      Metrics::Labels labels {{"element", GST_OBJECT_NAME(GST_MESSAGE_SRC(message))}};
+      registry.counter("gst_qos_messages_total", "QoS messages posted", labels).inc();
+      registry.gauge("gst_qos_proportion", "Last requested processing rate, below 1 means late", labels).set(proportion);
+
+      // The message carries the running total, the counter gets the increase since the last one
+      if (dropped != G_MAXUINT64)
+      {
+        guint64& last {qos_dropped[labels[0].second]};
+        registry.counter("gst_qos_dropped_total", "Buffers dropped for QoS", labels).inc(dropped >= last ? dropped - last : dropped);
+        last = dropped;
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void PipelineMetrics::update()
+{
+  gint64 value;
+  if (gst_element_query_position(pipeline, GST_FORMAT_TIME, &value))
+    position.set(value / double(GST_SECOND));
+  if (gst_element_query_duration(pipeline, GST_FORMAT_TIME, &value) && value >= 0)
+    duration.set(value / double(GST_SECOND));
+
+  std::lock_guard<std::mutex> lock {mutex};
+  for (Queue& queue : queues)
+  {
+    guint buffers, bytes;
+    guint64 time;
+    g_object_get(queue.element, "current-level-buffers", &buffers, "current-level-bytes", &bytes,
+        "current-level-time", &time, nullptr);
+    queue.buffers->set(buffers);
+    queue.bytes->set(bytes);
+    queue.time->set(time / double(GST_SECOND));
+  }
+}
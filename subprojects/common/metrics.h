@@ -0,0 +1,164 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Common: metrics registry exported in the Prometheus text format
+ *
+ * Counters, gauges and histograms are plain atomics updated with relaxed ordering, so they can
+ * be bumped from pad probes in the streaming threads without locks; only registering a metric
+ * takes the registry mutex. Server answers each connection on a Unix domain socket with the
+ * current values, either as a bare text dump or as an HTTP/1.0 response when the client sends
+ * a GET, so both of these work:
+ *   socat - UNIX-CONNECT:/run/user/1000/player.metrics
+ *   curl --unix-socket /run/user/1000/player.metrics http://localhost/metrics
+ *
+ * PipelineMetrics binds the registry to a pipeline: buffer and byte counters on every source
+ * pad, buffer interval histograms on the sink pads of sinks, queue fill levels, QoS drops,
+ * pipeline state, position and duration. Rates such as buffers per second are left to the
+ * scraper, rate(gst_pad_buffers_total[10s]).
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <gst/gst.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Metrics
+{
+
+// Label pairs, rendered in the given order
+typedef std::vector<std::pair<std::string, std::string>> Labels;
+
+class Counter
+{
+public:
+  void inc(guint64 n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+  guint64 get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<guint64> value {0};
+};
+
+class Gauge
+{
+public:
+  void set(double v) { value.store(v, std::memory_order_relaxed); }
+  void add(double v);
+  double get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<double> value {0.0};
+};
+
+class Histogram
+{
+public:
+  // Upper bounds of the buckets in increasing order, +Inf is implied
+  explicit Histogram(const std::vector<double>& bounds);
+
+  void observe(double v);
+  void render(std::string& out, const std::string& name, const std::string& labels) const;
+
+private:
+  std::vector<double> bounds;
+  std::unique_ptr<std::atomic<guint64>[]> buckets;
+  std::atomic<guint64> count {0};
+  std::atomic<double> sum {0.0};
+};
+
+class Registry
+{
+public:
+  // Return the metric with this name and labels, creating it on first use. The reference stays
+  // valid for the lifetime of the registry. A name is bound to one type and help text.
+  Counter& counter(const std::string& name, const std::string& help, const Labels& labels = Labels());
+  Gauge& gauge(const std::string& name, const std::string& help, const Labels& labels = Labels());
+  Histogram& histogram(const std::string& name, const std::string& help, const std::vector<double>& bounds,
+      const Labels& labels = Labels());
+
+  // All metrics in the Prometheus text exposition format 0.0.4
+  std::string render() const;
+
+private:
+  struct Family;
+  Family& family(const std::string& name, const std::string& help, const char* type);
+
+  mutable std::mutex mutex;
+  std::vector<std::unique_ptr<Family>> families;
+};
+
+class Server
+{
+public:
+  // Listen on path, replacing a stale socket file; is_listening() tells whether it worked
+  Server(const Registry& registry, const std::string& path);
+  ~Server();
+
+  Server(const Server&) = delete;
+  Server& operator=(const Server&) = delete;
+
+  bool is_listening() const { return listen_fd >= 0; }
+
+private:
+  void run();
+  void serve(int fd);
+
+  const Registry& registry;
+  std::string path;
+  int listen_fd {-1};
+  int wake_fd {-1};
+  std::thread thread;
+};
+
+} // namespace Metrics
+
+class PipelineMetrics
+{
+public:
+  // Instrument the elements already in the pipeline and the ones added later
+  PipelineMetrics(Metrics::Registry& registry, GstElement* pipeline);
+  ~PipelineMetrics();
+
+  PipelineMetrics(const PipelineMetrics&) = delete;
+  PipelineMetrics& operator=(const PipelineMetrics&) = delete;
+
+  // Feed the pipeline state and QoS drops, call it from the application's bus handler
+  void handle_message(GstMessage* message);
+
+  // Sample queue levels, position and duration, call it periodically from the main loop
+  void update();
+
+private:
+  static void on_element_added(GstBin*, GstBin*, GstElement* element, gpointer user_data);
+  static void on_element_removed(GstBin*, GstBin*, GstElement* element, gpointer user_data);
+  static void on_pad_added(GstElement* element, GstPad* pad, gpointer user_data);
+  void instrument(GstElement* element);
+  void instrument_pad(GstElement* element, GstPad* pad);
+
+  Metrics::Registry& registry;
+  GstElement* pipeline;
+  gulong added_id {0};
+  gulong removed_id {0};
+
+  Metrics::Gauge& state;
+  Metrics::Gauge& position;
+  Metrics::Gauge& duration;
+
+  struct Queue
+  {
+    GstElement* element;
+    Metrics::Gauge* buffers;
+    Metrics::Gauge* bytes;
+    Metrics::Gauge* time;
+  };
+  std::mutex mutex;
+  std::vector<Queue> queues;
+  std::map<std::string, guint64> qos_dropped;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,197 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Common: QoS-driven degradation of playback quality
+ */
+
+#include "qos_controller.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+
+// GstPlayFlags of playbin
+const guint play_flag_deinterlace {1 << 9};
+const guint play_flag_soft_colorbalance {1 << 10};
+
+// Thresholds on one interval: above them it is overloaded, below all of them there is headroom
+const gdouble overload_proportion {1.1};
+const gdouble overload_drop_ratio {0.05};
+const gdouble headroom_proportion {0.8};
+
+const guint degrade_after {2};
+const guint restore_after {10};
+const guint hold_after_change {2};
+
+bool has_property(GstElement* element, const char* name)
+{
+  return g_object_class_find_property(G_OBJECT_GET_CLASS(element), name) != nullptr;
+}
+
+bool is_video(GstElement* element, const char* role)
+{
+  const gchar* klass {gst_element_get_metadata(element, GST_ELEMENT_METADATA_KLASS)};
+  return klass && strstr(klass, "Video") && strstr(klass, role);
+}
+
+} // anonymous namespace
+
+QosController::QosController(GstElement* playbin)
+  : playbin {playbin}
+{
+  if (has_property(playbin, "flags"))
+    g_object_get(playbin, "flags", &flags, nullptr);
+
+  // Decoders and deinterlacers come and go with the streams, each one gets the current level
+  if (GST_IS_BIN(playbin))
+    added_id = g_signal_connect(playbin, "deep-element-added", G_CALLBACK(&on_element_added), this);
+}
+
+QosController::~QosController()
+{
+  if (added_id)
+    g_signal_handler_disconnect(playbin, added_id);
+}
+
+const char* QosController::get_level_name(guint level)
+{
+  static const char* names[] = {"full quality", "skip non-reference frames", "reduced resolution decoding",
+    "no post-processing"};
+  return names[level < max_level ? level : max_level];
+}
+
+void QosController::on_element_added(GstBin*, GstBin*, GstElement* element, gpointer user_data)
+{
+  // New elements already have full quality
+  QosController* self {static_cast<QosController*>(user_data)};
+  if (self->get_level() > 0)
+    self->apply(element);
+}
+
+void QosController::apply(GstElement* element)
+{
+  guint current {get_level()};
+
+  // gst-libav decoders; AVDISCARD_NONREF and half resolution
+  if (is_video(element, "Decoder"))
+  {
+    if (has_property(element, "skip-frame"))
+      g_object_set(element, "skip-frame", current >= 1 ? 1 : 0, nullptr);
+    if (has_property(element, "lowres"))
+      g_object_set(element, "lowres", current >= 2 ? 1 : 0, nullptr);
+  }
+
+  // A deinterlacer already plugged by playsink is switched off, 0 auto and 2 disabled
+  GstElementFactory* factory {gst_element_get_factory(element)};
+  if (factory && strcmp(GST_OBJECT_NAME(factory), "deinterlace") == 0)
+    g_object_set(element, "mode", current >= 3 ? 2 : 0, nullptr);
+}
+
+void QosController::set_level(guint new_level)
+{
+  level.store(new_level, std::memory_order_relaxed);
+
+  // playsink picks the flags up when it reconfigures the video chain
+  if (flags)
+  {
+    guint new_flags {new_level >= 3 ? flags & ~(play_flag_deinterlace | play_flag_soft_colorbalance) : flags};
+    g_object_set(playbin, "flags", new_flags, nullptr);
+  }
+
+  GstIterator* it {gst_bin_iterate_recurse(GST_BIN(playbin))};
+  gst_iterator_foreach(it, [] (const GValue* item, gpointer user_data) {
+    static_cast<QosController*>(user_data)->apply(GST_ELEMENT(g_value_get_object(item)));
+  }, this);
+  gst_iterator_free(it);
+
+  overloaded = headroom = 0;
+  hold = hold_after_change;
+}
+
+void QosController::handle_message(GstMessage* message)
+{
+  if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_QOS)
+    return;
+
+  GstFormat format;
+  guint64 processed, dropped;
+  gdouble proportion;
+  gst_message_parse_qos_stats(message, &format, &processed, &dropped);
+  gst_message_parse_qos_values(message, nullptr, &proportion, nullptr);
+
+  max_proportion = std::max(max_proportion, proportion);
+  if (dropped != G_MAXUINT64)
+    drops[GST_OBJECT_NAME(GST_MESSAGE_SRC(message))] = dropped;
+}
+
+bool QosController::update()
+{
+  // Frames rendered and dropped by the video sinks since the last evaluation
+  guint64 totals[2] {0, 0};
+  GstIterator* it {gst_bin_iterate_recurse(GST_BIN(playbin))};
+  gst_iterator_foreach(it, [] (const GValue* item, gpointer user_data) {
+    GstElement* sink {GST_ELEMENT(g_value_get_object(item))};
+    if (GST_IS_BIN(sink) || !GST_OBJECT_FLAG_IS_SET(sink, GST_ELEMENT_FLAG_SINK) || !is_video(sink, "Sink") ||
+        !has_property(sink, "stats"))
+      return;
+    GstStructure* stats {nullptr};
+    guint64 rendered {0}, dropped {0};
+    g_object_get(sink, "stats", &stats, nullptr);
+    if (!stats)
+      return;
+    gst_structure_get_uint64(stats, "rendered", &rendered);
+    gst_structure_get_uint64(stats, "dropped", &dropped);
+    gst_structure_free(stats);
+    static_cast<guint64*>(user_data)[0] += rendered;
+    static_cast<guint64*>(user_data)[1] += dropped;
+  }, totals);
+  gst_iterator_free(it);
+
+  // The sinks restart from zero after a flush or a new stream
+  guint64 rendered {totals[0] >= last_rendered ? totals[0] - last_rendered : totals[0]};
+  guint64 dropped {totals[1] >= last_dropped ? totals[1] - last_dropped : totals[1]};
+  last_rendered = sink_rendered = totals[0];
+  last_dropped = sink_dropped = totals[1];
+
+  gdouble proportion {max_proportion};
+  max_proportion = 0.0;
+
+  GstState state {GST_STATE(playbin)};
+  if (state != GST_STATE_PLAYING || rendered + dropped == 0)
+    return false;
+  if (hold)
+  {
+    hold--;
+    return false;
+  }
+
+  gdouble drop_ratio {gdouble(dropped) / (rendered + dropped)};
+  guint current {get_level()};
+  if (drop_ratio > overload_drop_ratio || proportion > overload_proportion)
+  {
+    headroom = 0;
+    if (++overloaded >= degrade_after && current < max_level)
+    {
+      GST_INFO_OBJECT(playbin, "overloaded, %.1f%% dropped, proportion %.2f: level %u", drop_ratio * 100,
+          proportion, current + 1);
+      set_level(current + 1);
+      return true;
+    }
+  }
+  else if (dropped == 0 && proportion < headroom_proportion)
+  {
+    overloaded = 0;
+    if (++headroom >= restore_after && current > 0)
+    {
+      GST_INFO_OBJECT(playbin, "headroom, proportion %.2f: level %u", proportion, current - 1);
+      set_level(current - 1);
+      return true;
+    }
+  }
+  else
+  {
+    // In between, neither direction gains
+    overloaded = headroom = 0;
+  }
+  return false;
+}
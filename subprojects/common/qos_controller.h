@@ -0,0 +1,76 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Common: QoS-driven degradation of playback quality
+ *
+ * An overloaded machine makes the sinks drop late frames and the elements post QoS messages,
+ * which the tutorials ignore, so playback just stutters. QosController watches both, the QoS
+ * proportion and drop totals from the bus and the rendered/dropped statistics of the sinks,
+ * and lowers the decoding and post-processing cost of a playbin in steps:
+ *   1 skip non-reference frames in decoders that support it (skip-frame)
+ *   2 decode at reduced resolution where supported (lowres)
+ *   3 drop post-processing: no deinterlacing and software color balance
+ * A step down is taken after two overloaded evaluations in a row, a step back up only after
+ * ten evaluations with headroom, and no decision is made during the two evaluations after a
+ * change, so the effect of a step is measured before the next one.
+ */
+
+#ifndef QOS_CONTROLLER_H
+#define QOS_CONTROLLER_H
+
+#include <gst/gst.h>
+#include <atomic>
+#include <map>
+#include <string>
+
+class QosController
+{
+public:
+  static const guint max_level {3};
+
+  explicit QosController(GstElement* playbin);
+  ~QosController();
+
+  QosController(const QosController&) = delete;
+  QosController& operator=(const QosController&) = delete;
+
+  // Feed QoS messages, call it from the application's bus handler
+  void handle_message(GstMessage* message);
+
+  // Evaluate the last interval and change the level if needed, call it periodically (about
+  // every 500 ms) from the main loop. Returns true when the level changed.
+  bool update();
+
+  guint get_level() const { return level.load(std::memory_order_relaxed); }
+  static const char* get_level_name(guint level);
+
+  // Frames dropped for QoS as reported by each element, and by the sinks in total
+  const std::map<std::string, guint64>& get_drops() const { return drops; }
+  guint64 get_sink_dropped() const { return sink_dropped; }
+  guint64 get_sink_rendered() const { return sink_rendered; }
+
+private:
+  static void on_element_added(GstBin*, GstBin*, GstElement* element, gpointer user_data);
+  void apply(GstElement* element);
+  void set_level(guint new_level);
+
+  GstElement* playbin;
+  gulong added_id {0};
+  guint flags {0};
+  std::atomic<guint> level {0};
+
+  // Current interval
+  gdouble max_proportion {0.0};
+  guint64 last_rendered {0};
+  guint64 last_dropped {0};
+
+  // Hysteresis
+  guint overloaded {0};
+  guint headroom {0};
+  guint hold {0};
+
+  std::map<std::string, guint64> drops;
+  guint64 sink_dropped {0};
+  guint64 sink_rendered {0};
+};
+
+#endif // QOS_CONTROLLER_H
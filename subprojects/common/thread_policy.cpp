@@ -0,0 +1,339 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Common: CPU affinity and scheduling policy for streaming threads
+ */
+
+#include "thread_policy.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+namespace
+{
+
+pid_t current_tid()
+{
+  return static_cast<pid_t>(syscall(SYS_gettid));
+}
+
+// "0,2-3" into a CPU set
+bool parse_cpus(const std::string& list, cpu_set_t& cpus)
+{
+  CPU_ZERO(&cpus);
+  std::istringstream in {list};
+  std::string range;
+  while (std::getline(in, range, ','))
+  {
+    int first, last;
+    char dash;
+    std::istringstream item {range};
+    if (!(item >> first))
+      return false;
+    last = first;
+    if (item >> dash && (dash != '-' || !(item >> last)))
+      return false;
+    if (first < 0 || last < first || last >= CPU_SETSIZE)
+      return false;
+    for (int cpu = first; cpu <= last; cpu++)
+      CPU_SET(cpu, &cpus);
+  }
+  return CPU_COUNT(&cpus) > 0;
+}
+
+} // anonymous namespace
+
+ThreadPolicy::ThreadPolicy(GstElement* pipeline)
+  : bus {gst_element_get_bus(pipeline)}
+{
+  if (sched_getaffinity(0, sizeof(default_cpus), &default_cpus) != 0)
+  {
+    CPU_ZERO(&default_cpus);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+      CPU_SET(cpu, &default_cpus);
+  }
+  errno = 0;
+  default_nice = getpriority(PRIO_PROCESS, current_tid());
+  if (errno != 0)
+    default_nice = 0;
+  gst_bus_set_sync_handler(bus, &on_sync_message, this, nullptr);
+}
+
+ThreadPolicy::~ThreadPolicy()
+{
+  gst_bus_set_sync_handler(bus, nullptr, nullptr, nullptr);
+  gst_object_unref(bus);
+}
+
+bool ThreadPolicy::parse(const std::string& spec, Rule& rule, std::string& error)
+{
+  rule = Rule();
+  CPU_ZERO(&rule.cpus);
+
+  std::string::size_type colon {spec.find(':')};
+  rule.match = spec.substr(0, colon);
+  if (rule.match.empty())
+  {
+    error = "missing element or factory name";
+    return false;
+  }
+  if (colon == std::string::npos)
+    return true;
+
+  // Commas separate the settings as well as the CPUs of a list, as in "cpus=0,2-3,fifo=10"
+  std::string settings {spec.substr(colon + 1)};
+  std::istringstream in {settings};
+  std::string setting;
+  while (std::getline(in, setting, ','))
+  {
+    std::string::size_type equal {setting.find('=')};
+    std::string key {setting.substr(0, equal)};
+    std::string value {equal == std::string::npos ? "" : setting.substr(equal + 1)};
+
+    // A bare number continues the previous cpus list
+    if (equal == std::string::npos && rule.affinity && !key.empty() && g_ascii_isdigit(key[0]))
+    {
+      cpu_set_t more;
+      if (!parse_cpus(key, more))
+      {
+        error = "invalid CPU list: " + key;
+        return false;
+      }
+      CPU_OR(&rule.cpus, &rule.cpus, &more);
+      continue;
+    }
+
+    if (key == "cpus")
+    {
+      if (!parse_cpus(value, rule.cpus))
+      {
+        error = "invalid CPU list: " + value;
+        return false;
+      }
+      rule.affinity = true;
+    }
+    else if (key == "fifo")
+    {
+      rule.priority = atoi(value.c_str());
+      if (rule.priority < sched_get_priority_min(SCHED_FIFO) || rule.priority > sched_get_priority_max(SCHED_FIFO))
+      {
+        error = "SCHED_FIFO priority out of range: " + value;
+        return false;
+      }
+      rule.fifo = true;
+    }
+    else if (key == "nice")
+    {
+      rule.nice = atoi(value.c_str());
+      if (rule.nice < -20 || rule.nice > 19)
+      {
+        error = "nice level out of range: " + value;
+        return false;
+      }
+      rule.renice = true;
+    }
+    else if (key == "name")
+    {
+      rule.name = value.substr(0, 15);
+    }
+    else
+    {
+      error = "unknown setting: " + key;
+      return false;
+    }
+  }
+  return true;
+}
+
+void ThreadPolicy::add_rule(const Rule& rule)
+{
+  std::lock_guard<std::mutex> lock {mutex};
+  rules.push_back(rule);
+}
+
+GstBusSyncReply ThreadPolicy::on_sync_message(GstBus*, GstMessage* message, gpointer user_data)
+{
+  if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_STREAM_STATUS)
+    return GST_BUS_PASS;
+
+  // Posted from the streaming thread itself, right after it started and before it ends
+  GstStreamStatusType type;
+  GstElement* owner;
+  gst_message_parse_stream_status(message, &type, &owner);
+  ThreadPolicy* self {static_cast<ThreadPolicy*>(user_data)};
+  if (type == GST_STREAM_STATUS_TYPE_ENTER)
+    self->enter(owner);
+  else if (type == GST_STREAM_STATUS_TYPE_LEAVE)
+    self->leave();
+  return GST_BUS_PASS;
+}
+
+void ThreadPolicy::enter(GstElement* owner)
+{
+  std::lock_guard<std::mutex> lock {mutex};
+
+  Thread thread;
+  thread.tid = current_tid();
+  thread.element = GST_OBJECT_NAME(owner);
+  GstElementFactory* factory {gst_element_get_factory(owner)};
+  std::string factory_name {factory ? GST_OBJECT_NAME(factory) : ""};
+
+  const Rule* rule {nullptr};
+  for (const Rule& candidate : rules)
+  {
+    if (candidate.match == "*" || candidate.match == thread.element || candidate.match == factory_name)
+    {
+      rule = &candidate;
+      break;
+    }
+  }
+
+  // Name every streaming thread, so they can be told apart even without a rule
+  thread.name = rule && !rule->name.empty() ? rule->name : ("gst:" + thread.element).substr(0, 15);
+  pthread_setname_np(pthread_self(), thread.name.c_str());
+
+  // The thread may have run the task of another element before, with that element's rule
+  std::ostringstream applied;
+  const cpu_set_t& cpus {rule && rule->affinity ? rule->cpus : default_cpus};
+  cpu_set_t current_cpus;
+  if (sched_getaffinity(0, sizeof(current_cpus), &current_cpus) != 0 || !CPU_EQUAL(&current_cpus, &cpus))
+  {
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) == 0)
+      applied << (rule && rule->affinity ? "pinned" : "affinity reset");
+    else
+      applied << "affinity failed: " << strerror(errno);
+  }
+  else if (rule && rule->affinity)
+  {
+    applied << "pinned";
+  }
+
+  int policy;
+  struct sched_param param {};
+  pthread_getschedparam(pthread_self(), &policy, &param);
+  if (rule && rule->fifo)
+  {
+    param.sched_priority = rule->priority;
+    int result {pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)};
+    applied << (applied.tellp() > 0 ? ", " : "");
+    if (result == 0)
+      applied << "fifo " << rule->priority;
+    else
+      applied << "fifo failed: " << strerror(result);
+  }
+  else
+  {
+    if (policy != SCHED_OTHER)
+    {
+      param.sched_priority = 0;
+      int result {pthread_setschedparam(pthread_self(), SCHED_OTHER, &param)};
+      applied << (applied.tellp() > 0 ? ", " : "");
+      if (result == 0)
+        applied << "policy reset";
+      else
+        applied << "policy reset failed: " << strerror(result);
+    }
+
+    // Per thread on Linux, the tid stands for the thread
+    int nice {rule && rule->renice ? rule->nice : default_nice};
+    errno = 0;
+    int current_nice {getpriority(PRIO_PROCESS, thread.tid)};
+    if ((rule && rule->renice) || errno != 0 || current_nice != nice)
+    {
+      applied << (applied.tellp() > 0 ? ", " : "");
+      if (setpriority(PRIO_PROCESS, thread.tid, nice) == 0)
+        applied << (rule && rule->renice ? "nice " : "nice reset to ") << nice;
+      else
+        applied << "nice failed: " << strerror(errno);
+    }
+  }
+  thread.applied = applied.str();
+
+  GST_INFO_OBJECT(owner, "streaming thread %d %s: %s", thread.tid, thread.name.c_str(),
+      thread.applied.empty() ? "default policy" : thread.applied.c_str());
+  threads.push_back(thread);
+}
+
+void ThreadPolicy::leave()
+{
+  std::lock_guard<std::mutex> lock {mutex};
+  pid_t tid {current_tid()};
+  for (auto it = threads.rbegin(); it != threads.rend(); ++it)
+  {
+    if (it->tid == tid && it->running)
+    {
+      sample(*it);
+      it->running = false;
+      break;
+    }
+  }
+}
+
+void ThreadPolicy::sample(Thread& thread)
+{
+  std::string task {"/proc/self/task/" + std::to_string(thread.tid)};
+
+  // The fields after the command name, whose parentheses may contain spaces
+  std::ifstream stat_file {task + "/stat"};
+  std::string stat((std::istreambuf_iterator<char>(stat_file)), std::istreambuf_iterator<char>());
+  std::string::size_type end {stat.rfind(')')};
+  if (end != std::string::npos)
+  {
+    std::istringstream fields {stat.substr(end + 2)};
+    std::vector<std::string> values((std::istream_iterator<std::string>(fields)), std::istream_iterator<std::string>());
+    // state is field 3, utime 14, stime 15, processor 39
+    if (values.size() > 36)
+    {
+      thread.cpu_seconds = (std::stod(values[11]) + std::stod(values[12])) / sysconf(_SC_CLK_TCK);
+      thread.last_cpu = std::stoi(values[36]);
+    }
+  }
+
+  std::ifstream status {task + "/status"};
+  std::string line;
+  while (std::getline(status, line))
+  {
+    if (line.compare(0, 24, "voluntary_ctxt_switches:") == 0)
+      thread.voluntary = std::stoll(line.substr(24));
+    else if (line.compare(0, 27, "nonvoluntary_ctxt_switches:") == 0)
+      thread.involuntary = std::stoll(line.substr(27));
+  }
+
+  // Only with CONFIG_SCHED_DEBUG
+  std::ifstream sched {task + "/sched"};
+  while (std::getline(sched, line))
+  {
+    if (line.compare(0, 16, "se.nr_migrations") == 0 && line.find(':') != std::string::npos)
+      thread.migrations = std::stoll(line.substr(line.find(':') + 1));
+  }
+}
+
+std::string ThreadPolicy::report()
+{
+  std::lock_guard<std::mutex> lock {mutex};
+  std::ostringstream out;
+  out << std::setw(8) << "tid" << "  " << std::left << std::setw(16) << "thread" << std::setw(20) << "element" <<
+    std::right << std::setw(10) << "CPU s" << std::setw(10) << "vol cs" << std::setw(10) << "invol cs" <<
+    std::setw(12) << "migrations" << std::setw(6) << "cpu" << "  policy" << std::endl;
+
+  for (Thread& thread : threads)
+  {
+    if (thread.running)
+      sample(thread);
+
+    auto value = [] (gint64 v) { return v < 0 ? std::string("-") : std::to_string(v); };
+    out << std::setw(8) << thread.tid << "  " << std::left << std::setw(16) << thread.name << std::setw(20) <<
+      thread.element << std::right << std::fixed << std::setprecision(2) << std::setw(10) << thread.cpu_seconds <<
+      std::setw(10) << value(thread.voluntary) << std::setw(10) << value(thread.involuntary) <<
+      std::setw(12) << value(thread.migrations) << std::setw(6) << value(thread.last_cpu) << "  " <<
+      (thread.applied.empty() ? "default" : thread.applied) << std::endl;
+  }
+  return out.str();
+}
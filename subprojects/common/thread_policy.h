@@ -0,0 +1,95 @@
+/* gstreamermm - a C++ wrapper for gstreamer
+ *
+ * Common: CPU affinity and scheduling policy for streaming threads
+ *
+ * Every streaming thread announces itself with a stream-status ENTER message before it runs
+ * its task. ThreadPolicy installs a sync bus handler, which runs in that very thread, so the
+ * thread can be configured in place: CPU affinity, SCHED_FIFO priority or SCHED_OTHER nice
+ * level, and a name shown by top -H and in /proc. Rules are matched against the name of the
+ * element owning the task or its factory name, the first matching rule wins:
+ *
+ *   MATCH[:key=value[,key=value...]]
+ *     cpus=0,2-3   CPU affinity
+ *     fifo=N       SCHED_FIFO with priority N (1-99, needs CAP_SYS_NICE or an rtprio limit)
+ *     nice=N       SCHED_OTHER with nice level N
+ *     name=STR     thread name, at most 15 characters (default gst:<element>)
+ *   e.g. "vqueue:cpus=2,fifo=10" "avdec_h264:cpus=3" "*:nice=5"
+ *
+ * GstTask threads come from a shared pool and run tasks of other elements afterwards, so a
+ * thread without a rule, or a setting its rule leaves out, is set back to the affinity and
+ * nice level the pipeline was created with, under SCHED_OTHER.
+ *
+ * report() lists each streaming thread with its CPU time, context switches and migrations
+ * from /proc/self/task, sampled at stream-status LEAVE for threads that already ended, to
+ * compare pinned against unpinned runs.
+ */
+
+#ifndef THREAD_POLICY_H
+#define THREAD_POLICY_H
+
+#include <gst/gst.h>
+#include <sched.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ThreadPolicy
+{
+public:
+  struct Rule
+  {
+    std::string match;
+    bool affinity {false};
+    cpu_set_t cpus;
+    bool fifo {false};
+    int priority {0};
+    bool renice {false};
+    int nice {0};
+    std::string name;
+  };
+
+  // Take over the sync handler of the pipeline's bus
+  explicit ThreadPolicy(GstElement* pipeline);
+  ~ThreadPolicy();
+
+  ThreadPolicy(const ThreadPolicy&) = delete;
+  ThreadPolicy& operator=(const ThreadPolicy&) = delete;
+
+  // Parse a rule in the format above, false and a message in error when it is invalid
+  static bool parse(const std::string& spec, Rule& rule, std::string& error);
+  void add_rule(const Rule& rule);
+
+  // One line per streaming thread seen so far
+  std::string report();
+
+private:
+  struct Thread
+  {
+    pid_t tid;
+    std::string element;
+    std::string name;
+    std::string applied;
+    bool running {true};
+    // From /proc, -1 when not available
+    double cpu_seconds {-1.0};
+    gint64 voluntary {-1};
+    gint64 involuntary {-1};
+    gint64 migrations {-1};
+    int last_cpu {-1};
+  };
+
+  static GstBusSyncReply on_sync_message(GstBus* bus, GstMessage* message, gpointer user_data);
+  void enter(GstElement* owner);
+  void leave();
+  static void sample(Thread& thread);
+
+  GstBus* bus;
+  // Of the thread that created the pipeline, restored where no rule applies
+  cpu_set_t default_cpus;
+  int default_nice;
+  std::mutex mutex;
+  std::vector<Rule> rules;
+  std::vector<Thread> threads;
+};
+
+#endif // THREAD_POLICY_H